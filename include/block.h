@@ -0,0 +1,69 @@
+#ifndef _BLOCK
+
+#define _BLOCK
+
+/*
+ *  Gameboy Emulator: Predecoded Block Cache
+ *
+ *  Code is decoded once into basic blocks (instructions up to the first
+ *  jump/call/return), keyed by ROM bank + PC, with the operands already
+ *  read. The interpreter steps through them instead of fetching every
+ *  opcode and operand through the memory map, and the JIT translates them.
+ *
+ *  Only code in ROM, work RAM and high RAM is cached. Writes to RAM pages
+ *  holding cached code drop the blocks decoded from them.
+ *
+ *  Blocks that jump back to their own start without writing anything are
+ *  marked as possible idle loops (waiting for LY, an interrupt flag...)
+ *
+ */
+
+typedef struct gb gb_t;
+
+#define MAX_BLOCK_INSTRUCTIONS 32
+
+struct block_instruction {
+    unsigned char opcode;
+    unsigned short operand;
+    unsigned short next_pc;     // address of the following instruction
+};
+
+struct block {
+    unsigned int key;           // rom bank << 16 | start address
+    unsigned short start;
+    unsigned short end;         // first address after the block
+    unsigned int cycles;        // cycles of the whole block (when no branch is taken)
+    unsigned char idle_loop;    // 1 if it's a loop that only reads memory (see scheduler.c)
+    int n_instructions;         // 0 if the code can't be cached (e.g. undefined opcode)
+    struct block_instruction instructions[MAX_BLOCK_INSTRUCTIONS];
+#ifdef JIT
+    unsigned int times_run;
+    int (*code)(gb_t* gb);      // NULL until the block is hot and translated
+#endif
+    struct block* next;
+};
+
+#define BLOCK_BUCKETS 4096      // blocks hash table size (power of 2)
+
+struct block_cache {
+    struct block* buckets[BLOCK_BUCKETS];
+    struct block* dead;                 // blocks dropped while they might still be in use, freed on the next lookup
+    unsigned short code_pages[256];     // amount of blocks decoded from each 256 byte page of RAM (to detect self modifying code)
+
+    /*
+     *  Set when code is dropped, a bank is switched or an IO register is written,
+     *  so whoever is running a whole block can stop after the current instruction
+     */
+    unsigned char exit_request;
+
+    // Interpreter position: next instruction of current to fetch
+    struct block* current;
+    int current_instruction;
+};
+
+struct block* block_lookup(gb_t* gb, unsigned short address);
+struct block_instruction* block_fetch(gb_t* gb, unsigned short address);
+void block_memory_write(gb_t* gb, unsigned short address);
+void block_flush(gb_t* gb);
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef _CHEATS
+
+#define _CHEATS
+
+/*
+ *  Gameboy Emulator: Cheats
+ *
+ *  > Game Genie and GameShark codes
+ *  http://bgb.bircd.org/pandocs.htm#gamegeniesharkcheats
+ *
+ *  Game Genie codes (ABC-DEF or ABC-DEF-GHI) patch a byte of ROM, in every bank
+ *  that can be mapped at the code's address (with a compare value, only in banks
+ *  where the byte is that value). Patched pages of ROM are copied for the slot
+ *  (0000-3FFF or 4000-7FFF) the code is for, and the page table maps the copy
+ *  instead when the bank is mapped there (see map_page in memory.c), so a patched
+ *  byte is read like any other.
+ *
+ *  GameShark codes (ABCDEFGH) set a byte of RAM at VBlank every frame.
+ *
+ *  Neither adds anything to reads and writes: without cheats nothing is mapped
+ *  differently, and ppu_event only checks if there are any pokes once a frame.
+ *
+ */
+
+typedef struct gb gb_t;
+
+#define CHEATS_MAX 64
+
+// Game Genie
+struct cheat_patch {
+    unsigned short address;     // 0000-7FFF
+    unsigned char value;
+    short compare;              // -1 patches every bank (that can be mapped at address)
+};
+
+// GameShark
+struct cheat_poke {
+    unsigned short address;     // A000-DFFF
+    unsigned char value;
+    unsigned char ram_bank;     // for A000-BFFF
+};
+
+struct cheats {
+    struct cheat_patch patches[CHEATS_MAX];
+    int n_patches;
+
+    struct cheat_poke pokes[CHEATS_MAX];
+    int n_pokes;
+
+    unsigned char** rom_pages[2];   // per slot, patched copy of each 256 byte page of ROM, or NULL (all NULL without patches)
+};
+
+int cheats_add(gb_t* gb, const char* code);
+void cheats_clear(gb_t* gb);
+
+unsigned char* cheats_rom_page(gb_t* gb, int slot, unsigned char* rom_page);
+void cheats_poke(gb_t* gb);
+
+#endif
@@ -28,6 +28,8 @@
  *
  */
 
+typedef struct gb gb_t;
+
 
 
 /*---- Registers & Control ----------------------------------------*/
@@ -94,7 +96,30 @@ struct registers {
     };
 };
 
-extern struct registers registers;
+/*
+ *  The rest of the CPU state (the registers are the first thing in gb_t, see gb.h)
+ */
+#ifdef LAZY_FLAGS
+#define LAZY_NONE 0 // registers.f is up to date (the operations are in cpu.c)
+
+struct lazy_flags {
+    unsigned char operation;    // last ALU operation (LAZY_NONE if registers.f is up to date)
+    unsigned char a;
+    unsigned char b;
+    unsigned char carry;        // carry in for ADC/SBC
+    unsigned short result;      // bit 8 is the carry out
+};
+#endif
+
+struct cpu {
+    unsigned char interrupt_master_enable;  /*Interrupt Master Enable Flag (enables or disables interrupts)*/
+    unsigned char halted;       /* If halted = 1, CPU is idle and waiting for interrupt request  */
+    unsigned char stopped;      /* If stopped = 1, CPU is stopped. */
+    int extra_instruction_cycles;   // Account for the extra cycles the JUMP instructions might take
+#ifdef LAZY_FLAGS
+    struct lazy_flags lazy;
+#endif
+};
 
 
 /*---- Flags ------------------------------------------------------*/
@@ -105,20 +130,25 @@ extern struct registers registers;
 #define FLAG_H ((unsigned char) 32) // 0010 0000
 #define FLAG_CY ((unsigned char) 16) // 0001 0000
 
+/*
+ *  Built with -DLAZY_FLAGS, the flags are only worked out when read,
+ *  so registers.f can be out of date: call this before reading it from outside the CPU
+ */
+void cpu_sync_flags(gb_t* gb);
+
 
 
 /*---- Instructions -----------------------------------------------*/
 
 
-/*
- *  Instruction set with disassembly, callback and parameters
- */
-struct instruction {
-    char* disassembly;
-    void (*execute)();
-    void* exec_argv1;
-    void* exec_argv2;
-};
+extern const unsigned char instructions_ticks[256];
+extern const unsigned char instructions_length[256];
+extern const unsigned char instructions_cb_ticks[256];
+
+extern const char* const instructions_disassembly[256];
+extern const char* const instructions_cb_disassembly[256];
+
+int cpu_execute_opcode(gb_t* gb, unsigned char opcode, unsigned short operand);
 
 
 /*---- Interrupts -------------------------------------------------*/
@@ -130,13 +160,13 @@ struct instruction {
 #define SERIAL_INTERRUPT ((unsigned char) 8) // 0000 1000
 #define JOYPAD_INTERRUPT ((unsigned char) 16) // 0001 0000
 
-void request_interrupt(unsigned char interrupt_flag);
+void request_interrupt(gb_t* gb, unsigned char interrupt_flag);
 
 
 
 /*---- Main Logic and Execution -----------------------------------*/
 
-int cpu();
-void boot_tests();
+int cpu(gb_t* gb);
+void boot_tests(gb_t* gb);
 
 #endif
@@ -0,0 +1,54 @@
+#ifndef _DIRTY
+
+#define _DIRTY
+
+/*
+ *  Gameboy Emulator: Dirty Page Tracking
+ *
+ *  Keeps track of which 256 byte pages of memory were written, so snapshots,
+ *  caches of decoded tiles or state diffs only have to look at the pages
+ *  that changed instead of comparing all of it.
+ *
+ *  Time is split in epochs: dirty_new_epoch starts one and returns its number,
+ *  and a page was written since then if dirty_page_written(page, that number).
+ *  Each user keeps the number of the epoch it started, so several of them can
+ *  look at the same pages independently.
+ *
+ *  Like battery backed RAM (see save.h) this costs nothing on the direct write
+ *  path: pages that haven't been written in the current epoch aren't mapped for
+ *  writing, the first write goes through write8bit which marks the page (and
+ *  maps it again). Anything that writes memory without going through the cpu
+ *  (OAM DMA, loading state...) marks the pages itself.
+ *
+ *  Pages are the 256 pages of the address space (only 8000-9FFF and C000-FFFF
+ *  are tracked, ROM doesn't change and A000-BFFF is whatever bank is mapped)
+ *  followed by the pages of cartridge RAM, DIRTY_RAM_PAGE onwards.
+ *
+ *  The IO registers in page FF also change on their own (LY, DIV, STAT...),
+ *  that page is only marked by the cpu writing it.
+ *
+ */
+
+#include "save.h"
+
+typedef struct gb gb_t;
+
+#define DIRTY_RAM_PAGE 0x100                    // page of the first 256 bytes of cartridge RAM
+#define DIRTY_PAGES (DIRTY_RAM_PAGE + SAVE_PAGES)
+
+struct dirty {
+    unsigned int epoch;                         // current epoch (0 until one is started)
+    unsigned int written[DIRTY_PAGES];          // epoch each page was last written in
+    unsigned long long bitmap[DIRTY_PAGES/64];  // pages written in the current epoch
+};
+
+unsigned int dirty_new_epoch(gb_t* gb);
+
+int dirty_page_written(gb_t* gb, int page, unsigned int since);
+int dirty_next_page(gb_t* gb, int page);
+
+int dirty_page_is_clean(gb_t* gb, int page);
+void dirty_mark(gb_t* gb, int page);
+void dirty_mark_all(gb_t* gb);
+
+#endif
@@ -2,6 +2,23 @@
 
 #define _EMULATOR
 
-extern unsigned long debugger;
+/*
+ *  Gameboy Emulator: Running Frames
+ *
+ *  What every frontend does with the gb it runs (part of libgbcore.a): the
+ *  emulator (main.c, with the window in gui.c) and gb-headless (headless.c).
+ *
+ */
+
+typedef struct gb gb_t;
+
+extern const int FRAME_MAX_CYCLES;
+extern unsigned int debug_from;     // the debugger starts at this address
+
+void emulator_start(gb_t* gb, const char* path);   // the state is written to path when it stops
+void emulator_stop(gb_t* gb);
+
+void boot(gb_t* gb);
+void update(gb_t* gb);
 
 #endif
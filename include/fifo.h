@@ -0,0 +1,74 @@
+#ifndef _FIFO
+
+#define _FIFO
+
+/*
+ *  Gameboy Emulator: Pixel FIFO
+ *
+ *  Only built with -DPIXEL_FIFO (otherwise none of this is compiled in, and
+ *  the ppu draws each line in one go when it starts, see draw_scanline).
+ *
+ *  > Pixel FIFO and mode 3 timing
+ *  https://gbdev.io/pandocs/pixel_fifo.html
+ *
+ *  Draws mode 3 dot by dot like the ppu does: a fetcher reads a tile line every
+ *  6 dots and pushes it into the background FIFO once that's empty, a pixel is
+ *  shifted out every dot and mixed with the sprite FIFO, the first fetch of the
+ *  line is thrown away, SCX % 8 pixels are discarded, and starting the window or
+ *  fetching a sprite stalls the output. So mode 3 takes 172 dots, or more with
+ *  a fine scroll, the window and sprites (up to 289), and LCD STAT follows it.
+ *
+ *  Registers are read when they're used (SCX and SCY on every fetch, WX on every
+ *  pixel, the palettes when a pixel is shifted out), so changing them halfway
+ *  through a line changes the rest of it. The line is drawn ahead when mode 3
+ *  starts; a write to an LCD register (FF40-FF4B) while it's being drawn first
+ *  runs the FIFO up to now with the old values, then draws the rest of the line
+ *  again (and moves the end of mode 3). The FIFO runs up to the start of the
+ *  instruction that writes (or of the block, with the JIT).
+ *
+ *  The FIFO isn't part of save states: loading one during mode 3 draws the line
+ *  again from the start of mode 3.
+ *
+ */
+
+typedef struct gb gb_t;
+
+#define FETCH_DOTS 6            // dots the fetcher takes for a tile line
+#define SPRITE_FETCH_DOTS 6     // and for a sprite's
+
+struct fifo_state {
+    int dot;                    // dots since mode 3 started
+    int x;                      // next pixel to draw
+    int discard;                // pixels to shift out without drawing (SCX % 8, or the window left of the screen)
+
+    unsigned char background[8];
+    int n_background;           // pixels left in the background FIFO (the last n_background of background)
+
+    unsigned char sprites[8];   // color number | attributes 0x90 (priority and palette), 0 is transparent
+    int sprites_head;           // the sprite FIFO is a ring, sprites[sprites_head] is shifted out next
+
+    int fetch_dots;             // into the tile line being fetched (negative for the first fetch, which is thrown away)
+    int fetch_x;                // tile column fetched next
+    unsigned char fetched[8];   // the tile line, once fetch_dots reaches FETCH_DOTS
+    unsigned char window;       // the fetcher is on the window
+
+    int next_sprite;            // in the line's sprite list
+    int sprite_dots;            // into fetching a sprite, -1 when there isn't one
+};
+
+struct pixel_fifo {
+    unsigned long long start;       // when mode 3 of the line being drawn started
+    int length;                     // dots it takes
+    unsigned char drawing;          // the line isn't finished yet
+    unsigned char window_drawn;     // the window shows on it
+
+    struct fifo_state state;        // at start + state.dot, everything before that is drawn for good
+};
+
+void fifo_start_line(gb_t* gb, unsigned long long start);
+void fifo_finish_line(gb_t* gb);
+
+void fifo_catch_up(gb_t* gb);
+void fifo_redraw(gb_t* gb);
+
+#endif
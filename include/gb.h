@@ -0,0 +1,95 @@
+#ifndef _GB
+
+#define _GB
+
+/*
+ *  Gameboy Emulator: Emulator Context
+ *
+ *  Everything a running Gameboy needs lives in one gb_t, and every part
+ *  of the emulator (cpu, memory, ppu, timer...) takes it as its first argument,
+ *  so any amount of independent Gameboys can run in the same process
+ *  (one at a time per thread).
+ *
+ *  Usage:
+ *
+ *      gb_t* gb = malloc(sizeof(gb_t));
+ *      gb_init(gb);
+ *      insert_cartridge(gb, "rom.gb");
+ *      load_roms(gb);
+ *      ...
+ *      gb_free(gb);
+ *
+ *  Only the window (gui.c) is still shared, it shows a single gb.
+ *
+ */
+
+typedef struct gb gb_t;
+
+#include "cpu.h"
+#include "mapper.h"
+#include "memory.h"
+#include "save.h"
+#include "dirty.h"
+#include "ppu.h"
+#include "timer.h"
+#include "joypad.h"
+#include "scheduler.h"
+#include "block.h"
+#include "trace.h"
+#include "state.h"
+#include "rewind.h"
+#include "cheats.h"
+
+#ifdef JIT
+#include "jit.h"
+#endif
+
+#ifdef PROFILE
+#include "profile.h"
+#endif
+
+#ifdef HEATMAP
+#include "heatmap.h"
+#endif
+
+struct gb {
+    struct registers registers; // must be first: the JIT addresses them from the gb pointer
+    struct cpu cpu;
+
+    struct scheduler scheduler;
+
+    union address_space memory;
+    struct memory_map memory_map;
+    struct dma dma;
+    struct cartridge cartridge;
+    struct cheats cheats;
+    struct save save;
+    struct dirty dirty;
+    struct rewind rewind;
+
+    struct ppu ppu;
+    struct timer timer;
+
+    struct block_cache block_cache;
+#ifdef JIT
+    struct jit jit;
+#endif
+#ifdef PROFILE
+    struct profile profile;
+#endif
+#ifdef HEATMAP
+    struct heatmap heatmap;
+#endif
+#ifdef TRACE
+    struct trace trace;
+#endif
+
+    unsigned char joypad_state; // keys pressed, set by the frontend (see handle_input in gui.c)
+
+    unsigned long debugger;     // prints every instruction while > 0
+};
+
+void gb_init(gb_t* gb);
+void gb_free(gb_t* gb);
+
+#endif
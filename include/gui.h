@@ -0,0 +1,25 @@
+#ifndef _GUI
+
+#define _GUI
+
+/*
+ * Gameboy Emulator: Window
+ *
+ * Shows a gb's frames and takes its keys: GLFW and OpenGL on macOS, SDL on
+ * Windows, nothing anywhere else. Only the emulator has it, libgbcore.a and
+ * gb-headless don't (so they don't need GLFW or GLEW).
+ *
+ * Resources:
+ *
+ * > OpenGL Textures
+ * https://learnopengl.com/Getting-started/Textures
+ */
+
+typedef struct gb gb_t;
+
+#define SCREEN_MULTIPLIER 2
+
+void init_gui(gb_t* gb);
+void render_frame(gb_t* gb);
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef _HEATMAP
+
+#define _HEATMAP
+
+/*
+ *  Gameboy Emulator: Memory Access Heatmap
+ *
+ *  Only built with -DHEATMAP (otherwise none of this is compiled in).
+ *
+ *  Counts the cpu's reads and writes (everything through mmu_read8bit and
+ *  mmu_write8bit) per 256 byte page, per ROM and cartridge RAM bank, and per
+ *  ppu mode for VRAM and OAM, along with how many of them were blocked by
+ *  the ppu mode or by OAM DMA. When the emulator exits they're written to
+ *  heatmap.csv, and the pages to heatmap.pgm (a 16x16 grid of pages, reads
+ *  on the left and writes on the right, brighter is more, on a log2 scale).
+ *
+ *  Every instruction that runs counts the bytes it's fetched from, even when
+ *  it's taken from the block cache (or run by the JIT, which leaves every
+ *  instruction to the interpreter in this build), and passes over an idle loop
+ *  the scheduler skips count what the pass it ran did. Decoding blocks isn't
+ *  counted, and neither is what the ppu and OAM DMA read, they have their own bus.
+ *
+ */
+
+#include <stdio.h>
+
+typedef struct gb gb_t;
+
+#define HEATMAP_ROM_BANKS 0x200     // MBC5 has the most
+#define HEATMAP_RAM_BANKS 16        // MBC5 too
+
+struct heatmap_counter {
+    unsigned long long reads;
+    unsigned long long writes;
+};
+
+// Only counters, heatmap_repeat goes through them as an array
+struct heatmap {
+    struct heatmap_counter pages[256];
+    struct heatmap_counter rom_banks[HEATMAP_ROM_BANKS + 1];   // the last one is the bootstrap rom
+    struct heatmap_counter ram_banks[HEATMAP_RAM_BANKS + 1];   // the last one is RAM the MBC handles (or that's disabled)
+    struct heatmap_counter vram_modes[4];
+    struct heatmap_counter oam_modes[4];
+    struct heatmap_counter vram_blocked;                        // by mode 3
+    struct heatmap_counter oam_blocked;                         // by modes 2 and 3
+    struct heatmap_counter dma_blocked;                         // by OAM DMA (-DDMA_TIMING)
+};
+
+void heatmap_count(gb_t* gb, unsigned short address, int write);
+void heatmap_repeat(gb_t* gb, const struct heatmap* before, unsigned long long times);
+void heatmap_write_csv(gb_t* gb, FILE* csv);
+void heatmap_write_pgm(gb_t* gb, FILE* pgm);
+void heatmap_dump(gb_t* gb);
+
+#endif
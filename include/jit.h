@@ -0,0 +1,38 @@
+#ifndef _JIT
+
+#define _JIT
+
+/*
+ *  Gameboy Emulator: x86-64 Dynamic Recompiler
+ *
+ *  Only built by the "emulator-jit" and "gb-headless-jit" make targets
+ *  (with -DJIT), and only used at runtime when enabled with "-j".
+ *
+ *  Blocks from the block cache (block.h) are translated into
+ *  native code once they're hot. Simple register instructions are
+ *  translated directly, everything else is a call into the interpreter
+ *  with the operand already decoded.
+ *
+ *  Resources:
+ *
+ *  > x86-64 instruction encoding
+ *  https://wiki.osdev.org/X86-64_Instruction_Encoding
+ *
+ *  > System V AMD64 calling convention
+ *  https://wiki.osdev.org/System_V_ABI
+ *
+ */
+
+typedef struct gb gb_t;
+
+struct jit {
+    unsigned char enabled;
+    unsigned char* code_buffer;
+    unsigned char* code;        // where the next instruction is emitted
+    unsigned long long start;   // when the running block started (its instructions move scheduler.now along from it)
+};
+
+int jit_run(gb_t* gb);
+void jit_free(gb_t* gb);
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef _JOYPAD
+
+#define _JOYPAD
+
+typedef struct gb gb_t;
+
+void joypad_event(gb_t* gb);
+
+#endif
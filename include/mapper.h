@@ -0,0 +1,54 @@
+#ifndef _MAPPER
+
+#define _MAPPER
+
+/*
+ *  Gameboy Emulator: Cartridge Mappers
+ *
+ *  The memory bank controller (MBC) in the cartridge decides which ROM and
+ *  RAM banks show up in the address space. Each kind of MBC is a mapper:
+ *  it handles writes to its registers (0000-7FFF) by pointing the cartridge's
+ *  rom_banks and ram_bank at the banks they select, and the page table maps
+ *  those directly, so reads never do any banking arithmetic.
+ *
+ *  Cartridge RAM that isn't mapped (disabled, missing, or not plain memory
+ *  like MBC2's 4 bit RAM and MBC3's clock registers) is read and written
+ *  through the mapper instead.
+ *
+ *  Resources:
+ *
+ *  > Memory bank controllers
+ *  https://gbdev.io/pandocs/MBCs.html
+ *
+ */
+
+typedef struct gb gb_t;
+
+struct mapper {
+    const char* name;
+    void (*map)(gb_t* gb);  // map the banks the registers select
+    void (*write_register)(gb_t* gb, unsigned short address, unsigned char data);
+    unsigned char (*read_ram)(gb_t* gb, unsigned short address);
+    void (*write_ram)(gb_t* gb, unsigned short address, unsigned char data);
+};
+
+#define RTC_SECONDS     0
+#define RTC_MINUTES     1
+#define RTC_HOURS       2
+#define RTC_DAYS        3   // lower 8 bits of the day counter
+#define RTC_DAYS_HIGH   4   // bit 0: day counter bit 8, bit 6: halt, bit 7: day counter carry
+
+#define RTC_REGISTERS 5
+
+// MBC3 real time clock, it keeps the time of the emulated Gameboy (it's brought up to date when it's accessed)
+struct rtc {
+    unsigned char registers[RTC_REGISTERS];
+    unsigned char latched[RTC_REGISTERS];   // what the cpu reads (a copy of registers from when it last latched them)
+    unsigned char latch;                    // last value written to 6000-7FFF (writing 0 and then 1 latches)
+    unsigned long long synced;              // time registers were last brought up to (the start of a second)
+};
+
+void mapper_init(gb_t* gb);
+int mapper_can_map(gb_t* gb, int slot, int bank);
+
+#endif
@@ -18,6 +18,8 @@
  *
  */
 
+typedef struct gb gb_t;
+
 // Gameboy address space (RAM + VRAM?)
 union address_space {
     struct {
@@ -93,51 +95,74 @@ union address_space {
     unsigned char memory[0x10000]; // 64K address space
 };
 
-extern unsigned char* memory;
-extern unsigned char* ioports;
-extern unsigned char* interrupt_request_register;
-extern unsigned char* interrupt_enable_register;
-extern unsigned char* lcdc;
-extern unsigned char* lcdc_stat;
-extern unsigned char* lcd_ly;
-extern unsigned char* lcd_lyc;
-extern unsigned char* lcd_scy;
-extern unsigned char* lcd_scx;
-extern unsigned char* lcd_windowy;
-extern unsigned char* lcd_windowx;
-extern unsigned char* lcd_bgp;
-extern unsigned char* rombanks;
-extern unsigned char* disabled_bootrom;
-extern unsigned char* tdiv;
-extern unsigned char* tima;
-extern unsigned char* tma;
-extern unsigned char* tac;
-extern unsigned char* dma;
-extern unsigned char* joyp;
-extern unsigned char* obj_palette_0_data;
-extern unsigned char* obj_palette_1_data;
-
-
-// Gameboy game read only memory (inserted cartridge)??
-extern unsigned char rom[0x200000];
-extern unsigned char ram_banks[0x8000];
-
-extern unsigned char mbctype;
-extern unsigned char romsizetype;
-extern unsigned char ramsizetype;
-
-extern unsigned char ram_enable_register;
-extern unsigned char rom_bank_number;
-extern unsigned char ram_or_upperrom_bank_number;
-extern unsigned char banking_mode_select;
-
-extern unsigned char cartridge_loaded;
-
-void insert_cartridge(char* filename);
-void load_roms();
-void load_tests(char* testpath);
-void check_disable_bootrom();
-int mmu_write8bit(unsigned short address, unsigned char data);
-void mmu_read8bit(unsigned char* destination, unsigned short address);
+// Gameboy game read only memory (inserted cartridge) and its MBC state
+struct cartridge {
+    unsigned char* rom; // mapped ROM file (or blank ROM while there's no cartridge)
+    unsigned int rom_size;
+    unsigned char* ram_banks; // Up to 16 8KB banks (MBC5), RAM can also be 2KB, 8KB, 32KB or 64KB (see save.c)
+    unsigned int ram_size;
+
+    unsigned char mbctype;
+    unsigned char romsizetype;
+    unsigned char ramsizetype;
+
+    const struct mapper* mapper; // picked from mbctype
+    int n_rom_banks;
+    int n_ram_banks;
+
+    unsigned char* rom_banks[2]; // banks mapped at 0000-3FFF and 4000-7FFF
+    int rom_bank_numbers[2];
+    unsigned char* ram_bank; // bank mapped at A000-BFFF, NULL if the mapper handles it
+
+    unsigned char ram_enable_register;
+    unsigned short rom_bank_number; // selects ROM bank number (5 bits on MBC1, 4 on MBC2, 7 on MBC3, 9 on MBC5)
+    unsigned char ram_or_upperrom_bank_number; // MBC1: 2 bits register selects ROM bank number upper 2 bits or RAM bank number
+    unsigned char banking_mode_select; // MBC1: 1 bit register selects between two MBC1 banking modes (mode 0 or 1)
+    unsigned char ram_bank_number; // MBC3: RAM bank or clock register, MBC5: RAM bank
+
+    struct rtc rtc; // MBC3
+
+    unsigned char cartridge_loaded; // 0 if cartridge isn't loaded, 1 if it's partially loaded (all except first 256 bytes), 2 if it's fully loaded
+};
+
+/*
+ *  Page table: where each 256 byte page of the address space is read from and written to.
+ *  A page that's NULL goes through the full (slow) access logic instead, because it has
+ *  registers, banking, or isn't accessible in the current ppu mode. Whatever an entry
+ *  depends on (banks, bootstrap rom, ppu mode, cached code) remaps it when it changes
+ */
+struct memory_map {
+    unsigned char* read[256];
+    unsigned char* write[256];
+};
+
+#define DMA_CYCLES 640 // 160 bytes, one every 4 cycles
+
+// OAM DMA that's running (only with -DDMA_TIMING, otherwise transfers are done right away)
+struct dma {
+    unsigned char active;
+    unsigned char source; // page the transfer copies (XX00-XX9F)
+};
+
+void mmu_init(gb_t* gb);
+int insert_cartridge(gb_t* gb, char* filename);
+void load_roms(gb_t* gb);
+int load_tests(gb_t* gb, char* testpath);
+void mmu_free(gb_t* gb);
+void check_disable_bootrom(gb_t* gb);
+int mmu_write8bit(gb_t* gb, unsigned short address, unsigned char data);
+void mmu_read8bit(gb_t* gb, unsigned char* destination, unsigned short address);
+void mmu_peek8bit(gb_t* gb, unsigned char* destination, unsigned short address);
+
+#define BOOTSTRAP_ROM_BANK 0x200 // past the last bank a mapper can select (MBC5 goes up to 0x1FF)
+
+int mmu_rom_bank(gb_t* gb, unsigned short address);
+
+void mmu_map_pages(gb_t* gb, int first, int last);
+
+void mmu_dma_event(gb_t* gb);
+#ifdef DMA_TIMING
+int mmu_dma_blocks(gb_t* gb, unsigned short address);
+#endif
 
 #endif
@@ -12,23 +12,116 @@
  *
  * > LCD
  * http://www.codeslinger.co.uk/pages/projects/gameboy/lcd.html
- *
- * > OpenGL Textures
- * https://learnopengl.com/Getting-started/Textures
  */
 
+typedef struct gb gb_t;
+
+#ifdef PIXEL_FIFO
+#include "fifo.h"
+#endif
 
-#define SCREEN_MULTIPLIER 2
 
 #define SCREEN_WIDTH 160
 #define SCREEN_HEIGHT 144
 
 
-extern unsigned char joypad_state;
+#define TILES 384  // in 8000-97FF, 16 bytes each
+
+/*
+ *  Tiles decoded to color numbers (0-3), one byte per pixel, so drawing a line
+ *  is looking them up instead of taking the bitplanes apart pixel by pixel.
+ *  A tile is decoded when it's first drawn, and again after its page of VRAM is
+ *  written: writes to pages with decoded tiles aren't mapped (see map_page in
+ *  memory.c), the first one goes through write8bit and drops them.
+ */
+struct tile_cache {
+    unsigned char lines[TILES][8][8];           // [tile][line][pixel]
+    unsigned char flipped_lines[TILES][8][8];   // X flipped
+    unsigned char decoded[TILES];
+    unsigned char decoded_pages[TILES/16];      // pages with decoded tiles (8000-97FF)
+};
+
+#define SPRITES 40             // in OAM
+#define SPRITES_PER_LINE 10
+
+// A sprite in OAM (FE00-FE9F)
+struct sprite_attributes {
+    unsigned char y;            // + 16
+    unsigned char x;            // + 8
+    unsigned char tile;
+    unsigned char attributes;
+};
+
+/*
+ *  The sprites each line draws, picked from OAM in one go instead of going
+ *  through all of it for every line: the first 10 in OAM that the line goes
+ *  through, in the order they get the pixels they overlap (lowest X first,
+ *  then OAM order). They're picked again when OAM or the sprite size changes.
+ */
+struct sprite_lists {
+    unsigned char sprites[SCREEN_HEIGHT][SPRITES_PER_LINE];    // indexes in OAM
+    unsigned char counts[SCREEN_HEIGHT];
+    unsigned char height;       // sprite height they were picked for (8 or 16)
+    unsigned char changed;      // OAM was written since
+};
+
+/*
+ *  Frame skipping: skipped frames aren't drawn (no render_tiles or render_sprites,
+ *  or the pixel FIFO shifts its pixels out without drawing them), everything else
+ *  is the same: LY, LCD STAT, mode 3 length, VBlank and their interrupts, and the
+ *  window line counter. Frames are picked as they start (LY 0), skip of every
+ *  `every` frames are skipped, or with every 0 only the ones asked for with
+ *  ppu_request_frame are drawn. It's a setting, not part of save states.
+ */
+struct frame_skip {
+    int skip;                   // frames skipped of every `every`, 0 draws them all
+    int every;
+    unsigned int count;         // frames started since it was set
+    unsigned char requested;    // the next frame is drawn (every 0)
+    unsigned char drawing;      // the current frame is drawn
+    unsigned char ready;        // a drawn frame got to VBlank since ppu_new_frame
+};
+
+struct ppu {
+    unsigned long long line_start;  // when the current scanline started
+    unsigned char window_line;      // line of the window the next line that shows it draws
+    unsigned char scanlinesbuffer[SCREEN_WIDTH*SCREEN_HEIGHT];
+    struct tile_cache tiles;
+    struct sprite_lists sprites;
+
+    // Color numbers of the background and window on the line being drawn, pixel x is bg_colors[8 + x]
+    // (there's a tile either side for the part of the first tile left of the screen, and the window's last one)
+    unsigned char bg_colors[8 + SCREEN_WIDTH + 8];
+
+    struct frame_skip frame_skip;
+
+#ifdef PIXEL_FIFO
+    struct pixel_fifo fifo;
+#endif
+};
+
+void ppu_init(gb_t* gb);
+
+void ppu_stat_event(gb_t* gb);
+void ppu_event(gb_t* gb);
+
+void ppu_write_register(gb_t* gb, unsigned short address, unsigned char data);
+
+void ppu_set_frame_skip(gb_t* gb, int skip, int every);
+void ppu_request_frame(gb_t* gb);
+int ppu_new_frame(gb_t* gb);
+
+#ifdef PIXEL_FIFO
+void ppu_fifo_restart(gb_t* gb);
+#endif
 
-void init_gui();
-void render_frame();
+const unsigned char* ppu_tile_line(gb_t* gb, int tile, int line, int x_flip);
+void ppu_palette_shades(unsigned char palette_register, unsigned char* shades);
+const unsigned char* ppu_line_sprites(gb_t* gb, int ly, int* n);
+const unsigned char* ppu_sprite_pixels(gb_t* gb, const struct sprite_attributes* sprite, int ly);
 
-void ppu(int cycles);
+int ppu_page_has_tiles(gb_t* gb, int page);
+void ppu_vram_written(gb_t* gb, unsigned short address);
+void ppu_oam_written(gb_t* gb);
 
 #endif
@@ -0,0 +1,41 @@
+#ifndef _PROFILE
+
+#define _PROFILE
+
+/*
+ *  Gameboy Emulator: Opcode Profiler
+ *
+ *  Only built with -DPROFILE (otherwise none of this is compiled in).
+ *
+ *  Counts how many times every opcode (and CB opcode) runs and the cycles
+ *  it takes, including the extra cycles of taken branches (and OAM DMA).
+ *  The report is written to profile.txt and profile.csv, sorted by cycles,
+ *  when the emulator exits or when it receives SIGUSR1.
+ *
+ *  With the JIT every instruction goes through the interpreter, so
+ *  nothing is missed (but it's slower). Passes over idle loops that the
+ *  scheduler skips aren't counted, they never run.
+ *
+ */
+
+#include <stdio.h>
+
+typedef struct gb gb_t;
+
+struct profile_counter {
+    unsigned long long executions;
+    unsigned long long cycles;          // including extra cycles
+    unsigned long long extra;           // executions that took extra cycles (e.g. branch taken)
+    unsigned long long extra_cycles;
+};
+
+struct profile {
+    struct profile_counter instructions[256];
+    struct profile_counter cb_instructions[256];
+};
+
+void profile_count(struct profile_counter* counter, int cycles, int extra_cycles);
+void profile_write_report(gb_t* gb, FILE* text, FILE* csv);
+void profile_dump(gb_t* gb);
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef _REWIND
+
+#define _REWIND
+
+/*
+ *  Gameboy Emulator: Rewind
+ *
+ *  Every interval frames the whole machine is captured (what a save state
+ *  has, see state.h), and holding the rewind key steps back through those
+ *  snapshots, newest first.
+ *
+ *  Only the newest snapshot is kept whole. Each one before it is kept as
+ *  its difference to the one after it: the XOR of the two (zero wherever
+ *  nothing changed) run length encoded page by page, leaving out the pages
+ *  that are all zero. Pages nothing wrote since the last capture (see dirty.h)
+ *  aren't even compared, so a capture costs about as much as what changed in
+ *  between, a few microseconds per frame in most games.
+ *
+ *  Stepping back XORs the newest difference into the newest snapshot and
+ *  loads the result. The differences share a buffer of fixed size, when
+ *  it's full the oldest are dropped.
+ *
+ */
+
+#include "state.h"
+#include "dirty.h"
+
+typedef struct gb gb_t;
+
+#define REWIND_BUDGET (16 << 20)        // bytes of differences kept (minutes of play in most games)
+#define REWIND_INTERVAL 2               // frames between snapshots
+#define REWIND_MAX_SNAPSHOTS (1 << 16)
+
+struct rewind_snapshot {
+    struct state_machine machine;
+    unsigned char pages[DIRTY_PAGES][0x100];    // address space, then cartridge RAM (the dirty page numbers)
+};
+
+struct rewind {
+    struct rewind_snapshot* latest;     // newest snapshot (NULL if rewinding isn't on)
+    unsigned char* scratch;             // a difference while it's encoded or decoded
+    int captured;                       // latest has been captured
+    unsigned int ram_size;              // of latest
+    unsigned int epoch;                 // dirty epoch started when gb was last at latest
+    int interval;
+    int frames;                         // run since gb was last at latest
+
+    // Differences, oldest first, in a ring buffer of budget bytes
+    unsigned char* buffer;
+    unsigned long long budget;
+    unsigned long long head;            // where the next one goes
+    unsigned long long used;
+    unsigned int* sizes;                // of each, REWIND_MAX_SNAPSHOTS of them
+    int first;                          // the oldest in sizes
+    int n_differences;
+
+    unsigned char held;                 // the rewind key is held (set by the frontend)
+};
+
+void rewind_init(gb_t* gb, unsigned long long budget, int interval);
+void rewind_free(gb_t* gb);
+
+void rewind_frame(gb_t* gb);
+void rewind_capture(gb_t* gb);
+int rewind_step(gb_t* gb);
+
+#endif
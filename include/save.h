@@ -0,0 +1,60 @@
+#ifndef _SAVE
+
+#define _SAVE
+
+/*
+ *  Gameboy Emulator: Cartridge RAM and Save Files
+ *
+ *  Cartridges with a battery keep their RAM when the Gameboy is off. For
+ *  those, RAM is a shared mapping of a .sav file next to the ROM, so it's
+ *  loaded by mapping it, and every write already is in the file (the page
+ *  cache) with no copying.
+ *
+ *  To get writes to disk at sensible times, the first write to each clean
+ *  256 byte page of RAM goes through save_mark_dirty (after it, writes to
+ *  the page are plain stores again). Dirty pages are handed to a background
+ *  thread as one range, which msyncs it:
+ *
+ *      > SAVE_DELAY_CYCLES after the first page got dirty
+ *      > as soon as SAVE_MAX_DIRTY_PAGES are dirty
+ *      > on a clean shutdown (save_free)
+ *
+ *  Cartridges without a battery get anonymous memory instead.
+ *
+ */
+
+#include <pthread.h>
+
+typedef struct gb gb_t;
+
+#define SAVE_DELAY_CYCLES       4194304     // 1 second
+#define SAVE_MAX_DIRTY_PAGES    32          // 8KB
+
+#define SAVE_PAGES (0x20000 >> 8)           // of the largest RAM (128KB)
+
+struct save {
+    int battery;                            // RAM is mapped from the .sav file
+    char path[4096];
+
+    unsigned char dirty[SAVE_PAGES];        // pages written since they were last handed to the thread
+    int n_dirty;
+
+    // Shared with the thread
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    unsigned int pending_start;             // range of RAM waiting to be synced (empty if start == end)
+    unsigned int pending_end;
+    int stop;
+};
+
+void save_set_path(gb_t* gb, const char* rom_path);
+void save_init(gb_t* gb);
+void save_free(gb_t* gb);
+
+int save_page_is_clean(gb_t* gb, unsigned int offset);
+void save_mark_dirty(gb_t* gb, unsigned int offset);
+
+void save_event(gb_t* gb);
+
+#endif
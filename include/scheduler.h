@@ -0,0 +1,59 @@
+#ifndef _SCHEDULER
+
+#define _SCHEDULER
+
+/*
+ *  Gameboy Emulator: Event Scheduler
+ *
+ *  Time is counted in cycles since power on. Instead of stepping the ppu,
+ *  timer and joypad after every instruction, each of them schedules the cycle
+ *  at which it next has something to do (an event), and the cpu runs freely
+ *  until the earliest one is due.
+ *
+ *  Events are handled at the end of the first instruction that reaches their
+ *  deadline, which is when the old per instruction polling would have seen them.
+ *  JIT blocks stop after that instruction too, and the instructions they leave
+ *  to the interpreter see the time they start at (for events they schedule, or
+ *  LY and LCD STAT worked out from it), as they would outside a block.
+ *
+ *  Idle loops (polling memory only events can change) are skipped up to the
+ *  next event too.
+ *
+ *  There's one slot per kind of event (a kind is either scheduled once or not
+ *  at all), events due at the same time run in slot order.
+ *
+ */
+
+typedef struct gb gb_t;
+
+#define EVENT_LCD_STAT  0   // ppu: update LCD STAT (mode, LY == LYC) and request its interrupts
+#define EVENT_PPU       1   // ppu: next mode change or end of scanline
+#define EVENT_DIV       2   // timer: DIV increment
+#define EVENT_TIMA      3   // timer: TIMA increment
+#define EVENT_JOYPAD    4   // joypad: keys pressed in the selected group request an interrupt
+#define EVENT_SAVE      5   // save: hand dirty battery backed RAM to the thread that writes it
+
+#define EVENT_DMA       6   // memory: OAM DMA is done (only with -DDMA_TIMING)
+
+#define EVENTS 7
+
+#define NO_EVENT ((unsigned long long) -1)  // deadline of an event that isn't scheduled
+
+struct scheduler {
+    unsigned long long now;                 // cycles since power on (while an instruction runs, when it started)
+    unsigned long long instruction_start;   // when the last instruction (or block) started
+    unsigned long long deadlines[EVENTS];
+    unsigned long long next_deadline;       // earliest of deadlines
+
+    unsigned long long idle_cycles;         // cycles skipped in idle loops (for stats, the frontend resets it)
+};
+
+void scheduler_init(gb_t* gb);
+
+void scheduler_schedule(gb_t* gb, int event, unsigned long long deadline);
+void scheduler_cancel(gb_t* gb, int event);
+void scheduler_interrupt_cleared(gb_t* gb);
+
+void scheduler_run(gb_t* gb, unsigned long long until);
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef _STATE
+
+#define _STATE
+
+/*
+ *  Gameboy Emulator: Save States
+ *
+ *  A save state is everything a running gb needs to continue from where it
+ *  was saved (the cartridge ROM isn't included, it has to be inserted already).
+ *
+ *  File:
+ *
+ *      header          STATE_MAGIC, version, the cartridge it's from and the section table
+ *      machine         registers, scheduler, ppu, timer, DMA and MBC state (struct state_machine)
+ *      memory          the 64KB address space
+ *      ram             cartridge RAM
+ *
+ *  Every section starts at a multiple of STATE_ALIGN (so it can be mapped on
+ *  its own), and can be packed with a simple run length encoding (STATE_PACK),
+ *  which is fast and works well on memory (mostly zeros and repeated tiles).
+ *  Structs are written as they are in memory: load on the same kind of machine.
+ *
+ *  Usage:
+ *
+ *      state_save(gb, "game.state", 0);
+ *      ...
+ *      struct state* state = state_open("game.state");
+ *      state_load(gb, state);      // as many times as needed
+ *      state_close(state);
+ *
+ *  state_open maps the file and checks it once, loading copies unpacked sections
+ *  straight out of the mapping, with no reading or parsing. Memory can't be mapped
+ *  in place (it's part of gb_t, see memory.h), but loading the same state into the
+ *  same gb again only copies the pages written since it was last loaded (see dirty.h),
+ *  so restoring over and over takes microseconds.
+ *
+ */
+
+typedef struct gb gb_t;
+
+#include "mapper.h"
+#include "scheduler.h"
+
+#define STATE_MAGIC "GBSTATE"
+#define STATE_VERSION 2
+
+#define STATE_ALIGN 4096
+
+#define STATE_PACK 1                // state_save flag: run length encode the sections
+
+#define STATE_MACHINE   0
+#define STATE_MEMORY    1
+#define STATE_RAM       2
+
+#define STATE_SECTIONS 3
+
+struct state_section {
+    unsigned int id;                // STATE_MACHINE, STATE_MEMORY...
+    unsigned int packed;            // 1 if it's run length encoded
+    unsigned long long offset;      // from the start of the file (a multiple of STATE_ALIGN)
+    unsigned long long size;        // in the file
+    unsigned long long unpacked_size;
+};
+
+struct state_header {
+    char magic[8];
+    unsigned int version;
+    unsigned int n_sections;
+    unsigned char title[16];        // cartridge header (0134-0143) of the ROM it was saved with
+    unsigned char checksum[2];      // and its global checksum (014E-014F)
+    struct state_section sections[STATE_SECTIONS];
+};
+
+// Everything that isn't memory, in a layout that doesn't depend on build options
+struct state_machine {
+    unsigned short af, bc, de, hl, sp, pc;
+    unsigned char interrupt_master_enable;
+    unsigned char halted;
+    unsigned char stopped;
+
+    unsigned long long now;
+    unsigned long long instruction_start;
+    unsigned long long deadlines[EVENTS];   // (a change to the events changes STATE_VERSION)
+
+    unsigned long long line_start;
+    unsigned char window_line;
+
+    unsigned long long counter_deadline;
+    int counter_cycles_left;
+    int first_iteration;
+
+    unsigned char dma_active;
+    unsigned char dma_source;
+
+    unsigned char cartridge_loaded;
+    unsigned char ram_enable_register;
+    unsigned short rom_bank_number;
+    unsigned char ram_or_upperrom_bank_number;
+    unsigned char banking_mode_select;
+    unsigned char ram_bank_number;
+    struct rtc rtc;
+};
+
+// A mapped state file
+struct state {
+    unsigned char* data;
+    unsigned long long size;
+    const struct state_header* header;
+
+    gb_t* loaded_into;              // gb it was last loaded into
+    unsigned int epoch;             // and the dirty epoch started right after
+};
+
+int state_save(gb_t* gb, const char* path, int flags);
+
+void state_capture(gb_t* gb, struct state_machine* machine);
+int state_restore(gb_t* gb, const struct state_machine* machine, const unsigned char* memory,
+        const unsigned char* ram, unsigned int ram_size);
+
+struct state* state_open(const char* path);
+int state_load(gb_t* gb, struct state* state);
+void state_close(struct state* state);
+
+// Run length encoding of the sections (see state.c)
+unsigned long long state_packed_bound(unsigned long long size);
+unsigned long long state_pack(const unsigned char* in, unsigned long long size, unsigned char* out);
+int state_unpack(const unsigned char* in, unsigned long long size, unsigned char* out, unsigned long long out_size);
+
+#endif
@@ -2,6 +2,19 @@
 
 #define _TIMER
 
-void timer(int cycles);
+typedef struct gb gb_t;
+
+struct timer {
+    unsigned long long counter_deadline;    // when TIMA is next incremented (while enabled)
+    int counter_cycles_left;                // cycles until TIMA's next increment (while disabled)
+    int first_iteration;
+};
+
+void timer_init(gb_t* gb);
+
+void timer_div_event(gb_t* gb);
+void timer_tima_event(gb_t* gb);
+
+void timer_write_tac(gb_t* gb, unsigned char data);
 
 #endif
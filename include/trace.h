@@ -0,0 +1,73 @@
+#ifndef _TRACE
+
+#define _TRACE
+
+/*
+ *  Gameboy Emulator: Execution Trace
+ *
+ *  Built with -DTRACE, every instruction is recorded into a ring buffer of
+ *  fixed size binary records (cycle, ROM bank, PC, opcode, registers before
+ *  it ran and the memory it accessed). Only the last TRACE_RECORDS are kept.
+ *
+ *  The buffer is written to TRACE_FILE when the emulator crashes, when it
+ *  hits an undefined opcode, or when it receives SIGUSR2. Decode it with
+ *  the "tracedecode" tool (make tracedecode; ./tracedecode trace.bin).
+ *  (Records are written as they are in memory: decode on the same kind of machine)
+ *
+ *  The debugger prints the same records, one line per instruction.
+ *
+ *  With the JIT every instruction goes through the interpreter, so
+ *  nothing is missed.
+ *
+ */
+
+#include <stdio.h>
+
+typedef struct gb gb_t;
+
+#define TRACE_RECORDS (1 << 16)     // (power of 2)
+#define TRACE_ACCESSES 4            // memory accesses kept per record (DMA makes many more)
+#define TRACE_FILE "trace.bin"
+
+#define TRACE_MAGIC "GBTRAC2"     // 2: 16 bit ROM banks
+
+struct trace_access {
+    unsigned short address;
+    unsigned char value;
+    unsigned char write;
+};
+
+struct trace_record {
+    unsigned long long cycle;       // when the instruction started
+    unsigned short pc;
+    unsigned short operand;         // immediate (or CB opcode)
+    unsigned short af, bc, de, hl, sp;
+    unsigned short bank;            // ROM bank of pc (0 if it isn't in ROM, BOOTSTRAP_ROM_BANK in the bootstrap rom)
+    unsigned char opcode;
+    unsigned char n_accesses;       // all accesses, even those that didn't fit
+    struct trace_access accesses[TRACE_ACCESSES];
+};
+
+// Trace file: header followed by n_records records, oldest first
+struct trace_file_header {
+    char magic[8];
+    unsigned int record_size;
+    unsigned int n_records;
+};
+
+#ifdef TRACE
+struct trace {
+    struct trace_record records[TRACE_RECORDS];
+    unsigned long long n_records;   // recorded since power on
+    struct trace_record* current;   // record of the running instruction (dispatch sets it back to NULL when it's done, so interrupts aren't recorded into it)
+};
+
+void trace_instruction(gb_t* gb, unsigned char opcode, unsigned short operand);
+void trace_memory_access(gb_t* gb, unsigned short address, unsigned char value, unsigned char write);
+int trace_dump(gb_t* gb, const char* path);
+#endif
+
+void trace_fill_record(gb_t* gb, struct trace_record* record, unsigned char opcode, unsigned short operand);
+void trace_print_record(FILE* out, const struct trace_record* record);
+
+#endif
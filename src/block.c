@@ -0,0 +1,305 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "gb.h"
+
+/*---- Decoding ---------------------------------------------------*/
+
+
+static unsigned char ends_block(unsigned char opcode) {
+
+    switch (opcode) {
+        case 0x10: // STOP
+        case 0x76: // HALT
+        case 0xf3: // DI
+        case 0xfb: // EI
+        case 0x18: case 0x20: case 0x28: case 0x30: case 0x38: // JR
+        case 0xc2: case 0xc3: case 0xca: case 0xd2: case 0xda: case 0xe9: // JP
+        case 0xc4: case 0xcc: case 0xcd: case 0xd4: case 0xdc: // CALL
+        case 0xc0: case 0xc8: case 0xc9: case 0xd0: case 0xd8: case 0xd9: // RET
+        case 0xc7: case 0xcf: case 0xd7: case 0xdf: case 0xe7: case 0xef: case 0xf7: case 0xff: // RST
+            return 1;
+    }
+
+    return 0;
+}
+
+/*
+ *  Only changes registers (no memory writes, stack or interrupt changes)
+ */
+static unsigned char only_reads(unsigned char opcode, unsigned char cb_opcode) {
+
+    if (opcode == 0xcb)     // everything but rotates, shifts, RES and SET of (HL)
+        return (cb_opcode & 7) != 6 || (cb_opcode >= 0x40 && cb_opcode < 0x80);
+
+    if (opcode >= 0x40 && opcode < 0x80)    // LD r,r and LD r,(HL) but not LD (HL),r or HALT
+        return opcode < 0x70 || opcode > 0x77;
+
+    if (opcode >= 0x80 && opcode < 0xc0)    // ALU A,r and A,(HL)
+        return 1;
+
+    switch (opcode) {
+        case 0x00: // NOP
+        case 0x01: case 0x11: case 0x21: case 0x31: // LD rr,d16
+        case 0x03: case 0x13: case 0x23: case 0x33: case 0x0b: case 0x1b: case 0x2b: case 0x3b: // INC/DEC rr
+        case 0x09: case 0x19: case 0x29: case 0x39: // ADD HL,rr
+        case 0x04: case 0x0c: case 0x14: case 0x1c: case 0x24: case 0x2c: case 0x3c: // INC r
+        case 0x05: case 0x0d: case 0x15: case 0x1d: case 0x25: case 0x2d: case 0x3d: // DEC r
+        case 0x06: case 0x0e: case 0x16: case 0x1e: case 0x26: case 0x2e: case 0x3e: // LD r,d8
+        case 0x0a: case 0x1a: case 0x2a: case 0x3a: case 0xf0: case 0xf2: case 0xfa: // LD A,(...)
+        case 0x07: case 0x0f: case 0x17: case 0x1f: case 0x27: case 0x2f: case 0x37: case 0x3f: // RLCA..CCF
+        case 0xc6: case 0xce: case 0xd6: case 0xde: case 0xe6: case 0xee: case 0xf6: case 0xfe: // ALU A,d8
+            return 1;
+    }
+
+    return 0;
+}
+
+/*
+ *  A block that only reads and whose last instruction (JR or JP) can jump back to its start
+ */
+static unsigned char is_idle_loop(struct block* block) {
+
+    for (int i = 0; i < block->n_instructions-1; i++)
+        if (!only_reads(block->instructions[i].opcode, block->instructions[i].operand & 0xff))
+            return 0;
+
+    struct block_instruction* last = &block->instructions[block->n_instructions-1];
+
+    switch (last->opcode) {
+        case 0x18: case 0x20: case 0x28: case 0x30: case 0x38: // JR
+            return (unsigned short) (last->next_pc + (signed char) last->operand) == block->start;
+        case 0xc2: case 0xc3: case 0xca: case 0xd2: case 0xda: // JP
+            return last->operand == block->start;
+    }
+
+    return 0;
+}
+
+/*
+ *  Cached code lives in ROM, work RAM or high RAM.
+ *  Returns the end of the region address is in, or 0 if it isn't cached
+ */
+static unsigned int code_region_end(gb_t* gb, unsigned short address) {
+
+    if (address < 0x100 && mmu_rom_bank(gb, address) == BOOTSTRAP_ROM_BANK)
+        return 0x100;
+    if (address < 0x4000)
+        return 0x4000;
+    if (address < 0x8000)
+        return 0x8000;
+    if (address >= 0xc000 && address < 0xe000)
+        return 0xe000;
+    if (address >= 0xff80 && address < 0xffff)
+        return 0xffff;
+
+    return 0;
+}
+
+static struct block** block_bucket(gb_t* gb, unsigned int key) {
+
+    return &gb->block_cache.buckets[(key ^ (key >> 14)) & (BLOCK_BUCKETS-1)];
+}
+
+static void count_code_pages(gb_t* gb, struct block* block, int count) {
+
+    if (block->start < 0x8000 || block->start == block->end)
+        return;
+
+    for (int page = block->start >> 8; page <= (block->end-1) >> 8; page++) {
+
+        gb->block_cache.code_pages[page] += count;
+
+        // The first block decoded from a page, or the last one dropped:
+        // writes to pages with code have to go through block_memory_write
+        if (gb->block_cache.code_pages[page] == (count > 0))
+            mmu_map_pages(gb, page, page);
+    }
+}
+
+/*
+ *  Decode the block starting at address
+ */
+static struct block* decode_block(gb_t* gb, unsigned short address, unsigned int key) {
+
+    struct block* block = calloc(1, sizeof(struct block));
+
+    block->key = key;
+    block->start = address;
+
+    unsigned int region_end = code_region_end(gb, address);
+    unsigned int pc = address;
+
+    while (block->n_instructions < MAX_BLOCK_INSTRUCTIONS) {
+
+        unsigned char opcode;
+        mmu_peek8bit(gb, &opcode, pc);
+
+        // Undefined opcodes have no cycles, leave those to the interpreter
+        if (!instructions_ticks[opcode] || pc + instructions_length[opcode] > region_end)
+            break;
+
+        unsigned char lo = 0, hi = 0;
+        if (instructions_length[opcode] > 1)
+            mmu_peek8bit(gb, &lo, pc+1);
+        if (instructions_length[opcode] > 2)
+            mmu_peek8bit(gb, &hi, pc+2);
+
+        pc += instructions_length[opcode];
+
+        struct block_instruction* instruction = &block->instructions[block->n_instructions++];
+        instruction->opcode = opcode;
+        instruction->operand = (hi << 8) | lo;
+        instruction->next_pc = pc;
+
+        block->cycles += opcode == 0xcb ? instructions_cb_ticks[lo] : instructions_ticks[opcode];
+
+        if (ends_block(opcode))
+            break;
+    }
+
+    block->end = pc;
+
+    if (block->n_instructions)
+        block->idle_loop = is_idle_loop(block);
+
+    struct block** bucket = block_bucket(gb, key);
+    block->next = *bucket;
+    *bucket = block;
+
+    count_code_pages(gb, block, 1);
+
+    return block;
+}
+
+
+
+/*---- Lookup and Invalidation ------------------------------------*/
+
+
+/*
+ *  Get the block starting at address, decoding it if needed
+ *  Returns NULL if the code there isn't cached
+ */
+struct block* block_lookup(gb_t* gb, unsigned short address) {
+
+    while (gb->block_cache.dead) {
+        struct block* next = gb->block_cache.dead->next;
+        free(gb->block_cache.dead);
+        gb->block_cache.dead = next;
+    }
+
+    if (!code_region_end(gb, address))
+        return NULL;
+
+#ifdef DMA_TIMING
+    // The cpu reads 0xFF from the bus OAM DMA is using (that mustn't be cached)
+    if (mmu_dma_blocks(gb, address))
+        return NULL;
+#endif
+
+    unsigned int key = ((address < 0x8000 ? mmu_rom_bank(gb, address) : 0) << 16) | address;
+
+    struct block* block = *block_bucket(gb, key);
+
+    while (block && block->key != key)
+        block = block->next;
+
+    if (!block)
+        block = decode_block(gb, address, key);
+
+    return block->n_instructions ? block : NULL;
+}
+
+/*
+ *  Get the predecoded instruction at address (for the interpreter)
+ *  Returns NULL if the code there isn't cached
+ */
+struct block_instruction* block_fetch(gb_t* gb, unsigned short address) {
+
+    // Usually the next instruction is the one after the last in the same block
+    if (gb->block_cache.current && gb->block_cache.current_instruction < gb->block_cache.current->n_instructions
+            && address == gb->block_cache.current->instructions[gb->block_cache.current_instruction-1].next_pc)
+        return &gb->block_cache.current->instructions[gb->block_cache.current_instruction++];
+
+    // or the first one of the same block (loops)
+    if (!gb->block_cache.current || address != gb->block_cache.current->start)
+        gb->block_cache.current = block_lookup(gb, address);
+
+    if (!gb->block_cache.current)
+        return NULL;
+
+    gb->block_cache.current_instruction = 1;
+    return &gb->block_cache.current->instructions[0];
+}
+
+/*
+ *  Drop every block decoded from page
+ */
+static void invalidate_page(gb_t* gb, unsigned char page) {
+
+    for (int i = 0; i < BLOCK_BUCKETS; i++) {
+
+        struct block** link = &gb->block_cache.buckets[i];
+
+        while (*link) {
+
+            struct block* block = *link;
+
+            if (block->start >= 0x8000 && block->start != block->end
+                    && block->start >> 8 <= page && (block->end-1) >> 8 >= page) {
+
+                *link = block->next;
+                count_code_pages(gb, block, -1);
+
+                if (block == gb->block_cache.current)
+                    gb->block_cache.current = NULL;
+
+                block->next = gb->block_cache.dead;
+                gb->block_cache.dead = block;
+            }
+            else
+                link = &block->next;
+        }
+    }
+
+    gb->block_cache.exit_request = 1;
+}
+
+void block_memory_write(gb_t* gb, unsigned short address) {
+
+    if (address < 0x8000 || (address >= 0xff00 && (address < 0xff80 || address == 0xffff))) {
+
+        // Bank switches (and disabling the bootstrap rom) change what code is mapped
+        gb->block_cache.current = NULL;
+        gb->block_cache.exit_request = 1;
+    }
+    else if (gb->block_cache.code_pages[address >> 8])
+        invalidate_page(gb, address >> 8);
+}
+
+/*
+ *  Drop every block (must not be called while one is running)
+ */
+void block_flush(gb_t* gb) {
+
+    for (int i = 0; i < BLOCK_BUCKETS; i++) {
+
+        while (gb->block_cache.buckets[i]) {
+            struct block* next = gb->block_cache.buckets[i]->next;
+            free(gb->block_cache.buckets[i]);
+            gb->block_cache.buckets[i] = next;
+        }
+    }
+
+    while (gb->block_cache.dead) {
+        struct block* next = gb->block_cache.dead->next;
+        free(gb->block_cache.dead);
+        gb->block_cache.dead = next;
+    }
+
+    memset(gb->block_cache.code_pages, 0, sizeof(gb->block_cache.code_pages));
+    mmu_map_pages(gb, 0x80, 0xff);
+
+    gb->block_cache.current = NULL;
+}
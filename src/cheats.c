@@ -0,0 +1,250 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gb.h"
+
+/*---- Codes ------------------------------------------------------*/
+
+
+/*
+ *  Read the hex digits of code into digits (dashes are skipped)
+ *  Returns how many there are, or -1 if there's something else or more than max
+ */
+static int hex_digits(const char* code, unsigned char* digits, int max) {
+
+    int n = 0;
+
+    for (; *code; code++) {
+
+        char c = *code;
+
+        if (c == '-')
+            continue;
+
+        if (n == max)
+            return -1;
+
+        if (c >= '0' && c <= '9')
+            digits[n++] = c - '0';
+        else if (c >= 'a' && c <= 'f')
+            digits[n++] = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            digits[n++] = c - 'A' + 10;
+        else
+            return -1;
+    }
+
+    return n;
+}
+
+/*
+ *  Game Genie: ABC-DEF-GHI
+ *
+ *      AB      new value
+ *      FCDE    address, with F XORed with 0xF
+ *      GI      compare value, rotated right by 2 and XORed with 0xBA (H isn't used)
+ */
+static int parse_game_genie(const unsigned char* d, int n, struct cheat_patch* patch) {
+
+    patch->value = d[0] << 4 | d[1];
+    patch->address = (d[5] ^ 0xf) << 12 | d[2] << 8 | d[3] << 4 | d[4];
+    patch->compare = -1;
+
+    if (n == 9) {
+        unsigned char compare = d[6] << 4 | d[8];
+        patch->compare = (unsigned char) (compare >> 2 | compare << 6) ^ 0xba;
+    }
+
+    // Only ROM can be patched
+    return patch->address < 0x8000 ? 0 : -1;
+}
+
+/*
+ *  GameShark: ABCDEFGH
+ *
+ *      AB      external RAM bank (for A000-BFFF)
+ *      CD      new value
+ *      GHEF    address
+ */
+static int parse_game_shark(const unsigned char* d, struct cheat_poke* poke) {
+
+    poke->ram_bank = d[0] << 4 | d[1];
+    poke->value = d[2] << 4 | d[3];
+    poke->address = d[6] << 12 | d[7] << 8 | d[4] << 4 | d[5];
+
+    // Only RAM can be poked
+    return poke->address >= 0xa000 && poke->address < 0xe000 ? 0 : -1;
+}
+
+
+
+/*---- Game Genie -------------------------------------------------*/
+
+
+static void free_rom_pages(gb_t* gb) {
+
+    struct cheats* cheats = &gb->cheats;
+
+    for (int slot = 0; slot < 2; slot++) {
+
+        if (!cheats->rom_pages[slot])
+            continue;
+
+        for (unsigned int page = 0; page < gb->cartridge.rom_size >> 8; page++)
+            free(cheats->rom_pages[slot][page]);
+
+        free(cheats->rom_pages[slot]);
+        cheats->rom_pages[slot] = NULL;
+    }
+}
+
+/*
+ *  Copy the pages of ROM the patches change, and map the copies
+ *  (called whenever the patches change)
+ */
+static void patch_rom(gb_t* gb) {
+
+    struct cheats* cheats = &gb->cheats;
+    struct cartridge* cartridge = &gb->cartridge;
+
+    free_rom_pages(gb);
+
+    if (cheats->n_patches) {
+
+        for (int slot = 0; slot < 2; slot++)
+            cheats->rom_pages[slot] = calloc(cartridge->rom_size >> 8, sizeof(unsigned char*));
+
+        for (int i = 0; i < cheats->n_patches; i++) {
+
+            struct cheat_patch* patch = &cheats->patches[i];
+
+            // A code for 0000-3FFF patches the banks that can be mapped there, one for 4000-7FFF the switchable ones
+            int slot = patch->address >> 14;
+
+            for (unsigned int bank = 0; bank < cartridge->rom_size / 0x4000; bank++) {
+
+                if (!mapper_can_map(gb, slot, bank))
+                    continue;
+
+                unsigned int offset = bank*0x4000 + (patch->address & 0x3fff);
+
+                if (patch->compare >= 0 && cartridge->rom[offset] != patch->compare)
+                    continue;
+
+                unsigned char** page = &cheats->rom_pages[slot][offset >> 8];
+
+                if (!*page) {
+                    *page = malloc(0x100);
+                    memcpy(*page, &cartridge->rom[offset & ~0xff], 0x100);
+                }
+
+                (*page)[offset & 0xff] = patch->value;
+            }
+        }
+    }
+
+    // Code decoded from the old bytes is gone
+    block_flush(gb);
+    mmu_map_pages(gb, 0x00, 0x7f);
+}
+
+/*
+ *  What map_page maps instead of the ROM page at rom_page, when it's mapped in slot
+ *  (0 for 0000-3FFF, 1 for 4000-7FFF)
+ */
+unsigned char* cheats_rom_page(gb_t* gb, int slot, unsigned char* rom_page) {
+
+    if (!gb->cheats.rom_pages[slot])
+        return rom_page;
+
+    unsigned char* patched = gb->cheats.rom_pages[slot][(rom_page - gb->cartridge.rom) >> 8];
+
+    return patched ? patched : rom_page;
+}
+
+
+
+/*---- GameShark --------------------------------------------------*/
+
+
+/*
+ *  Set the RAM the codes poke (called when VBlank starts)
+ */
+void cheats_poke(gb_t* gb) {
+
+    struct cartridge* cartridge = &gb->cartridge;
+
+    for (int i = 0; i < gb->cheats.n_pokes; i++) {
+
+        struct cheat_poke* poke = &gb->cheats.pokes[i];
+
+        unsigned int offset = poke->ram_bank*0x2000 + (poke->address - 0xa000);
+
+        if (poke->address < 0xc000 && cartridge->ram_banks && offset < cartridge->ram_size) {
+
+            // Straight into the bank, mapped or not
+            save_mark_dirty(gb, offset);
+            dirty_mark(gb, DIRTY_RAM_PAGE + (offset >> 8));
+            cartridge->ram_banks[offset] = poke->value;
+        }
+        else {
+
+            // Work RAM (or a bank the cartridge doesn't have: the mapped one gets it)
+            mmu_write8bit(gb, poke->address, poke->value);
+        }
+    }
+}
+
+
+
+/*---- Adding and Removing ----------------------------------------*/
+
+
+/*
+ *  Add a Game Genie (ABC-DEF or ABC-DEF-GHI) or GameShark (ABCDEFGH) code
+ *  Returns 0 on success, or -1 if it isn't a valid code
+ */
+int cheats_add(gb_t* gb, const char* code) {
+
+    struct cheats* cheats = &gb->cheats;
+
+    unsigned char digits[9];
+    int n = hex_digits(code, digits, 9);
+
+    if ((n == 6 || n == 9) && cheats->n_patches < CHEATS_MAX
+            && !parse_game_genie(digits, n, &cheats->patches[cheats->n_patches])) {
+
+        cheats->n_patches++;
+        patch_rom(gb);
+    }
+    else if (n == 8 && cheats->n_pokes < CHEATS_MAX
+            && !parse_game_shark(digits, &cheats->pokes[cheats->n_pokes])) {
+
+        cheats->n_pokes++;
+    }
+    else {
+        fprintf(stderr, "Couldn't add cheat %s: it isn't a Game Genie or GameShark code (or there are too many)\n", code);
+        return -1;
+    }
+
+    printf("Cheat %s on\n", code);
+
+    return 0;
+}
+
+/*
+ *  Remove every code (the ROM they were for is being replaced, or on exit)
+ */
+void cheats_clear(gb_t* gb) {
+
+    struct cheats* cheats = &gb->cheats;
+
+    cheats->n_pokes = 0;
+
+    if (!cheats->n_patches)
+        return;
+
+    cheats->n_patches = 0;
+    patch_rom(gb);
+}
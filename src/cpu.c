@@ -3,120 +3,185 @@
 #include <stdlib.h>
 
 #include "cpu.h"
-#include "emulator.h"
+#include "gb.h"
 #include "memory.h"
+#include "block.h"
 
-struct registers registers = {{{0}}};
+#ifdef JIT
+#include "jit.h"
+#endif
 
-static unsigned char interrupt_master_enable = 0;   /*Interrupt Master Enable Flag (enables or disables interrupts)*/
 
-static unsigned char halted = 0;    /* If halted = 1, CPU is idle and waiting for interrupt request  */
 
-static unsigned char stopped = 0;   /* If stopped = 1, CPU is stopped. */
+/*---- Flags ------------------------------------------------------*/
 
 
+#ifdef LAZY_FLAGS
 
-/*---- Flags ------------------------------------------------------*/
+/*
+ *  With LAZY_FLAGS, the 8-bit ALU, rotate and shift operations don't work out
+ *  Z/N/H/CY one by one: they only record the operation, its operands and its result.
+ *
+ *  The flags are materialized into registers.f when something reads them
+ *  (conditional jumps and returns, PUSH AF, DAA, the debugger...), and before
+ *  any other operation changes them with set_flag/clear_flag
+ *
+ *  Bit 8 of the result is the carry out (or the carry kept by INC/DEC)
+ */
+// LAZY_NONE (0) is in cpu.h, load_machine uses it too
+#define LAZY_ADD 1
+#define LAZY_SUB 2
+#define LAZY_AND 3
+#define LAZY_LOGIC 4 // OR, XOR, SWAP
+#define LAZY_INC 5
+#define LAZY_DEC 6
+#define LAZY_SHIFT 7
+#define LAZY_ROTATE_A 8 // RLCA, RLA, RRCA, RRA (Z is always cleared)
 
+static unsigned char lazy_flags(gb_t* gb, unsigned char operation, unsigned char a, unsigned char b, unsigned char carry, unsigned short result) {
 
-static void set_flag(unsigned char flag) {
+    gb->cpu.lazy.operation = operation;
+    gb->cpu.lazy.a = a;
+    gb->cpu.lazy.b = b;
+    gb->cpu.lazy.carry = carry;
+    gb->cpu.lazy.result = result;
 
-    registers.f |= flag;
+    return result & 0xFF;
 }
 
-static void clear_flag(unsigned char flag) {
+static void materialize_flags(gb_t* gb) {
 
-    registers.f &= ~flag;
-}
+    unsigned char f = 0;
+
+    switch (gb->cpu.lazy.operation) {
+        case LAZY_NONE:
+            return;
+        case LAZY_ADD:
+            if ((gb->cpu.lazy.a & 0xF) + (gb->cpu.lazy.b & 0xF) + gb->cpu.lazy.carry > 0xF) f |= FLAG_H;
+            break;
+        case LAZY_SUB:
+            f |= FLAG_N;
+            if ((gb->cpu.lazy.a & 0xF) < (gb->cpu.lazy.b & 0xF) + gb->cpu.lazy.carry) f |= FLAG_H;
+            break;
+        case LAZY_AND:
+            f |= FLAG_H;
+            break;
+        case LAZY_INC:
+            if ((gb->cpu.lazy.a & 0xF) == 0xF) f |= FLAG_H;
+            break;
+        case LAZY_DEC:
+            f |= FLAG_N;
+            if ((gb->cpu.lazy.a & 0xF) == 0) f |= FLAG_H;
+            break;
+    }
 
+    if (!(gb->cpu.lazy.result & 0xFF) && gb->cpu.lazy.operation != LAZY_ROTATE_A) f |= FLAG_Z;
+    if (gb->cpu.lazy.result > 0xFF) f |= FLAG_CY;
 
+    gb->registers.f = f | (gb->registers.f & 0x0F);
+    gb->cpu.lazy.operation = LAZY_NONE;
+}
 
+#endif
 
+static void set_flag(gb_t* gb, unsigned char flag) {
 
-/*---- CPU Operations ---------------------------------------------*/
+#ifdef LAZY_FLAGS
+    materialize_flags(gb);
+#endif
+    gb->registers.f |= flag;
+}
 
-// Account for the extra cycles the JUMP instructions might take
-static int extra_instruction_cycles = 0;
+static void clear_flag(gb_t* gb, unsigned char flag) {
 
-/*---- CPU Utils ----------------*/
+#ifdef LAZY_FLAGS
+    materialize_flags(gb);
+#endif
+    gb->registers.f &= ~flag;
+}
 
-static unsigned char read8bit_operand() {
+static unsigned char flags(gb_t* gb) {
 
-    unsigned char mem_read;
-    mmu_read8bit(&mem_read, registers.pc++);
+#ifdef LAZY_FLAGS
+    materialize_flags(gb);
+#endif
+    return gb->registers.f;
+}
 
-    if (debugger)
-        printf("8-bit read: %d\n", mem_read);
+#ifdef LAZY_FLAGS
+// 1 if the carry flag is set (without materializing the rest of the flags)
+static unsigned char carry_flag(gb_t* gb) {
 
-    return mem_read;
+    if (gb->cpu.lazy.operation != LAZY_NONE)
+        return gb->cpu.lazy.result > 0xFF;
+
+    return gb->registers.f & FLAG_CY ? 1 : 0;
 }
+#endif
 
-static char read8bit_signed_operand() {
+// 1 if flag is set, for the conditional jumps, calls and returns
+static unsigned char test_flag(gb_t* gb, unsigned char flag) {
 
-    unsigned char mem_read;
-    mmu_read8bit(&mem_read, registers.pc++);
+#ifdef LAZY_FLAGS
+    if (flag == FLAG_Z && gb->cpu.lazy.operation != LAZY_NONE)
+        return !(gb->cpu.lazy.result & 0xFF) && gb->cpu.lazy.operation != LAZY_ROTATE_A;
+    if (flag == FLAG_CY)
+        return carry_flag(gb);
+#endif
+    return flag & flags(gb) ? 1 : 0;
+}
 
-    if (debugger)
-        printf("signed 8-bit read: %d\n", (char) mem_read);
+void cpu_sync_flags(gb_t* gb) {
 
-    return (char) mem_read;
+    flags(gb);
 }
 
-static unsigned short read16bit_operand() {
 
-    unsigned char operand_low, operand_high;
-    mmu_read8bit(&operand_low, registers.pc++);
-    mmu_read8bit(&operand_high, registers.pc++);
 
-    unsigned short operand = 0 | operand_high;
-    operand = (operand << 8) | operand_low;
 
-    if (debugger)
-        printf("16-bit read: %d\n", operand);
 
-    return operand;
+/*---- CPU Operations ---------------------------------------------*/
+
+
+/*---- CPU Utils ----------------*/
+
+static unsigned char read8bit_operand(gb_t* gb) {
+
+    unsigned char mem_read;
+    mmu_read8bit(gb, &mem_read, gb->registers.pc++);
+
+    return mem_read;
 }
 
-static void debug() {
-    printf("\n===============================\n");
-    printf("register(A): %d\n", registers.a);
-    printf("register(F): %d\n", registers.f);
-    printf("register(B): %d\n", registers.b);
-    printf("register(C): %d\n", registers.c);
-    printf("register(D): %d\n", registers.d);
-    printf("register(E): %d\n", registers.e);
-    printf("register(H): %d\n", registers.h);
-    printf("register(L): %d\n", registers.l);
+static unsigned short read16bit_operand(gb_t* gb) {
 
-    printf("===============================\n");
-    printf("register(SP): %d\n", registers.sp);
-    printf("register(PC): %d\n", registers.pc);
+    unsigned char operand_low, operand_high;
+    mmu_read8bit(gb, &operand_low, gb->registers.pc++);
+    mmu_read8bit(gb, &operand_high, gb->registers.pc++);
 
-    printf("===============================\n");
-    printf("register(AF): %d\n", registers.af);
-    printf("register(BC): %d\n", registers.bc);
-    printf("register(DE): %d\n", registers.de);
-    printf("register(HL): %d\n", registers.hl);
-    printf("===============================\n\n");
+    unsigned short operand = 0 | operand_high;
+    operand = (operand << 8) | operand_low;
+
+    return operand;
 }
 
 
 
 /*---- 8-Bit Loads --------------*/
 
-static void load8bit(unsigned char * destination, unsigned char * source) {
+static void load8bit(gb_t* gb, unsigned char * destination, unsigned char * source) {
 
-    assert(!(source >= &memory[0] && source < &memory[0x10000-1]));
-    assert(!(destination >= &memory[0] && destination < &memory[0x10000-1]));
+    assert(!(source >= &gb->memory.memory[0] && source < &gb->memory.memory[0x10000-1]));
+    assert(!(destination >= &gb->memory.memory[0] && destination < &gb->memory.memory[0x10000-1]));
 
     *destination = *source;
 
 }
 
-static void load8bit_debug(unsigned char * destination, unsigned char * source) {
+static void load8bit_debug(gb_t* gb, unsigned char * destination, unsigned char * source) {
 
-    assert(!(source >= &memory[0] && source < &memory[0x10000-1]));
-    assert(!(destination >= &memory[0] && destination < &memory[0x10000-1]));
+    assert(!(source >= &gb->memory.memory[0] && source < &gb->memory.memory[0x10000-1]));
+    assert(!(destination >= &gb->memory.memory[0] && destination < &gb->memory.memory[0x10000-1]));
 
     printf("ld d, d: %x\n", *source);
 
@@ -124,93 +189,85 @@ static void load8bit_debug(unsigned char * destination, unsigned char * source)
 
 }
 
-static void load8bit_operand(unsigned char * destination, void* _unused) {
-
-    unsigned char operand = read8bit_operand();
+static void load8bit_operand(gb_t* gb, unsigned char * destination, unsigned char operand) {
 
-    load8bit(destination, &operand);
+    load8bit(gb, destination, &operand);
 }
 
-static void load8bit_to_mem(unsigned short * reg_with_pointer, unsigned char * source) {
+static void load8bit_to_mem(gb_t* gb, unsigned short * reg_with_pointer, unsigned char * source) {
 
 
-    extra_instruction_cycles = mmu_write8bit(*reg_with_pointer, *source); 
+    gb->cpu.extra_instruction_cycles = mmu_write8bit(gb, *reg_with_pointer, *source); 
 }
 
-static void load8bit_to_mem_operand(unsigned char * source) {
+static void load8bit_to_mem_operand(gb_t* gb, unsigned char * source, unsigned short address) {
 
-    unsigned short address = read16bit_operand();
-    load8bit_to_mem(&address, source);
+    load8bit_to_mem(gb, &address, source);
 }
 
-static void load8bit_to_mem_from_operand(unsigned short * reg_with_pointer) {
+static void load8bit_to_mem_from_operand(gb_t* gb, unsigned short * reg_with_pointer, unsigned char value) {
 
-    unsigned char value = read8bit_operand();
-    load8bit_to_mem(reg_with_pointer, &value);
+    load8bit_to_mem(gb, reg_with_pointer, &value);
 
 }
 
-static void load8bit_from_mem(unsigned char* destination, unsigned short* reg_with_pointer) {
+static void load8bit_from_mem(gb_t* gb, unsigned char* destination, unsigned short* reg_with_pointer) {
 
-    mmu_read8bit(destination, *reg_with_pointer);
+    mmu_read8bit(gb, destination, *reg_with_pointer);
 }
 
-static void load8bit_from_mem_operand(unsigned char * destination) {
+static void load8bit_from_mem_operand(gb_t* gb, unsigned char * destination, unsigned short address) {
 
-    unsigned short address = read16bit_operand();
-
-    load8bit_from_mem(destination, &address);
+    load8bit_from_mem(gb, destination, &address);
 
 }
 
-static void load8bit_from_io_mem(unsigned char* destination, unsigned char* offset_reg) {
+static void load8bit_from_io_mem(gb_t* gb, unsigned char* destination, unsigned char* offset_reg) {
 
     unsigned short pos = 0xFF00 + *offset_reg;
-    load8bit_from_mem(destination, &pos);
+    load8bit_from_mem(gb, destination, &pos);
 }
 
-static void load8bit_from_io_mem_operand(unsigned char* destination) {
+static void load8bit_from_io_mem_operand(gb_t* gb, unsigned char* destination, unsigned char operand) {
 
-    unsigned char operand = read8bit_operand();
     unsigned short pos = 0xFF00 + operand;
-    load8bit_from_mem(destination, &pos);
+    load8bit_from_mem(gb, destination, &pos);
 }
 
-static void load8bit_to_io_mem(unsigned char* offset_reg, unsigned char* source) {
+static void load8bit_to_io_mem(gb_t* gb, unsigned char* offset_reg, unsigned char* source) {
 
     unsigned short pos = 0xFF00 + *offset_reg;
-    load8bit_to_mem(&pos, source);
+    load8bit_to_mem(gb, &pos, source);
 }
 
-static void load8bit_to_io_mem_operand(unsigned char* source) {
+static void load8bit_to_io_mem_operand(gb_t* gb, unsigned char* source, unsigned char operand) {
 
-    unsigned char operand = read8bit_operand();
     unsigned short pos = 0xFF00 + operand;
-    load8bit_to_mem(&pos, source);
+    load8bit_to_mem(gb, &pos, source);
 }
 
-static void load8bit_inc_to_mem() {
+static void load8bit_inc_to_mem(gb_t* gb) {
 
-    load8bit_to_mem(&registers.hl, &registers.a);
-    registers.hl++;
+    load8bit_to_mem(gb, &gb->registers.hl, &gb->registers.a);
+    gb->registers.hl++;
 }
 
-static void load8bit_inc_from_mem() {
+static void load8bit_inc_from_mem(gb_t* gb) {
 
-    load8bit_from_mem(&registers.a, &registers.hl);
-    registers.hl++;
+    load8bit_from_mem(gb, &gb->registers.a, &gb->registers.hl);
+    gb->registers.hl++;
 }
 
-static void load8bit_dec_to_mem() {
+static void load8bit_dec_to_mem(gb_t* gb) {
 
-    load8bit_to_mem(&registers.hl, &registers.a);
-    registers.hl--;
+    load8bit_to_mem(gb, &gb->registers.hl, &gb->registers.a);
+    gb->registers.hl--;
 }
 
-static void load8bit_dec_from_mem() {
+static void load8bit_dec_from_mem(gb_t* gb) {
 
-    load8bit_from_mem(&registers.a, &registers.hl);
-    registers.hl--;
+    load8bit_from_mem(gb, &gb->registers.a, &gb->registers.hl);
+    gb->registers.hl--;
 }
 
 
@@ -218,427 +275,470 @@ static void load8bit_dec_from_mem() {
 
 /*---- 16-Bit Loads -------------*/
 
-static void load16bit(unsigned short * destination, unsigned short *source) {
+static void load16bit(gb_t* gb, unsigned short * destination, unsigned short *source) {
 
     *destination = *source;
 }
 
-static void load16bit_operand(unsigned short * destination) {
-
-    unsigned short operand = read16bit_operand();
+static void load16bit_operand(gb_t* gb, unsigned short * destination, unsigned short operand) {
 
-    load16bit(destination, &operand);
+    load16bit(gb, destination, &operand);
 }
 
-static void push_op(unsigned char * hi_reg, unsigned char * lo_reg) {
+static void push_op(gb_t* gb, unsigned char * hi_reg, unsigned char * lo_reg) {
 
-    mmu_write8bit(--registers.sp, *hi_reg);
-    mmu_write8bit(--registers.sp, *lo_reg);
+    if (lo_reg == &gb->registers.f)
+        flags(gb);
+
+    mmu_write8bit(gb, --gb->registers.sp, *hi_reg);
+    mmu_write8bit(gb, --gb->registers.sp, *lo_reg);
 }
 
-static void pop_op(unsigned char* hi_reg, unsigned char* lo_reg) {
+static void pop_op(gb_t* gb, unsigned char* hi_reg, unsigned char* lo_reg) {
 
-    mmu_read8bit(lo_reg, registers.sp++);
-    mmu_read8bit(hi_reg, registers.sp++);
+    mmu_read8bit(gb, lo_reg, gb->registers.sp++);
+    mmu_read8bit(gb, hi_reg, gb->registers.sp++);
 
-    if (lo_reg == &registers.f)
-        registers.f &= 0xf0;
+    if (lo_reg == &gb->registers.f) {
+        gb->registers.f &= 0xf0;
+#ifdef LAZY_FLAGS
+        gb->cpu.lazy.operation = LAZY_NONE;
+#endif
+    }
 }
 
-static void load16bit_sp_operand_offset() {
+static void load16bit_sp_operand_offset(gb_t* gb, char operand) {
 
-    char operand = read8bit_signed_operand();
-    unsigned short operand_plus_sp = operand + registers.sp;
-    unsigned char lo = registers.sp & 0xFF;
+    unsigned short operand_plus_sp = operand + gb->registers.sp;
+    unsigned char lo = gb->registers.sp & 0xFF;
 
     //half carry flag
-    if ((lo & 0xF) + (operand & 0xF) > 0xF ) set_flag(FLAG_H);
-    else clear_flag(FLAG_H);
+    if ((lo & 0xF) + (operand & 0xF) > 0xF ) set_flag(gb, FLAG_H);
+    else clear_flag(gb, FLAG_H);
 
     // carry flag
-    if ((operand & 0xFF) + (lo & 0xFF) > 0xFF ) set_flag(FLAG_CY);
-    else clear_flag(FLAG_CY);
+    if ((operand & 0xFF) + (lo & 0xFF) > 0xFF ) set_flag(gb, FLAG_CY);
+    else clear_flag(gb, FLAG_CY);
 
-    load16bit(&registers.hl, &operand_plus_sp);
+    load16bit(gb, &gb->registers.hl, &operand_plus_sp);
 
-    clear_flag(FLAG_Z | FLAG_N);
+    clear_flag(gb, FLAG_Z | FLAG_N);
 }
 
-static void load16bit_sp_to_mem() {
+static void load16bit_sp_to_mem(gb_t* gb, unsigned short operand) {
 
-    unsigned short operand = read16bit_operand();
-    unsigned char lo = registers.sp & 0xFF;
-    unsigned char hi = registers.sp >> 8;
+    unsigned char lo = gb->registers.sp & 0xFF;
+    unsigned char hi = gb->registers.sp >> 8;
 
-    load8bit_to_mem(&operand, &lo);
+    load8bit_to_mem(gb, &operand, &lo);
     operand++;
-    load8bit_to_mem(&operand, &hi);
+    load8bit_to_mem(gb, &operand, &hi);
 
 }
 
 /*---- 8-Bit ALU ----------------*/
 
-static void add8bit(unsigned char* s) {
+static void add8bit(gb_t* gb, unsigned char* s) {
+
+#ifdef LAZY_FLAGS
+    gb->registers.a = lazy_flags(gb, LAZY_ADD, gb->registers.a, *s, 0, gb->registers.a + *s);
+#else
 
     // in C arithmetic is done with integers (int)
 
     // carry flag
-    if ((registers.a & 0xFF) + (*s & 0xFF) > 0xFF) set_flag(FLAG_CY);
-    else clear_flag(FLAG_CY);
+    if ((gb->registers.a & 0xFF) + (*s & 0xFF) > 0xFF) set_flag(gb, FLAG_CY);
+    else clear_flag(gb, FLAG_CY);
 
     // half carry flag
     // (h is set if there's an overflow from the lowest 4 bits to the highest 4)
-    if ((*s & 0xF) + (registers.a & 0xF) > 0xF) set_flag(FLAG_H);
-    else clear_flag(FLAG_H);
+    if ((*s & 0xF) + (gb->registers.a & 0xF) > 0xF) set_flag(gb, FLAG_H);
+    else clear_flag(gb, FLAG_H);
 
-    registers.a += *s;
+    gb->registers.a += *s;
 
     // zero flag
-    if (registers.a == 0) set_flag(FLAG_Z);
-    else clear_flag(FLAG_Z);
+    if (gb->registers.a == 0) set_flag(gb, FLAG_Z);
+    else clear_flag(gb, FLAG_Z);
 
     // add/sub flag
-    clear_flag(FLAG_N);
+    clear_flag(gb, FLAG_N);
 
+#endif
 }
 
-static void add8bit_from_mem() {
+static void add8bit_from_mem(gb_t* gb) {
 
     unsigned char mem_read;
-    mmu_read8bit(&mem_read, registers.hl);
-    add8bit(&mem_read);
+    mmu_read8bit(gb, &mem_read, gb->registers.hl);
+    add8bit(gb, &mem_read);
 }
 
-static void add8bit_operand() {
+static void add8bit_operand(gb_t* gb, unsigned char operand) {
 
-    unsigned char operand = read8bit_operand();
-    add8bit(&operand);
+    add8bit(gb, &operand);
 }
 
-static void sub(unsigned char* reg) {
+static void sub(gb_t* gb, unsigned char* reg) {
+
+#ifdef LAZY_FLAGS
+    gb->registers.a = lazy_flags(gb, LAZY_SUB, gb->registers.a, *reg, 0, gb->registers.a - *reg);
+#else
 
-    registers.a -= *reg;
+    gb->registers.a -= *reg;
     
-    if ( (registers.a & 0xF) + (*reg & 0xF) > 0xF ) set_flag(FLAG_H); // Half carry if adding back the subtracted number changes the upper nibble
-    else clear_flag(FLAG_H);
+    if ( (gb->registers.a & 0xF) + (*reg & 0xF) > 0xF ) set_flag(gb, FLAG_H); // Half carry if adding back the subtracted number changes the upper nibble
+    else clear_flag(gb, FLAG_H);
 
-    if (registers.a) clear_flag(FLAG_Z);
-    else set_flag(FLAG_Z);
+    if (gb->registers.a) clear_flag(gb, FLAG_Z);
+    else set_flag(gb, FLAG_Z);
 
-    if ( ((registers.a + *reg) & 0xFF) < registers.a ) set_flag(FLAG_CY); // Carry if subtraction is bigger than original number
-    else clear_flag(FLAG_CY);
+    if ( ((gb->registers.a + *reg) & 0xFF) < gb->registers.a ) set_flag(gb, FLAG_CY); // Carry if subtraction is bigger than original number
+    else clear_flag(gb, FLAG_CY);
     
-    set_flag(FLAG_N);
+    set_flag(gb, FLAG_N);
+#endif
 }
 
-static void sub_from_mem() {
+static void sub_from_mem(gb_t* gb) {
 
     unsigned char mem_read;
-    mmu_read8bit(&mem_read, registers.hl);
-    sub(&mem_read);
+    mmu_read8bit(gb, &mem_read, gb->registers.hl);
+    sub(gb, &mem_read);
 }
 
-static void sub_operand() {
+static void sub_operand(gb_t* gb, unsigned char operand) {
 
-    unsigned char operand = read8bit_operand();
-    sub(&operand);
+    sub(gb, &operand);
 }
 
-static void adc(unsigned char* s) {
+static void adc(gb_t* gb, unsigned char* s) {
+
+#ifdef LAZY_FLAGS
+    unsigned char carry = carry_flag(gb);
+    gb->registers.a = lazy_flags(gb, LAZY_ADD, gb->registers.a, *s, carry, gb->registers.a + *s + carry);
+#else
 
-    unsigned char adc = registers.f & FLAG_CY ? 1 : 0;
+    unsigned char adc = gb->registers.f & FLAG_CY ? 1 : 0;
 
     // carry flag
-    if (registers.a + *s + adc > 0xFF) set_flag(FLAG_CY);
-    else clear_flag(FLAG_CY);
+    if (gb->registers.a + *s + adc > 0xFF) set_flag(gb, FLAG_CY);
+    else clear_flag(gb, FLAG_CY);
     
     // half carry flag
     // (h is set if there's an overflow from the lowest 4 bits to the highest 4)
-    if ((*s & 0xF) + (registers.a & 0xF) + adc > 0xF) set_flag(FLAG_H);
-    else clear_flag(FLAG_H);
+    if ((*s & 0xF) + (gb->registers.a & 0xF) + adc > 0xF) set_flag(gb, FLAG_H);
+    else clear_flag(gb, FLAG_H);
 
-    registers.a += *s + adc;
+    gb->registers.a += *s + adc;
 
     // zero flag
-    if (registers.a == 0) set_flag(FLAG_Z);
-    else clear_flag(FLAG_Z);
+    if (gb->registers.a == 0) set_flag(gb, FLAG_Z);
+    else clear_flag(gb, FLAG_Z);
 
     // add/sub flag
-    clear_flag(FLAG_N);
+    clear_flag(gb, FLAG_N);
 
+#endif
 }
 
-static void sbc(unsigned char* reg) {
+static void sbc(gb_t* gb, unsigned char* reg) {
 
-    unsigned char sbc = registers.f & FLAG_CY ? 1 : 0;
+#ifdef LAZY_FLAGS
+    unsigned char carry = carry_flag(gb);
+    gb->registers.a = lazy_flags(gb, LAZY_SUB, gb->registers.a, *reg, carry, gb->registers.a - *reg - carry);
+#else
 
-    registers.a -= *reg;
-    registers.a -= sbc;
+    unsigned char sbc = gb->registers.f & FLAG_CY ? 1 : 0;
+
+    gb->registers.a -= *reg;
+    gb->registers.a -= sbc;
     
-    if ( (registers.a & 0xF) + (*reg & 0xF) + sbc > 0xF ) set_flag(FLAG_H); // Half carry if adding back the subtracted number changes the upper nibble
-    else clear_flag(FLAG_H);
+    if ( (gb->registers.a & 0xF) + (*reg & 0xF) + sbc > 0xF ) set_flag(gb, FLAG_H); // Half carry if adding back the subtracted number changes the upper nibble
+    else clear_flag(gb, FLAG_H);
 
-    if (registers.a) clear_flag(FLAG_Z);
-    else set_flag(FLAG_Z);
+    if (gb->registers.a) clear_flag(gb, FLAG_Z);
+    else set_flag(gb, FLAG_Z);
 
-    if ( ((registers.a + *reg + sbc)) > 0xFF ) set_flag(FLAG_CY); // Carry if subtraction is bigger than original number
-    else clear_flag(FLAG_CY);
+    if ( ((gb->registers.a + *reg + sbc)) > 0xFF ) set_flag(gb, FLAG_CY); // Carry if subtraction is bigger than original number
+    else clear_flag(gb, FLAG_CY);
     
-    set_flag(FLAG_N);
+    set_flag(gb, FLAG_N);
 
+#endif
 }
 
-static void sbc_from_mem() {
+static void sbc_from_mem(gb_t* gb) {
 
     unsigned char mem_read;
-    mmu_read8bit(&mem_read, registers.hl);
-    sbc(&mem_read);
+    mmu_read8bit(gb, &mem_read, gb->registers.hl);
+    sbc(gb, &mem_read);
 }
 
-static void sbc_operand() {
+static void sbc_operand(gb_t* gb, unsigned char operand) {
 
-    unsigned char operand = read8bit_operand();
-    sbc(&operand);
+    sbc(gb, &operand);
 }
 
-static void adc_from_mem(unsigned short* reg_with_pointer) {
+static void adc_from_mem(gb_t* gb, unsigned short* reg_with_pointer) {
 
     unsigned char mem_read;
-    mmu_read8bit(&mem_read, *reg_with_pointer);
-    adc(&mem_read);
+    mmu_read8bit(gb, &mem_read, *reg_with_pointer);
+    adc(gb, &mem_read);
 }
 
-static void adc_operand() {
+static void adc_operand(gb_t* gb, unsigned char operand) {
 
-    unsigned char operand = read8bit_operand();
-    adc(&operand);
+    adc(gb, &operand);
 }
 
-static void xor_reg(unsigned char* reg) {
+static void xor_reg(gb_t* gb, unsigned char* reg) {
+
+#ifdef LAZY_FLAGS
+    gb->registers.a = lazy_flags(gb, LAZY_LOGIC, 0, 0, 0, gb->registers.a ^ *reg);
+#else
 
-    registers.a ^= *reg;
+    gb->registers.a ^= *reg;
 
-    if (registers.a == 0)
-        set_flag(FLAG_Z);
+    if (gb->registers.a == 0)
+        set_flag(gb, FLAG_Z);
     else
-        clear_flag(FLAG_Z);
+        clear_flag(gb, FLAG_Z);
 
-    clear_flag(FLAG_N | FLAG_H | FLAG_CY);
+    clear_flag(gb, FLAG_N | FLAG_H | FLAG_CY);
+#endif
 }
 
-static void xor_reg_from_mem(unsigned short * reg_with_pointer) {
+static void xor_reg_from_mem(gb_t* gb, unsigned short * reg_with_pointer) {
 
     unsigned char mem_read;
-    mmu_read8bit(&mem_read, *reg_with_pointer);
-    xor_reg(&mem_read);
+    mmu_read8bit(gb, &mem_read, *reg_with_pointer);
+    xor_reg(gb, &mem_read);
 }
 
-static void xor_operand() {
+static void xor_operand(gb_t* gb, unsigned char operand) {
 
-    unsigned char operand = read8bit_operand();
-    xor_reg(&operand);
+    xor_reg(gb, &operand);
 }
 
-static void and_reg(unsigned char* reg) {
+static void and_reg(gb_t* gb, unsigned char* reg) {
 
-    registers.a &= *reg;
+#ifdef LAZY_FLAGS
+    gb->registers.a = lazy_flags(gb, LAZY_AND, 0, 0, 0, gb->registers.a & *reg);
+#else
 
-    if (registers.a == 0)
-        set_flag(FLAG_Z);
+    gb->registers.a &= *reg;
+
+    if (gb->registers.a == 0)
+        set_flag(gb, FLAG_Z);
     else
-        clear_flag(FLAG_Z);
+        clear_flag(gb, FLAG_Z);
 
-    clear_flag(FLAG_N | FLAG_CY);
-    set_flag(FLAG_H);
+    clear_flag(gb, FLAG_N | FLAG_CY);
+    set_flag(gb, FLAG_H);
+#endif
 }
 
-static void and_operand (){
-
-    unsigned char operand = read8bit_operand();
-    and_reg(&operand);
+static void and_operand(gb_t* gb, unsigned char operand) {
 
+    and_reg(gb, &operand);
 }
 
-static void and_from_mem(){
+static void and_from_mem(gb_t* gb){
 
     unsigned char mem_read;
-    mmu_read8bit(&mem_read, registers.hl);
-    and_reg(&mem_read);
+    mmu_read8bit(gb, &mem_read, gb->registers.hl);
+    and_reg(gb, &mem_read);
 }
 
-static void or_reg(unsigned char* reg) {
+static void or_reg(gb_t* gb, unsigned char* reg) {
 
-    registers.a |= *reg;
+#ifdef LAZY_FLAGS
+    gb->registers.a = lazy_flags(gb, LAZY_LOGIC, 0, 0, 0, gb->registers.a | *reg);
+#else
 
-    if (registers.a == 0)
-        set_flag(FLAG_Z);
+    gb->registers.a |= *reg;
+
+    if (gb->registers.a == 0)
+        set_flag(gb, FLAG_Z);
     else
-        clear_flag(FLAG_Z);
+        clear_flag(gb, FLAG_Z);
 
-    clear_flag(FLAG_N | FLAG_H | FLAG_CY);
+    clear_flag(gb, FLAG_N | FLAG_H | FLAG_CY);
+#endif
 }
 
-static void or_from_mem(){
+static void or_from_mem(gb_t* gb){
 
     unsigned char mem_read;
-    mmu_read8bit(&mem_read, registers.hl);
-    or_reg(&mem_read);
+    mmu_read8bit(gb, &mem_read, gb->registers.hl);
+    or_reg(gb, &mem_read);
 }
 
-static void or_operand (){
-
-    unsigned char operand = read8bit_operand();
-    or_reg(&operand);
+static void or_operand(gb_t* gb, unsigned char operand) {
 
+    or_reg(gb, &operand);
 }
 
-static void inc8bit(unsigned char* reg) {
+static void inc8bit(gb_t* gb, unsigned char* reg) {
+
+#ifdef LAZY_FLAGS
+    *reg = lazy_flags(gb, LAZY_INC, *reg, 0, 0, ((*reg + 1) & 0xFF) | (carry_flag(gb) << 8));
+#else
 
-    if ( (1 & 0xF) + (*reg & 0xF) > 0xF ) set_flag(FLAG_H);
-    else clear_flag(FLAG_H);
+    if ( (1 & 0xF) + (*reg & 0xF) > 0xF ) set_flag(gb, FLAG_H);
+    else clear_flag(gb, FLAG_H);
 
     (*reg)++;
 
-    if (*reg==0) set_flag(FLAG_Z);
-    else clear_flag(FLAG_Z);
+    if (*reg==0) set_flag(gb, FLAG_Z);
+    else clear_flag(gb, FLAG_Z);
 
-    clear_flag(FLAG_N);
+    clear_flag(gb, FLAG_N);
 
+#endif
 }
 
-static void inc8bit_from_mem() {
+static void inc8bit_from_mem(gb_t* gb) {
 
     unsigned char mem_read;
-    mmu_read8bit(&mem_read, registers.hl);
+    mmu_read8bit(gb, &mem_read, gb->registers.hl);
 
     // increment variable to set the flags
-    inc8bit(&mem_read);
+    inc8bit(gb, &mem_read);
 
-    mmu_write8bit(registers.hl, mem_read);
+    mmu_write8bit(gb, gb->registers.hl, mem_read);
 
 }
 
-static void dec8bit(unsigned char* reg) {
+static void dec8bit(gb_t* gb, unsigned char* reg) {
+
+#ifdef LAZY_FLAGS
+    *reg = lazy_flags(gb, LAZY_DEC, *reg, 0, 0, ((*reg - 1) & 0xFF) | (carry_flag(gb) << 8));
+#else
 
     (*reg)--;
 
-    if ( ((*reg) & 0xF) + (1 & 0xF) > 0xF ) set_flag(FLAG_H); // If after decrementing, the addition overflows the lower nibble, then the subtraction had to borrow from the upper nibble 
-    else clear_flag(FLAG_H);
+    if ( ((*reg) & 0xF) + (1 & 0xF) > 0xF ) set_flag(gb, FLAG_H); // If after decrementing, the addition overflows the lower nibble, then the subtraction had to borrow from the upper nibble 
+    else clear_flag(gb, FLAG_H);
 
-    if (*reg==0) set_flag(FLAG_Z);
-    else clear_flag(FLAG_Z);
+    if (*reg==0) set_flag(gb, FLAG_Z);
+    else clear_flag(gb, FLAG_Z);
 
-    set_flag(FLAG_N);
+    set_flag(gb, FLAG_N);
 
+#endif
 }
 
-static void dec8bit_from_mem(){
+static void dec8bit_from_mem(gb_t* gb){
 
     unsigned char mem_read;
-    mmu_read8bit(&mem_read, registers.hl);
+    mmu_read8bit(gb, &mem_read, gb->registers.hl);
 
     // decrement variable to set the flags
-    dec8bit(&mem_read);
+    dec8bit(gb, &mem_read);
 
-    mmu_write8bit(registers.hl, mem_read);
+    mmu_write8bit(gb, gb->registers.hl, mem_read);
 }
 
-static void cp_op(unsigned char* reg) {
+static void cp_op(gb_t* gb, unsigned char* reg) {
+
+#ifdef LAZY_FLAGS
+    lazy_flags(gb, LAZY_SUB, gb->registers.a, *reg, 0, gb->registers.a - *reg);
+#else
 
     unsigned char s = *reg;
-    unsigned char cp_a = registers.a - s;
+    unsigned char cp_a = gb->registers.a - s;
 
     // zero flag
-    if (cp_a == 0) set_flag(FLAG_Z);
-    else clear_flag(FLAG_Z);
+    if (cp_a == 0) set_flag(gb, FLAG_Z);
+    else clear_flag(gb, FLAG_Z);
 
     // add/sub flag
-    set_flag(FLAG_N);
+    set_flag(gb, FLAG_N);
 
     // half carry flag
     // (h is set if there's an overflow from the lowest 4 bits to the highest 4)
     // check if adding back the number subtracted alters the upper nibble
-    if ( (cp_a & 0xF) + (s & 0xF) > 0xF ) set_flag(FLAG_H);
-    else clear_flag(FLAG_H);
+    if ( (cp_a & 0xF) + (s & 0xF) > 0xF ) set_flag(gb, FLAG_H);
+    else clear_flag(gb, FLAG_H);
 
     // carry flag
-    if (cp_a > registers.a) set_flag(FLAG_CY);
-    else clear_flag(FLAG_CY);
+    if (cp_a > gb->registers.a) set_flag(gb, FLAG_CY);
+    else clear_flag(gb, FLAG_CY);
+#endif
 }
 
-static void cp_operand() {
+static void cp_operand(gb_t* gb, unsigned char s) {
 
-    unsigned char s = read8bit_operand();
-    cp_op(&s);
+    cp_op(gb, &s);
 }
 
-static void cp_mem(unsigned short* reg_w_pointer) {
+static void cp_mem(gb_t* gb, unsigned short* reg_w_pointer) {
 
     unsigned char mem_read;
-    mmu_read8bit(&mem_read, *reg_w_pointer);
-    cp_op(&mem_read);
+    mmu_read8bit(gb, &mem_read, *reg_w_pointer);
+    cp_op(gb, &mem_read);
 }
 
 
 
 /*---- 16-Bit Arithmetic --------*/
 
-static void add16bit(unsigned short* source) {
+static void add16bit(gb_t* gb, unsigned short* source) {
 
     // Add 16 bits are two 8 bit adds
     // First, add low register L with low eight bits of source.
     // Then, add high register H with high eight bits of source, + carry from previous 
 
-    if ( (registers.l & 0xF) + (*source & 0xF) > 0xF ) set_flag(FLAG_H);
-    else clear_flag(FLAG_H);
+    if ( (gb->registers.l & 0xF) + (*source & 0xF) > 0xF ) set_flag(gb, FLAG_H);
+    else clear_flag(gb, FLAG_H);
     
-    if ( registers.l + (*source & 0xFF) > 0xFF ) set_flag(FLAG_CY);
-    else clear_flag(FLAG_CY);
+    if ( gb->registers.l + (*source & 0xFF) > 0xFF ) set_flag(gb, FLAG_CY);
+    else clear_flag(gb, FLAG_CY);
 
-    registers.l += *source & 0xFF;
+    gb->registers.l += *source & 0xFF;
 
-    unsigned char carry = (registers.f & FLAG_CY ? 1 : 0);
+    unsigned char carry = (gb->registers.f & FLAG_CY ? 1 : 0);
 
-    if ( (registers.h & 0xF) + ((*source >> 8) & 0xF) + carry > 0xF ) set_flag(FLAG_H);
-    else clear_flag(FLAG_H);
+    if ( (gb->registers.h & 0xF) + ((*source >> 8) & 0xF) + carry > 0xF ) set_flag(gb, FLAG_H);
+    else clear_flag(gb, FLAG_H);
 
-    if ( registers.h + (*source >> 8) + carry > 0xFF ) set_flag(FLAG_CY);
-    else clear_flag(FLAG_CY);
+    if ( gb->registers.h + (*source >> 8) + carry > 0xFF ) set_flag(gb, FLAG_CY);
+    else clear_flag(gb, FLAG_CY);
 
-    registers.h = registers.h + (*source >> 8) + carry; // ADC to high byte
+    gb->registers.h = gb->registers.h + (*source >> 8) + carry; // ADC to high byte
 
-    clear_flag(FLAG_N);
+    clear_flag(gb, FLAG_N);
 }
 
-static void inc16bit(unsigned short* reg) {
+static void inc16bit(gb_t* gb, unsigned short* reg) {
 
     (*reg)++;
 }
 
-static void dec16bit(unsigned short* reg) {
+static void dec16bit(gb_t* gb, unsigned short* reg) {
 
     (*reg)--;
 }
 
 
-static void add16bit_sp_operand() {
+static void add16bit_sp_operand(gb_t* gb, char operand) {
 
-
-    char operand = read8bit_signed_operand();
-    unsigned char lo = registers.sp & 0xFF;
+    unsigned char lo = gb->registers.sp & 0xFF;
 
     // TODO: i should have refactored the flags code when i had the chance to do it 
 
     //half carry flag
-    if ((lo & 0xF) + (operand & 0xF) > 0xF ) set_flag(FLAG_H);
-    else clear_flag(FLAG_H);
+    if ((lo & 0xF) + (operand & 0xF) > 0xF ) set_flag(gb, FLAG_H);
+    else clear_flag(gb, FLAG_H);
 
     // carry flag
-    if ((operand & 0xFF) + (lo & 0xFF) > 0xFF ) set_flag(FLAG_CY);
-    else clear_flag(FLAG_CY);
+    if ((operand & 0xFF) + (lo & 0xFF) > 0xFF ) set_flag(gb, FLAG_CY);
+    else clear_flag(gb, FLAG_CY);
 
-    registers.sp += operand;
-    clear_flag(FLAG_Z | FLAG_N);
+    gb->registers.sp += operand;
+    clear_flag(gb, FLAG_Z | FLAG_N);
 
 }
 
@@ -646,137 +746,167 @@ static void add16bit_sp_operand() {
 
 /*---- Miscellaneous ------------*/
 
-static void nop () {
+static void nop(gb_t* gb) {
 
     // do nothing
 }
 
-static void disable_interrupts() {
+static void disable_interrupts(gb_t* gb) {
 
-    interrupt_master_enable = 0;
+    gb->cpu.interrupt_master_enable = 0;
 }
 
-static void enable_interrupts() {
+static void enable_interrupts(gb_t* gb) {
 
-    interrupt_master_enable = 1;
+    gb->cpu.interrupt_master_enable = 1;
 }
 
-static void halt() {
+static void halt(gb_t* gb) {
 
-    halted = 1;
+    gb->cpu.halted = 1;
 }
 
-static void complement(){
+static void complement(gb_t* gb){
 
-    registers.a = ~registers.a;
-    set_flag(FLAG_N | FLAG_H);
+    gb->registers.a = ~gb->registers.a;
+    set_flag(gb, FLAG_N | FLAG_H);
 }
 
-static void swap (unsigned char* reg) {
+static void swap(gb_t* gb, unsigned char* reg) {
+
+#ifdef LAZY_FLAGS
+    *reg = lazy_flags(gb, LAZY_LOGIC, 0, 0, 0, ((*reg >> 4) | (*reg << 4)) & 0xFF);
+#else
 
     unsigned char new_lo = *reg >> 4;
     unsigned char new_hi = *reg << 4;
     *reg = (((0x00) | new_lo) | new_hi);
 
     if (*reg)
-        clear_flag(FLAG_Z);
+        clear_flag(gb, FLAG_Z);
     else
-        set_flag(FLAG_Z);
+        set_flag(gb, FLAG_Z);
 
-    clear_flag(FLAG_N | FLAG_H | FLAG_CY);
+    clear_flag(gb, FLAG_N | FLAG_H | FLAG_CY);
+#endif
 }
 
-static void stop_cpu() {
+static void stop_cpu(gb_t* gb) {
 
-    stopped = 1;
+    gb->cpu.stopped = 1;
 
     printf("~Stopped.\n");
 }
 
-static void ccf_op() {
+static void ccf_op(gb_t* gb) {
 
-    unsigned char flag_cy_value = registers.f & FLAG_CY;
+    unsigned char flag_cy_value = flags(gb) & FLAG_CY;
 
     if(flag_cy_value)
-        clear_flag(FLAG_CY);
+        clear_flag(gb, FLAG_CY);
     else
-        set_flag(FLAG_CY);
+        set_flag(gb, FLAG_CY);
 
-    clear_flag(FLAG_N | FLAG_H);
+    clear_flag(gb, FLAG_N | FLAG_H);
 }
 
-static void scf_op() {
+static void scf_op(gb_t* gb) {
 
-    set_flag(FLAG_CY);
+    set_flag(gb, FLAG_CY);
 
-    clear_flag(FLAG_N | FLAG_H);
+    clear_flag(gb, FLAG_N | FLAG_H);
 }
 
 
 /*---- Rotates & Shifts ---------*/
 
-static void rl_op(unsigned char* reg) {
+static void rl_op(gb_t* gb, unsigned char* reg) {
+
+#ifdef LAZY_FLAGS
+    *reg = lazy_flags(gb, LAZY_SHIFT, 0, 0, 0, (*reg << 1) | carry_flag(gb));
+#else
 
     // check if carry is set
-    unsigned char hadcarry = (registers.f & FLAG_CY) >> 4;
+    unsigned char hadcarry = (gb->registers.f & FLAG_CY) >> 4;
 
     // check highest bit from reg to check if carry should be set
-    if ((*reg >> 7) & 1) set_flag(FLAG_CY);
-    else clear_flag(FLAG_CY);
+    if ((*reg >> 7) & 1) set_flag(gb, FLAG_CY);
+    else clear_flag(gb, FLAG_CY);
 
     // rotate and add carry
     *reg <<= 1;
     *reg |= hadcarry;
 
-    if (*reg == 0) set_flag(FLAG_Z);
-    else clear_flag(FLAG_Z);
+    if (*reg == 0) set_flag(gb, FLAG_Z);
+    else clear_flag(gb, FLAG_Z);
 
-    clear_flag(FLAG_N | FLAG_H);
+    clear_flag(gb, FLAG_N | FLAG_H);
+#endif
 }
 
-static void rla_op() {
+static void rla_op(gb_t* gb) {
+
+#ifdef LAZY_FLAGS
+    rl_op(gb, &gb->registers.a);
+    gb->cpu.lazy.operation = LAZY_ROTATE_A;
+#else
 
-    rl_op(&registers.a);
-    clear_flag(FLAG_Z);
+    rl_op(gb, &gb->registers.a);
+    clear_flag(gb, FLAG_Z);
+#endif
 }
 
-static void sla_op(unsigned char* reg) {
+static void sla_op(gb_t* gb, unsigned char* reg) {
+
+#ifdef LAZY_FLAGS
+    *reg = lazy_flags(gb, LAZY_SHIFT, 0, 0, 0, *reg << 1);
+#else
     unsigned char left_most_bit = 0x80 & *reg;
     *reg = *reg<<1;
 
     if (left_most_bit)
-        set_flag(FLAG_CY);
+        set_flag(gb, FLAG_CY);
     else
-        clear_flag(FLAG_CY);
+        clear_flag(gb, FLAG_CY);
 
     if (!*reg)
-        set_flag(FLAG_Z);
+        set_flag(gb, FLAG_Z);
     else
-        clear_flag(FLAG_Z);
+        clear_flag(gb, FLAG_Z);
 
-    clear_flag(FLAG_N | FLAG_H);
+    clear_flag(gb, FLAG_N | FLAG_H);
+#endif
 }
 
-static void srl_op(unsigned char* reg) {
+static void srl_op(gb_t* gb, unsigned char* reg) {
+
+#ifdef LAZY_FLAGS
+    *reg = lazy_flags(gb, LAZY_SHIFT, 0, 0, 0, (*reg >> 1) | ((*reg & 1) << 8));
+#else
     unsigned char right_most_bit = 0x1 & *reg;
     *reg = *reg>>1;
 
     if (right_most_bit)
-        set_flag(FLAG_CY);
+        set_flag(gb, FLAG_CY);
     else
-        clear_flag(FLAG_CY);
+        clear_flag(gb, FLAG_CY);
 
     if (!*reg)
-        set_flag(FLAG_Z);
+        set_flag(gb, FLAG_Z);
     else
-        clear_flag(FLAG_Z);
+        clear_flag(gb, FLAG_Z);
 
-    clear_flag(FLAG_N | FLAG_H);
+    clear_flag(gb, FLAG_N | FLAG_H);
+#endif
 }
 
-static void rr_op(unsigned char* reg) {
+static void rr_op(gb_t* gb, unsigned char* reg) {
+
+#ifdef LAZY_FLAGS
+    *reg = lazy_flags(gb, LAZY_SHIFT, 0, 0, 0, (*reg >> 1) | (carry_flag(gb) << 7) | ((*reg & 1) << 8));
+#else
     unsigned char right_most_bit = 0x1 & *reg;
-    unsigned char carry_flag_value = FLAG_CY & registers.f;
+    unsigned char carry_flag_value = FLAG_CY & gb->registers.f;
     *reg = *reg>>1;
 
     if(carry_flag_value)
@@ -785,89 +915,122 @@ static void rr_op(unsigned char* reg) {
         *reg = *reg & 0x7F;
 
     if (right_most_bit)
-        set_flag(FLAG_CY);
+        set_flag(gb, FLAG_CY);
     else
-        clear_flag(FLAG_CY);
+        clear_flag(gb, FLAG_CY);
 
     if (!*reg)
-        set_flag(FLAG_Z);
+        set_flag(gb, FLAG_Z);
     else
-        clear_flag(FLAG_Z);
+        clear_flag(gb, FLAG_Z);
 
-    clear_flag(FLAG_N | FLAG_H);
+    clear_flag(gb, FLAG_N | FLAG_H);
+#endif
 }
 
-static void rra_op() {
+static void rra_op(gb_t* gb) {
 
-    rr_op(&registers.a);
+#ifdef LAZY_FLAGS
+    rr_op(gb, &gb->registers.a);
+    gb->cpu.lazy.operation = LAZY_ROTATE_A;
+#else
 
-    clear_flag(FLAG_Z | FLAG_N | FLAG_H);
+    rr_op(gb, &gb->registers.a);
+
+    clear_flag(gb, FLAG_Z | FLAG_N | FLAG_H);
+#endif
 }
 
-static void rlc_op(unsigned char* reg) {
+static void rlc_op(gb_t* gb, unsigned char* reg) {
+
+#ifdef LAZY_FLAGS
+    *reg = lazy_flags(gb, LAZY_SHIFT, 0, 0, 0, (*reg << 1) | (*reg >> 7));
+#else
     unsigned char left_most_bit = 0x80 & *reg;
     *reg = *reg<<1;
 
     if (left_most_bit) {
         *reg = *reg | 0x1;
-        set_flag(FLAG_CY);
+        set_flag(gb, FLAG_CY);
     }else{
         *reg = *reg & 0xFE;
-        clear_flag(FLAG_CY);
+        clear_flag(gb, FLAG_CY);
     }
 
     if (!*reg)
-        set_flag(FLAG_Z);
+        set_flag(gb, FLAG_Z);
     else
-        clear_flag(FLAG_Z);
+        clear_flag(gb, FLAG_Z);
 
-    clear_flag(FLAG_H | FLAG_N);
+    clear_flag(gb, FLAG_H | FLAG_N);
+#endif
 }
 
-static void rlca_op() {
+static void rlca_op(gb_t* gb) {
 
-    rlc_op(&registers.a);
+#ifdef LAZY_FLAGS
+    rlc_op(gb, &gb->registers.a);
+    gb->cpu.lazy.operation = LAZY_ROTATE_A;
+#else
 
-    clear_flag(FLAG_Z);
+    rlc_op(gb, &gb->registers.a);
+
+    clear_flag(gb, FLAG_Z);
+#endif
 }
 
-static void rrc_op(unsigned char* reg) {
+static void rrc_op(gb_t* gb, unsigned char* reg) {
+
+#ifdef LAZY_FLAGS
+    *reg = lazy_flags(gb, LAZY_SHIFT, 0, 0, 0, (*reg >> 1) | ((*reg & 1) << 7) | ((*reg & 1) << 8));
+#else
     unsigned char right_most_bit = 0x1 & *reg;
     *reg = *reg>>1;
 
     if(right_most_bit){
         *reg = *reg | 0x80;
-        set_flag(FLAG_CY);
+        set_flag(gb, FLAG_CY);
     }else{
         *reg = *reg & 0x7F;
-        clear_flag(FLAG_CY);
+        clear_flag(gb, FLAG_CY);
     }
 
     if(!*reg)
-        set_flag(FLAG_Z);
+        set_flag(gb, FLAG_Z);
     else
-        clear_flag(FLAG_Z);
+        clear_flag(gb, FLAG_Z);
 
-    clear_flag(FLAG_H | FLAG_N);
+    clear_flag(gb, FLAG_H | FLAG_N);
+#endif
 }
 
-static void rrca_op() {
+static void rrca_op(gb_t* gb) {
+
+#ifdef LAZY_FLAGS
+    rrc_op(gb, &gb->registers.a);
+    gb->cpu.lazy.operation = LAZY_ROTATE_A;
+#else
 
-    rrc_op(&registers.a);
+    rrc_op(gb, &gb->registers.a);
 
-    clear_flag(FLAG_Z);
+    clear_flag(gb, FLAG_Z);
+#endif
 }
 
-static void sra_op(unsigned char* reg) {
+static void sra_op(gb_t* gb, unsigned char* reg) {
+
+#ifdef LAZY_FLAGS
+    *reg = lazy_flags(gb, LAZY_SHIFT, 0, 0, 0, (*reg >> 1) | (*reg & 0x80) | ((*reg & 1) << 8));
+#else
 
     unsigned char left_most_bit = 0x80 & *reg;
     unsigned char right_most_bit = 0x1 & *reg;
     *reg = *reg>>1;
 
     if (right_most_bit)
-        set_flag(FLAG_CY);
+        set_flag(gb, FLAG_CY);
     else
-        clear_flag(FLAG_CY);
+        clear_flag(gb, FLAG_CY);
 
     if (left_most_bit)
         *reg = *reg | 0x80;
@@ -875,210 +1038,201 @@ static void sra_op(unsigned char* reg) {
         *reg = *reg & 0x7F;
 
     if (!*reg)
-        set_flag(FLAG_Z);
+        set_flag(gb, FLAG_Z);
     else
-        clear_flag(FLAG_Z);
+        clear_flag(gb, FLAG_Z);
 
-    clear_flag(FLAG_H | FLAG_N);
+    clear_flag(gb, FLAG_H | FLAG_N);
+#endif
 }
 
-static void rlc_from_mem() {
+static void rlc_from_mem(gb_t* gb) {
 
     unsigned char mem_read;
-    mmu_read8bit(&mem_read, registers.hl);
+    mmu_read8bit(gb, &mem_read, gb->registers.hl);
     
     // Rotate variable to set flags and value
-    rlc_op(&mem_read);
+    rlc_op(gb, &mem_read);
 
-    mmu_write8bit(registers.hl, mem_read);
+    mmu_write8bit(gb, gb->registers.hl, mem_read);
 
 }
 
-static void rrc_from_mem() {
+static void rrc_from_mem(gb_t* gb) {
 
     unsigned char mem_read;
-    mmu_read8bit(&mem_read, registers.hl);
-    rrc_op(&mem_read);
-    mmu_write8bit(registers.hl, mem_read);
+    mmu_read8bit(gb, &mem_read, gb->registers.hl);
+    rrc_op(gb, &mem_read);
+    mmu_write8bit(gb, gb->registers.hl, mem_read);
 }
 
-static void rl_from_mem() {
+static void rl_from_mem(gb_t* gb) {
 
     unsigned char mem_read;
-    mmu_read8bit(&mem_read, registers.hl);
-    rl_op(&mem_read);
-    mmu_write8bit(registers.hl, mem_read);
+    mmu_read8bit(gb, &mem_read, gb->registers.hl);
+    rl_op(gb, &mem_read);
+    mmu_write8bit(gb, gb->registers.hl, mem_read);
 }
 
-static void rr_from_mem() {
+static void rr_from_mem(gb_t* gb) {
 
     unsigned char mem_read;
-    mmu_read8bit(&mem_read, registers.hl);
-    rr_op(&mem_read);
-    mmu_write8bit(registers.hl, mem_read);
+    mmu_read8bit(gb, &mem_read, gb->registers.hl);
+    rr_op(gb, &mem_read);
+    mmu_write8bit(gb, gb->registers.hl, mem_read);
 }
 
-static void sla_from_mem() {
+static void sla_from_mem(gb_t* gb) {
 
     unsigned char mem_read;
-    mmu_read8bit(&mem_read, registers.hl);
-    sla_op(&mem_read);
-    mmu_write8bit(registers.hl, mem_read);
+    mmu_read8bit(gb, &mem_read, gb->registers.hl);
+    sla_op(gb, &mem_read);
+    mmu_write8bit(gb, gb->registers.hl, mem_read);
 }
 
-static void sra_from_mem() {
+static void sra_from_mem(gb_t* gb) {
 
     unsigned char mem_read;
-    mmu_read8bit(&mem_read, registers.hl);
-    sra_op(&mem_read);
-    mmu_write8bit(registers.hl, mem_read);
+    mmu_read8bit(gb, &mem_read, gb->registers.hl);
+    sra_op(gb, &mem_read);
+    mmu_write8bit(gb, gb->registers.hl, mem_read);
 }
 
-static void swap_from_mem() {
+static void swap_from_mem(gb_t* gb) {
 
     unsigned char mem_read;
-    mmu_read8bit(&mem_read, registers.hl);
-    swap(&mem_read);
-    mmu_write8bit(registers.hl, mem_read);
+    mmu_read8bit(gb, &mem_read, gb->registers.hl);
+    swap(gb, &mem_read);
+    mmu_write8bit(gb, gb->registers.hl, mem_read);
 }
 
-static void srl_from_mem() {
+static void srl_from_mem(gb_t* gb) {
 
     unsigned char mem_read;
-    mmu_read8bit(&mem_read, registers.hl);
-    srl_op(&mem_read);
-    mmu_write8bit(registers.hl, mem_read);
+    mmu_read8bit(gb, &mem_read, gb->registers.hl);
+    srl_op(gb, &mem_read);
+    mmu_write8bit(gb, gb->registers.hl, mem_read);
 }
 
-static void daa_op(){
+static void daa_op(gb_t* gb){
     unsigned char correction = 0;
-    unsigned char flag_cy_value = FLAG_CY & registers.f;
-    unsigned char flag_h_value = FLAG_H & registers.f;
-    unsigned char flag_n_value = FLAG_N & registers.f;
+    unsigned char flag_cy_value = FLAG_CY & flags(gb);
+    unsigned char flag_h_value = FLAG_H & gb->registers.f;
+    unsigned char flag_n_value = FLAG_N & gb->registers.f;
 
-    if (flag_h_value || (!flag_n_value && (registers.a & 0xF) > 9))
+    if (flag_h_value || (!flag_n_value && (gb->registers.a & 0xF) > 9))
         correction |= 0x6;
 
-    if (flag_cy_value || (!flag_n_value && registers.a > 0x99)) {
+    if (flag_cy_value || (!flag_n_value && gb->registers.a > 0x99)) {
         
         correction |= 0x60;
-        set_flag(FLAG_CY);
+        set_flag(gb, FLAG_CY);
     }
     else
-        clear_flag(FLAG_CY);
+        clear_flag(gb, FLAG_CY);
 
-    registers.a += flag_n_value ? -correction : correction;
+    gb->registers.a += flag_n_value ? -correction : correction;
 
-    if (registers.a)
-        clear_flag(FLAG_Z);
+    if (gb->registers.a)
+        clear_flag(gb, FLAG_Z);
     else
-        set_flag(FLAG_Z);
+        set_flag(gb, FLAG_Z);
 
-    clear_flag(FLAG_H);
+    clear_flag(gb, FLAG_H);
 
 }
 
 /*---- Bit Opcodes --------------*/
 
 // Tests bit of a register
-static void bit_op(void* n, unsigned char * reg) {
-
-    unsigned char n_byte = (unsigned char) n;
+static void bit_op(gb_t* gb, unsigned char n, unsigned char * reg) {
 
-    if ( (*reg >> n_byte ) & 1 ) clear_flag(FLAG_Z);
-    else set_flag(FLAG_Z);
+    if ( (*reg >> n ) & 1 ) clear_flag(gb, FLAG_Z);
+    else set_flag(gb, FLAG_Z);
 
-    clear_flag(FLAG_N);
-    set_flag(FLAG_H);
+    clear_flag(gb, FLAG_N);
+    set_flag(gb, FLAG_H);
 }
 
-static void bit_op_from_mem(void* n, unsigned short * reg) {
+static void bit_op_from_mem(gb_t* gb, unsigned char n, unsigned short * reg) {
 
     unsigned char mem_read;
-    mmu_read8bit(&mem_read, *reg);
-    bit_op(n, &mem_read);
+    mmu_read8bit(gb, &mem_read, *reg);
+    bit_op(gb, n, &mem_read);
 }
 
-static void set_op(void* n, unsigned char* reg) {
+static void set_op(gb_t* gb, unsigned char n, unsigned char* reg) {
 
-    unsigned char n_byte = (unsigned char) n;
-
-    *reg |= (1 << (n_byte));
+    *reg |= (1 << n);
 }
 
-static void set_op_from_mem(void* n , unsigned short* reg_with_pointer) {
+static void set_op_from_mem(gb_t* gb, unsigned char n, unsigned short* reg_with_pointer) {
 
     unsigned char mem_read;
-    mmu_read8bit(&mem_read, *reg_with_pointer);
-    set_op(n, &mem_read);
-    mmu_write8bit(registers.hl, mem_read);
+    mmu_read8bit(gb, &mem_read, *reg_with_pointer);
+    set_op(gb, n, &mem_read);
+    mmu_write8bit(gb, gb->registers.hl, mem_read);
 }
 
-static void res_op(void* n, unsigned char* reg) {
-
-    unsigned char n_byte = (unsigned char) n;
+static void res_op(gb_t* gb, unsigned char n, unsigned char* reg) {
 
-    *reg &= ~(1 << (n_byte));
+    *reg &= ~(1 << n);
 }
 
-static void res_from_mem(void* n , unsigned short* reg_with_pointer) {
+static void res_from_mem(gb_t* gb, unsigned char n, unsigned short* reg_with_pointer) {
 
     unsigned char mem_read;
-    mmu_read8bit(&mem_read, *reg_with_pointer);
-    res_op(n, &mem_read);
-    mmu_write8bit(registers.hl, mem_read);
+    mmu_read8bit(gb, &mem_read, *reg_with_pointer);
+    res_op(gb, n, &mem_read);
+    mmu_write8bit(gb, gb->registers.hl, mem_read);
 }
 
 /*---- Jumps --------------------*/
 
-static void jump(unsigned short *reg) {
+static void jump(gb_t* gb, unsigned short *reg) {
 
-    registers.pc = *reg;
-    extra_instruction_cycles = 4;
+    gb->registers.pc = *reg;
+    gb->cpu.extra_instruction_cycles = 4;
 }
 
-static void jump_operand(void* unused , void* unused2) {
+static void jump_operand(gb_t* gb, unsigned short operand) {
 
-    registers.pc = read16bit_operand();
-    extra_instruction_cycles = 4;
+    gb->registers.pc = operand;
+    gb->cpu.extra_instruction_cycles = 4;
 }
 
-static void jump_add_operand() {
+static void jump_add_operand(gb_t* gb, char operand) {
 
-    registers.pc += read8bit_signed_operand();
-    extra_instruction_cycles = 4;
+    gb->registers.pc += operand;
+    gb->cpu.extra_instruction_cycles = 4;
 }
 
 //TODO: general jump condition?
 
 // Sets program counter to operand on condition
 // Jump_cond is 0 if should jump if flag == 0, and is a value > 0 if should jump if flag is not zero
-static void jump_condition_operand(void* flag, void* jump_cond) {
+static void jump_condition_operand(gb_t* gb, unsigned char flag, unsigned char jump_cond, unsigned short operand) {
 
-    unsigned char flag_value = (unsigned char) flag & registers.f ? 1 : 0;
+    unsigned char flag_value = test_flag(gb, flag);
 
-    unsigned short operand = read16bit_operand();
+    if (flag_value == jump_cond) {
 
-    if (flag_value == (unsigned char) jump_cond) {
-
-        registers.pc = operand;
-        extra_instruction_cycles = 4;
+        gb->registers.pc = operand;
+        gb->cpu.extra_instruction_cycles = 4;
     }
 
 }
 
 // Adds operand to the current program counter on condition
 // jump_cond is 0 if condition is NOT FLAG, jump_cond is 1 if condition is FLAG
-static void jump_condition_add_operand(void* flag, void* jump_cond) {
-
-    unsigned char flag_value = (unsigned char) flag & registers.f ? 1 : 0;
+static void jump_condition_add_operand(gb_t* gb, unsigned char flag, unsigned char jump_cond, char operand) {
 
-    char operand = read8bit_signed_operand();
+    unsigned char flag_value = test_flag(gb, flag);
 
-    if (flag_value == (unsigned char) jump_cond) {
+    if (flag_value == jump_cond) {
 
-        registers.pc += operand;
-        extra_instruction_cycles = 4;
+        gb->registers.pc += operand;
+        gb->cpu.extra_instruction_cycles = 4;
     }
 }
 
@@ -1087,68 +1241,65 @@ static void jump_condition_add_operand(void* flag, void* jump_cond) {
 
 /*---- Calls --------------------*/
 
-static void call(unsigned short address) {
+static void call(gb_t* gb, unsigned short address) {
 
-    mmu_write8bit(--registers.sp, registers.pchi);
-    mmu_write8bit(--registers.sp, registers.pclo);
+    mmu_write8bit(gb, --gb->registers.sp, gb->registers.pchi);
+    mmu_write8bit(gb, --gb->registers.sp, gb->registers.pclo);
 
-    registers.pc = address;
+    gb->registers.pc = address;
 
 }
 
-static void call_operand() {
-
-    unsigned short operand = read16bit_operand();
+static void call_operand(gb_t* gb, unsigned short operand) {
 
-    call(operand);
+    call(gb, operand);
 }
 
-static void rst(void* address){
+static void rst(gb_t* gb, unsigned short address){
 
-    call((unsigned short) address);
+    call(gb, address);
 
 }
 
 // call_cond is 0 if condition is NOT FLAG, call_cond is 1 if condition is FLAG
 // ex: call nz 123
 
-static void call_condition(void* flag, void* call_cond) {
+static void call_condition(gb_t* gb, unsigned char flag, unsigned char call_cond, unsigned short operand) {
 
-    unsigned char flag_value = (unsigned char) flag & registers.f ? 1 : 0;
-    unsigned short operand = read16bit_operand();
+    unsigned char flag_value = test_flag(gb, flag);
 
-    if (flag_value == (unsigned char) call_cond) {
+    if (flag_value == call_cond) {
 
-        call(operand);
-        extra_instruction_cycles = 12;
+        call(gb, operand);
+        gb->cpu.extra_instruction_cycles = 12;
     }
 }
 
 /*---- Returns ------------------*/
 
-static void ret_op() {
+static void ret_op(gb_t* gb) {
     
-    mmu_read8bit(&registers.pclo, registers.sp++);
-    mmu_read8bit(&registers.pchi, registers.sp++);
+    mmu_read8bit(gb, &gb->registers.pclo, gb->registers.sp++);
+    mmu_read8bit(gb, &gb->registers.pchi, gb->registers.sp++);
 
 }
 
 // jump_cond is 0 if condition is NOT FLAG, jump_cond is 1 if condition is FLAG
-static void ret_condition(void* flag, void* ret_cond) {
+static void ret_condition(gb_t* gb, unsigned char flag, unsigned char ret_cond) {
 
-    unsigned char flag_value = (unsigned char) flag & registers.f ? 1 : 0;
+    unsigned char flag_value = test_flag(gb, flag);
 
-    if (flag_value == (unsigned char) ret_cond) {
+    if (flag_value == ret_cond) {
 
-        ret_op();
-        extra_instruction_cycles = 12;
+        ret_op(gb);
+        gb->cpu.extra_instruction_cycles = 12;
     }
 
 }
 
-static void ret_interrupt(){
-    ret_op();
-    enable_interrupts();
+static void ret_interrupt(gb_t* gb){
+    ret_op(gb);
+    enable_interrupts(gb);
 }
 
 
@@ -1158,270 +1309,7 @@ static void ret_interrupt(){
 /*---- Instructions -----------------------------------------------*/
 
 
-/*
- * Instruction disassemblies copied from https://github.com/CTurt/Cinoop
- */
-static const struct instruction instructions[256] = {
-    { "NOP", nop},                          // 0x00
-    { "LD BC, 0x%04X", load16bit_operand, &registers.bc},                // 0x01
-    { "LD (BC), A", load8bit_to_mem, &registers.bc, &registers.a },                   // 0x02
-    { "INC BC", inc16bit, &registers.bc},                       // 0x03
-    { "INC B", inc8bit, &registers.b},                        // 0x04
-    { "DEC B", dec8bit, &registers.b},                        // 0x05
-    { "LD B, 0x%02X", load8bit_operand, &registers.b },                 // 0x06
-    { "RLCA", rlca_op},                         // 0x07
-    { "LD (0x%04X), SP", load16bit_sp_to_mem},              // 0x08
-    { "ADD HL, BC", add16bit, &registers.bc},                   // 0x09
-    { "LD A, (BC)", load8bit_from_mem, &registers.a, &registers.bc},                   // 0x0a
-    { "DEC BC", dec16bit, &registers.bc},                       // 0x0b
-    { "INC C", inc8bit, &registers.c },                        // 0x0c
-    { "DEC C", dec8bit, &registers.c},                        // 0x0d
-    { "LD C, 0x%02X", load8bit_operand, &registers.c },                 // 0x0e
-    { "RRCA", rrca_op},                         // 0x0f
-    { "STOP", stop_cpu},                         // 0x10
-    { "LD DE, 0x%04X", load16bit_operand, &registers.de },                // 0x11
-    { "LD (DE), A", load8bit_to_mem, &registers.de, &registers.a},                   // 0x12
-    { "INC DE", inc16bit, &registers.de},                       // 0x13
-    { "INC D", inc8bit, &registers.d},                        // 0x14
-    { "DEC D", dec8bit, &registers.d},                        // 0x15
-    { "LD D, 0x%02X", load8bit_operand, &registers.d},                 // 0x16
-    { "RLA", rla_op},                          // 0x17
-    { "JR 0x%02X", jump_add_operand},                    // 0x18
-    { "ADD HL, DE", add16bit, &registers.de},                   // 0x19
-    { "LD A, (DE)", load8bit_from_mem, &registers.a, &registers.de },                   // 0x1a
-    { "DEC DE", dec16bit, &registers.de},                       // 0x1b
-    { "INC E", inc8bit, &registers.e},                        // 0x1c
-    { "DEC E", dec8bit, &registers.e},                        // 0x1d
-    { "LD E, 0x%02X", load8bit_operand, &registers.e},                 // 0x1e
-    { "RRA", rra_op},                          // 0x1f
-    { "JR NZ, 0x%02X", jump_condition_add_operand, (void*) FLAG_Z, (void*) 0 },                // 0x20
-    { "LD HL, 0x%04X", load16bit_operand, &registers.hl },                // 0x21
-    { "LDI (HL), A", load8bit_inc_to_mem},                  // 0x22
-    { "INC HL", inc16bit, &registers.hl},                       // 0x23
-    { "INC H", inc8bit, &registers.h},                        // 0x24
-    { "DEC H", dec8bit, &registers.h},                        // 0x25
-    { "LD H, 0x%02X", load8bit_operand, &registers.h},                 // 0x26
-    { "DAA", daa_op},                          // 0x27
-    { "JR Z, 0x%02X", jump_condition_add_operand, (void*) FLAG_Z, (void*) 1},                 // 0x28
-    { "ADD HL, HL", add16bit, &registers.hl},                   // 0x29
-    { "LDI A, (HL)", load8bit_inc_from_mem},                  // 0x2a
-    { "DEC HL", dec16bit, &registers.hl},                       // 0x2b
-    { "INC L", inc8bit, &registers.l},                        // 0x2c
-    { "DEC L", dec8bit, &registers.l},                        // 0x2d
-    { "LD L, 0x%02X", load8bit_operand, &registers.l},                 // 0x2e
-    { "CPL", complement},                          // 0x2f
-    { "JR NC, 0x%02X", jump_condition_add_operand, (void*) FLAG_CY, (void*) 0},                // 0x30
-    { "LD SP, 0x%04X", load16bit_operand, &registers.sp},             // 0x31
-    { "LDD (HL), A", load8bit_dec_to_mem},                  // 0x32
-    { "INC SP", inc16bit, &registers.sp},                       // 0x33
-    { "INC (HL)", inc8bit_from_mem},                     // 0x34
-    { "DEC (HL)", dec8bit_from_mem},                     // 0x35
-    { "LD (HL), 0x%02X", load8bit_to_mem_from_operand, &registers.hl},              // 0x36
-    { "SCF", scf_op},                          // 0x37
-    { "JR C, 0x%02X", jump_condition_add_operand, (void*) FLAG_CY, (void*) 1},                 // 0x38
-    { "ADD HL, SP", add16bit, &registers.sp},                   // 0x39
-    { "LDD A, (HL)", load8bit_dec_from_mem},                  // 0x3a
-    { "DEC SP", dec16bit, &registers.sp},                       // 0x3b
-    { "INC A", inc8bit, &registers.a},                        // 0x3c
-    { "DEC A", dec8bit, &registers.a},                        // 0x3d
-    { "LD A, 0x%02X", load8bit_operand, &registers.a},                 // 0x3e
-    { "CCF", ccf_op},                          // 0x3f
-    { "LD B, B", load8bit, &registers.b, &registers.b},                      // 0x40
-    { "LD B, C", load8bit, &registers.b, &registers.c},                      // 0x41
-    { "LD B, D", load8bit, &registers.b, &registers.d},                      // 0x42
-    { "LD B, E", load8bit, &registers.b, &registers.e},                      // 0x43
-    { "LD B, H", load8bit, &registers.b, &registers.h},                      // 0x44
-    { "LD B, L", load8bit, &registers.b, &registers.l},                      // 0x45
-    { "LD B, (HL)", load8bit_from_mem, &registers.b, &registers.hl},                   // 0x46
-    { "LD B, A", load8bit, &registers.b, &registers.a},                      // 0x47
-    { "LD C, B", load8bit, &registers.c, &registers.b},                      // 0x48
-    { "LD C, C", load8bit, &registers.c, &registers.c},                      // 0x49
-    { "LD C, D", load8bit, &registers.c, &registers.d},                      // 0x4a
-    { "LD C, E", load8bit, &registers.c, &registers.e},                      // 0x4b
-    { "LD C, H", load8bit, &registers.c, &registers.h},                      // 0x4c
-    { "LD C, L", load8bit, &registers.c, &registers.l},                      // 0x4d
-    { "LD C, (HL)", load8bit_from_mem, &registers.c, &registers.hl},                   // 0x4e
-    { "LD C, A", load8bit, &registers.c, &registers.a},                      // 0x4f
-    { "LD D, B", load8bit, &registers.d, &registers.b},                      // 0x50
-    { "LD D, C", load8bit, &registers.d, &registers.c},                      // 0x51
-    { "LD D, D", load8bit_debug, &registers.d, &registers.d},                      // 0x52
-    { "LD D, E", load8bit, &registers.d, &registers.e},                      // 0x53
-    { "LD D, H", load8bit, &registers.d, &registers.h},                      // 0x54
-    { "LD D, L", load8bit, &registers.d, &registers.l},                      // 0x55
-    { "LD D, (HL)", load8bit_from_mem, &registers.d, &registers.hl},                   // 0x56
-    { "LD D, A", load8bit, &registers.d, &registers.a},                      // 0x57
-    { "LD E, B", load8bit, &registers.e, &registers.b},                      // 0x58
-    { "LD E, C", load8bit, &registers.e, &registers.c},                      // 0x59
-    { "LD E, D", load8bit, &registers.e, &registers.d},                      // 0x5a
-    { "LD E, E", load8bit, &registers.e, &registers.e},                      // 0x5b
-    { "LD E, H", load8bit, &registers.e, &registers.h},                      // 0x5c
-    { "LD E, L", load8bit, &registers.e, &registers.l},                      // 0x5d
-    { "LD E, (HL)", load8bit_from_mem, &registers.e, &registers.hl},                   // 0x5e
-    { "LD E, A", load8bit, &registers.e, &registers.a},                      // 0x5f
-    { "LD H, B", load8bit, &registers.h, &registers.b},                      // 0x60
-    { "LD H, C", load8bit, &registers.h, &registers.c},                      // 0x61
-    { "LD H, D", load8bit, &registers.h, &registers.d},                      // 0x62
-    { "LD H, E", load8bit, &registers.h, &registers.e},                      // 0x63
-    { "LD H, H", load8bit, &registers.h, &registers.h},                      // 0x64
-    { "LD H, L", load8bit, &registers.h, &registers.l},                      // 0x65
-    { "LD H, (HL)", load8bit_from_mem, &registers.h, &registers.hl},                   // 0x66
-    { "LD H, A", load8bit, &registers.h, &registers.a},                      // 0x67
-    { "LD L, B", load8bit, &registers.l, &registers.b},                      // 0x68
-    { "LD L, C", load8bit, &registers.l, &registers.c},                      // 0x69
-    { "LD L, D", load8bit, &registers.l, &registers.d},                      // 0x6a
-    { "LD L, E", load8bit, &registers.l, &registers.e},                      // 0x6b
-    { "LD L, H", load8bit, &registers.l, &registers.h},                      // 0x6c
-    { "LD L, L", load8bit, &registers.l, &registers.l},                      // 0x6d
-    { "LD L, (HL)", load8bit_from_mem, &registers.l, &registers.hl},                   // 0x6e
-    { "LD L, A", load8bit, &registers.l, &registers.a},                      // 0x6f
-    { "LD (HL), B", load8bit_to_mem, &registers.hl, &registers.b},                   // 0x70
-    { "LD (HL), C", load8bit_to_mem, &registers.hl, &registers.c},                   // 0x71
-    { "LD (HL), D", load8bit_to_mem, &registers.hl, &registers.d},                   // 0x72
-    { "LD (HL), E", load8bit_to_mem, &registers.hl, &registers.e},                   // 0x73
-    { "LD (HL), H", load8bit_to_mem, &registers.hl, &registers.h},                   // 0x74
-    { "LD (HL), L", load8bit_to_mem, &registers.hl, &registers.l},                   // 0x75
-    { "HALT", halt},                         // 0x76
-    { "LD (HL), A", load8bit_to_mem, &registers.hl, &registers.a },                   // 0x77
-    { "LD A, B", load8bit, &registers.a, &registers.b},                      // 0x78
-    { "LD A, C", load8bit, &registers.a, &registers.c},                      // 0x79
-    { "LD A, D", load8bit, &registers.a, &registers.d},                      // 0x7a
-    { "LD A, E", load8bit, &registers.a, &registers.e},                      // 0x7b
-    { "LD A, H", load8bit, &registers.a, &registers.h},                      // 0x7c
-    { "LD A, L", load8bit, &registers.a, &registers.l},                      // 0x7d
-    { "LD A, (HL)", load8bit_from_mem, &registers.a, &registers.hl},                   // 0x7e
-    { "LD A, A", load8bit, &registers.a, &registers.a},                      // 0x7f
-    { "ADD A, B", add8bit, &registers.b},                     // 0x80
-    { "ADD A, C", add8bit, &registers.c},                     // 0x81
-    { "ADD A, D", add8bit, &registers.d},                     // 0x82
-    { "ADD A, E", add8bit, &registers.e},                     // 0x83
-    { "ADD A, H", add8bit, &registers.h},                     // 0x84
-    { "ADD A, L", add8bit, &registers.l},                     // 0x85
-    { "ADD A, (HL)", add8bit_from_mem},                  // 0x86
-    { "ADD A", add8bit, &registers.a},                        // 0x87
-    { "ADC B", adc, &registers.b},                        // 0x88
-    { "ADC C", adc, &registers.c},                        // 0x89
-    { "ADC D", adc, &registers.d},                        // 0x8a
-    { "ADC E", adc, &registers.e},                        // 0x8b
-    { "ADC H", adc, &registers.h},                        // 0x8c
-    { "ADC L", adc, &registers.l},                        // 0x8d
-    { "ADC (HL)", adc_from_mem, &registers.hl},                     // 0x8e
-    { "ADC A", adc, &registers.a},                        // 0x8f
-    { "SUB B", sub, &registers.b},                        // 0x90
-    { "SUB C", sub, &registers.c},                        // 0x91
-    { "SUB D", sub, &registers.d},                        // 0x92
-    { "SUB E", sub, &registers.e},                        // 0x93
-    { "SUB H", sub, &registers.h},                        // 0x94
-    { "SUB L", sub, &registers.l},                        // 0x95
-    { "SUB (HL)", sub_from_mem},                     // 0x96
-    { "SUB A", sub, &registers.a},                        // 0x97
-    { "SBC B", sbc, &registers.b},                        // 0x98
-    { "SBC C", sbc, &registers.c},                        // 0x99
-    { "SBC D", sbc, &registers.d},                        // 0x9a
-    { "SBC E", sbc, &registers.e},                        // 0x9b
-    { "SBC H", sbc, &registers.h},                        // 0x9c
-    { "SBC L", sbc, &registers.l},                        // 0x9d
-    { "SBC (HL)", sbc_from_mem},                     // 0x9e
-    { "SBC A", sbc, &registers.a},                        // 0x9f
-    { "AND B", and_reg, &registers.b},                        // 0xa0
-    { "AND C", and_reg, &registers.c},                        // 0xa1
-    { "AND D", and_reg, &registers.d},                        // 0xa2
-    { "AND E", and_reg, &registers.e},                        // 0xa3
-    { "AND H", and_reg, &registers.h},                        // 0xa4
-    { "AND L", and_reg, &registers.l},                        // 0xa5
-    { "AND (HL)", and_from_mem},                     // 0xa6
-    { "AND A", and_reg, &registers.a},                        // 0xa7
-    { "XOR B", xor_reg, &registers.b},                        // 0xa8
-    { "XOR C", xor_reg, &registers.c},                        // 0xa9
-    { "XOR D", xor_reg, &registers.d},                        // 0xaa
-    { "XOR E", xor_reg, &registers.e},                        // 0xab
-    { "XOR H", xor_reg, &registers.h},                        // 0xac
-    { "XOR L", xor_reg, &registers.l},                        // 0xad
-    { "XOR (HL)", xor_reg_from_mem, &registers.hl},                     // 0xae
-    { "XOR A", xor_reg, &registers.a},                        // 0xaf
-    { "OR B", or_reg, &registers.b},                         // 0xb0
-    { "OR C", or_reg, &registers.c},                         // 0xb1
-    { "OR D", or_reg, &registers.d},                         // 0xb2
-    { "OR E", or_reg, &registers.e},                         // 0xb3
-    { "OR H", or_reg, &registers.h},                         // 0xb4
-    { "OR L", or_reg, &registers.l},                         // 0xb5
-    { "OR (HL)", or_from_mem},                      // 0xb6
-    { "OR A", or_reg, &registers.a},                         // 0xb7
-    { "CP B", cp_op, &registers.b},                         // 0xb8
-    { "CP C", cp_op, &registers.c},                         // 0xb9
-    { "CP D", cp_op, &registers.d},                         // 0xba
-    { "CP E", cp_op, &registers.e},                         // 0xbb
-    { "CP H", cp_op, &registers.h},                         // 0xbc
-    { "CP L", cp_op, &registers.l},                         // 0xbd
-    { "CP (HL)", cp_mem, &registers.hl},                      // 0xbe
-    { "CP A", cp_op, &registers.a},                         // 0xbf
-    { "RET NZ", ret_condition, (void*) FLAG_Z, (void*) 0},                       // 0xc0
-    { "POP BC", pop_op, &registers.b, &registers.c},                       // 0xc1
-    { "JP NZ, 0x%04X", jump_condition_operand, (void*) FLAG_Z, (void*) 0},                // 0xc2
-    { "JP 0x%04X", jump_operand},                    // 0xc3
-    { "CALL NZ, 0x%04X", call_condition, (void*) FLAG_Z, (void*) 0},              // 0xc4
-    { "PUSH BC", push_op, &registers.b, &registers.c },                      // 0xc5
-    { "ADD A, 0x%02X", add8bit_operand},                // 0xc6
-    { "RST 0x00", rst, (void*) 0x00},                     // 0xc7
-    { "RET Z", ret_condition, (void *) FLAG_Z, (void*) 1},                        // 0xc8
-    { "RET", ret_op},                          // 0xc9
-    { "JP Z, 0x%04X", jump_condition_operand, (void*) FLAG_Z, (void*) 1},                 // 0xca
-    { "CB %02X", NULL}, //should never fall here                     // 0xcb
-    { "CALL Z, 0x%04X", call_condition, (void*) FLAG_Z, (void*) 1},               // 0xcc
-    { "CALL 0x%04X", call_operand},                  // 0xcd
-    { "ADC 0x%02X", adc_operand},                   // 0xce
-    { "RST 0x08",  rst, (void*) 0x08},                     // 0xcf
-    { "RET NC", ret_condition, (void *) FLAG_CY, (void*) 0},                       // 0xd0
-    { "POP DE", pop_op, &registers.d, &registers.e},                       // 0xd1
-    { "JP NC, 0x%04X", jump_condition_operand, (void*) FLAG_CY, (void*) 0},                // 0xd2
-    { "UNKNOWN", NULL},                      // 0xd3
-    { "CALL NC, 0x%04X", call_condition, (void*) FLAG_CY, (void*) 0},              // 0xd4
-    { "PUSH DE", push_op, &registers.d, &registers.e},                      // 0xd5
-    { "SUB 0x%02X", sub_operand},                   // 0xd6
-    { "RST 0x10",  rst, (void*) 0x10},                     // 0xd7
-    { "RET C", ret_condition, (void *) FLAG_CY, (void*) 1},                        // 0xd8
-    { "RETI", ret_interrupt},                         // 0xd9
-    { "JP C, 0x%04X", jump_condition_operand, (void*) FLAG_CY, (void*) 1},                 // 0xda
-    { "UNKNOWN", NULL},                      // 0xdb
-    { "CALL C, 0x%04X", call_condition, (void*) FLAG_CY, (void*) 1},               // 0xdc
-    { "UNKNOWN", NULL},                      // 0xdd
-    { "SBC 0x%02X", sbc_operand},                   // 0xde
-    { "RST 0x18",  rst, (void*) 0x18},                     // 0xdf
-    { "LD (0xFF00 + 0x%02X), A", load8bit_to_io_mem_operand, &registers.a},      // 0xe0
-    { "POP HL", pop_op, &registers.h, &registers.l},                       // 0xe1
-    { "LD (0xFF00 + C), A", load8bit_to_io_mem, &registers.c, &registers.a},           // 0xe2
-    { "UNKNOWN", NULL},                      // 0xe3
-    { "UNKNOWN", NULL},                      // 0xe4
-    { "PUSH HL", push_op, &registers.h, &registers.l},                      // 0xe5
-    { "AND 0x%02X", and_operand},                   // 0xe6
-    { "RST 0x20",  rst, (void*) 0x20},                     // 0xe7
-    { "ADD SP,0x%02X", add16bit_sp_operand},                // 0xe8
-    { "JP HL", jump, &registers.hl},                        // 0xe9
-    { "LD (0x%04X), A", load8bit_to_mem_operand, &registers.a},               // 0xea
-    { "UNKNOWN", NULL},                      // 0xeb
-    { "UNKNOWN", NULL},                      // 0xec
-    { "UNKNOWN", NULL},                      // 0xed
-    { "XOR 0x%02X", xor_operand},                   // 0xee
-    { "RST 0x28",  rst, (void*) 0x28},                     // 0xef
-    { "LD A, (0xFF00 + 0x%02X)", load8bit_from_io_mem_operand, &registers.a},      // 0xf0
-    { "POP AF", pop_op, &registers.a, &registers.f},                       // 0xf1
-    { "LD A, (0xFF00 + C)", load8bit_from_io_mem, &registers.a, &registers.c},           // 0xf2
-    { "DI", disable_interrupts},                           // 0xf3
-    { "UNKNOWN", NULL},                      // 0xf4
-    { "PUSH AF", push_op, &registers.a, &registers.f},                      // 0xf5
-    { "OR 0x%02X", or_operand},                    // 0xf6
-    { "RST 0x30",  rst, (void*) 0x30},                     // 0xf7
-    { "LD HL, SP+0x%02X", load16bit_sp_operand_offset},             // 0xf8
-    { "LD SP, HL", load16bit, &registers.sp, &registers.hl},                    // 0xf9
-    { "LD A, (0x%04X)", load8bit_from_mem_operand, &registers.a},               // 0xfa
-    { "EI", enable_interrupts},                           // 0xfb
-    { "UNKNOWN", NULL},                      // 0xfc
-    { "UNKNOWN", NULL},                      // 0xfd
-    { "CP 0x%02X", cp_operand},                    // 0xfe
-    { "RST 0x38",  rst, (void*) 0x38},                     // 0xff
-};
-
-
-static const unsigned char instructions_ticks[256] = {
+const unsigned char instructions_ticks[256] = {
     4, 12, 8, 8, 4, 4, 8, 4,     20, 8, 8, 8, 4, 4, 8, 4, // 0x0_
     4, 12, 8, 8, 4, 4, 8, 4,     12, 8, 8, 8, 4, 4, 8, 4, // 0x1_
     8, 12, 8, 8, 4, 4, 8, 4,     8, 8, 8, 8, 4, 4, 8, 4, // 0x2_
@@ -1444,268 +1332,29 @@ static const unsigned char instructions_ticks[256] = {
 };
 
 /*
- * Instructions with prefix CB
+ * Instruction length in bytes, counting the opcode
+ * (the CB prefix counts as an opcode with an 8 bit operand)
  */
-static const struct instruction instructions_cb[256] = {
-    { "RLC B", rlc_op, &registers.b},           // 0x00
-    { "RLC C", rlc_op, &registers.c},           // 0x01
-    { "RLC D", rlc_op, &registers.d},           // 0x02
-    { "RLC E", rlc_op, &registers.e},           // 0x03
-    { "RLC H", rlc_op, &registers.h},           // 0x04
-    { "RLC L", rlc_op, &registers.l},           // 0x05
-    { "RLC (HL)", rlc_from_mem},      // 0x06
-    { "RLC A", rlc_op, &registers.a},           // 0x07
-    { "RRC B", rrc_op, &registers.b},           // 0x08
-    { "RRC C", rrc_op, &registers.c},           // 0x09
-    { "RRC D", rrc_op, &registers.d},           // 0x0a
-    { "RRC E", rrc_op, &registers.e},           // 0x0b
-    { "RRC H", rrc_op, &registers.h},           // 0x0c
-    { "RRC L", rrc_op, &registers.l},           // 0x0d
-    { "RRC (HL)", rrc_from_mem},      // 0x0e
-    { "RRC A", rrc_op, &registers.a},           // 0x0f
-    { "RL B", rl_op, &registers.b},             // 0x10
-    { "RL C", rl_op, &registers.c},             // 0x11
-    { "RL D", rl_op, &registers.d},             // 0x12
-    { "RL E", rl_op, &registers.e},             // 0x13
-    { "RL H", rl_op, &registers.h},             // 0x14
-    { "RL L", rl_op, &registers.l},             // 0x15
-    { "RL (HL)", rl_from_mem},        // 0x16
-    { "RL A", rl_op, &registers.a},             // 0x17
-    { "RR B", rr_op, &registers.b},             // 0x18
-    { "RR C", rr_op, &registers.c},             // 0x19
-    { "RR D", rr_op, &registers.d},             // 0x1a
-    { "RR E", rr_op, &registers.e},             // 0x1b
-    { "RR H", rr_op, &registers.h},             // 0x1c
-    { "RR L", rr_op, &registers.l},             // 0x1d
-    { "RR (HL)", rr_from_mem},        // 0x1e
-    { "RR A", rr_op, &registers.a},             // 0x1f
-    { "SLA B", sla_op, &registers.b},           // 0x20
-    { "SLA C", sla_op, &registers.c},           // 0x21
-    { "SLA D", sla_op, &registers.d},           // 0x22
-    { "SLA E", sla_op, &registers.e},           // 0x23
-    { "SLA H", sla_op, &registers.h},           // 0x24
-    { "SLA L", sla_op, &registers.l},           // 0x25
-    { "SLA (HL)", sla_from_mem},      // 0x26
-    { "SLA A", sla_op, &registers.a},           // 0x27
-    { "SRA B", sra_op, &registers.b},           // 0x28
-    { "SRA C", sra_op, &registers.c},           // 0x29
-    { "SRA D", sra_op, &registers.d},           // 0x2a
-    { "SRA E", sra_op, &registers.e},           // 0x2b
-    { "SRA H", sra_op, &registers.h},           // 0x2c
-    { "SRA L", sra_op, &registers.l},           // 0x2d
-    { "SRA (HL)", sra_from_mem},      // 0x2e
-    { "SRA A", sra_op, &registers.a},           // 0x2f
-    { "SWAP B", swap, &registers.b},         // 0x30
-    { "SWAP C", swap, &registers.c},         // 0x31
-    { "SWAP D", swap, &registers.d},         // 0x32
-    { "SWAP E", swap, &registers.e},         // 0x33
-    { "SWAP H", swap, &registers.h},         // 0x34
-    { "SWAP L", swap, &registers.l},         // 0x35
-    { "SWAP (HL)", swap_from_mem},    // 0x36
-    { "SWAP A", swap, &registers.a},         // 0x37
-    { "SRL B", srl_op, &registers.b},           // 0x38
-    { "SRL C", srl_op, &registers.c},           // 0x39
-    { "SRL D", srl_op, &registers.d},           // 0x3a
-    { "SRL E", srl_op, &registers.e},           // 0x3b
-    { "SRL H", srl_op, &registers.h},           // 0x3c
-    { "SRL L", srl_op, &registers.l},           // 0x3d
-    { "SRL (HL)", srl_from_mem},      // 0x3e
-    { "SRL A", srl_op, &registers.a},           // 0x3f
-    { "BIT 0, B", bit_op, (void*) 0, &registers.b },      // 0x40
-    { "BIT 0, C", bit_op, (void*) 0, &registers.c },      // 0x41
-    { "BIT 0, D", bit_op, (void*) 0, &registers.d },      // 0x42
-    { "BIT 0, E", bit_op, (void*) 0, &registers.e },      // 0x43
-    { "BIT 0, H", bit_op, (void*) 0, &registers.h },      // 0x44
-    { "BIT 0, L", bit_op, (void*) 0, &registers.l },      // 0x45
-    { "BIT 0, (HL)", bit_op_from_mem, (void*) 0, &registers.hl }, // 0x46
-    { "BIT 0, A", bit_op, (void*) 0, &registers.a },      // 0x47
-    { "BIT 1, B", bit_op, (void*) 1, &registers.b },      // 0x48
-    { "BIT 1, C", bit_op, (void*) 1, &registers.c },      // 0x49
-    { "BIT 1, D", bit_op, (void*) 1, &registers.d },      // 0x4a
-    { "BIT 1, E", bit_op, (void*) 1, &registers.e },      // 0x4b
-    { "BIT 1, H", bit_op, (void*) 1, &registers.h },      // 0x4c
-    { "BIT 1, L", bit_op, (void*) 1, &registers.l },      // 0x4d
-    { "BIT 1, (HL)", bit_op_from_mem, (void*) 1, &registers.hl }, // 0x4e
-    { "BIT 1, A", bit_op, (void*) 1, &registers.a },      // 0x4f
-    { "BIT 2, B", bit_op, (void*) 2, &registers.b },      // 0x50
-    { "BIT 2, C", bit_op, (void*) 2, &registers.c },      // 0x51
-    { "BIT 2, D", bit_op, (void*) 2, &registers.d },      // 0x52
-    { "BIT 2, E", bit_op, (void*) 2, &registers.e },      // 0x53
-    { "BIT 2, H", bit_op, (void*) 2, &registers.h },      // 0x54
-    { "BIT 2, L", bit_op, (void*) 2, &registers.l },      // 0x55
-    { "BIT 2, (HL)", bit_op_from_mem, (void*) 2, &registers.hl }, // 0x56
-    { "BIT 2, A", bit_op, (void*) 2, &registers.a },      // 0x57
-    { "BIT 3, B", bit_op, (void*) 3, &registers.b },      // 0x58
-    { "BIT 3, C", bit_op, (void*) 3, &registers.c },      // 0x59
-    { "BIT 3, D", bit_op, (void*) 3, &registers.d },      // 0x5a
-    { "BIT 3, E", bit_op, (void*) 3, &registers.e },      // 0x5b
-    { "BIT 3, H", bit_op, (void*) 3, &registers.h },      // 0x5c
-    { "BIT 3, L", bit_op, (void*) 3, &registers.l },      // 0x5d
-    { "BIT 3, (HL)", bit_op_from_mem, (void*) 3, &registers.hl }, // 0x5e
-    { "BIT 3, A", bit_op, (void*) 3, &registers.a },      // 0x5f
-    { "BIT 4, B", bit_op, (void*) 4, &registers.b },      // 0x60
-    { "BIT 4, C", bit_op, (void*) 4, &registers.c },      // 0x61
-    { "BIT 4, D", bit_op, (void*) 4, &registers.d },      // 0x62
-    { "BIT 4, E", bit_op, (void*) 4, &registers.e },      // 0x63
-    { "BIT 4, H", bit_op, (void*) 4, &registers.h },      // 0x64
-    { "BIT 4, L", bit_op, (void*) 4, &registers.l },      // 0x65
-    { "BIT 4, (HL)", bit_op_from_mem, (void*) 4, &registers.hl }, // 0x66
-    { "BIT 4, A", bit_op, (void*) 4, &registers.a },      // 0x67
-    { "BIT 5, B", bit_op, (void*) 5, &registers.b },      // 0x68
-    { "BIT 5, C", bit_op, (void*) 5, &registers.c },      // 0x69
-    { "BIT 5, D", bit_op, (void*) 5, &registers.d },      // 0x6a
-    { "BIT 5, E", bit_op, (void*) 5, &registers.e },      // 0x6b
-    { "BIT 5, H", bit_op, (void*) 5, &registers.h },      // 0x6c
-    { "BIT 5, L", bit_op, (void*) 5, &registers.l },      // 0x6d
-    { "BIT 5, (HL)", bit_op_from_mem, (void*) 5, &registers.hl }, // 0x6e
-    { "BIT 5, A", bit_op, (void*) 5, &registers.a },      // 0x6f
-    { "BIT 6, B", bit_op, (void*) 6, &registers.b },      // 0x70
-    { "BIT 6, C", bit_op, (void*) 6, &registers.c },      // 0x71
-    { "BIT 6, D", bit_op, (void*) 6, &registers.d },      // 0x72
-    { "BIT 6, E", bit_op, (void*) 6, &registers.e },      // 0x73
-    { "BIT 6, H", bit_op, (void*) 6, &registers.h },      // 0x74
-    { "BIT 6, L", bit_op, (void*) 6, &registers.l },      // 0x75
-    { "BIT 6, (HL)", bit_op_from_mem, (void*) 6, &registers.hl}, // 0x76
-    { "BIT 6, A", bit_op, (void*) 6, &registers.a },      // 0x77
-    { "BIT 7, B", bit_op, (void*) 7, &registers.b },      // 0x78
-    { "BIT 7, C", bit_op, (void*) 7, &registers.c },      // 0x79
-    { "BIT 7, D", bit_op, (void*) 7, &registers.d },      // 0x7a
-    { "BIT 7, E", bit_op, (void*) 7, &registers.e },      // 0x7b
-    { "BIT 7, H", bit_op, (void*) 7, &registers.h },      // 0x7c
-    { "BIT 7, L", bit_op, (void*) 7, &registers.l },      // 0x7d
-    { "BIT 7, (HL)", bit_op_from_mem, (void*) 7, &registers.hl }, // 0x7e
-    { "BIT 7, A", bit_op, (void*) 7, &registers.a },      // 0x7f
-    { "RES 0, B", res_op, (void*) 0, &registers.b},      // 0x80
-    { "RES 0, C", res_op, (void*) 0, &registers.c},      // 0x81
-    { "RES 0, D", res_op, (void*) 0, &registers.d},      // 0x82
-    { "RES 0, E", res_op, (void*) 0, &registers.e},      // 0x83
-    { "RES 0, H", res_op, (void*) 0, &registers.h},      // 0x84
-    { "RES 0, L", res_op, (void*) 0, &registers.l},      // 0x85
-    { "RES 0, (HL)", res_from_mem, (void*) 0, &registers.hl}, // 0x86
-    { "RES 0, A", res_op, (void*) 0, &registers.a},      // 0x87
-    { "RES 1, B", res_op, (void*) 1, &registers.b},      // 0x88
-    { "RES 1, C", res_op, (void*) 1, &registers.c},      // 0x89
-    { "RES 1, D", res_op, (void*) 1, &registers.d},      // 0x8a
-    { "RES 1, E", res_op, (void*) 1, &registers.e},      // 0x8b
-    { "RES 1, H", res_op, (void*) 1, &registers.h},      // 0x8c
-    { "RES 1, L", res_op, (void*) 1, &registers.l},      // 0x8d
-    { "RES 1, (HL)", res_from_mem, (void*) 1, &registers.hl}, // 0x8e
-    { "RES 1, A", res_op, (void*) 1, &registers.a},      // 0x8f
-    { "RES 2, B", res_op, (void*) 2, &registers.b},      // 0x90
-    { "RES 2, C", res_op, (void*) 2, &registers.c},      // 0x91
-    { "RES 2, D", res_op, (void*) 2, &registers.d},      // 0x92
-    { "RES 2, E", res_op, (void*) 2, &registers.e},      // 0x93
-    { "RES 2, H", res_op, (void*) 2, &registers.h},      // 0x94
-    { "RES 2, L", res_op, (void*) 2, &registers.l},      // 0x95
-    { "RES 2, (HL)", res_from_mem, (void*) 2, &registers.hl}, // 0x96
-    { "RES 2, A", res_op, (void*) 2, &registers.a},      // 0x97
-    { "RES 3, B", res_op, (void*) 3, &registers.b},      // 0x98
-    { "RES 3, C", res_op, (void*) 3, &registers.c},      // 0x99
-    { "RES 3, D", res_op, (void*) 3, &registers.d},      // 0x9a
-    { "RES 3, E", res_op, (void*) 3, &registers.e},      // 0x9b
-    { "RES 3, H", res_op, (void*) 3, &registers.h},      // 0x9c
-    { "RES 3, L", res_op, (void*) 3, &registers.l},      // 0x9d
-    { "RES 3, (HL)", res_from_mem, (void*) 3, &registers.hl}, // 0x9e
-    { "RES 3, A", res_op, (void*) 3, &registers.a},      // 0x9f
-    { "RES 4, B", res_op, (void*) 4, &registers.b},      // 0xa0
-    { "RES 4, C", res_op, (void*) 4, &registers.c},      // 0xa1
-    { "RES 4, D", res_op, (void*) 4, &registers.d},      // 0xa2
-    { "RES 4, E", res_op, (void*) 4, &registers.e},      // 0xa3
-    { "RES 4, H", res_op, (void*) 4, &registers.h},      // 0xa4
-    { "RES 4, L", res_op, (void*) 4, &registers.l},      // 0xa5
-    { "RES 4, (HL)", res_from_mem, (void*) 4, &registers.hl}, // 0xa6
-    { "RES 4, A", res_op, (void*) 4, &registers.a},      // 0xa7
-    { "RES 5, B", res_op, (void*) 5, &registers.b},      // 0xa8
-    { "RES 5, C", res_op, (void*) 5, &registers.c},      // 0xa9
-    { "RES 5, D", res_op, (void*) 5, &registers.d},      // 0xaa
-    { "RES 5, E", res_op, (void*) 5, &registers.e},      // 0xab
-    { "RES 5, H", res_op, (void*) 5, &registers.h},      // 0xac
-    { "RES 5, L", res_op, (void*) 5, &registers.l},      // 0xad
-    { "RES 5, (HL)", res_from_mem, (void*) 5, &registers.hl}, // 0xae
-    { "RES 5, A", res_op, (void*) 5, &registers.a},      // 0xaf
-    { "RES 6, B", res_op, (void*) 6, &registers.b},      // 0xb0
-    { "RES 6, C", res_op, (void*) 6, &registers.c},      // 0xb1
-    { "RES 6, D", res_op, (void*) 6, &registers.d},      // 0xb2
-    { "RES 6, E", res_op, (void*) 6, &registers.e},      // 0xb3
-    { "RES 6, H", res_op, (void*) 6, &registers.h},      // 0xb4
-    { "RES 6, L", res_op, (void*) 6, &registers.l},      // 0xb5
-    { "RES 6, (HL)", res_from_mem, (void*) 6, &registers.hl}, // 0xb6
-    { "RES 6, A", res_op, (void*) 6, &registers.a},      // 0xb7
-    { "RES 7, B", res_op, (void*) 7, &registers.b},      // 0xb8
-    { "RES 7, C", res_op, (void*) 7, &registers.c},      // 0xb9
-    { "RES 7, D", res_op, (void*) 7, &registers.d},      // 0xba
-    { "RES 7, E", res_op, (void*) 7, &registers.e},      // 0xbb
-    { "RES 7, H", res_op, (void*) 7, &registers.h},      // 0xbc
-    { "RES 7, L", res_op, (void*) 7, &registers.l},      // 0xbd
-    { "RES 7, (HL)", res_from_mem, (void*) 7, &registers.hl}, // 0xbe
-    { "RES 7, A", res_op, (void*) 7, &registers.a},      // 0xbf
-    { "SET 0, B", set_op, (void*) 0, &registers.b },      // 0xc0
-    { "SET 0, C", set_op, (void*) 0, &registers.c },      // 0xc1
-    { "SET 0, D", set_op, (void*) 0, &registers.d },      // 0xc2
-    { "SET 0, E", set_op, (void*) 0, &registers.e },      // 0xc3
-    { "SET 0, H", set_op, (void*) 0, &registers.h },      // 0xc4
-    { "SET 0, L", set_op, (void*) 0, &registers.l },      // 0xc5
-    { "SET 0, (HL)", set_op_from_mem, (void*) 0, &registers.hl }, // 0xc6
-    { "SET 0, A", set_op, (void*) 0, &registers.a },      // 0xc7
-    { "SET 1, B", set_op, (void*) 1, &registers.b },      // 0xc8
-    { "SET 1, C", set_op, (void*) 1, &registers.c },      // 0xc9
-    { "SET 1, D", set_op, (void*) 1, &registers.d },      // 0xca
-    { "SET 1, E", set_op, (void*) 1, &registers.e },      // 0xcb
-    { "SET 1, H", set_op, (void*) 1, &registers.h },      // 0xcc
-    { "SET 1, L", set_op, (void*) 1, &registers.l },      // 0xcd
-    { "SET 1, (HL)", set_op_from_mem, (void*) 1, &registers.hl }, // 0xce
-    { "SET 1, A", set_op, (void*) 1, &registers.a },      // 0xcf
-    { "SET 2, B", set_op, (void*) 2, &registers.b },      // 0xd0
-    { "SET 2, C", set_op, (void*) 2, &registers.c },      // 0xd1
-    { "SET 2, D", set_op, (void*) 2, &registers.d },      // 0xd2
-    { "SET 2, E", set_op, (void*) 2, &registers.e },      // 0xd3
-    { "SET 2, H", set_op, (void*) 2, &registers.h },      // 0xd4
-    { "SET 2, L", set_op, (void*) 2, &registers.l },      // 0xd5
-    { "SET 2, (HL)", set_op_from_mem, (void*) 2, &registers.hl }, // 0xd6
-    { "SET 2, A", set_op, (void*) 2, &registers.a },      // 0xd7
-    { "SET 3, B", set_op, (void*) 3, &registers.b },      // 0xd8
-    { "SET 3, C", set_op, (void*) 3, &registers.c },      // 0xd9
-    { "SET 3, D", set_op, (void*) 3, &registers.d },      // 0xda
-    { "SET 3, E", set_op, (void*) 3, &registers.e },      // 0xdb
-    { "SET 3, H", set_op, (void*) 3, &registers.h },      // 0xdc
-    { "SET 3, L", set_op, (void*) 3, &registers.l },      // 0xdd
-    { "SET 3, (HL)", set_op_from_mem, (void*) 3, &registers.hl }, // 0xde
-    { "SET 3, A", set_op, (void*) 3, &registers.a },      // 0xdf
-    { "SET 4, B", set_op, (void*) 4, &registers.b },      // 0xe0
-    { "SET 4, C", set_op, (void*) 4, &registers.c },      // 0xe1
-    { "SET 4, D", set_op, (void*) 4, &registers.d },      // 0xe2
-    { "SET 4, E", set_op, (void*) 4, &registers.e },      // 0xe3
-    { "SET 4, H", set_op, (void*) 4, &registers.h },      // 0xe4
-    { "SET 4, L", set_op, (void*) 4, &registers.l },      // 0xe5
-    { "SET 4, (HL)", set_op_from_mem, (void*) 4, &registers.hl }, // 0xe6
-    { "SET 4, A", set_op, (void*) 4, &registers.a },      // 0xe7
-    { "SET 5, B", set_op, (void*) 5, &registers.b },      // 0xe8
-    { "SET 5, C", set_op, (void*) 5, &registers.c },      // 0xe9
-    { "SET 5, D", set_op, (void*) 5, &registers.d },      // 0xea
-    { "SET 5, E", set_op, (void*) 5, &registers.e },      // 0xeb
-    { "SET 5, H", set_op, (void*) 5, &registers.h },      // 0xec
-    { "SET 5, L", set_op, (void*) 5, &registers.l },      // 0xed
-    { "SET 5, (HL)", set_op_from_mem, (void*) 5, &registers.hl }, // 0xee
-    { "SET 5, A", set_op, (void*) 5, &registers.a },      // 0xef
-    { "SET 6, B", set_op, (void*) 6, &registers.b },      // 0xf0
-    { "SET 6, C", set_op, (void*) 6, &registers.c },      // 0xf1
-    { "SET 6, D", set_op, (void*) 6, &registers.d },      // 0xf2
-    { "SET 6, E", set_op, (void*) 6, &registers.e },      // 0xf3
-    { "SET 6, H", set_op, (void*) 6, &registers.h },      // 0xf4
-    { "SET 6, L", set_op, (void*) 6, &registers.l },      // 0xf5
-    { "SET 6, (HL)", set_op_from_mem, (void*) 6, &registers.hl }, // 0xf6
-    { "SET 6, A", set_op, (void*) 6, &registers.a },      // 0xf7
-    { "SET 7, B", set_op, (void*) 7, &registers.b },      // 0xf8
-    { "SET 7, C", set_op, (void*) 7, &registers.c },      // 0xf9
-    { "SET 7, D", set_op, (void*) 7, &registers.d },      // 0xfa
-    { "SET 7, E", set_op, (void*) 7, &registers.e },      // 0xfb
-    { "SET 7, H", set_op, (void*) 7, &registers.h },      // 0xfc
-    { "SET 7, L", set_op, (void*) 7, &registers.l },      // 0xfd
-    { "SET 7, (HL)", set_op_from_mem, (void*) 7, &registers.hl}, // 0xfe
-    { "SET 7, A", set_op, (void*) 7, &registers.a},      // 0xff
+const unsigned char instructions_length[256] = {
+    1, 3, 1, 1, 1, 1, 2, 1,  3, 1, 1, 1, 1, 1, 2, 1, // 0x0_
+    1, 3, 1, 1, 1, 1, 2, 1,  2, 1, 1, 1, 1, 1, 2, 1, // 0x1_
+    2, 3, 1, 1, 1, 1, 2, 1,  2, 1, 1, 1, 1, 1, 2, 1, // 0x2_
+    2, 3, 1, 1, 1, 1, 2, 1,  2, 1, 1, 1, 1, 1, 2, 1, // 0x3_
+    1, 1, 1, 1, 1, 1, 1, 1,  1, 1, 1, 1, 1, 1, 1, 1, // 0x4_
+    1, 1, 1, 1, 1, 1, 1, 1,  1, 1, 1, 1, 1, 1, 1, 1, // 0x5_
+    1, 1, 1, 1, 1, 1, 1, 1,  1, 1, 1, 1, 1, 1, 1, 1, // 0x6_
+    1, 1, 1, 1, 1, 1, 1, 1,  1, 1, 1, 1, 1, 1, 1, 1, // 0x7_
+    1, 1, 1, 1, 1, 1, 1, 1,  1, 1, 1, 1, 1, 1, 1, 1, // 0x8_
+    1, 1, 1, 1, 1, 1, 1, 1,  1, 1, 1, 1, 1, 1, 1, 1, // 0x9_
+    1, 1, 1, 1, 1, 1, 1, 1,  1, 1, 1, 1, 1, 1, 1, 1, // 0xa_
+    1, 1, 1, 1, 1, 1, 1, 1,  1, 1, 1, 1, 1, 1, 1, 1, // 0xb_
+    1, 1, 3, 3, 3, 1, 2, 1,  1, 1, 3, 2, 3, 3, 2, 1, // 0xc_
+    1, 1, 3, 1, 3, 1, 2, 1,  1, 1, 3, 1, 3, 1, 2, 1, // 0xd_
+    2, 1, 1, 1, 1, 1, 2, 1,  2, 1, 3, 1, 1, 1, 2, 1, // 0xe_
+    2, 1, 1, 1, 1, 1, 2, 1,  2, 1, 3, 1, 1, 1, 2, 1, // 0xf_
 };
 
-static const unsigned char instructions_cb_ticks[256] = {
+const unsigned char instructions_cb_ticks[256] = {
     8, 8, 8, 8, 8,  8, 16, 8,  8, 8, 8, 8, 8, 8, 16, 8, // 0x0_
     8, 8, 8, 8, 8,  8, 16, 8,  8, 8, 8, 8, 8, 8, 16, 8, // 0x1_
     8, 8, 8, 8, 8,  8, 16, 8,  8, 8, 8, 8, 8, 8, 16, 8, // 0x2_
@@ -1737,12 +1386,12 @@ static const unsigned char instructions_cb_ticks[256] = {
 #define SERIAL_INTERRUPT ((unsigned char) 8) // 0000 1000
 #define JOYPAD_INTERRUPT ((unsigned char) 16) // 0001 0000
 
-void request_interrupt(unsigned char interrupt_flag) {
+void request_interrupt(gb_t* gb, unsigned char interrupt_flag) {
 
-    *interrupt_request_register |= interrupt_flag;
+    *gb->memory.interrupt_request_register |= interrupt_flag;
 }
 
-static void process_interrupts() {
+static void process_interrupts(gb_t* gb) {
 
     unsigned char test_mask = 1;
 
@@ -1752,23 +1401,24 @@ static void process_interrupts() {
          * interrupt enable register (which is set by the game), then the request is acknowledged
          * and processed.
          */
-        if ( (*interrupt_request_register & test_mask) & *interrupt_enable_register ) {
+        if ( (*gb->memory.interrupt_request_register & test_mask) & *gb->memory.interrupt_enable_register ) {
 
             // When an enabled interrupt is requested, the cpu is no longer halted;
-            halted = 0;
+            gb->cpu.halted = 0;
 
-            if ( interrupt_master_enable ) {
+            if ( gb->cpu.interrupt_master_enable ) {
 
-                disable_interrupts();
+                disable_interrupts(gb);
 
                 /*   Acknowledge the request:
                      clear the interrupt request bit that triggered the request */
-                *interrupt_request_register &= ~test_mask;
+                *gb->memory.interrupt_request_register &= ~test_mask;
+                scheduler_interrupt_cleared(gb);
 
                 /*   Call the interruption handler
                  * (Interruption handlers are in addresses 0x40 to 0x60) */
                 unsigned short address = 0x40 + 0x8*i;
-                call(address);
+                call(gb, address);
             
             }
 
@@ -1781,9 +1431,6 @@ static void process_interrupts() {
 
     }
 
-
-    check_disable_bootrom();
-
 }
 
 
@@ -1792,76 +1439,753 @@ static void process_interrupts() {
 
 /*---- Main Logic and Execution -----------------------------------*/
 
-static int execute() {
 
-    // Use mmu read instead
-    /* unsigned char opcode = memory[registers.pc++]; */
-    unsigned char opcode;
-    mmu_read8bit(&opcode, registers.pc++);
+/*
+ *  Opcodes are dispatched with computed gotos (GCC/Clang "labels as values")
+ *  when the compiler supports them, and with a plain switch otherwise.
+ *  Define CPU_SWITCH_DISPATCH to force the switch.
+ *
+ *  Every opcode has its own case with the register operands written out,
+ *  so there's no indirect call and no pointer argument to load per instruction
+ */
+#if defined(__GNUC__) && !defined(CPU_SWITCH_DISPATCH)
+#define COMPUTED_GOTO
+#endif
+
+#ifdef COMPUTED_GOTO
+#define DISPATCH(table, opcode) goto *table[opcode];
+#define OPCODE(n) op_##n
+#define CB_OPCODE(n) cb_op_##n
+#define UNDEFINED_OPCODE op_undefined
+#else
+#define DISPATCH(table, opcode) switch (opcode)
+#define OPCODE(n) case n
+#define CB_OPCODE(n) case n
+#define UNDEFINED_OPCODE default
+#endif
+
+#define NEXT goto done
+#define NEXT_CB goto done_cb
 
-    if (opcode == 0xe4)
-        printf("UNKNOWN CODE IN PC: %x\n", registers.pc-1);
+/*
+ *  Execute an already fetched opcode
+ *
+ *  operand holds the 8 or 16 bit immediate that followed the opcode (if any),
+ *  and the program counter already points past it
+ */
+static int dispatch(gb_t* gb, unsigned char opcode, unsigned short operand) {
+
+    gb->cpu.extra_instruction_cycles = 0;
+
+#ifdef TRACE
+    trace_instruction(gb, opcode, operand);
+#endif
+
+#ifdef COMPUTED_GOTO
+    static const void* const dispatch_table[256] = {
+        &&op_0x00, &&op_0x01, &&op_0x02, &&op_0x03, &&op_0x04, &&op_0x05, &&op_0x06, &&op_0x07,
+        &&op_0x08, &&op_0x09, &&op_0x0a, &&op_0x0b, &&op_0x0c, &&op_0x0d, &&op_0x0e, &&op_0x0f,
+        &&op_0x10, &&op_0x11, &&op_0x12, &&op_0x13, &&op_0x14, &&op_0x15, &&op_0x16, &&op_0x17,
+        &&op_0x18, &&op_0x19, &&op_0x1a, &&op_0x1b, &&op_0x1c, &&op_0x1d, &&op_0x1e, &&op_0x1f,
+        &&op_0x20, &&op_0x21, &&op_0x22, &&op_0x23, &&op_0x24, &&op_0x25, &&op_0x26, &&op_0x27,
+        &&op_0x28, &&op_0x29, &&op_0x2a, &&op_0x2b, &&op_0x2c, &&op_0x2d, &&op_0x2e, &&op_0x2f,
+        &&op_0x30, &&op_0x31, &&op_0x32, &&op_0x33, &&op_0x34, &&op_0x35, &&op_0x36, &&op_0x37,
+        &&op_0x38, &&op_0x39, &&op_0x3a, &&op_0x3b, &&op_0x3c, &&op_0x3d, &&op_0x3e, &&op_0x3f,
+        &&op_0x40, &&op_0x41, &&op_0x42, &&op_0x43, &&op_0x44, &&op_0x45, &&op_0x46, &&op_0x47,
+        &&op_0x48, &&op_0x49, &&op_0x4a, &&op_0x4b, &&op_0x4c, &&op_0x4d, &&op_0x4e, &&op_0x4f,
+        &&op_0x50, &&op_0x51, &&op_0x52, &&op_0x53, &&op_0x54, &&op_0x55, &&op_0x56, &&op_0x57,
+        &&op_0x58, &&op_0x59, &&op_0x5a, &&op_0x5b, &&op_0x5c, &&op_0x5d, &&op_0x5e, &&op_0x5f,
+        &&op_0x60, &&op_0x61, &&op_0x62, &&op_0x63, &&op_0x64, &&op_0x65, &&op_0x66, &&op_0x67,
+        &&op_0x68, &&op_0x69, &&op_0x6a, &&op_0x6b, &&op_0x6c, &&op_0x6d, &&op_0x6e, &&op_0x6f,
+        &&op_0x70, &&op_0x71, &&op_0x72, &&op_0x73, &&op_0x74, &&op_0x75, &&op_0x76, &&op_0x77,
+        &&op_0x78, &&op_0x79, &&op_0x7a, &&op_0x7b, &&op_0x7c, &&op_0x7d, &&op_0x7e, &&op_0x7f,
+        &&op_0x80, &&op_0x81, &&op_0x82, &&op_0x83, &&op_0x84, &&op_0x85, &&op_0x86, &&op_0x87,
+        &&op_0x88, &&op_0x89, &&op_0x8a, &&op_0x8b, &&op_0x8c, &&op_0x8d, &&op_0x8e, &&op_0x8f,
+        &&op_0x90, &&op_0x91, &&op_0x92, &&op_0x93, &&op_0x94, &&op_0x95, &&op_0x96, &&op_0x97,
+        &&op_0x98, &&op_0x99, &&op_0x9a, &&op_0x9b, &&op_0x9c, &&op_0x9d, &&op_0x9e, &&op_0x9f,
+        &&op_0xa0, &&op_0xa1, &&op_0xa2, &&op_0xa3, &&op_0xa4, &&op_0xa5, &&op_0xa6, &&op_0xa7,
+        &&op_0xa8, &&op_0xa9, &&op_0xaa, &&op_0xab, &&op_0xac, &&op_0xad, &&op_0xae, &&op_0xaf,
+        &&op_0xb0, &&op_0xb1, &&op_0xb2, &&op_0xb3, &&op_0xb4, &&op_0xb5, &&op_0xb6, &&op_0xb7,
+        &&op_0xb8, &&op_0xb9, &&op_0xba, &&op_0xbb, &&op_0xbc, &&op_0xbd, &&op_0xbe, &&op_0xbf,
+        &&op_0xc0, &&op_0xc1, &&op_0xc2, &&op_0xc3, &&op_0xc4, &&op_0xc5, &&op_0xc6, &&op_0xc7,
+        &&op_0xc8, &&op_0xc9, &&op_0xca, &&op_0xcb, &&op_0xcc, &&op_0xcd, &&op_0xce, &&op_0xcf,
+        &&op_0xd0, &&op_0xd1, &&op_0xd2, &&op_undefined, &&op_0xd4, &&op_0xd5, &&op_0xd6, &&op_0xd7,
+        &&op_0xd8, &&op_0xd9, &&op_0xda, &&op_undefined, &&op_0xdc, &&op_undefined, &&op_0xde, &&op_0xdf,
+        &&op_0xe0, &&op_0xe1, &&op_0xe2, &&op_undefined, &&op_undefined, &&op_0xe5, &&op_0xe6, &&op_0xe7,
+        &&op_0xe8, &&op_0xe9, &&op_0xea, &&op_undefined, &&op_undefined, &&op_undefined, &&op_0xee, &&op_0xef,
+        &&op_0xf0, &&op_0xf1, &&op_0xf2, &&op_0xf3, &&op_undefined, &&op_0xf5, &&op_0xf6, &&op_0xf7,
+        &&op_0xf8, &&op_0xf9, &&op_0xfa, &&op_0xfb, &&op_undefined, &&op_undefined, &&op_0xfe, &&op_0xff,
+    };
+    static const void* const dispatch_table_cb[256] = {
+        &&cb_op_0x00, &&cb_op_0x01, &&cb_op_0x02, &&cb_op_0x03, &&cb_op_0x04, &&cb_op_0x05, &&cb_op_0x06, &&cb_op_0x07,
+        &&cb_op_0x08, &&cb_op_0x09, &&cb_op_0x0a, &&cb_op_0x0b, &&cb_op_0x0c, &&cb_op_0x0d, &&cb_op_0x0e, &&cb_op_0x0f,
+        &&cb_op_0x10, &&cb_op_0x11, &&cb_op_0x12, &&cb_op_0x13, &&cb_op_0x14, &&cb_op_0x15, &&cb_op_0x16, &&cb_op_0x17,
+        &&cb_op_0x18, &&cb_op_0x19, &&cb_op_0x1a, &&cb_op_0x1b, &&cb_op_0x1c, &&cb_op_0x1d, &&cb_op_0x1e, &&cb_op_0x1f,
+        &&cb_op_0x20, &&cb_op_0x21, &&cb_op_0x22, &&cb_op_0x23, &&cb_op_0x24, &&cb_op_0x25, &&cb_op_0x26, &&cb_op_0x27,
+        &&cb_op_0x28, &&cb_op_0x29, &&cb_op_0x2a, &&cb_op_0x2b, &&cb_op_0x2c, &&cb_op_0x2d, &&cb_op_0x2e, &&cb_op_0x2f,
+        &&cb_op_0x30, &&cb_op_0x31, &&cb_op_0x32, &&cb_op_0x33, &&cb_op_0x34, &&cb_op_0x35, &&cb_op_0x36, &&cb_op_0x37,
+        &&cb_op_0x38, &&cb_op_0x39, &&cb_op_0x3a, &&cb_op_0x3b, &&cb_op_0x3c, &&cb_op_0x3d, &&cb_op_0x3e, &&cb_op_0x3f,
+        &&cb_op_0x40, &&cb_op_0x41, &&cb_op_0x42, &&cb_op_0x43, &&cb_op_0x44, &&cb_op_0x45, &&cb_op_0x46, &&cb_op_0x47,
+        &&cb_op_0x48, &&cb_op_0x49, &&cb_op_0x4a, &&cb_op_0x4b, &&cb_op_0x4c, &&cb_op_0x4d, &&cb_op_0x4e, &&cb_op_0x4f,
+        &&cb_op_0x50, &&cb_op_0x51, &&cb_op_0x52, &&cb_op_0x53, &&cb_op_0x54, &&cb_op_0x55, &&cb_op_0x56, &&cb_op_0x57,
+        &&cb_op_0x58, &&cb_op_0x59, &&cb_op_0x5a, &&cb_op_0x5b, &&cb_op_0x5c, &&cb_op_0x5d, &&cb_op_0x5e, &&cb_op_0x5f,
+        &&cb_op_0x60, &&cb_op_0x61, &&cb_op_0x62, &&cb_op_0x63, &&cb_op_0x64, &&cb_op_0x65, &&cb_op_0x66, &&cb_op_0x67,
+        &&cb_op_0x68, &&cb_op_0x69, &&cb_op_0x6a, &&cb_op_0x6b, &&cb_op_0x6c, &&cb_op_0x6d, &&cb_op_0x6e, &&cb_op_0x6f,
+        &&cb_op_0x70, &&cb_op_0x71, &&cb_op_0x72, &&cb_op_0x73, &&cb_op_0x74, &&cb_op_0x75, &&cb_op_0x76, &&cb_op_0x77,
+        &&cb_op_0x78, &&cb_op_0x79, &&cb_op_0x7a, &&cb_op_0x7b, &&cb_op_0x7c, &&cb_op_0x7d, &&cb_op_0x7e, &&cb_op_0x7f,
+        &&cb_op_0x80, &&cb_op_0x81, &&cb_op_0x82, &&cb_op_0x83, &&cb_op_0x84, &&cb_op_0x85, &&cb_op_0x86, &&cb_op_0x87,
+        &&cb_op_0x88, &&cb_op_0x89, &&cb_op_0x8a, &&cb_op_0x8b, &&cb_op_0x8c, &&cb_op_0x8d, &&cb_op_0x8e, &&cb_op_0x8f,
+        &&cb_op_0x90, &&cb_op_0x91, &&cb_op_0x92, &&cb_op_0x93, &&cb_op_0x94, &&cb_op_0x95, &&cb_op_0x96, &&cb_op_0x97,
+        &&cb_op_0x98, &&cb_op_0x99, &&cb_op_0x9a, &&cb_op_0x9b, &&cb_op_0x9c, &&cb_op_0x9d, &&cb_op_0x9e, &&cb_op_0x9f,
+        &&cb_op_0xa0, &&cb_op_0xa1, &&cb_op_0xa2, &&cb_op_0xa3, &&cb_op_0xa4, &&cb_op_0xa5, &&cb_op_0xa6, &&cb_op_0xa7,
+        &&cb_op_0xa8, &&cb_op_0xa9, &&cb_op_0xaa, &&cb_op_0xab, &&cb_op_0xac, &&cb_op_0xad, &&cb_op_0xae, &&cb_op_0xaf,
+        &&cb_op_0xb0, &&cb_op_0xb1, &&cb_op_0xb2, &&cb_op_0xb3, &&cb_op_0xb4, &&cb_op_0xb5, &&cb_op_0xb6, &&cb_op_0xb7,
+        &&cb_op_0xb8, &&cb_op_0xb9, &&cb_op_0xba, &&cb_op_0xbb, &&cb_op_0xbc, &&cb_op_0xbd, &&cb_op_0xbe, &&cb_op_0xbf,
+        &&cb_op_0xc0, &&cb_op_0xc1, &&cb_op_0xc2, &&cb_op_0xc3, &&cb_op_0xc4, &&cb_op_0xc5, &&cb_op_0xc6, &&cb_op_0xc7,
+        &&cb_op_0xc8, &&cb_op_0xc9, &&cb_op_0xca, &&cb_op_0xcb, &&cb_op_0xcc, &&cb_op_0xcd, &&cb_op_0xce, &&cb_op_0xcf,
+        &&cb_op_0xd0, &&cb_op_0xd1, &&cb_op_0xd2, &&cb_op_0xd3, &&cb_op_0xd4, &&cb_op_0xd5, &&cb_op_0xd6, &&cb_op_0xd7,
+        &&cb_op_0xd8, &&cb_op_0xd9, &&cb_op_0xda, &&cb_op_0xdb, &&cb_op_0xdc, &&cb_op_0xdd, &&cb_op_0xde, &&cb_op_0xdf,
+        &&cb_op_0xe0, &&cb_op_0xe1, &&cb_op_0xe2, &&cb_op_0xe3, &&cb_op_0xe4, &&cb_op_0xe5, &&cb_op_0xe6, &&cb_op_0xe7,
+        &&cb_op_0xe8, &&cb_op_0xe9, &&cb_op_0xea, &&cb_op_0xeb, &&cb_op_0xec, &&cb_op_0xed, &&cb_op_0xee, &&cb_op_0xef,
+        &&cb_op_0xf0, &&cb_op_0xf1, &&cb_op_0xf2, &&cb_op_0xf3, &&cb_op_0xf4, &&cb_op_0xf5, &&cb_op_0xf6, &&cb_op_0xf7,
+        &&cb_op_0xf8, &&cb_op_0xf9, &&cb_op_0xfa, &&cb_op_0xfb, &&cb_op_0xfc, &&cb_op_0xfd, &&cb_op_0xfe, &&cb_op_0xff,
+    };
+#endif
+
+    DISPATCH(dispatch_table, opcode) {
+
+        OPCODE(0x00): nop(gb); NEXT;                                                        // NOP
+        OPCODE(0x01): load16bit_operand(gb, &gb->registers.bc, operand); NEXT;                    // LD BC, 0x%04X
+        OPCODE(0x02): load8bit_to_mem(gb, &gb->registers.bc, &gb->registers.a); NEXT;                 // LD (BC), A
+        OPCODE(0x03): inc16bit(gb, &gb->registers.bc); NEXT;                                      // INC BC
+        OPCODE(0x04): inc8bit(gb, &gb->registers.b); NEXT;                                        // INC B
+        OPCODE(0x05): dec8bit(gb, &gb->registers.b); NEXT;                                        // DEC B
+        OPCODE(0x06): load8bit_operand(gb, &gb->registers.b, operand); NEXT;                      // LD B, 0x%02X
+        OPCODE(0x07): rlca_op(gb); NEXT;                                                    // RLCA
+        OPCODE(0x08): load16bit_sp_to_mem(gb, operand); NEXT;                                 // LD (0x%04X), SP
+        OPCODE(0x09): add16bit(gb, &gb->registers.bc); NEXT;                                      // ADD HL, BC
+        OPCODE(0x0a): load8bit_from_mem(gb, &gb->registers.a, &gb->registers.bc); NEXT;               // LD A, (BC)
+        OPCODE(0x0b): dec16bit(gb, &gb->registers.bc); NEXT;                                      // DEC BC
+        OPCODE(0x0c): inc8bit(gb, &gb->registers.c); NEXT;                                        // INC C
+        OPCODE(0x0d): dec8bit(gb, &gb->registers.c); NEXT;                                        // DEC C
+        OPCODE(0x0e): load8bit_operand(gb, &gb->registers.c, operand); NEXT;                      // LD C, 0x%02X
+        OPCODE(0x0f): rrca_op(gb); NEXT;                                                    // RRCA
+        OPCODE(0x10): stop_cpu(gb); NEXT;                                                   // STOP
+        OPCODE(0x11): load16bit_operand(gb, &gb->registers.de, operand); NEXT;                    // LD DE, 0x%04X
+        OPCODE(0x12): load8bit_to_mem(gb, &gb->registers.de, &gb->registers.a); NEXT;                 // LD (DE), A
+        OPCODE(0x13): inc16bit(gb, &gb->registers.de); NEXT;                                      // INC DE
+        OPCODE(0x14): inc8bit(gb, &gb->registers.d); NEXT;                                        // INC D
+        OPCODE(0x15): dec8bit(gb, &gb->registers.d); NEXT;                                        // DEC D
+        OPCODE(0x16): load8bit_operand(gb, &gb->registers.d, operand); NEXT;                      // LD D, 0x%02X
+        OPCODE(0x17): rla_op(gb); NEXT;                                                     // RLA
+        OPCODE(0x18): jump_add_operand(gb, operand); NEXT;                                    // JR 0x%02X
+        OPCODE(0x19): add16bit(gb, &gb->registers.de); NEXT;                                      // ADD HL, DE
+        OPCODE(0x1a): load8bit_from_mem(gb, &gb->registers.a, &gb->registers.de); NEXT;               // LD A, (DE)
+        OPCODE(0x1b): dec16bit(gb, &gb->registers.de); NEXT;                                      // DEC DE
+        OPCODE(0x1c): inc8bit(gb, &gb->registers.e); NEXT;                                        // INC E
+        OPCODE(0x1d): dec8bit(gb, &gb->registers.e); NEXT;                                        // DEC E
+        OPCODE(0x1e): load8bit_operand(gb, &gb->registers.e, operand); NEXT;                      // LD E, 0x%02X
+        OPCODE(0x1f): rra_op(gb); NEXT;                                                     // RRA
+        OPCODE(0x20): jump_condition_add_operand(gb, FLAG_Z, 0, operand); NEXT;               // JR NZ, 0x%02X
+        OPCODE(0x21): load16bit_operand(gb, &gb->registers.hl, operand); NEXT;                    // LD HL, 0x%04X
+        OPCODE(0x22): load8bit_inc_to_mem(gb); NEXT;                                        // LDI (HL), A
+        OPCODE(0x23): inc16bit(gb, &gb->registers.hl); NEXT;                                      // INC HL
+        OPCODE(0x24): inc8bit(gb, &gb->registers.h); NEXT;                                        // INC H
+        OPCODE(0x25): dec8bit(gb, &gb->registers.h); NEXT;                                        // DEC H
+        OPCODE(0x26): load8bit_operand(gb, &gb->registers.h, operand); NEXT;                      // LD H, 0x%02X
+        OPCODE(0x27): daa_op(gb); NEXT;                                                     // DAA
+        OPCODE(0x28): jump_condition_add_operand(gb, FLAG_Z, 1, operand); NEXT;               // JR Z, 0x%02X
+        OPCODE(0x29): add16bit(gb, &gb->registers.hl); NEXT;                                      // ADD HL, HL
+        OPCODE(0x2a): load8bit_inc_from_mem(gb); NEXT;                                      // LDI A, (HL)
+        OPCODE(0x2b): dec16bit(gb, &gb->registers.hl); NEXT;                                      // DEC HL
+        OPCODE(0x2c): inc8bit(gb, &gb->registers.l); NEXT;                                        // INC L
+        OPCODE(0x2d): dec8bit(gb, &gb->registers.l); NEXT;                                        // DEC L
+        OPCODE(0x2e): load8bit_operand(gb, &gb->registers.l, operand); NEXT;                      // LD L, 0x%02X
+        OPCODE(0x2f): complement(gb); NEXT;                                                 // CPL
+        OPCODE(0x30): jump_condition_add_operand(gb, FLAG_CY, 0, operand); NEXT;              // JR NC, 0x%02X
+        OPCODE(0x31): load16bit_operand(gb, &gb->registers.sp, operand); NEXT;                    // LD SP, 0x%04X
+        OPCODE(0x32): load8bit_dec_to_mem(gb); NEXT;                                        // LDD (HL), A
+        OPCODE(0x33): inc16bit(gb, &gb->registers.sp); NEXT;                                      // INC SP
+        OPCODE(0x34): inc8bit_from_mem(gb); NEXT;                                           // INC (HL)
+        OPCODE(0x35): dec8bit_from_mem(gb); NEXT;                                           // DEC (HL)
+        OPCODE(0x36): load8bit_to_mem_from_operand(gb, &gb->registers.hl, operand); NEXT;         // LD (HL), 0x%02X
+        OPCODE(0x37): scf_op(gb); NEXT;                                                     // SCF
+        OPCODE(0x38): jump_condition_add_operand(gb, FLAG_CY, 1, operand); NEXT;              // JR C, 0x%02X
+        OPCODE(0x39): add16bit(gb, &gb->registers.sp); NEXT;                                      // ADD HL, SP
+        OPCODE(0x3a): load8bit_dec_from_mem(gb); NEXT;                                      // LDD A, (HL)
+        OPCODE(0x3b): dec16bit(gb, &gb->registers.sp); NEXT;                                      // DEC SP
+        OPCODE(0x3c): inc8bit(gb, &gb->registers.a); NEXT;                                        // INC A
+        OPCODE(0x3d): dec8bit(gb, &gb->registers.a); NEXT;                                        // DEC A
+        OPCODE(0x3e): load8bit_operand(gb, &gb->registers.a, operand); NEXT;                      // LD A, 0x%02X
+        OPCODE(0x3f): ccf_op(gb); NEXT;                                                     // CCF
+        OPCODE(0x40): load8bit(gb, &gb->registers.b, &gb->registers.b); NEXT;                         // LD B, B
+        OPCODE(0x41): load8bit(gb, &gb->registers.b, &gb->registers.c); NEXT;                         // LD B, C
+        OPCODE(0x42): load8bit(gb, &gb->registers.b, &gb->registers.d); NEXT;                         // LD B, D
+        OPCODE(0x43): load8bit(gb, &gb->registers.b, &gb->registers.e); NEXT;                         // LD B, E
+        OPCODE(0x44): load8bit(gb, &gb->registers.b, &gb->registers.h); NEXT;                         // LD B, H
+        OPCODE(0x45): load8bit(gb, &gb->registers.b, &gb->registers.l); NEXT;                         // LD B, L
+        OPCODE(0x46): load8bit_from_mem(gb, &gb->registers.b, &gb->registers.hl); NEXT;               // LD B, (HL)
+        OPCODE(0x47): load8bit(gb, &gb->registers.b, &gb->registers.a); NEXT;                         // LD B, A
+        OPCODE(0x48): load8bit(gb, &gb->registers.c, &gb->registers.b); NEXT;                         // LD C, B
+        OPCODE(0x49): load8bit(gb, &gb->registers.c, &gb->registers.c); NEXT;                         // LD C, C
+        OPCODE(0x4a): load8bit(gb, &gb->registers.c, &gb->registers.d); NEXT;                         // LD C, D
+        OPCODE(0x4b): load8bit(gb, &gb->registers.c, &gb->registers.e); NEXT;                         // LD C, E
+        OPCODE(0x4c): load8bit(gb, &gb->registers.c, &gb->registers.h); NEXT;                         // LD C, H
+        OPCODE(0x4d): load8bit(gb, &gb->registers.c, &gb->registers.l); NEXT;                         // LD C, L
+        OPCODE(0x4e): load8bit_from_mem(gb, &gb->registers.c, &gb->registers.hl); NEXT;               // LD C, (HL)
+        OPCODE(0x4f): load8bit(gb, &gb->registers.c, &gb->registers.a); NEXT;                         // LD C, A
+        OPCODE(0x50): load8bit(gb, &gb->registers.d, &gb->registers.b); NEXT;                         // LD D, B
+        OPCODE(0x51): load8bit(gb, &gb->registers.d, &gb->registers.c); NEXT;                         // LD D, C
+        OPCODE(0x52): load8bit_debug(gb, &gb->registers.d, &gb->registers.d); NEXT;                   // LD D, D
+        OPCODE(0x53): load8bit(gb, &gb->registers.d, &gb->registers.e); NEXT;                         // LD D, E
+        OPCODE(0x54): load8bit(gb, &gb->registers.d, &gb->registers.h); NEXT;                         // LD D, H
+        OPCODE(0x55): load8bit(gb, &gb->registers.d, &gb->registers.l); NEXT;                         // LD D, L
+        OPCODE(0x56): load8bit_from_mem(gb, &gb->registers.d, &gb->registers.hl); NEXT;               // LD D, (HL)
+        OPCODE(0x57): load8bit(gb, &gb->registers.d, &gb->registers.a); NEXT;                         // LD D, A
+        OPCODE(0x58): load8bit(gb, &gb->registers.e, &gb->registers.b); NEXT;                         // LD E, B
+        OPCODE(0x59): load8bit(gb, &gb->registers.e, &gb->registers.c); NEXT;                         // LD E, C
+        OPCODE(0x5a): load8bit(gb, &gb->registers.e, &gb->registers.d); NEXT;                         // LD E, D
+        OPCODE(0x5b): load8bit(gb, &gb->registers.e, &gb->registers.e); NEXT;                         // LD E, E
+        OPCODE(0x5c): load8bit(gb, &gb->registers.e, &gb->registers.h); NEXT;                         // LD E, H
+        OPCODE(0x5d): load8bit(gb, &gb->registers.e, &gb->registers.l); NEXT;                         // LD E, L
+        OPCODE(0x5e): load8bit_from_mem(gb, &gb->registers.e, &gb->registers.hl); NEXT;               // LD E, (HL)
+        OPCODE(0x5f): load8bit(gb, &gb->registers.e, &gb->registers.a); NEXT;                         // LD E, A
+        OPCODE(0x60): load8bit(gb, &gb->registers.h, &gb->registers.b); NEXT;                         // LD H, B
+        OPCODE(0x61): load8bit(gb, &gb->registers.h, &gb->registers.c); NEXT;                         // LD H, C
+        OPCODE(0x62): load8bit(gb, &gb->registers.h, &gb->registers.d); NEXT;                         // LD H, D
+        OPCODE(0x63): load8bit(gb, &gb->registers.h, &gb->registers.e); NEXT;                         // LD H, E
+        OPCODE(0x64): load8bit(gb, &gb->registers.h, &gb->registers.h); NEXT;                         // LD H, H
+        OPCODE(0x65): load8bit(gb, &gb->registers.h, &gb->registers.l); NEXT;                         // LD H, L
+        OPCODE(0x66): load8bit_from_mem(gb, &gb->registers.h, &gb->registers.hl); NEXT;               // LD H, (HL)
+        OPCODE(0x67): load8bit(gb, &gb->registers.h, &gb->registers.a); NEXT;                         // LD H, A
+        OPCODE(0x68): load8bit(gb, &gb->registers.l, &gb->registers.b); NEXT;                         // LD L, B
+        OPCODE(0x69): load8bit(gb, &gb->registers.l, &gb->registers.c); NEXT;                         // LD L, C
+        OPCODE(0x6a): load8bit(gb, &gb->registers.l, &gb->registers.d); NEXT;                         // LD L, D
+        OPCODE(0x6b): load8bit(gb, &gb->registers.l, &gb->registers.e); NEXT;                         // LD L, E
+        OPCODE(0x6c): load8bit(gb, &gb->registers.l, &gb->registers.h); NEXT;                         // LD L, H
+        OPCODE(0x6d): load8bit(gb, &gb->registers.l, &gb->registers.l); NEXT;                         // LD L, L
+        OPCODE(0x6e): load8bit_from_mem(gb, &gb->registers.l, &gb->registers.hl); NEXT;               // LD L, (HL)
+        OPCODE(0x6f): load8bit(gb, &gb->registers.l, &gb->registers.a); NEXT;                         // LD L, A
+        OPCODE(0x70): load8bit_to_mem(gb, &gb->registers.hl, &gb->registers.b); NEXT;                 // LD (HL), B
+        OPCODE(0x71): load8bit_to_mem(gb, &gb->registers.hl, &gb->registers.c); NEXT;                 // LD (HL), C
+        OPCODE(0x72): load8bit_to_mem(gb, &gb->registers.hl, &gb->registers.d); NEXT;                 // LD (HL), D
+        OPCODE(0x73): load8bit_to_mem(gb, &gb->registers.hl, &gb->registers.e); NEXT;                 // LD (HL), E
+        OPCODE(0x74): load8bit_to_mem(gb, &gb->registers.hl, &gb->registers.h); NEXT;                 // LD (HL), H
+        OPCODE(0x75): load8bit_to_mem(gb, &gb->registers.hl, &gb->registers.l); NEXT;                 // LD (HL), L
+        OPCODE(0x76): halt(gb); NEXT;                                                       // HALT
+        OPCODE(0x77): load8bit_to_mem(gb, &gb->registers.hl, &gb->registers.a); NEXT;                 // LD (HL), A
+        OPCODE(0x78): load8bit(gb, &gb->registers.a, &gb->registers.b); NEXT;                         // LD A, B
+        OPCODE(0x79): load8bit(gb, &gb->registers.a, &gb->registers.c); NEXT;                         // LD A, C
+        OPCODE(0x7a): load8bit(gb, &gb->registers.a, &gb->registers.d); NEXT;                         // LD A, D
+        OPCODE(0x7b): load8bit(gb, &gb->registers.a, &gb->registers.e); NEXT;                         // LD A, E
+        OPCODE(0x7c): load8bit(gb, &gb->registers.a, &gb->registers.h); NEXT;                         // LD A, H
+        OPCODE(0x7d): load8bit(gb, &gb->registers.a, &gb->registers.l); NEXT;                         // LD A, L
+        OPCODE(0x7e): load8bit_from_mem(gb, &gb->registers.a, &gb->registers.hl); NEXT;               // LD A, (HL)
+        OPCODE(0x7f): load8bit(gb, &gb->registers.a, &gb->registers.a); NEXT;                         // LD A, A
+        OPCODE(0x80): add8bit(gb, &gb->registers.b); NEXT;                                        // ADD A, B
+        OPCODE(0x81): add8bit(gb, &gb->registers.c); NEXT;                                        // ADD A, C
+        OPCODE(0x82): add8bit(gb, &gb->registers.d); NEXT;                                        // ADD A, D
+        OPCODE(0x83): add8bit(gb, &gb->registers.e); NEXT;                                        // ADD A, E
+        OPCODE(0x84): add8bit(gb, &gb->registers.h); NEXT;                                        // ADD A, H
+        OPCODE(0x85): add8bit(gb, &gb->registers.l); NEXT;                                        // ADD A, L
+        OPCODE(0x86): add8bit_from_mem(gb); NEXT;                                           // ADD A, (HL)
+        OPCODE(0x87): add8bit(gb, &gb->registers.a); NEXT;                                        // ADD A
+        OPCODE(0x88): adc(gb, &gb->registers.b); NEXT;                                            // ADC B
+        OPCODE(0x89): adc(gb, &gb->registers.c); NEXT;                                            // ADC C
+        OPCODE(0x8a): adc(gb, &gb->registers.d); NEXT;                                            // ADC D
+        OPCODE(0x8b): adc(gb, &gb->registers.e); NEXT;                                            // ADC E
+        OPCODE(0x8c): adc(gb, &gb->registers.h); NEXT;                                            // ADC H
+        OPCODE(0x8d): adc(gb, &gb->registers.l); NEXT;                                            // ADC L
+        OPCODE(0x8e): adc_from_mem(gb, &gb->registers.hl); NEXT;                                  // ADC (HL)
+        OPCODE(0x8f): adc(gb, &gb->registers.a); NEXT;                                            // ADC A
+        OPCODE(0x90): sub(gb, &gb->registers.b); NEXT;                                            // SUB B
+        OPCODE(0x91): sub(gb, &gb->registers.c); NEXT;                                            // SUB C
+        OPCODE(0x92): sub(gb, &gb->registers.d); NEXT;                                            // SUB D
+        OPCODE(0x93): sub(gb, &gb->registers.e); NEXT;                                            // SUB E
+        OPCODE(0x94): sub(gb, &gb->registers.h); NEXT;                                            // SUB H
+        OPCODE(0x95): sub(gb, &gb->registers.l); NEXT;                                            // SUB L
+        OPCODE(0x96): sub_from_mem(gb); NEXT;                                               // SUB (HL)
+        OPCODE(0x97): sub(gb, &gb->registers.a); NEXT;                                            // SUB A
+        OPCODE(0x98): sbc(gb, &gb->registers.b); NEXT;                                            // SBC B
+        OPCODE(0x99): sbc(gb, &gb->registers.c); NEXT;                                            // SBC C
+        OPCODE(0x9a): sbc(gb, &gb->registers.d); NEXT;                                            // SBC D
+        OPCODE(0x9b): sbc(gb, &gb->registers.e); NEXT;                                            // SBC E
+        OPCODE(0x9c): sbc(gb, &gb->registers.h); NEXT;                                            // SBC H
+        OPCODE(0x9d): sbc(gb, &gb->registers.l); NEXT;                                            // SBC L
+        OPCODE(0x9e): sbc_from_mem(gb); NEXT;                                               // SBC (HL)
+        OPCODE(0x9f): sbc(gb, &gb->registers.a); NEXT;                                            // SBC A
+        OPCODE(0xa0): and_reg(gb, &gb->registers.b); NEXT;                                        // AND B
+        OPCODE(0xa1): and_reg(gb, &gb->registers.c); NEXT;                                        // AND C
+        OPCODE(0xa2): and_reg(gb, &gb->registers.d); NEXT;                                        // AND D
+        OPCODE(0xa3): and_reg(gb, &gb->registers.e); NEXT;                                        // AND E
+        OPCODE(0xa4): and_reg(gb, &gb->registers.h); NEXT;                                        // AND H
+        OPCODE(0xa5): and_reg(gb, &gb->registers.l); NEXT;                                        // AND L
+        OPCODE(0xa6): and_from_mem(gb); NEXT;                                               // AND (HL)
+        OPCODE(0xa7): and_reg(gb, &gb->registers.a); NEXT;                                        // AND A
+        OPCODE(0xa8): xor_reg(gb, &gb->registers.b); NEXT;                                        // XOR B
+        OPCODE(0xa9): xor_reg(gb, &gb->registers.c); NEXT;                                        // XOR C
+        OPCODE(0xaa): xor_reg(gb, &gb->registers.d); NEXT;                                        // XOR D
+        OPCODE(0xab): xor_reg(gb, &gb->registers.e); NEXT;                                        // XOR E
+        OPCODE(0xac): xor_reg(gb, &gb->registers.h); NEXT;                                        // XOR H
+        OPCODE(0xad): xor_reg(gb, &gb->registers.l); NEXT;                                        // XOR L
+        OPCODE(0xae): xor_reg_from_mem(gb, &gb->registers.hl); NEXT;                              // XOR (HL)
+        OPCODE(0xaf): xor_reg(gb, &gb->registers.a); NEXT;                                        // XOR A
+        OPCODE(0xb0): or_reg(gb, &gb->registers.b); NEXT;                                         // OR B
+        OPCODE(0xb1): or_reg(gb, &gb->registers.c); NEXT;                                         // OR C
+        OPCODE(0xb2): or_reg(gb, &gb->registers.d); NEXT;                                         // OR D
+        OPCODE(0xb3): or_reg(gb, &gb->registers.e); NEXT;                                         // OR E
+        OPCODE(0xb4): or_reg(gb, &gb->registers.h); NEXT;                                         // OR H
+        OPCODE(0xb5): or_reg(gb, &gb->registers.l); NEXT;                                         // OR L
+        OPCODE(0xb6): or_from_mem(gb); NEXT;                                                // OR (HL)
+        OPCODE(0xb7): or_reg(gb, &gb->registers.a); NEXT;                                         // OR A
+        OPCODE(0xb8): cp_op(gb, &gb->registers.b); NEXT;                                          // CP B
+        OPCODE(0xb9): cp_op(gb, &gb->registers.c); NEXT;                                          // CP C
+        OPCODE(0xba): cp_op(gb, &gb->registers.d); NEXT;                                          // CP D
+        OPCODE(0xbb): cp_op(gb, &gb->registers.e); NEXT;                                          // CP E
+        OPCODE(0xbc): cp_op(gb, &gb->registers.h); NEXT;                                          // CP H
+        OPCODE(0xbd): cp_op(gb, &gb->registers.l); NEXT;                                          // CP L
+        OPCODE(0xbe): cp_mem(gb, &gb->registers.hl); NEXT;                                        // CP (HL)
+        OPCODE(0xbf): cp_op(gb, &gb->registers.a); NEXT;                                          // CP A
+        OPCODE(0xc0): ret_condition(gb, FLAG_Z, 0); NEXT;                                     // RET NZ
+        OPCODE(0xc1): pop_op(gb, &gb->registers.b, &gb->registers.c); NEXT;                           // POP BC
+        OPCODE(0xc2): jump_condition_operand(gb, FLAG_Z, 0, operand); NEXT;                   // JP NZ, 0x%04X
+        OPCODE(0xc3): jump_operand(gb, operand); NEXT;                                        // JP 0x%04X
+        OPCODE(0xc4): call_condition(gb, FLAG_Z, 0, operand); NEXT;                           // CALL NZ, 0x%04X
+        OPCODE(0xc5): push_op(gb, &gb->registers.b, &gb->registers.c); NEXT;                          // PUSH BC
+        OPCODE(0xc6): add8bit_operand(gb, operand); NEXT;                                     // ADD A, 0x%02X
+        OPCODE(0xc7): rst(gb, 0x00); NEXT;                                                    // RST 0x00
+        OPCODE(0xc8): ret_condition(gb, FLAG_Z, 1); NEXT;                                     // RET Z
+        OPCODE(0xc9): ret_op(gb); NEXT;                                                     // RET
+        OPCODE(0xca): jump_condition_operand(gb, FLAG_Z, 1, operand); NEXT;                   // JP Z, 0x%04X
+        OPCODE(0xcc): call_condition(gb, FLAG_Z, 1, operand); NEXT;                           // CALL Z, 0x%04X
+        OPCODE(0xcd): call_operand(gb, operand); NEXT;                                        // CALL 0x%04X
+        OPCODE(0xce): adc_operand(gb, operand); NEXT;                                         // ADC 0x%02X
+        OPCODE(0xcf): rst(gb, 0x08); NEXT;                                                    // RST 0x08
+        OPCODE(0xd0): ret_condition(gb, FLAG_CY, 0); NEXT;                                    // RET NC
+        OPCODE(0xd1): pop_op(gb, &gb->registers.d, &gb->registers.e); NEXT;                           // POP DE
+        OPCODE(0xd2): jump_condition_operand(gb, FLAG_CY, 0, operand); NEXT;                  // JP NC, 0x%04X
+        OPCODE(0xd4): call_condition(gb, FLAG_CY, 0, operand); NEXT;                          // CALL NC, 0x%04X
+        OPCODE(0xd5): push_op(gb, &gb->registers.d, &gb->registers.e); NEXT;                          // PUSH DE
+        OPCODE(0xd6): sub_operand(gb, operand); NEXT;                                         // SUB 0x%02X
+        OPCODE(0xd7): rst(gb, 0x10); NEXT;                                                    // RST 0x10
+        OPCODE(0xd8): ret_condition(gb, FLAG_CY, 1); NEXT;                                    // RET C
+        OPCODE(0xd9): ret_interrupt(gb); NEXT;                                              // RETI
+        OPCODE(0xda): jump_condition_operand(gb, FLAG_CY, 1, operand); NEXT;                  // JP C, 0x%04X
+        OPCODE(0xdc): call_condition(gb, FLAG_CY, 1, operand); NEXT;                          // CALL C, 0x%04X
+        OPCODE(0xde): sbc_operand(gb, operand); NEXT;                                         // SBC 0x%02X
+        OPCODE(0xdf): rst(gb, 0x18); NEXT;                                                    // RST 0x18
+        OPCODE(0xe0): load8bit_to_io_mem_operand(gb, &gb->registers.a, operand); NEXT;            // LD (0xFF00 + 0x%02X), A
+        OPCODE(0xe1): pop_op(gb, &gb->registers.h, &gb->registers.l); NEXT;                           // POP HL
+        OPCODE(0xe2): load8bit_to_io_mem(gb, &gb->registers.c, &gb->registers.a); NEXT;               // LD (0xFF00 + C), A
+        OPCODE(0xe5): push_op(gb, &gb->registers.h, &gb->registers.l); NEXT;                          // PUSH HL
+        OPCODE(0xe6): and_operand(gb, operand); NEXT;                                         // AND 0x%02X
+        OPCODE(0xe7): rst(gb, 0x20); NEXT;                                                    // RST 0x20
+        OPCODE(0xe8): add16bit_sp_operand(gb, operand); NEXT;                                 // ADD SP,0x%02X
+        OPCODE(0xe9): jump(gb, &gb->registers.hl); NEXT;                                          // JP HL
+        OPCODE(0xea): load8bit_to_mem_operand(gb, &gb->registers.a, operand); NEXT;               // LD (0x%04X), A
+        OPCODE(0xee): xor_operand(gb, operand); NEXT;                                         // XOR 0x%02X
+        OPCODE(0xef): rst(gb, 0x28); NEXT;                                                    // RST 0x28
+        OPCODE(0xf0): load8bit_from_io_mem_operand(gb, &gb->registers.a, operand); NEXT;          // LD A, (0xFF00 + 0x%02X)
+        OPCODE(0xf1): pop_op(gb, &gb->registers.a, &gb->registers.f); NEXT;                           // POP AF
+        OPCODE(0xf2): load8bit_from_io_mem(gb, &gb->registers.a, &gb->registers.c); NEXT;             // LD A, (0xFF00 + C)
+        OPCODE(0xf3): disable_interrupts(gb); NEXT;                                         // DI
+        OPCODE(0xf5): push_op(gb, &gb->registers.a, &gb->registers.f); NEXT;                          // PUSH AF
+        OPCODE(0xf6): or_operand(gb, operand); NEXT;                                          // OR 0x%02X
+        OPCODE(0xf7): rst(gb, 0x30); NEXT;                                                    // RST 0x30
+        OPCODE(0xf8): load16bit_sp_operand_offset(gb, operand); NEXT;                         // LD HL, SP+0x%02X
+        OPCODE(0xf9): load16bit(gb, &gb->registers.sp, &gb->registers.hl); NEXT;                      // LD SP, HL
+        OPCODE(0xfa): load8bit_from_mem_operand(gb, &gb->registers.a, operand); NEXT;             // LD A, (0x%04X)
+        OPCODE(0xfb): enable_interrupts(gb); NEXT;                                          // EI
+        OPCODE(0xfe): cp_operand(gb, operand); NEXT;                                          // CP 0x%02X
+        OPCODE(0xff): rst(gb, 0x38); NEXT;                                                    // RST 0x38
+        OPCODE(0xcb): goto prefix_cb;                                                      // CB %02X
+
+        UNDEFINED_OPCODE:
+            printf("Operation not defined: %s -> 0x%x in PC: %x\n", instructions_disassembly[opcode], opcode, gb->registers.pc-1);
+#ifdef TRACE
+            trace_dump(gb, TRACE_FILE);
+#endif
+            exit(1);
+    }
 
-    int time;   /* time is in cycles */
-    extra_instruction_cycles = 0;
-    struct instruction instruction;
+prefix_cb:
+    DISPATCH(dispatch_table_cb, (unsigned char) operand) {
+
+        CB_OPCODE(0x00): rlc_op(gb, &gb->registers.b); NEXT_CB;                                   // RLC B
+        CB_OPCODE(0x01): rlc_op(gb, &gb->registers.c); NEXT_CB;                                   // RLC C
+        CB_OPCODE(0x02): rlc_op(gb, &gb->registers.d); NEXT_CB;                                   // RLC D
+        CB_OPCODE(0x03): rlc_op(gb, &gb->registers.e); NEXT_CB;                                   // RLC E
+        CB_OPCODE(0x04): rlc_op(gb, &gb->registers.h); NEXT_CB;                                   // RLC H
+        CB_OPCODE(0x05): rlc_op(gb, &gb->registers.l); NEXT_CB;                                   // RLC L
+        CB_OPCODE(0x06): rlc_from_mem(gb); NEXT_CB;                                         // RLC (HL)
+        CB_OPCODE(0x07): rlc_op(gb, &gb->registers.a); NEXT_CB;                                   // RLC A
+        CB_OPCODE(0x08): rrc_op(gb, &gb->registers.b); NEXT_CB;                                   // RRC B
+        CB_OPCODE(0x09): rrc_op(gb, &gb->registers.c); NEXT_CB;                                   // RRC C
+        CB_OPCODE(0x0a): rrc_op(gb, &gb->registers.d); NEXT_CB;                                   // RRC D
+        CB_OPCODE(0x0b): rrc_op(gb, &gb->registers.e); NEXT_CB;                                   // RRC E
+        CB_OPCODE(0x0c): rrc_op(gb, &gb->registers.h); NEXT_CB;                                   // RRC H
+        CB_OPCODE(0x0d): rrc_op(gb, &gb->registers.l); NEXT_CB;                                   // RRC L
+        CB_OPCODE(0x0e): rrc_from_mem(gb); NEXT_CB;                                         // RRC (HL)
+        CB_OPCODE(0x0f): rrc_op(gb, &gb->registers.a); NEXT_CB;                                   // RRC A
+        CB_OPCODE(0x10): rl_op(gb, &gb->registers.b); NEXT_CB;                                    // RL B
+        CB_OPCODE(0x11): rl_op(gb, &gb->registers.c); NEXT_CB;                                    // RL C
+        CB_OPCODE(0x12): rl_op(gb, &gb->registers.d); NEXT_CB;                                    // RL D
+        CB_OPCODE(0x13): rl_op(gb, &gb->registers.e); NEXT_CB;                                    // RL E
+        CB_OPCODE(0x14): rl_op(gb, &gb->registers.h); NEXT_CB;                                    // RL H
+        CB_OPCODE(0x15): rl_op(gb, &gb->registers.l); NEXT_CB;                                    // RL L
+        CB_OPCODE(0x16): rl_from_mem(gb); NEXT_CB;                                          // RL (HL)
+        CB_OPCODE(0x17): rl_op(gb, &gb->registers.a); NEXT_CB;                                    // RL A
+        CB_OPCODE(0x18): rr_op(gb, &gb->registers.b); NEXT_CB;                                    // RR B
+        CB_OPCODE(0x19): rr_op(gb, &gb->registers.c); NEXT_CB;                                    // RR C
+        CB_OPCODE(0x1a): rr_op(gb, &gb->registers.d); NEXT_CB;                                    // RR D
+        CB_OPCODE(0x1b): rr_op(gb, &gb->registers.e); NEXT_CB;                                    // RR E
+        CB_OPCODE(0x1c): rr_op(gb, &gb->registers.h); NEXT_CB;                                    // RR H
+        CB_OPCODE(0x1d): rr_op(gb, &gb->registers.l); NEXT_CB;                                    // RR L
+        CB_OPCODE(0x1e): rr_from_mem(gb); NEXT_CB;                                          // RR (HL)
+        CB_OPCODE(0x1f): rr_op(gb, &gb->registers.a); NEXT_CB;                                    // RR A
+        CB_OPCODE(0x20): sla_op(gb, &gb->registers.b); NEXT_CB;                                   // SLA B
+        CB_OPCODE(0x21): sla_op(gb, &gb->registers.c); NEXT_CB;                                   // SLA C
+        CB_OPCODE(0x22): sla_op(gb, &gb->registers.d); NEXT_CB;                                   // SLA D
+        CB_OPCODE(0x23): sla_op(gb, &gb->registers.e); NEXT_CB;                                   // SLA E
+        CB_OPCODE(0x24): sla_op(gb, &gb->registers.h); NEXT_CB;                                   // SLA H
+        CB_OPCODE(0x25): sla_op(gb, &gb->registers.l); NEXT_CB;                                   // SLA L
+        CB_OPCODE(0x26): sla_from_mem(gb); NEXT_CB;                                         // SLA (HL)
+        CB_OPCODE(0x27): sla_op(gb, &gb->registers.a); NEXT_CB;                                   // SLA A
+        CB_OPCODE(0x28): sra_op(gb, &gb->registers.b); NEXT_CB;                                   // SRA B
+        CB_OPCODE(0x29): sra_op(gb, &gb->registers.c); NEXT_CB;                                   // SRA C
+        CB_OPCODE(0x2a): sra_op(gb, &gb->registers.d); NEXT_CB;                                   // SRA D
+        CB_OPCODE(0x2b): sra_op(gb, &gb->registers.e); NEXT_CB;                                   // SRA E
+        CB_OPCODE(0x2c): sra_op(gb, &gb->registers.h); NEXT_CB;                                   // SRA H
+        CB_OPCODE(0x2d): sra_op(gb, &gb->registers.l); NEXT_CB;                                   // SRA L
+        CB_OPCODE(0x2e): sra_from_mem(gb); NEXT_CB;                                         // SRA (HL)
+        CB_OPCODE(0x2f): sra_op(gb, &gb->registers.a); NEXT_CB;                                   // SRA A
+        CB_OPCODE(0x30): swap(gb, &gb->registers.b); NEXT_CB;                                     // SWAP B
+        CB_OPCODE(0x31): swap(gb, &gb->registers.c); NEXT_CB;                                     // SWAP C
+        CB_OPCODE(0x32): swap(gb, &gb->registers.d); NEXT_CB;                                     // SWAP D
+        CB_OPCODE(0x33): swap(gb, &gb->registers.e); NEXT_CB;                                     // SWAP E
+        CB_OPCODE(0x34): swap(gb, &gb->registers.h); NEXT_CB;                                     // SWAP H
+        CB_OPCODE(0x35): swap(gb, &gb->registers.l); NEXT_CB;                                     // SWAP L
+        CB_OPCODE(0x36): swap_from_mem(gb); NEXT_CB;                                        // SWAP (HL)
+        CB_OPCODE(0x37): swap(gb, &gb->registers.a); NEXT_CB;                                     // SWAP A
+        CB_OPCODE(0x38): srl_op(gb, &gb->registers.b); NEXT_CB;                                   // SRL B
+        CB_OPCODE(0x39): srl_op(gb, &gb->registers.c); NEXT_CB;                                   // SRL C
+        CB_OPCODE(0x3a): srl_op(gb, &gb->registers.d); NEXT_CB;                                   // SRL D
+        CB_OPCODE(0x3b): srl_op(gb, &gb->registers.e); NEXT_CB;                                   // SRL E
+        CB_OPCODE(0x3c): srl_op(gb, &gb->registers.h); NEXT_CB;                                   // SRL H
+        CB_OPCODE(0x3d): srl_op(gb, &gb->registers.l); NEXT_CB;                                   // SRL L
+        CB_OPCODE(0x3e): srl_from_mem(gb); NEXT_CB;                                         // SRL (HL)
+        CB_OPCODE(0x3f): srl_op(gb, &gb->registers.a); NEXT_CB;                                   // SRL A
+        CB_OPCODE(0x40): bit_op(gb, 0, &gb->registers.b); NEXT_CB;                                // BIT 0, B
+        CB_OPCODE(0x41): bit_op(gb, 0, &gb->registers.c); NEXT_CB;                                // BIT 0, C
+        CB_OPCODE(0x42): bit_op(gb, 0, &gb->registers.d); NEXT_CB;                                // BIT 0, D
+        CB_OPCODE(0x43): bit_op(gb, 0, &gb->registers.e); NEXT_CB;                                // BIT 0, E
+        CB_OPCODE(0x44): bit_op(gb, 0, &gb->registers.h); NEXT_CB;                                // BIT 0, H
+        CB_OPCODE(0x45): bit_op(gb, 0, &gb->registers.l); NEXT_CB;                                // BIT 0, L
+        CB_OPCODE(0x46): bit_op_from_mem(gb, 0, &gb->registers.hl); NEXT_CB;                      // BIT 0, (HL)
+        CB_OPCODE(0x47): bit_op(gb, 0, &gb->registers.a); NEXT_CB;                                // BIT 0, A
+        CB_OPCODE(0x48): bit_op(gb, 1, &gb->registers.b); NEXT_CB;                                // BIT 1, B
+        CB_OPCODE(0x49): bit_op(gb, 1, &gb->registers.c); NEXT_CB;                                // BIT 1, C
+        CB_OPCODE(0x4a): bit_op(gb, 1, &gb->registers.d); NEXT_CB;                                // BIT 1, D
+        CB_OPCODE(0x4b): bit_op(gb, 1, &gb->registers.e); NEXT_CB;                                // BIT 1, E
+        CB_OPCODE(0x4c): bit_op(gb, 1, &gb->registers.h); NEXT_CB;                                // BIT 1, H
+        CB_OPCODE(0x4d): bit_op(gb, 1, &gb->registers.l); NEXT_CB;                                // BIT 1, L
+        CB_OPCODE(0x4e): bit_op_from_mem(gb, 1, &gb->registers.hl); NEXT_CB;                      // BIT 1, (HL)
+        CB_OPCODE(0x4f): bit_op(gb, 1, &gb->registers.a); NEXT_CB;                                // BIT 1, A
+        CB_OPCODE(0x50): bit_op(gb, 2, &gb->registers.b); NEXT_CB;                                // BIT 2, B
+        CB_OPCODE(0x51): bit_op(gb, 2, &gb->registers.c); NEXT_CB;                                // BIT 2, C
+        CB_OPCODE(0x52): bit_op(gb, 2, &gb->registers.d); NEXT_CB;                                // BIT 2, D
+        CB_OPCODE(0x53): bit_op(gb, 2, &gb->registers.e); NEXT_CB;                                // BIT 2, E
+        CB_OPCODE(0x54): bit_op(gb, 2, &gb->registers.h); NEXT_CB;                                // BIT 2, H
+        CB_OPCODE(0x55): bit_op(gb, 2, &gb->registers.l); NEXT_CB;                                // BIT 2, L
+        CB_OPCODE(0x56): bit_op_from_mem(gb, 2, &gb->registers.hl); NEXT_CB;                      // BIT 2, (HL)
+        CB_OPCODE(0x57): bit_op(gb, 2, &gb->registers.a); NEXT_CB;                                // BIT 2, A
+        CB_OPCODE(0x58): bit_op(gb, 3, &gb->registers.b); NEXT_CB;                                // BIT 3, B
+        CB_OPCODE(0x59): bit_op(gb, 3, &gb->registers.c); NEXT_CB;                                // BIT 3, C
+        CB_OPCODE(0x5a): bit_op(gb, 3, &gb->registers.d); NEXT_CB;                                // BIT 3, D
+        CB_OPCODE(0x5b): bit_op(gb, 3, &gb->registers.e); NEXT_CB;                                // BIT 3, E
+        CB_OPCODE(0x5c): bit_op(gb, 3, &gb->registers.h); NEXT_CB;                                // BIT 3, H
+        CB_OPCODE(0x5d): bit_op(gb, 3, &gb->registers.l); NEXT_CB;                                // BIT 3, L
+        CB_OPCODE(0x5e): bit_op_from_mem(gb, 3, &gb->registers.hl); NEXT_CB;                      // BIT 3, (HL)
+        CB_OPCODE(0x5f): bit_op(gb, 3, &gb->registers.a); NEXT_CB;                                // BIT 3, A
+        CB_OPCODE(0x60): bit_op(gb, 4, &gb->registers.b); NEXT_CB;                                // BIT 4, B
+        CB_OPCODE(0x61): bit_op(gb, 4, &gb->registers.c); NEXT_CB;                                // BIT 4, C
+        CB_OPCODE(0x62): bit_op(gb, 4, &gb->registers.d); NEXT_CB;                                // BIT 4, D
+        CB_OPCODE(0x63): bit_op(gb, 4, &gb->registers.e); NEXT_CB;                                // BIT 4, E
+        CB_OPCODE(0x64): bit_op(gb, 4, &gb->registers.h); NEXT_CB;                                // BIT 4, H
+        CB_OPCODE(0x65): bit_op(gb, 4, &gb->registers.l); NEXT_CB;                                // BIT 4, L
+        CB_OPCODE(0x66): bit_op_from_mem(gb, 4, &gb->registers.hl); NEXT_CB;                      // BIT 4, (HL)
+        CB_OPCODE(0x67): bit_op(gb, 4, &gb->registers.a); NEXT_CB;                                // BIT 4, A
+        CB_OPCODE(0x68): bit_op(gb, 5, &gb->registers.b); NEXT_CB;                                // BIT 5, B
+        CB_OPCODE(0x69): bit_op(gb, 5, &gb->registers.c); NEXT_CB;                                // BIT 5, C
+        CB_OPCODE(0x6a): bit_op(gb, 5, &gb->registers.d); NEXT_CB;                                // BIT 5, D
+        CB_OPCODE(0x6b): bit_op(gb, 5, &gb->registers.e); NEXT_CB;                                // BIT 5, E
+        CB_OPCODE(0x6c): bit_op(gb, 5, &gb->registers.h); NEXT_CB;                                // BIT 5, H
+        CB_OPCODE(0x6d): bit_op(gb, 5, &gb->registers.l); NEXT_CB;                                // BIT 5, L
+        CB_OPCODE(0x6e): bit_op_from_mem(gb, 5, &gb->registers.hl); NEXT_CB;                      // BIT 5, (HL)
+        CB_OPCODE(0x6f): bit_op(gb, 5, &gb->registers.a); NEXT_CB;                                // BIT 5, A
+        CB_OPCODE(0x70): bit_op(gb, 6, &gb->registers.b); NEXT_CB;                                // BIT 6, B
+        CB_OPCODE(0x71): bit_op(gb, 6, &gb->registers.c); NEXT_CB;                                // BIT 6, C
+        CB_OPCODE(0x72): bit_op(gb, 6, &gb->registers.d); NEXT_CB;                                // BIT 6, D
+        CB_OPCODE(0x73): bit_op(gb, 6, &gb->registers.e); NEXT_CB;                                // BIT 6, E
+        CB_OPCODE(0x74): bit_op(gb, 6, &gb->registers.h); NEXT_CB;                                // BIT 6, H
+        CB_OPCODE(0x75): bit_op(gb, 6, &gb->registers.l); NEXT_CB;                                // BIT 6, L
+        CB_OPCODE(0x76): bit_op_from_mem(gb, 6, &gb->registers.hl); NEXT_CB;                      // BIT 6, (HL)
+        CB_OPCODE(0x77): bit_op(gb, 6, &gb->registers.a); NEXT_CB;                                // BIT 6, A
+        CB_OPCODE(0x78): bit_op(gb, 7, &gb->registers.b); NEXT_CB;                                // BIT 7, B
+        CB_OPCODE(0x79): bit_op(gb, 7, &gb->registers.c); NEXT_CB;                                // BIT 7, C
+        CB_OPCODE(0x7a): bit_op(gb, 7, &gb->registers.d); NEXT_CB;                                // BIT 7, D
+        CB_OPCODE(0x7b): bit_op(gb, 7, &gb->registers.e); NEXT_CB;                                // BIT 7, E
+        CB_OPCODE(0x7c): bit_op(gb, 7, &gb->registers.h); NEXT_CB;                                // BIT 7, H
+        CB_OPCODE(0x7d): bit_op(gb, 7, &gb->registers.l); NEXT_CB;                                // BIT 7, L
+        CB_OPCODE(0x7e): bit_op_from_mem(gb, 7, &gb->registers.hl); NEXT_CB;                      // BIT 7, (HL)
+        CB_OPCODE(0x7f): bit_op(gb, 7, &gb->registers.a); NEXT_CB;                                // BIT 7, A
+        CB_OPCODE(0x80): res_op(gb, 0, &gb->registers.b); NEXT_CB;                                // RES 0, B
+        CB_OPCODE(0x81): res_op(gb, 0, &gb->registers.c); NEXT_CB;                                // RES 0, C
+        CB_OPCODE(0x82): res_op(gb, 0, &gb->registers.d); NEXT_CB;                                // RES 0, D
+        CB_OPCODE(0x83): res_op(gb, 0, &gb->registers.e); NEXT_CB;                                // RES 0, E
+        CB_OPCODE(0x84): res_op(gb, 0, &gb->registers.h); NEXT_CB;                                // RES 0, H
+        CB_OPCODE(0x85): res_op(gb, 0, &gb->registers.l); NEXT_CB;                                // RES 0, L
+        CB_OPCODE(0x86): res_from_mem(gb, 0, &gb->registers.hl); NEXT_CB;                         // RES 0, (HL)
+        CB_OPCODE(0x87): res_op(gb, 0, &gb->registers.a); NEXT_CB;                                // RES 0, A
+        CB_OPCODE(0x88): res_op(gb, 1, &gb->registers.b); NEXT_CB;                                // RES 1, B
+        CB_OPCODE(0x89): res_op(gb, 1, &gb->registers.c); NEXT_CB;                                // RES 1, C
+        CB_OPCODE(0x8a): res_op(gb, 1, &gb->registers.d); NEXT_CB;                                // RES 1, D
+        CB_OPCODE(0x8b): res_op(gb, 1, &gb->registers.e); NEXT_CB;                                // RES 1, E
+        CB_OPCODE(0x8c): res_op(gb, 1, &gb->registers.h); NEXT_CB;                                // RES 1, H
+        CB_OPCODE(0x8d): res_op(gb, 1, &gb->registers.l); NEXT_CB;                                // RES 1, L
+        CB_OPCODE(0x8e): res_from_mem(gb, 1, &gb->registers.hl); NEXT_CB;                         // RES 1, (HL)
+        CB_OPCODE(0x8f): res_op(gb, 1, &gb->registers.a); NEXT_CB;                                // RES 1, A
+        CB_OPCODE(0x90): res_op(gb, 2, &gb->registers.b); NEXT_CB;                                // RES 2, B
+        CB_OPCODE(0x91): res_op(gb, 2, &gb->registers.c); NEXT_CB;                                // RES 2, C
+        CB_OPCODE(0x92): res_op(gb, 2, &gb->registers.d); NEXT_CB;                                // RES 2, D
+        CB_OPCODE(0x93): res_op(gb, 2, &gb->registers.e); NEXT_CB;                                // RES 2, E
+        CB_OPCODE(0x94): res_op(gb, 2, &gb->registers.h); NEXT_CB;                                // RES 2, H
+        CB_OPCODE(0x95): res_op(gb, 2, &gb->registers.l); NEXT_CB;                                // RES 2, L
+        CB_OPCODE(0x96): res_from_mem(gb, 2, &gb->registers.hl); NEXT_CB;                         // RES 2, (HL)
+        CB_OPCODE(0x97): res_op(gb, 2, &gb->registers.a); NEXT_CB;                                // RES 2, A
+        CB_OPCODE(0x98): res_op(gb, 3, &gb->registers.b); NEXT_CB;                                // RES 3, B
+        CB_OPCODE(0x99): res_op(gb, 3, &gb->registers.c); NEXT_CB;                                // RES 3, C
+        CB_OPCODE(0x9a): res_op(gb, 3, &gb->registers.d); NEXT_CB;                                // RES 3, D
+        CB_OPCODE(0x9b): res_op(gb, 3, &gb->registers.e); NEXT_CB;                                // RES 3, E
+        CB_OPCODE(0x9c): res_op(gb, 3, &gb->registers.h); NEXT_CB;                                // RES 3, H
+        CB_OPCODE(0x9d): res_op(gb, 3, &gb->registers.l); NEXT_CB;                                // RES 3, L
+        CB_OPCODE(0x9e): res_from_mem(gb, 3, &gb->registers.hl); NEXT_CB;                         // RES 3, (HL)
+        CB_OPCODE(0x9f): res_op(gb, 3, &gb->registers.a); NEXT_CB;                                // RES 3, A
+        CB_OPCODE(0xa0): res_op(gb, 4, &gb->registers.b); NEXT_CB;                                // RES 4, B
+        CB_OPCODE(0xa1): res_op(gb, 4, &gb->registers.c); NEXT_CB;                                // RES 4, C
+        CB_OPCODE(0xa2): res_op(gb, 4, &gb->registers.d); NEXT_CB;                                // RES 4, D
+        CB_OPCODE(0xa3): res_op(gb, 4, &gb->registers.e); NEXT_CB;                                // RES 4, E
+        CB_OPCODE(0xa4): res_op(gb, 4, &gb->registers.h); NEXT_CB;                                // RES 4, H
+        CB_OPCODE(0xa5): res_op(gb, 4, &gb->registers.l); NEXT_CB;                                // RES 4, L
+        CB_OPCODE(0xa6): res_from_mem(gb, 4, &gb->registers.hl); NEXT_CB;                         // RES 4, (HL)
+        CB_OPCODE(0xa7): res_op(gb, 4, &gb->registers.a); NEXT_CB;                                // RES 4, A
+        CB_OPCODE(0xa8): res_op(gb, 5, &gb->registers.b); NEXT_CB;                                // RES 5, B
+        CB_OPCODE(0xa9): res_op(gb, 5, &gb->registers.c); NEXT_CB;                                // RES 5, C
+        CB_OPCODE(0xaa): res_op(gb, 5, &gb->registers.d); NEXT_CB;                                // RES 5, D
+        CB_OPCODE(0xab): res_op(gb, 5, &gb->registers.e); NEXT_CB;                                // RES 5, E
+        CB_OPCODE(0xac): res_op(gb, 5, &gb->registers.h); NEXT_CB;                                // RES 5, H
+        CB_OPCODE(0xad): res_op(gb, 5, &gb->registers.l); NEXT_CB;                                // RES 5, L
+        CB_OPCODE(0xae): res_from_mem(gb, 5, &gb->registers.hl); NEXT_CB;                         // RES 5, (HL)
+        CB_OPCODE(0xaf): res_op(gb, 5, &gb->registers.a); NEXT_CB;                                // RES 5, A
+        CB_OPCODE(0xb0): res_op(gb, 6, &gb->registers.b); NEXT_CB;                                // RES 6, B
+        CB_OPCODE(0xb1): res_op(gb, 6, &gb->registers.c); NEXT_CB;                                // RES 6, C
+        CB_OPCODE(0xb2): res_op(gb, 6, &gb->registers.d); NEXT_CB;                                // RES 6, D
+        CB_OPCODE(0xb3): res_op(gb, 6, &gb->registers.e); NEXT_CB;                                // RES 6, E
+        CB_OPCODE(0xb4): res_op(gb, 6, &gb->registers.h); NEXT_CB;                                // RES 6, H
+        CB_OPCODE(0xb5): res_op(gb, 6, &gb->registers.l); NEXT_CB;                                // RES 6, L
+        CB_OPCODE(0xb6): res_from_mem(gb, 6, &gb->registers.hl); NEXT_CB;                         // RES 6, (HL)
+        CB_OPCODE(0xb7): res_op(gb, 6, &gb->registers.a); NEXT_CB;                                // RES 6, A
+        CB_OPCODE(0xb8): res_op(gb, 7, &gb->registers.b); NEXT_CB;                                // RES 7, B
+        CB_OPCODE(0xb9): res_op(gb, 7, &gb->registers.c); NEXT_CB;                                // RES 7, C
+        CB_OPCODE(0xba): res_op(gb, 7, &gb->registers.d); NEXT_CB;                                // RES 7, D
+        CB_OPCODE(0xbb): res_op(gb, 7, &gb->registers.e); NEXT_CB;                                // RES 7, E
+        CB_OPCODE(0xbc): res_op(gb, 7, &gb->registers.h); NEXT_CB;                                // RES 7, H
+        CB_OPCODE(0xbd): res_op(gb, 7, &gb->registers.l); NEXT_CB;                                // RES 7, L
+        CB_OPCODE(0xbe): res_from_mem(gb, 7, &gb->registers.hl); NEXT_CB;                         // RES 7, (HL)
+        CB_OPCODE(0xbf): res_op(gb, 7, &gb->registers.a); NEXT_CB;                                // RES 7, A
+        CB_OPCODE(0xc0): set_op(gb, 0, &gb->registers.b); NEXT_CB;                                // SET 0, B
+        CB_OPCODE(0xc1): set_op(gb, 0, &gb->registers.c); NEXT_CB;                                // SET 0, C
+        CB_OPCODE(0xc2): set_op(gb, 0, &gb->registers.d); NEXT_CB;                                // SET 0, D
+        CB_OPCODE(0xc3): set_op(gb, 0, &gb->registers.e); NEXT_CB;                                // SET 0, E
+        CB_OPCODE(0xc4): set_op(gb, 0, &gb->registers.h); NEXT_CB;                                // SET 0, H
+        CB_OPCODE(0xc5): set_op(gb, 0, &gb->registers.l); NEXT_CB;                                // SET 0, L
+        CB_OPCODE(0xc6): set_op_from_mem(gb, 0, &gb->registers.hl); NEXT_CB;                      // SET 0, (HL)
+        CB_OPCODE(0xc7): set_op(gb, 0, &gb->registers.a); NEXT_CB;                                // SET 0, A
+        CB_OPCODE(0xc8): set_op(gb, 1, &gb->registers.b); NEXT_CB;                                // SET 1, B
+        CB_OPCODE(0xc9): set_op(gb, 1, &gb->registers.c); NEXT_CB;                                // SET 1, C
+        CB_OPCODE(0xca): set_op(gb, 1, &gb->registers.d); NEXT_CB;                                // SET 1, D
+        CB_OPCODE(0xcb): set_op(gb, 1, &gb->registers.e); NEXT_CB;                                // SET 1, E
+        CB_OPCODE(0xcc): set_op(gb, 1, &gb->registers.h); NEXT_CB;                                // SET 1, H
+        CB_OPCODE(0xcd): set_op(gb, 1, &gb->registers.l); NEXT_CB;                                // SET 1, L
+        CB_OPCODE(0xce): set_op_from_mem(gb, 1, &gb->registers.hl); NEXT_CB;                      // SET 1, (HL)
+        CB_OPCODE(0xcf): set_op(gb, 1, &gb->registers.a); NEXT_CB;                                // SET 1, A
+        CB_OPCODE(0xd0): set_op(gb, 2, &gb->registers.b); NEXT_CB;                                // SET 2, B
+        CB_OPCODE(0xd1): set_op(gb, 2, &gb->registers.c); NEXT_CB;                                // SET 2, C
+        CB_OPCODE(0xd2): set_op(gb, 2, &gb->registers.d); NEXT_CB;                                // SET 2, D
+        CB_OPCODE(0xd3): set_op(gb, 2, &gb->registers.e); NEXT_CB;                                // SET 2, E
+        CB_OPCODE(0xd4): set_op(gb, 2, &gb->registers.h); NEXT_CB;                                // SET 2, H
+        CB_OPCODE(0xd5): set_op(gb, 2, &gb->registers.l); NEXT_CB;                                // SET 2, L
+        CB_OPCODE(0xd6): set_op_from_mem(gb, 2, &gb->registers.hl); NEXT_CB;                      // SET 2, (HL)
+        CB_OPCODE(0xd7): set_op(gb, 2, &gb->registers.a); NEXT_CB;                                // SET 2, A
+        CB_OPCODE(0xd8): set_op(gb, 3, &gb->registers.b); NEXT_CB;                                // SET 3, B
+        CB_OPCODE(0xd9): set_op(gb, 3, &gb->registers.c); NEXT_CB;                                // SET 3, C
+        CB_OPCODE(0xda): set_op(gb, 3, &gb->registers.d); NEXT_CB;                                // SET 3, D
+        CB_OPCODE(0xdb): set_op(gb, 3, &gb->registers.e); NEXT_CB;                                // SET 3, E
+        CB_OPCODE(0xdc): set_op(gb, 3, &gb->registers.h); NEXT_CB;                                // SET 3, H
+        CB_OPCODE(0xdd): set_op(gb, 3, &gb->registers.l); NEXT_CB;                                // SET 3, L
+        CB_OPCODE(0xde): set_op_from_mem(gb, 3, &gb->registers.hl); NEXT_CB;                      // SET 3, (HL)
+        CB_OPCODE(0xdf): set_op(gb, 3, &gb->registers.a); NEXT_CB;                                // SET 3, A
+        CB_OPCODE(0xe0): set_op(gb, 4, &gb->registers.b); NEXT_CB;                                // SET 4, B
+        CB_OPCODE(0xe1): set_op(gb, 4, &gb->registers.c); NEXT_CB;                                // SET 4, C
+        CB_OPCODE(0xe2): set_op(gb, 4, &gb->registers.d); NEXT_CB;                                // SET 4, D
+        CB_OPCODE(0xe3): set_op(gb, 4, &gb->registers.e); NEXT_CB;                                // SET 4, E
+        CB_OPCODE(0xe4): set_op(gb, 4, &gb->registers.h); NEXT_CB;                                // SET 4, H
+        CB_OPCODE(0xe5): set_op(gb, 4, &gb->registers.l); NEXT_CB;                                // SET 4, L
+        CB_OPCODE(0xe6): set_op_from_mem(gb, 4, &gb->registers.hl); NEXT_CB;                      // SET 4, (HL)
+        CB_OPCODE(0xe7): set_op(gb, 4, &gb->registers.a); NEXT_CB;                                // SET 4, A
+        CB_OPCODE(0xe8): set_op(gb, 5, &gb->registers.b); NEXT_CB;                                // SET 5, B
+        CB_OPCODE(0xe9): set_op(gb, 5, &gb->registers.c); NEXT_CB;                                // SET 5, C
+        CB_OPCODE(0xea): set_op(gb, 5, &gb->registers.d); NEXT_CB;                                // SET 5, D
+        CB_OPCODE(0xeb): set_op(gb, 5, &gb->registers.e); NEXT_CB;                                // SET 5, E
+        CB_OPCODE(0xec): set_op(gb, 5, &gb->registers.h); NEXT_CB;                                // SET 5, H
+        CB_OPCODE(0xed): set_op(gb, 5, &gb->registers.l); NEXT_CB;                                // SET 5, L
+        CB_OPCODE(0xee): set_op_from_mem(gb, 5, &gb->registers.hl); NEXT_CB;                      // SET 5, (HL)
+        CB_OPCODE(0xef): set_op(gb, 5, &gb->registers.a); NEXT_CB;                                // SET 5, A
+        CB_OPCODE(0xf0): set_op(gb, 6, &gb->registers.b); NEXT_CB;                                // SET 6, B
+        CB_OPCODE(0xf1): set_op(gb, 6, &gb->registers.c); NEXT_CB;                                // SET 6, C
+        CB_OPCODE(0xf2): set_op(gb, 6, &gb->registers.d); NEXT_CB;                                // SET 6, D
+        CB_OPCODE(0xf3): set_op(gb, 6, &gb->registers.e); NEXT_CB;                                // SET 6, E
+        CB_OPCODE(0xf4): set_op(gb, 6, &gb->registers.h); NEXT_CB;                                // SET 6, H
+        CB_OPCODE(0xf5): set_op(gb, 6, &gb->registers.l); NEXT_CB;                                // SET 6, L
+        CB_OPCODE(0xf6): set_op_from_mem(gb, 6, &gb->registers.hl); NEXT_CB;                      // SET 6, (HL)
+        CB_OPCODE(0xf7): set_op(gb, 6, &gb->registers.a); NEXT_CB;                                // SET 6, A
+        CB_OPCODE(0xf8): set_op(gb, 7, &gb->registers.b); NEXT_CB;                                // SET 7, B
+        CB_OPCODE(0xf9): set_op(gb, 7, &gb->registers.c); NEXT_CB;                                // SET 7, C
+        CB_OPCODE(0xfa): set_op(gb, 7, &gb->registers.d); NEXT_CB;                                // SET 7, D
+        CB_OPCODE(0xfb): set_op(gb, 7, &gb->registers.e); NEXT_CB;                                // SET 7, E
+        CB_OPCODE(0xfc): set_op(gb, 7, &gb->registers.h); NEXT_CB;                                // SET 7, H
+        CB_OPCODE(0xfd): set_op(gb, 7, &gb->registers.l); NEXT_CB;                                // SET 7, L
+        CB_OPCODE(0xfe): set_op_from_mem(gb, 7, &gb->registers.hl); NEXT_CB;                      // SET 7, (HL)
+        CB_OPCODE(0xff): set_op(gb, 7, &gb->registers.a); NEXT_CB;                                // SET 7, A
+    }
 
-    if (opcode == 0xcb) {       /* if op is CB prefix, execute next op from the CB instruction set */
+done:
+#ifdef TRACE
+    gb->trace.current = NULL;
+#endif
+#ifdef PROFILE
+    profile_count(&gb->profile.instructions[opcode], instructions_ticks[opcode], gb->cpu.extra_instruction_cycles);
+#endif
+    return instructions_ticks[opcode] + gb->cpu.extra_instruction_cycles;
+
+done_cb:
+#ifdef TRACE
+    gb->trace.current = NULL;
+#endif
+#ifdef PROFILE
+    profile_count(&gb->profile.cb_instructions[(unsigned char) operand], instructions_cb_ticks[(unsigned char) operand], gb->cpu.extra_instruction_cycles);
+#endif
+    return instructions_cb_ticks[(unsigned char) operand] + gb->cpu.extra_instruction_cycles;
+}
+
+#ifdef HEATMAP
+/*
+ *  Count the fetch of an instruction that wasn't read through mmu_read8bit
+ *  (pc already points past it)
+ */
+static void count_fetch(gb_t* gb, unsigned char opcode) {
 
-        // Use mmu read instead
-        /* opcode = memory[registers.pc++]; */
-        mmu_read8bit(&opcode, registers.pc++);
-        instruction = instructions_cb[opcode];
-        time = instructions_cb_ticks[opcode];
-    }
-    else {
-        instruction = instructions[opcode];
-        time = instructions_ticks[opcode];
-    }
+    for (int i = instructions_length[opcode]; i > 0; i--)
+        heatmap_count(gb, gb->registers.pc - i, 0);
+}
+#endif
 
-    if (instruction.execute) {
+/*
+ *  Fetch the opcode and its operand, then execute it
+ *
+ *  Code that's already been decoded is taken from the block cache
+ *  instead of being read again through the memory map
+ */
+static int execute(gb_t* gb) {
 
-        if (debugger)
-            printf("%s -> 0x%x\n", instruction.disassembly, opcode);
+    struct block_instruction* instruction = gb->debugger ? NULL : block_fetch(gb, gb->registers.pc);
 
-        instruction.execute(instruction.exec_argv1, instruction.exec_argv2);
+    if (instruction) {
 
-        if (debugger)
-            debug();
+        gb->registers.pc = instruction->next_pc;
+#ifdef HEATMAP
+        count_fetch(gb, instruction->opcode);
+#endif
+        return dispatch(gb, instruction->opcode, instruction->operand);
+    }
 
-    } else {
+    unsigned char opcode;
+    mmu_read8bit(gb, &opcode, gb->registers.pc++);
 
-        printf("Operation not defined: %s -> 0x%x\n", instruction.disassembly, opcode);
-        exit(1);
+    unsigned short operand = 0;
 
+    switch (instructions_length[opcode]) {
+        case 2:
+            operand = read8bit_operand(gb);
+            break;
+        case 3:
+            operand = read16bit_operand(gb);
+            break;
     }
 
+    if (gb->debugger) {
 
-    return time + extra_instruction_cycles;
+        struct trace_record record;
+        trace_fill_record(gb, &record, opcode, operand);
+        trace_print_record(stdout, &record);
+    }
+
+    return dispatch(gb, opcode, operand); /* time is in cycles */
 }
 
+/*
+ *  Execute an opcode decoded somewhere else (e.g. by the JIT)
+ *
+ *  The program counter must already point to the next instruction
+ */
+int cpu_execute_opcode(gb_t* gb, unsigned char opcode, unsigned short operand) {
+
+#ifdef HEATMAP
+    count_fetch(gb, opcode);
+#endif
+    return dispatch(gb, opcode, operand);
+}
 
-int cpu() {
 
-    if (stopped)    /* when the CPU is stopped, just keep updating the window (return random number of cycles) */
+int cpu(gb_t* gb) {
+
+    if (gb->cpu.stopped)    /* when the CPU is stopped, just keep updating the window (return random number of cycles) */
         return 1;
-    int cycles = 0;
+    int cycles = -1;
 
-    if (!halted)
-        cycles = execute();
-    else
+    if (gb->cpu.halted)
         cycles = 4;
+#ifdef JIT
+    /* The JIT runs a whole block at a time, and returns -1
+     * when the block can't be translated so the interpreter runs it instead */
+    else if (gb->jit.enabled && !gb->debugger)
+        cycles = jit_run(gb);
+#endif
+
+    if (cycles < 0)
+        cycles = execute(gb);
 
-    process_interrupts();
+    if (*gb->memory.interrupt_request_register & *gb->memory.interrupt_enable_register & 0x1F)
+        process_interrupts(gb);
 
     return cycles;
 }
 
-void boot_tests() {
-    registers.af = 0x01B0;
-    registers.bc = 0x0013;
-    registers.de = 0x00D8;
-    registers.hl = 0x014D;
-    registers.sp = 0xfffe;
-    registers.pc = 0x100;
+void boot_tests(gb_t* gb) {
+    gb->registers.af = 0x01B0;
+    gb->registers.bc = 0x0013;
+    gb->registers.de = 0x00D8;
+    gb->registers.hl = 0x014D;
+    gb->registers.sp = 0xfffe;
+    gb->registers.pc = 0x100;
 }
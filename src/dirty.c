@@ -0,0 +1,101 @@
+#include <string.h>
+
+#include "gb.h"
+
+/*---- Epochs -----------------------------------------------------*/
+
+
+/*
+ *  Start a new epoch (every page is clean in it)
+ *  Returns its number, to ask what was written since
+ */
+unsigned int dirty_new_epoch(gb_t* gb) {
+
+    struct dirty* dirty = &gb->dirty;
+
+    dirty->epoch++;
+    memset(dirty->bitmap, 0, sizeof(dirty->bitmap));
+
+    // First writes to every page have to be marked again (ROM is never mapped for writing)
+    mmu_map_pages(gb, 0x80, 0xff);
+
+    return dirty->epoch;
+}
+
+/*
+ *  Was page written during epoch since or after it
+ */
+int dirty_page_written(gb_t* gb, int page, unsigned int since) {
+
+    return gb->dirty.written[page] >= since;
+}
+
+/*
+ *  First page from page onwards written in the current epoch
+ *  Returns -1 if there's none
+ */
+int dirty_next_page(gb_t* gb, int page) {
+
+    struct dirty* dirty = &gb->dirty;
+
+    while (page < DIRTY_PAGES) {
+
+        // Bits of the pages from page to the end of its word
+        unsigned long long bits = dirty->bitmap[page/64] >> (page % 64);
+
+        if (bits)
+            return page + __builtin_ctzll(bits);
+
+        page = (page/64 + 1)*64;
+    }
+
+    return -1;
+}
+
+
+
+/*---- Marking ----------------------------------------------------*/
+
+
+/*
+ *  Writes to clean pages have to go through dirty_mark
+ */
+int dirty_page_is_clean(gb_t* gb, int page) {
+
+    return gb->dirty.written[page] != gb->dirty.epoch;
+}
+
+/*
+ *  Called when page is written
+ */
+void dirty_mark(gb_t* gb, int page) {
+
+    struct dirty* dirty = &gb->dirty;
+
+    if (!dirty_page_is_clean(gb, page))
+        return;
+
+    dirty->written[page] = dirty->epoch;
+    dirty->bitmap[page/64] |= 1ULL << (page % 64);
+
+    // Writes to the page go straight to it now (RAM pages could be mapped anywhere in A000-BFFF)
+    if (page < DIRTY_RAM_PAGE)
+        mmu_map_pages(gb, page, page);
+    else
+        mmu_map_pages(gb, 0xa0, 0xbf);
+}
+
+/*
+ *  Everything changed (e.g. cartridge RAM was replaced)
+ */
+void dirty_mark_all(gb_t* gb) {
+
+    struct dirty* dirty = &gb->dirty;
+
+    for (int page = 0; page < DIRTY_PAGES; page++)
+        dirty->written[page] = dirty->epoch;
+
+    memset(dirty->bitmap, 0xff, sizeof(dirty->bitmap));
+
+    mmu_map_pages(gb, 0x80, 0xff);
+}
@@ -1,15 +1,12 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <unistd.h>
-#include <time.h>
 
-#include "emulator.h"
-#include "memory.h"
-#include "cpu.h"
-#include "ppu.h"
-#include "timer.h"
+#if defined(PROFILE) || defined(TRACE)
+#include <signal.h>
+#endif
 
-unsigned long debugger = 0;
+#include "emulator.h"
+#include "gb.h"
 
 
 const int FRAME_MAX_CYCLES = 69905; /*
@@ -22,69 +19,108 @@ const int FRAME_MAX_CYCLES = 69905; /*
                                      *      We can use this to sync graphics with procressing instructions
                                      */
 
-unsigned long emulation_time = 0;   /* time is in cycles */
-
 unsigned int debugger_offset = 0;
 unsigned int debug_from = -1;
 
-void process_input() {
-    
-    // Before applying new states, reset the previous ones to avoid bugs
-    /* *joyp |= 0xF; */ // No longer needed bc no longer allow ANY write to the lower 4 bits
-
-    // joypad_state is defined in memory after reading from $FF00 joypad reg
-    // It holds information about the keys pressed
-    // The upper 4 bits are for standard inputs, the lower 4 are for direction inputs
+// Closing the window exits from inside the frame, the save (and the state, with -w) is written then
+static gb_t* running_gb = NULL;
+static const char* state_path = NULL;
 
-    /* printf("Before pressing, joypad is %x and joypad state is %x\n", *joyp, joypad_state); */
-    // $FF00 bit 4 with value 0 selects direction keys
-    if ((joypad_state & 0xF) && !(*joyp & 0x10)) {
+static void write_state(gb_t* gb) {
 
-        // Key pressed is a standard input and the type set
-        // in the joypad register ($FF00) is standard
+    if (state_path && !state_save(gb, state_path, STATE_PACK))
+        printf("State written to %s\n", state_path);
+}
 
-        *joyp &= ~(joypad_state & 0xF);
+static void write_save_at_exit(void) {
 
+    if (running_gb) {
+        write_state(running_gb);
+        save_free(running_gb);
     }
-    // $FF00 bit 5 with value 0 selects button keys
-    else if ((joypad_state & 0xF0) && !(*joyp & 0x20)) {
+}
 
-        // Key pressed is a direction input and the type set
-        // in the joypad register ($FF00) is direction
+#ifdef PROFILE
+static gb_t* profiled_gb = NULL;
+static volatile sig_atomic_t profile_requested = 0;
 
-       *joyp &= ~(joypad_state >> 4);
+// SIGUSR1 asks for the profile, it's written after the current frame
+static void request_profile(int signum) {
 
-    }
-    else {
+    profile_requested = 1;
+}
 
-        // If no joypad_state is set, no key was inputted, so reset the key pressed in $ff00
+static void dump_profile_at_exit(void) {
 
-        return;
-    }
+    if (profiled_gb)
+        profile_dump(profiled_gb);
+}
+#endif
+
+#ifdef HEATMAP
+// Closing the window exits from inside the frame too
+static gb_t* heatmap_gb = NULL;
+
+static void dump_heatmap_at_exit(void) {
+
+    if (heatmap_gb)
+        heatmap_dump(heatmap_gb);
+}
+#endif
+
+#ifdef TRACE
+static gb_t* traced_gb = NULL;
+static volatile sig_atomic_t trace_requested = 0;
 
-    request_interrupt(JOYPAD_INTERRUPT);
+// SIGUSR2 asks for the trace, it's written after the current frame
+static void request_trace(int signum) {
 
+    trace_requested = 1;
 }
 
+// On a crash the trace is written right away, then the signal does what it usually does
+static void dump_trace_on_crash(int signum) {
+
+    trace_dump(traced_gb, TRACE_FILE);
+
+    signal(signum, SIG_DFL);
+    raise(signum);
+}
+#endif
+
 /*
  *  Update is called 60 times per second
  *
  *  It keeps the CPU running in sync with the PPU,
- *  and draws a frame every time it's run
+ *  the frontend shows a frame every time it's run
  *
  */
-void update() {
+void update(gb_t* gb) {
 
-    unsigned int cycles_this_frame = 0;
+    unsigned long long frame_end = gb->scheduler.now + FRAME_MAX_CYCLES;
 
-    while (cycles_this_frame < FRAME_MAX_CYCLES) {
+    // Keys might have changed since the last frame
+    scheduler_schedule(gb, EVENT_JOYPAD, gb->scheduler.now + 1);
+
+    while (gb->scheduler.now < frame_end) {
+
+        if (debug_from > 0xffff && !gb->debugger) {
+
+            /* The cpu runs until the end of the frame, and the ppu, timer and joypad
+             * are kept in sync by the events they schedule
+             */
+            scheduler_run(gb, frame_end);
+            break;
+        }
 
-        if (registers.pc == debug_from)
-            debugger++;
+        // Debugging goes one instruction at a time
 
-        int cycles = cpu();
+        if (gb->registers.pc == debug_from)
+            gb->debugger++;
 
-        if (debugger && (!debugger_offset || !(debugger_offset--))) {
+        scheduler_run(gb, gb->scheduler.now + 1);
+
+        if (gb->debugger && (!debugger_offset || !(debugger_offset--))) {
             int c = getchar();
             switch(c) {
             case 'n':
@@ -101,104 +137,96 @@ void update() {
                 break;
             }
         }
+    }
 
 
-        ppu(cycles); /* The Pixel Processing Unit receives the
-                      * the amount of cycles run by the processor
-                      * in order to keep it in sync with the processor.
-                      */
-
-        timer(cycles); /* Same thing as the PPU goes for timers */
-
-        process_input();
-
-        cycles_this_frame += cycles;
+#ifdef PROFILE
+    if (profile_requested) {
+        profile_requested = 0;
+        profile_dump(gb);
     }
+#endif
 
+#ifdef TRACE
+    if (trace_requested) {
+        trace_requested = 0;
+        trace_dump(gb, TRACE_FILE);
+    }
+#endif
 
-    render_frame();
-
-    emulation_time += cycles_this_frame;
+#ifdef IDLE_STATS
+    printf("Skipped %llu/%d cycles in idle loops\n", gb->scheduler.idle_cycles, FRAME_MAX_CYCLES);
+#endif
+    gb->scheduler.idle_cycles = 0;
 }
 
-static void boot() {
+void boot(gb_t* gb) {
 
     // Set keys as "unpressed" when the nintendo starts
-    *joyp |= 0xF;
+    *gb->memory.joyp |= 0xF;
 
     // Set initial DIV value
-    *tdiv = 0;
+    *gb->memory.tdiv = 0;
 
     printf("Booting...\n");
 
 }
 
 
-void emulate() {
-
-    boot();
-
-    while (1) {
-
-        clock_t clock_start = clock();
-
-        update();
-
-        clock_t clock_end = clock();
-        double time_taken = ((double) (clock_end-clock_start))/CLOCKS_PER_SEC;
-
-        sleep((1/60)-time_taken);
-    }
-
+/*
+ *  gb is the one this process runs: its save is written when it exits however it does,
+ *  and so are its state to path (unless it's NULL) and the profile, heatmap and trace
+ *  (-DPROFILE, -DHEATMAP, -DTRACE), which SIGUSR1 and SIGUSR2 ask for too
+ */
+void emulator_start(gb_t* gb, const char* path) {
+
+    running_gb = gb;
+    state_path = path;
+    atexit(write_save_at_exit);
+
+#ifdef PROFILE
+    profiled_gb = gb;
+    atexit(dump_profile_at_exit);
+    signal(SIGUSR1, request_profile);
+#endif
+
+#ifdef HEATMAP
+    heatmap_gb = gb;
+    atexit(dump_heatmap_at_exit);
+#endif
+
+#ifdef TRACE
+    traced_gb = gb;
+    signal(SIGUSR2, request_trace);
+    signal(SIGSEGV, dump_trace_on_crash);
+    signal(SIGBUS, dump_trace_on_crash);
+    signal(SIGILL, dump_trace_on_crash);
+    signal(SIGFPE, dump_trace_on_crash);
+    signal(SIGABRT, dump_trace_on_crash);
+#endif
 }
 
+/*
+ *  gb is done running: its state, the profile and the heatmap are written now instead
+ *  of at exit (and the save by gb_free)
+ */
+void emulator_stop(gb_t* gb) {
 
-int main(int argc, char *argv[]) {
-
-    char* romstring = "roms/tetris-jp.gb";
-
-    char* testing = NULL;
-    if (argc > 1 && argv[1][0]=='-' && argv[1][1]=='d') {
-
-        if (argc > 2) debug_from = atoi(argv[2]);
-        else debug_from = 0;
-    }
-    else if (argc > 1 && argv[1][0]=='-' && argv[1][1]=='t' && argc > 2) {
-
-        testing = argv[2];
-
-        if (argc > 3 && argv[3][0]=='-' && argv[3][1]=='d') {
-
-            if (argc > 4) debug_from = atoi(argv[4]);
-            else debug_from = 0x100;
-        }
-    }
-    else if (argc > 1 && argv[1][0]=='-' && argv[1][1]=='r') {
-        if (argc > 2)
-            romstring = argv[2];
-        else
-            exit(3);
-    }
-
-    insert_cartridge(romstring);
-
-    init_gui();
-
-    load_roms();
-
-
-    if (testing != NULL) {
+    write_state(gb);
 
-        // TODO: To run the whole "cpu_instr" test, i need to implement MBC1
-        // http://slack.net/~ant/old/gb-tests/
-        load_tests(testing);
+#ifdef PROFILE
+    profile_dump(gb);
+    profiled_gb = NULL;
+#endif
 
-        boot_tests();
-    }
+#ifdef HEATMAP
+    heatmap_dump(gb);
+    heatmap_gb = NULL;
+#endif
 
-    emulate();
+#ifdef TRACE
+    traced_gb = NULL;
+#endif
 
-    return 0;
+    running_gb = NULL;
 }
-
-// IDEA: make smallest possible version of the emulator ?
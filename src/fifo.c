@@ -0,0 +1,277 @@
+#ifdef PIXEL_FIFO
+
+#include <string.h>
+
+#include "gb.h"
+
+/*---- Fetcher ----------------------------------------------------*/
+
+
+/*
+ *  Read the next tile line of the background or window into fetched
+ */
+static void fetch_tile(gb_t* gb, struct fifo_state* state) {
+
+    unsigned char lcdc = *gb->memory.lcdc;
+    unsigned short tilemap_base_address;
+    unsigned char y, column;
+
+    if (state->window) {
+        tilemap_base_address = lcdc & 0x40 ? 0x9C00 : 0x9800;  // Test LCDC Bit 6
+        y = gb->ppu.window_line;
+        column = state->fetch_x % 32;
+    }
+    else {
+        tilemap_base_address = lcdc & 0x08 ? 0x9C00 : 0x9800;  // Test LCDC Bit 3
+        y = *gb->memory.lcd_scy + *gb->memory.lcd_ly;
+        column = (*gb->memory.lcd_scx/8 + state->fetch_x) % 32;
+    }
+
+    unsigned char tile_id = gb->memory.memory[tilemap_base_address + (y/8)*32 + column];
+    int tile = lcdc & 0x10 ? tile_id : 256 + (signed char) tile_id;  // Test LCDC Bit 4
+
+    memcpy(state->fetched, ppu_tile_line(gb, tile, y % 8, 0), 8);
+}
+
+/*
+ *  Mix the next sprite of the line into the sprite FIFO
+ *  (pixels another sprite already has stay its own)
+ */
+static void fetch_sprite(gb_t* gb, struct fifo_state* state) {
+
+    int n_sprites;
+    const unsigned char* sprites = ppu_line_sprites(gb, *gb->memory.lcd_ly, &n_sprites);
+    const struct sprite_attributes* sprite = &((const struct sprite_attributes*) gb->memory.oam)[sprites[state->next_sprite++]];
+
+    const unsigned char* pixels = ppu_sprite_pixels(gb, sprite, *gb->memory.lcd_ly);
+
+    // Only sprites partly off the left edge start before x
+    for (int pixel = state->x + 8 - sprite->x; pixel < 8; pixel++) {
+
+        unsigned char* slot = &state->sprites[(state->sprites_head + pixel - (state->x + 8 - sprite->x)) % 8];
+
+        if (!*slot && pixels[pixel])
+            *slot = pixels[pixel] | (sprite->attributes & 0x90);
+    }
+}
+
+
+
+/*---- Dots -------------------------------------------------------*/
+
+
+static int window_starts(gb_t* gb, struct fifo_state* state) {
+
+    unsigned char lcdc = *gb->memory.lcdc;
+
+    // Window and background enabled (LCDC Bits 5 and 0), LY has reached WY, and the next pixel is at WX-7 or past it
+    return (lcdc & 0x21) == 0x21 && *gb->memory.lcd_windowy <= *gb->memory.lcd_ly && state->x >= *gb->memory.lcd_windowx - 7;
+}
+
+static int sprite_starts(gb_t* gb, struct fifo_state* state) {
+
+    int n_sprites;
+    const unsigned char* sprites = ppu_line_sprites(gb, *gb->memory.lcd_ly, &n_sprites);
+
+    // The sprite's X (+ 8) is reached (LCDC Bit 1 enables sprites)
+    return (*gb->memory.lcdc & 0x2) && state->next_sprite < n_sprites
+        && ((const struct sprite_attributes*) gb->memory.oam)[sprites[state->next_sprite]].x <= state->x + 8;
+}
+
+/*
+ *  Shift out the next pixel, and draw it if draw is set
+ */
+static void shift_pixel(gb_t* gb, struct fifo_state* state, int draw) {
+
+    unsigned char background = state->background[8 - state->n_background--];
+
+    if (state->discard) {
+        state->discard--;
+        return;
+    }
+
+    unsigned char sprite = state->sprites[state->sprites_head];
+    state->sprites[state->sprites_head] = 0;
+    state->sprites_head = (state->sprites_head + 1) % 8;
+
+    int x = state->x++;
+
+    if (!draw)
+        return;
+
+    unsigned char lcdc = *gb->memory.lcdc;
+    unsigned char shades[4];
+
+    // Without the background (LCDC Bit 0) it's white, and sprites are over all of it
+    if (!(lcdc & 0x1))
+        background = 0;
+
+    // Color index 0 is transparent for sprites, and behind the background only background color 0 is drawn over
+    if ((lcdc & 0x2) && (sprite & 3) && !((sprite & 0x80) && background)) {
+
+        ppu_palette_shades(sprite & 0x10 ? *gb->memory.obj_palette_1_data : *gb->memory.obj_palette_0_data, shades);
+        gb->ppu.scanlinesbuffer[*gb->memory.lcd_ly*SCREEN_WIDTH + x] = shades[sprite & 3];
+    }
+    else if (lcdc & 0x1) {
+
+        ppu_palette_shades(*gb->memory.lcd_bgp, shades);
+        gb->ppu.scanlinesbuffer[*gb->memory.lcd_ly*SCREEN_WIDTH + x] = shades[background];
+    }
+    else
+        gb->ppu.scanlinesbuffer[*gb->memory.lcd_ly*SCREEN_WIDTH + x] = 255;
+}
+
+/*
+ *  Run one dot of mode 3
+ *  Returns 1 when the line is finished
+ */
+static int step(gb_t* gb, struct fifo_state* state, int draw) {
+
+    state->dot++;
+
+    // The fetcher works on its tile line (then waits with it until the background FIFO is empty)
+    if (state->fetch_dots < FETCH_DOTS && ++state->fetch_dots == FETCH_DOTS)
+        fetch_tile(gb, state);
+
+    // A sprite is fetched once the fetcher is on the last dot of its tile line (or has it), nothing is shifted out until then
+    if (state->sprite_dots >= 0) {
+
+        if (state->fetch_dots >= FETCH_DOTS - 1 && ++state->sprite_dots == SPRITE_FETCH_DOTS) {
+            fetch_sprite(gb, state);
+            state->sprite_dots = -1;
+        }
+
+        return 0;
+    }
+
+    if (state->fetch_dots == FETCH_DOTS && !state->n_background) {
+
+        memcpy(state->background, state->fetched, 8);
+        state->n_background = 8;
+
+        state->fetch_dots = 0;
+        state->fetch_x++;
+    }
+
+    if (!state->n_background)
+        return 0;
+
+    // The window starts: the background FIFO is cleared and the fetcher starts again from the window's first tile
+    if (!state->window && window_starts(gb, state)) {
+
+        state->window = 1;
+        state->n_background = 0;
+        state->fetch_dots = 0;
+        state->fetch_x = 0;
+
+        // (the part of it left of the screen, with WX under 7)
+        state->discard = state->x == 0 && *gb->memory.lcd_windowx < 7 ? 7 - *gb->memory.lcd_windowx : 0;
+        return 0;
+    }
+
+    if (!state->discard && sprite_starts(gb, state)) {
+        state->sprite_dots = 0;
+        return 0;
+    }
+
+    shift_pixel(gb, state, draw);
+
+    return state->x == SCREEN_WIDTH;
+}
+
+
+
+/*---- Lines ------------------------------------------------------*/
+
+
+/*
+ *  Draw the line from where the FIFO is to its end (with the registers as they are now)
+ */
+static void draw_ahead(gb_t* gb) {
+
+    struct pixel_fifo* fifo = &gb->ppu.fifo;
+    struct fifo_state state = fifo->state;
+
+    while (!step(gb, &state, gb->ppu.frame_skip.drawing))
+        ;
+
+    fifo->length = state.dot;
+    fifo->window_drawn = state.window;
+}
+
+/*
+ *  Mode 3 of a visible line starts at start
+ */
+void fifo_start_line(gb_t* gb, unsigned long long start) {
+
+    struct pixel_fifo* fifo = &gb->ppu.fifo;
+    struct fifo_state* state = &fifo->state;
+
+    memset(state, 0, sizeof(struct fifo_state));
+
+    // The first fetch is thrown away (and it's a dot more than a fetch before the first pixel)
+    state->fetch_dots = -FETCH_DOTS - 1;
+    state->discard = *gb->memory.lcd_scx % 8;
+    state->sprite_dots = -1;
+
+    fifo->start = start;
+    fifo->drawing = 1;
+
+    draw_ahead(gb);
+}
+
+/*
+ *  Mode 3 is over (the line was drawn by then)
+ */
+void fifo_finish_line(gb_t* gb) {
+
+    struct pixel_fifo* fifo = &gb->ppu.fifo;
+
+    if (!fifo->drawing)
+        return;
+
+    fifo->drawing = 0;
+
+    // Only lines that show the window move it down
+    if (fifo->window_drawn)
+        gb->ppu.window_line++;
+}
+
+/*
+ *  Called before an LCD register is written: the line so far is drawn with what it was
+ */
+void fifo_catch_up(gb_t* gb) {
+
+    struct pixel_fifo* fifo = &gb->ppu.fifo;
+
+    if (!fifo->drawing || gb->scheduler.now < fifo->start || gb->scheduler.now >= fifo->start + fifo->length)
+        return;
+
+    while (fifo->state.dot < (int) (gb->scheduler.now - fifo->start))
+        step(gb, &fifo->state, gb->ppu.frame_skip.drawing);
+}
+
+/*
+ *  Called after an LCD register is written: the rest of the line is drawn again,
+ *  and mode 3 might end at a different time
+ */
+void fifo_redraw(gb_t* gb) {
+
+    struct pixel_fifo* fifo = &gb->ppu.fifo;
+
+    if (!fifo->drawing || gb->scheduler.now < fifo->start || gb->scheduler.now >= fifo->start + fifo->length)
+        return;
+
+    // (the LCD was turned off)
+    if (!(*gb->memory.lcdc & 0x80)) {
+        fifo->drawing = 0;
+        return;
+    }
+
+    draw_ahead(gb);
+
+    // Next ppu event is the end of mode 3 (see schedule_ppu)
+    scheduler_schedule(gb, EVENT_PPU, fifo->start + fifo->length + 1);
+}
+
+#endif
@@ -0,0 +1,34 @@
+#include <string.h>
+
+#include "gb.h"
+
+/*
+ *  Reset gb to a Gameboy with no cartridge inserted
+ */
+void gb_init(gb_t* gb) {
+
+    memset(gb, 0, sizeof(gb_t));
+
+    scheduler_init(gb);
+
+    mmu_init(gb);
+    ppu_init(gb);
+    timer_init(gb);
+}
+
+/*
+ *  Free everything gb allocated while running (not gb itself)
+ */
+void gb_free(gb_t* gb) {
+
+    block_flush(gb);
+
+    rewind_free(gb);
+    cheats_clear(gb);
+    save_free(gb);
+    mmu_free(gb);
+
+#ifdef JIT
+    jit_free(gb);
+#endif
+}
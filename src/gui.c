@@ -0,0 +1,370 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+
+/* #ifdef __APPLE__ */
+#ifndef _WIN32
+#define GLEW_STATIC
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#endif
+
+#ifdef _WIN32
+#include <SDL.h>
+#endif
+
+
+#include "gb.h"
+#include "gui.h"
+
+
+static int graphics_enabled = 0;
+
+
+/*---- Key Events -------------------------------------------------*/
+
+static void handle_input(GLFWwindow* window, int key, int scancode, int action, int mods) {
+
+    /* Joypad Key has 8 bits for 8 buttons
+     * Bit 7 = Standard Start
+     * Bit 6 = Standard Select
+     * Bit 5 = Standard Button B
+     * Bit 4 = Standard Button A
+     * Bit 3 = Direction Input Down
+     * Bit 2 = Direction Input Up
+     * Bit 1 = Direction Input Left
+     * Bit 0 = Direction Input Right
+     */
+
+    /* Joypad Register $FF00 holds this information:
+     
+        Bit 7 - Not used
+        Bit 6 - Not used
+        Bit 5 - P15 Select Button Keys      (0=Select)
+        Bit 4 - P14 Select Direction Keys   (0=Select)
+        Bit 3 - P13 Input Down  or Start    (0=Pressed) (Read Only)
+        Bit 2 - P12 Input Up    or Select   (0=Pressed) (Read Only)
+        Bit 1 - P11 Input Left  or Button B (0=Pressed) (Read Only)
+        Bit 0 - P10 Input Right or Button A (0=Pressed) (Read Only)
+
+    */
+
+
+
+    gb_t* gb = glfwGetWindowUserPointer(window);
+
+    unsigned char joypad_key = 0;
+    switch (key) {
+        case GLFW_KEY_D:
+            // Right direction
+            joypad_key = 1;
+            break;
+        case GLFW_KEY_A:
+            // Left
+            joypad_key = 1 << 1;
+            break;
+        case GLFW_KEY_W:
+            // Up
+            joypad_key = 1 << 2;
+            break;
+        case GLFW_KEY_S:
+            // Down
+            joypad_key = 1 << 3;
+            break;
+        case GLFW_KEY_J:
+            // Button A
+            joypad_key = 1 << 4;
+            break;
+        case GLFW_KEY_K:
+            // Button B
+            joypad_key = 1 << 5;
+            break;
+        case GLFW_KEY_M:
+            // Standard Select
+            joypad_key = 1 << 6;
+            break;
+        case GLFW_KEY_N:
+            // Standard Start
+            joypad_key = 1 << 7;
+            break;
+        case GLFW_KEY_BACKSPACE:
+            // Rewind while it's held (see rewind.h)
+            gb->rewind.held = action != GLFW_RELEASE;
+            return;
+        default:
+            // When it's not one of those keys do nothing
+            return;
+    }
+
+    if (action == GLFW_PRESS) {
+
+        // Set the key as pressed:
+        // this state is used every emulator loop to check for inputs pressed
+        gb->joypad_state |= joypad_key;
+
+    }
+    else if (action == GLFW_RELEASE) {
+
+        // The button is no longer pressed so clear it from the joypad state
+        gb->joypad_state &= ~joypad_key;
+
+    }
+
+}
+
+
+
+
+
+/*---- Rendering --------------------------------------------------*/
+
+
+#ifdef __APPLE__
+static GLFWwindow* window;
+
+static void framebuffer_size_callback(GLFWwindow* window, int width, int height)
+{
+    // make sure the viewport matches the new window dimensions; note that width and
+    // height will be significantly larger than specified on retina displays.
+    glViewport(0, 0, SCREEN_WIDTH*SCREEN_MULTIPLIER, SCREEN_HEIGHT*SCREEN_MULTIPLIER);
+}
+
+static void window_size_callback(GLFWwindow* window, int width, int height) {
+    // make sure the viewport matches the new window dimensions; note that width and
+    // height will be significantly larger than specified on retina displays.
+    glViewport(0, 0, width, height);
+}
+
+#endif
+
+#ifdef _WIN32
+static SDL_Window* window = NULL;
+static SDL_Renderer * renderer = NULL;
+static SDL_Texture * texture = NULL;
+static SDL_Event e;
+#endif
+
+void init_gui(gb_t* gb) {
+#ifdef __APPLE__
+    /* Initialize the library */
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    /* glfwWindowHint(GLFW_DECORATED, GL_FALSE); */
+
+    window = glfwCreateWindow(SCREEN_WIDTH*SCREEN_MULTIPLIER, SCREEN_HEIGHT*SCREEN_MULTIPLIER, "Gameboy", NULL, NULL);
+    if (!window)
+    {
+        glfwTerminate();
+        exit(-1);
+    }
+
+    glfwMakeContextCurrent(window);
+
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwSetWindowSizeCallback(window, window_size_callback);
+
+    glfwSetWindowAspectRatio(window, SCREEN_WIDTH, SCREEN_HEIGHT);
+
+    /* Glew initialization */
+    if (glewInit() != GLEW_OK) exit(1);
+
+    /* Create shaders */
+    const char* vert_shader = "\
+        #version 330 core\n\
+        layout (location = 0) in vec3 iPos;\
+        layout (location = 1) in vec2 iTexCoord;\
+        out vec2 TexCoord;\
+        void main()\
+        {\
+            TexCoord = vec2(iTexCoord.x, iTexCoord.y);\
+            gl_Position = vec4(iPos, 1.0);\
+        }\
+    ";
+
+    unsigned int vertex = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vertex, 1, &vert_shader, NULL);
+    glCompileShader(vertex);
+
+    // print compile errors
+    int success;
+    glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
+    char infoLog[512];
+    if(!success)
+    {
+        glGetShaderInfoLog(vertex, 512, NULL, infoLog);
+        printf("Compile Error: %s\n", infoLog);
+    };
+
+    const char* frag_shader = "\
+        #version 330 core\n\
+        out vec4 frag_color;\
+        in vec2 TexCoord;\
+        uniform sampler2D tex;\
+        void main()\
+        {\
+            frag_color = vec4(texture(tex, TexCoord).r);\
+        }\
+    ";
+
+    unsigned int fragment = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fragment, 1, &frag_shader, NULL);
+    glCompileShader(fragment);
+
+    // print compile errors
+    glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
+    if(!success)
+    {
+        glGetShaderInfoLog(fragment, 512, NULL, infoLog);
+        printf("Compile Error: %s\n", infoLog);
+    };
+
+    unsigned int prog_id = glCreateProgram();
+
+    glAttachShader(prog_id, vertex);
+    glAttachShader(prog_id, fragment);
+    glLinkProgram(prog_id);
+
+    glGetProgramiv(prog_id, GL_LINK_STATUS, &success);
+    if(!success)
+    {
+        glGetProgramInfoLog(prog_id, 512, NULL, infoLog);
+        printf("Compile Error: %s\n", infoLog);
+    }
+
+    glDeleteShader(vertex);
+    glDeleteShader(fragment);
+
+    glUseProgram(prog_id);
+
+    float vertices[] = {
+        // positions          // texture coords
+         1.0f,  1.0f, 0.0f,   1.0f, 0.0f,   // top right
+         1.0f, -1.0f, 0.0f,   1.0f, 1.0f,   // bottom right
+        -1.0f, -1.0f, 0.0f,   0.0f, 1.0f,   // bottom left
+        -1.0f,  1.0f, 0.0f,   0.0f, 0.0f    // top left
+    };
+    unsigned int indices[] = {
+        0, 1, 3, // first triangle
+        1, 2, 3  // second triangle
+    };
+
+    unsigned int vertex_attr_buf, vertex_data_buf, elem_data_buf;
+    glGenVertexArrays(1, &vertex_attr_buf);
+    glGenBuffers(1, &vertex_data_buf);
+    glGenBuffers(1, &elem_data_buf);
+
+
+    glBindVertexArray(vertex_attr_buf); /* we only need to set it once */
+
+    glBindBuffer(GL_ARRAY_BUFFER, vertex_data_buf);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elem_data_buf);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+
+    int textureLoc = glGetUniformLocation(prog_id, "tex");
+
+    glUniform1i(textureLoc, 0); // Set the active texture location (default is 0) (when bindTexture, it'll bind to active texture, and we can have multiple of these)
+
+    /* Bind texture once, since we only use one and we won't be changing it */
+    unsigned int tex;
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	// set texture wrapping to GL_REPEAT (default wrapping method)
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    // set texture filtering parameters
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    glClearColor(0, 0, 0, 1);
+
+    
+    /* Set input handler for key presses (for the gb shown in the window) */
+    glfwSetWindowUserPointer(window, gb);
+    glfwSetKeyCallback(window, handle_input);
+
+#endif
+
+#ifdef _WIN32
+    SDL_Init( SDL_INIT_VIDEO );
+    //Create window
+    window = SDL_CreateWindow( "Gameboy", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN );
+    renderer = SDL_CreateRenderer(window, -1, 0);
+    //Get window surface
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, SCREEN_WIDTH, SCREEN_HEIGHT);
+#endif
+    graphics_enabled = 1;
+}
+
+
+void render_frame(gb_t* gb) {
+    if (graphics_enabled) {
+
+#ifdef __APPLE__
+        if(!glfwWindowShouldClose(window)) {
+
+            /* Render here */
+
+            /* glClear(GL_COLOR_BUFFER_BIT); */ // don't need it for now
+
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, SCREEN_WIDTH, SCREEN_HEIGHT, 0, GL_RED, GL_UNSIGNED_BYTE, gb->ppu.scanlinesbuffer);
+
+            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+
+            /* Swap front and back buffers
+             * (back buffer is being written to, front buffer is being rendered)
+             */
+            glfwSwapBuffers(window);
+
+            /* Poll for and process events */
+            glfwPollEvents();
+
+        }
+        else {
+            glfwDestroyWindow(window);
+            glfwTerminate();
+            exit(0);
+        }
+#endif
+
+#ifdef _WIN32
+        unsigned int pixels [SCREEN_WIDTH*SCREEN_HEIGHT];
+        for (int i=0; i<sizeof(gb->ppu.scanlinesbuffer);i++){
+            unsigned int  aux = gb->ppu.scanlinesbuffer[i];
+            pixels[i] =  0xFF00000000;
+            for(int j = 0; j<3;j++){
+                pixels[i] |= (aux << j*8);
+            }
+        }
+        //memset(pixels, 255, SCREEN_WIDTH * SCREEN_HEIGHT * sizeof(int));
+        SDL_UpdateTexture(texture, NULL, pixels, SCREEN_WIDTH * sizeof(int));
+        SDL_RenderClear(renderer);
+        SDL_RenderCopy(renderer, texture, NULL, NULL);
+        SDL_RenderPresent(renderer);
+
+        if( SDL_PollEvent( &e ) != 0 ) {
+           //User requests quit
+           if( e.type == SDL_QUIT ) {
+               SDL_DestroyWindow( window );
+               window = NULL;
+               SDL_DestroyRenderer(renderer);
+               SDL_DestroyTexture(texture);
+               SDL_Quit();
+               exit(0);
+           }
+        }
+
+#endif
+
+    }
+}
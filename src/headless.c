@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "emulator.h"
+#include "gb.h"
+
+
+static const int CPU_HZ = 4194304;
+
+/*
+ *  Write the frame in scanlinesbuffer as a binary PGM (160x144, 255 is white)
+ */
+static int dump_frame(gb_t* gb, const char* prefix, int number) {
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s%06d.pgm", prefix, number);
+
+    FILE* pgm = fopen(path, "wb");
+
+    if (!pgm) {
+        perror(path);
+        return -1;
+    }
+
+    fprintf(pgm, "P5\n%d %d\n255\n", SCREEN_WIDTH, SCREEN_HEIGHT);
+    fwrite(gb->ppu.scanlinesbuffer, 1, sizeof(gb->ppu.scanlinesbuffer), pgm);
+    fclose(pgm);
+
+    return 0;
+}
+
+/*
+ *  Run cycles cycles as fast as possible, writing every dump_every-th frame the LCD shows
+ *  to prefix (if there's one), numbered from first. Only those frames are drawn, the others
+ *  are skipped (and so is the one that's already started).
+ *  Returns how many were written, or -1 if one couldn't be
+ */
+static int run(gb_t* gb, unsigned long long cycles, const char* prefix, int dump_every, int first) {
+
+    unsigned long long end = gb->scheduler.now + cycles;
+    int vblanks = 0, dumped = 0;
+    unsigned char last_ly = *gb->memory.lcd_ly;
+
+    ppu_set_frame_skip(gb, 0, 0);
+
+    if (prefix)
+        ppu_request_frame(gb);
+
+    while (gb->scheduler.now < end) {
+
+        /* A scanline at a time: a drawn frame is written at VBlank,
+         * before the next one can start drawing over it
+         */
+        unsigned long long line_end = gb->scheduler.now + 456;
+        scheduler_run(gb, line_end < end ? line_end : end);
+
+        unsigned char ly = *gb->memory.lcd_ly;
+
+        if (ly >= 144 && last_ly < 144 && prefix) {
+
+            if (ppu_new_frame(gb) && dump_frame(gb, prefix, first + dumped++))
+                return -1;
+
+            if (++vblanks % dump_every == 0)
+                ppu_request_frame(gb);
+        }
+
+        last_ly = ly;
+    }
+
+    return dumped;
+}
+
+/*
+ *  Runs a ROM without a window (nothing but libgbcore.a, no GLFW or GLEW)
+ *
+ *  Usage: gb-headless ROM [-f FRAMES | -n CYCLES] [-o PREFIX [-e N]] [-l FILE [-p PASSES]] [-w FILE] [-c CODE]... [-j]
+ *         gb-headless -t TESTROM [...]
+ *
+ *  -f runs FRAMES frames of FRAME_MAX_CYCLES (600 by default), -n runs CYCLES cycles instead
+ *  -o writes every Nth frame the LCD shows (-e, every one by default) to PREFIX000000.pgm, PREFIX000001.pgm, ...
+ *  -l loads a save state first, -p runs PASSES times, loading it again before each (their frames are numbered on)
+ *  -w writes a save state at the end
+ *  -c enters a Game Genie or GameShark code, -j runs hot code through the recompiler (-DJIT)
+ */
+int main(int argc, char *argv[]) {
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s ROM [-f FRAMES | -n CYCLES] [-o PREFIX [-e N]] [-l FILE [-p PASSES]] [-w FILE] [-c CODE]... [-j]\n", argv[0]);
+        fprintf(stderr, "       %s -t TESTROM [...]\n", argv[0]);
+        return 1;
+    }
+
+    char* romstring = argv[1];
+    char* testing = NULL;
+
+    unsigned long long cycles = 600ULL * FRAME_MAX_CYCLES;
+    char* prefix = NULL;
+    int dump_every = 1;
+    char* load_path = NULL;
+    char* write_path = NULL;
+    int passes = 1;
+
+    for (int i = 1; i < argc - 1; i++) {
+
+        if (argv[i][0] != '-')
+            continue;
+
+        switch (argv[i][1]) {
+        case 't':
+            testing = argv[i+1];
+            break;
+        case 'f':
+            cycles = strtoull(argv[i+1], NULL, 0) * FRAME_MAX_CYCLES;
+            break;
+        case 'n':
+            cycles = strtoull(argv[i+1], NULL, 0);
+            break;
+        case 'o':
+            prefix = argv[i+1];
+            break;
+        case 'e':
+            dump_every = atoi(argv[i+1]);
+            break;
+        case 'l':
+            load_path = argv[i+1];
+            break;
+        case 'w':
+            write_path = argv[i+1];
+            break;
+        case 'p':
+            passes = atoi(argv[i+1]);
+            break;
+        }
+    }
+
+    if (dump_every < 1) {
+        fprintf(stderr, "Can't write every %d frames\n", dump_every);
+        return 1;
+    }
+
+    if (passes < 1 || (passes > 1 && !load_path)) {
+        fprintf(stderr, "Can't run %d passes (more than one needs a state to start them from)\n", passes);
+        return 1;
+    }
+
+    gb_t* gb = malloc(sizeof(gb_t));
+    gb_init(gb);
+
+    emulator_start(gb, write_path);
+
+#ifdef JIT
+    // "-j" (anywhere) runs hot code through the recompiler
+    for (int i = 1; i < argc; i++) {
+
+        if (argv[i][0]=='-' && argv[i][1]=='j')
+            gb->jit.enabled = 1;
+    }
+#endif
+
+    // A test rom (-t) is inserted by load_tests instead
+    if (testing == NULL && insert_cartridge(gb, romstring))
+        return 1;
+
+    load_roms(gb);
+
+    if (testing != NULL) {
+
+        if (load_tests(gb, testing))
+            return 1;
+
+        boot_tests(gb);
+    }
+
+    for (int i = 1; i < argc - 1; i++) {
+
+        if (argv[i][0]=='-' && argv[i][1]=='c' && cheats_add(gb, argv[i+1]))
+            return 1;
+    }
+
+    boot(gb);
+
+    // Kept open: loading it again only copies back the pages written since (see state.h)
+    struct state* state = NULL;
+
+    if (load_path && !(state = state_open(load_path)))
+        return 1;
+
+    clock_t clock_start = clock();
+
+    int dumped = 0;
+
+    for (int pass = 0; pass < passes; pass++) {
+
+        if (state && state_load(gb, state))
+            return 1;
+
+        int pass_dumped = run(gb, cycles, prefix, dump_every, dumped);
+
+        if (pass_dumped < 0)
+            return 1;
+
+        dumped += pass_dumped;
+    }
+
+    double seconds = ((double) (clock()-clock_start))/CLOCKS_PER_SEC;
+
+    if (state)
+        state_close(state);
+
+    printf("Ran %llu cycles (%.1f frames) in %.3fs, %.1fx real time\n",
+            cycles * passes, (double) cycles * passes / FRAME_MAX_CYCLES, seconds, seconds ? (double) cycles * passes / CPU_HZ / seconds : 0);
+
+    if (prefix)
+        printf("Wrote %d frames to %s*.pgm\n", dumped, prefix);
+
+    emulator_stop(gb);
+
+    gb_free(gb);
+    free(gb);
+
+    return 0;
+}
@@ -0,0 +1,215 @@
+#ifdef HEATMAP
+
+#include <stdio.h>
+
+#include "gb.h"
+
+static const int CELL_SIZE = 16;   // pixels per page in heatmap.pgm
+
+/*
+ *  Called for every read and write, before it's done
+ */
+void heatmap_count(gb_t* gb, unsigned short address, int write) {
+
+    struct heatmap* heatmap = &gb->heatmap;
+
+#define COUNT(counter) (write ? (counter).writes++ : (counter).reads++)
+
+    COUNT(heatmap->pages[address >> 8]);
+
+    unsigned char mode = *gb->memory.lcdc_stat & 3;
+
+#ifdef DMA_TIMING
+    if (mmu_dma_blocks(gb, address)) {
+        COUNT(heatmap->dma_blocked);
+        return;
+    }
+#endif
+
+    if (address < 0x8000) {
+
+        // Writes go to the MBC, not to a bank
+        if (write)
+            return;
+
+        if (address < 0x100 && gb->cartridge.cartridge_loaded < 2)
+            COUNT(heatmap->rom_banks[HEATMAP_ROM_BANKS]);
+        else
+            COUNT(heatmap->rom_banks[gb->cartridge.rom_bank_numbers[address >> 14] & (HEATMAP_ROM_BANKS-1)]);
+    }
+    else if (address < 0xa000) {
+
+        COUNT(heatmap->vram_modes[mode]);
+
+        if (mode == 3)
+            COUNT(heatmap->vram_blocked);
+    }
+    else if (address < 0xc000) {
+
+        if (gb->cartridge.ram_bank) {
+
+            int bank = (gb->cartridge.ram_bank - gb->cartridge.ram_banks) / 0x2000;
+            COUNT(heatmap->ram_banks[bank & (HEATMAP_RAM_BANKS-1)]);
+        }
+        else
+            COUNT(heatmap->ram_banks[HEATMAP_RAM_BANKS]);
+    }
+    else if (address >= 0xfe00 && address < 0xfea0) {
+
+        COUNT(heatmap->oam_modes[mode]);
+
+        if (mode > 1)
+            COUNT(heatmap->oam_blocked);
+    }
+
+#undef COUNT
+}
+
+/*
+ *  Count what was done since before again, times more
+ *  (for the passes over an idle loop the scheduler skips, which do what the one it ran did)
+ */
+void heatmap_repeat(gb_t* gb, const struct heatmap* before, unsigned long long times) {
+
+    struct heatmap_counter* counters = (struct heatmap_counter*) &gb->heatmap;
+    const struct heatmap_counter* counters_before = (const struct heatmap_counter*) before;
+
+    for (unsigned int i = 0; i < sizeof(struct heatmap) / sizeof(struct heatmap_counter); i++) {
+
+        counters[i].reads += (counters[i].reads - counters_before[i].reads) * times;
+        counters[i].writes += (counters[i].writes - counters_before[i].writes) * times;
+    }
+}
+
+
+
+/*---- Report -----------------------------------------------------*/
+
+
+static void write_counter(FILE* csv, const char* region, const char* index, const struct heatmap_counter* counter) {
+
+    fprintf(csv, "%s,%s,%llu,%llu\n", region, index, counter->reads, counter->writes);
+}
+
+/*
+ *  Every page, and the banks, modes and blocked accesses that had any
+ */
+void heatmap_write_csv(gb_t* gb, FILE* csv) {
+
+    struct heatmap* heatmap = &gb->heatmap;
+    char index[16];
+
+    fprintf(csv, "region,index,reads,writes\n");
+
+    for (int page = 0; page < 256; page++) {
+        sprintf(index, "%02x00", page);
+        write_counter(csv, "page", index, &heatmap->pages[page]);
+    }
+
+    for (int bank = 0; bank <= HEATMAP_ROM_BANKS; bank++) {
+
+        if (!heatmap->rom_banks[bank].reads)
+            continue;
+
+        if (bank == HEATMAP_ROM_BANKS)
+            sprintf(index, "bootstrap");
+        else
+            sprintf(index, "%d", bank);
+
+        write_counter(csv, "rom_bank", index, &heatmap->rom_banks[bank]);
+    }
+
+    for (int bank = 0; bank <= HEATMAP_RAM_BANKS; bank++) {
+
+        if (!heatmap->ram_banks[bank].reads && !heatmap->ram_banks[bank].writes)
+            continue;
+
+        if (bank == HEATMAP_RAM_BANKS)
+            sprintf(index, "mbc");
+        else
+            sprintf(index, "%d", bank);
+
+        write_counter(csv, "ram_bank", index, &heatmap->ram_banks[bank]);
+    }
+
+    for (int mode = 0; mode < 4; mode++) {
+        sprintf(index, "%d", mode);
+        write_counter(csv, "vram_mode", index, &heatmap->vram_modes[mode]);
+        write_counter(csv, "oam_mode", index, &heatmap->oam_modes[mode]);
+    }
+
+    write_counter(csv, "blocked", "vram", &heatmap->vram_blocked);
+    write_counter(csv, "blocked", "oam", &heatmap->oam_blocked);
+    write_counter(csv, "blocked", "dma", &heatmap->dma_blocked);
+}
+
+// Bits in count (a log2 scale that's 0 for 0)
+static int magnitude(unsigned long long count) {
+
+    return count ? 64 - __builtin_clzll(count) : 0;
+}
+
+/*
+ *  The pages as a binary PGM: reads on the left, writes on the right, a gap between them
+ */
+void heatmap_write_pgm(gb_t* gb, FILE* pgm) {
+
+    struct heatmap_counter* pages = gb->heatmap.pages;
+
+    unsigned long long most = 0;
+
+    for (int page = 0; page < 256; page++) {
+        if (pages[page].reads > most)
+            most = pages[page].reads;
+        if (pages[page].writes > most)
+            most = pages[page].writes;
+    }
+
+    int width = 33*CELL_SIZE, height = 16*CELL_SIZE;
+
+    fprintf(pgm, "P5\n%d %d\n255\n", width, height);
+
+    for (int y = 0; y < height; y++) {
+
+        for (int x = 0; x < width; x++) {
+
+            int panel = x / (17*CELL_SIZE);   // 0 reads, 1 writes
+            int column = (x - panel*17*CELL_SIZE) / CELL_SIZE;
+
+            unsigned char shade = 0;
+
+            if (column < 16 && most) {
+
+                struct heatmap_counter* counter = &pages[(y / CELL_SIZE)*16 + column];
+                unsigned long long count = panel ? counter->writes : counter->reads;
+
+                shade = 255 * magnitude(count) / magnitude(most);
+            }
+
+            fputc(shade, pgm);
+        }
+    }
+}
+
+/*
+ *  Write heatmap.csv and heatmap.pgm
+ */
+void heatmap_dump(gb_t* gb) {
+
+    FILE* csv = fopen("heatmap.csv", "w");
+    FILE* pgm = fopen("heatmap.pgm", "wb");
+
+    if (csv) {
+        heatmap_write_csv(gb, csv);
+        fclose(csv);
+    }
+
+    if (pgm) {
+        heatmap_write_pgm(gb, pgm);
+        fclose(pgm);
+    }
+
+    printf("Memory heatmap written to heatmap.csv and heatmap.pgm\n");
+}
+
+#endif
@@ -0,0 +1,504 @@
+#ifdef JIT
+
+#ifndef __x86_64__
+#error "The JIT only generates x86-64 code"
+#endif
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "gb.h"
+
+#define HOT_BLOCK_THRESHOLD 16  // times a block is interpreted before it's translated
+
+
+
+/*---- Code Generation --------------------------------------------*/
+
+
+/*
+ *  Generated blocks are functions int block(gb_t* gb) returning the cycles taken,
+ *  with these registers kept through the whole block:
+ *
+ *      rbx = gb
+ *      r12d = cycles taken so far
+ *      r13 = &gb->block_cache.exit_request
+ *
+ *  Guest registers live in memory (gb->registers, the first member of gb_t
+ *  so the offsets fit in a byte), and are accessed as [rbx + offset]
+ *
+ *  A block is left after the instruction that reaches the next event's deadline,
+ *  like the interpreter stops at it (see scheduler.h), so each instruction adds its
+ *  cycles and leaves pc past itself before the check. Instructions run by the
+ *  interpreter see the time they start at, as they would outside a block
+ */
+
+#define CODE_BUFFER_SIZE (8 << 20)  // 8MB
+#define MAX_BLOCK_CODE_SIZE 4096    // (a block of 32 instructions takes less than 3K)
+
+#define REGISTER(r) ((unsigned char) offsetof(gb_t, registers.r))
+
+#define OFFSET_HL 0xff // register index 6 is (HL), which isn't translated
+
+static const unsigned char register_offsets[8] = {
+    REGISTER(b), REGISTER(c), REGISTER(d), REGISTER(e), REGISTER(h), REGISTER(l), OFFSET_HL, REGISTER(a)
+};
+
+static const unsigned char register_pair_offsets[4] = {
+    REGISTER(bc), REGISTER(de), REGISTER(hl), REGISTER(sp)
+};
+
+static void emit8(gb_t* gb, unsigned char byte) {
+
+    *gb->jit.code++ = byte;
+}
+
+static void emit16(gb_t* gb, unsigned short word) {
+
+    memcpy(gb->jit.code, &word, 2);
+    gb->jit.code += 2;
+}
+
+static void emit32(gb_t* gb, unsigned int dword) {
+
+    memcpy(gb->jit.code, &dword, 4);
+    gb->jit.code += 4;
+}
+
+static void emit64(gb_t* gb, unsigned long qword) {
+
+    memcpy(gb->jit.code, &qword, 8);
+    gb->jit.code += 8;
+}
+
+/* ModRM for [rbx + disp8] with the given reg field */
+static void emit_rbx_operand(gb_t* gb, unsigned char reg, unsigned char offset) {
+
+    emit8(gb, 0x40 | (reg << 3) | 3);
+    emit8(gb, offset);
+}
+
+/* Convert the x86 flags in ah (from lahf) to the Gameboy flags in ah
+ *
+ * lahf: SF ZF 0 AF 0 PF 1 CF (bits 7-0)
+ * flag register: Z N H CY 0 0 0 0
+ *
+ * ZF and AF are one bit to the right of Z and H,
+ * and x86 AF/CF mean the same as H/CY for 8 bit adds and subtractions
+ */
+static void emit_convert_flags(gb_t* gb, unsigned char keep_carry, unsigned char n_flag) {
+
+    if (!keep_carry) {
+        emit8(gb, 0x88); emit8(gb, 0xe1);                       // mov cl, ah
+        emit8(gb, 0x80); emit8(gb, 0xe1); emit8(gb, 0x01);      // and cl, 1
+        emit8(gb, 0xc0); emit8(gb, 0xe1); emit8(gb, 0x04);      // shl cl, 4
+    }
+
+    emit8(gb, 0x80); emit8(gb, 0xe4); emit8(gb, 0x50);      // and ah, 0x50
+    emit8(gb, 0xd0); emit8(gb, 0xe4);                       // shl ah, 1
+
+    if (!keep_carry) {
+        emit8(gb, 0x08); emit8(gb, 0xcc);       // or ah, cl
+    }
+
+    if (n_flag) {
+        emit8(gb, 0x80); emit8(gb, 0xcc); emit8(gb, FLAG_N);    // or ah, FLAG_N
+    }
+}
+
+/* Replace the flags in F (keeping the ones in mask) with ah */
+static void emit_store_flags(gb_t* gb, unsigned char mask) {
+
+    emit8(gb, 0x80); emit_rbx_operand(gb, 4, REGISTER(f)); emit8(gb, mask);     // and byte [f], mask
+    emit8(gb, 0x08); emit_rbx_operand(gb, 4, REGISTER(f));                      // or byte [f], ah
+}
+
+static void emit_add_cycles(gb_t* gb, int cycles) {
+
+    if (!cycles)
+        return;
+
+    emit8(gb, 0x41); emit8(gb, 0x81); emit8(gb, 0xc4); emit32(gb, cycles);      // add r12d, cycles
+}
+
+/*
+ *  8 bit ALU operation with A: ADD ADC SUB SBC AND XOR OR CP (in opcode order)
+ *  with either a register or an immediate
+ */
+static void emit_alu(gb_t* gb, unsigned char operation, unsigned char source_offset, unsigned char immediate, unsigned char is_immediate) {
+
+    static const unsigned char x86_register_opcodes[8] = { 0x02, 0x12, 0x2a, 0x1a, 0x22, 0x32, 0x0a, 0x3a };
+    static const unsigned char x86_immediate_opcodes[8] = { 0x04, 0x14, 0x2c, 0x1c, 0x24, 0x34, 0x0c, 0x3c };
+
+    unsigned char is_logic = operation >= 4 && operation <= 6;
+
+    emit8(gb, 0x0f); emit8(gb, 0xb6); emit_rbx_operand(gb, 0, REGISTER(a));     // movzx eax, byte [a]
+
+    if (operation == 1 || operation == 3) {
+        // Load the carry into the x86 carry flag
+        emit8(gb, 0x0f); emit8(gb, 0xb6); emit_rbx_operand(gb, 1, REGISTER(f));     // movzx ecx, byte [f]
+        emit8(gb, 0xc0); emit8(gb, 0xe9); emit8(gb, 0x05);                          // shr cl, 5 (CF = bit 4)
+    }
+
+    if (is_immediate) {
+        emit8(gb, x86_immediate_opcodes[operation]); emit8(gb, immediate);      // op al, imm8
+    }
+    else {
+        emit8(gb, x86_register_opcodes[operation]); emit_rbx_operand(gb, 0, source_offset);     // op al, byte [r]
+    }
+
+    emit8(gb, 0x9f);    // lahf
+
+    if (operation != 7) {
+        emit8(gb, 0x88); emit_rbx_operand(gb, 0, REGISTER(a));      // mov byte [a], al
+    }
+
+    if (is_logic) {
+
+        // Only Z depends on the result (H is set by AND)
+        emit8(gb, 0x80); emit8(gb, 0xe4); emit8(gb, 0x40);      // and ah, 0x40
+        emit8(gb, 0xd0); emit8(gb, 0xe4);                       // shl ah, 1
+        if (operation == 4) {
+            emit8(gb, 0x80); emit8(gb, 0xcc); emit8(gb, FLAG_H);    // or ah, FLAG_H
+        }
+    }
+    else
+        emit_convert_flags(gb, 0, operation >= 2);
+
+    emit_store_flags(gb, 0x0f);
+}
+
+/*
+ *  Translate instruction directly into x86 if possible
+ *  Returns 0 if it must be run by the interpreter
+ */
+static unsigned char emit_native(gb_t* gb, struct block_instruction* instruction) {
+
+    unsigned char opcode = instruction->opcode;
+
+    // Debug breakpoint, prints
+    if (opcode == 0x52)
+        return 0;
+
+#if defined(PROFILE) || defined(TRACE) || defined(HEATMAP)
+    // The profiler, the trace and the heatmap record instructions in the interpreter
+    return 0;
+#endif
+
+    // NOP
+    if (opcode == 0x00)
+        return 1;
+
+#ifdef LAZY_FLAGS
+    // The interpreter keeps the flags pending, so leave anything touching them to it
+    if ((opcode >= 0x80 && opcode < 0xc0) || (opcode & 0xc7) == 0xc6
+            || (opcode < 0x40 && ((opcode & 0x6) == 0x4 || opcode == 0x2f || opcode == 0x37 || opcode == 0x3f)))
+        return 0;
+#endif
+
+    // LD r, r'
+    if (opcode >= 0x40 && opcode < 0x80) {
+
+        unsigned char destination = register_offsets[(opcode >> 3) & 7];
+        unsigned char source = register_offsets[opcode & 7];
+
+        if (destination == OFFSET_HL || source == OFFSET_HL)
+            return 0;
+
+        emit8(gb, 0x0f); emit8(gb, 0xb6); emit_rbx_operand(gb, 0, source);      // movzx eax, byte [source]
+        emit8(gb, 0x88); emit_rbx_operand(gb, 0, destination);                  // mov byte [destination], al
+        return 1;
+    }
+
+    // 8 bit ALU with register
+    if (opcode >= 0x80 && opcode < 0xc0) {
+
+        if (register_offsets[opcode & 7] == OFFSET_HL)
+            return 0;
+
+        emit_alu(gb, (opcode >> 3) & 7, register_offsets[opcode & 7], 0, 0);
+        return 1;
+    }
+
+    // 8 bit ALU with immediate
+    if ((opcode & 0xc7) == 0xc6) {
+
+        emit_alu(gb, (opcode >> 3) & 7, 0, instruction->operand, 1);
+        return 1;
+    }
+
+    if (opcode < 0x40) {
+
+        unsigned char r = register_offsets[(opcode >> 3) & 7];
+        unsigned char rr = register_pair_offsets[(opcode >> 4) & 3];
+
+        switch (opcode & 0xf) {
+
+            case 0x1: // LD rr, nn
+                emit8(gb, 0x66); emit8(gb, 0xc7); emit_rbx_operand(gb, 0, rr); emit16(gb, instruction->operand);
+                return 1;
+            case 0x3: // INC rr
+                emit8(gb, 0x66); emit8(gb, 0xff); emit_rbx_operand(gb, 0, rr);
+                return 1;
+            case 0xb: // DEC rr
+                emit8(gb, 0x66); emit8(gb, 0xff); emit_rbx_operand(gb, 1, rr);
+                return 1;
+        }
+
+        if (r == OFFSET_HL)
+            return 0;
+
+        switch (opcode & 0x7) {
+
+            case 0x4: // INC r
+            case 0x5: // DEC r
+                emit8(gb, 0xfe); emit_rbx_operand(gb, opcode & 1, r);       // inc/dec byte [r]
+                emit8(gb, 0x9f);                                            // lahf
+                emit_convert_flags(gb, 1, opcode & 1);
+                emit_store_flags(gb, 0x1f);
+                return 1;
+            case 0x6: // LD r, n
+                emit8(gb, 0xc6); emit_rbx_operand(gb, 0, r); emit8(gb, instruction->operand);
+                return 1;
+        }
+    }
+
+    switch (opcode) {
+
+        case 0x2f: // CPL
+            emit8(gb, 0xf6); emit_rbx_operand(gb, 2, REGISTER(a));                                  // not byte [a]
+            emit8(gb, 0x80); emit_rbx_operand(gb, 1, REGISTER(f)); emit8(gb, FLAG_N | FLAG_H);      // or byte [f], N|H
+            return 1;
+        case 0x37: // SCF
+            emit8(gb, 0x80); emit_rbx_operand(gb, 4, REGISTER(f)); emit8(gb, ~(FLAG_N | FLAG_H));       // and byte [f], ~(N|H)
+            emit8(gb, 0x80); emit_rbx_operand(gb, 1, REGISTER(f)); emit8(gb, FLAG_CY);                  // or byte [f], CY
+            return 1;
+        case 0x3f: // CCF
+            emit8(gb, 0x80); emit_rbx_operand(gb, 6, REGISTER(f)); emit8(gb, FLAG_CY);                  // xor byte [f], CY
+            emit8(gb, 0x80); emit_rbx_operand(gb, 4, REGISTER(f)); emit8(gb, ~(FLAG_N | FLAG_H));       // and byte [f], ~(N|H)
+            return 1;
+        case 0xf9: // LD SP, HL
+            emit8(gb, 0x0f); emit8(gb, 0xb7); emit_rbx_operand(gb, 0, REGISTER(hl));    // movzx eax, word [hl]
+            emit8(gb, 0x66); emit8(gb, 0x89); emit_rbx_operand(gb, 0, REGISTER(sp));    // mov word [sp], ax
+            return 1;
+    }
+
+    return 0;
+}
+
+/*
+ *  Call the interpreter for instruction, with the program counter already past it
+ *  and the time when it starts
+ */
+static void emit_interpreter_call(gb_t* gb, struct block_instruction* instruction) {
+
+    emit8(gb, 0x48); emit8(gb, 0x8b); emit8(gb, 0x83); emit32(gb, offsetof(gb_t, jit.start));                    // mov rax, [rbx + start]
+    emit8(gb, 0x4c); emit8(gb, 0x01); emit8(gb, 0xe0);                                                          // add rax, r12
+    emit8(gb, 0x48); emit8(gb, 0x89); emit8(gb, 0x83); emit32(gb, offsetof(gb_t, scheduler.now));               // mov [rbx + now], rax
+    emit8(gb, 0x48); emit8(gb, 0x89); emit8(gb, 0x83); emit32(gb, offsetof(gb_t, scheduler.instruction_start)); // mov [rbx + instruction_start], rax
+
+    emit8(gb, 0x66); emit8(gb, 0xc7); emit_rbx_operand(gb, 0, REGISTER(pc));   // mov word [pc], next_pc
+    emit16(gb, instruction->next_pc);
+    emit8(gb, 0x48); emit8(gb, 0x89); emit8(gb, 0xdf);                          // mov rdi, rbx
+    emit8(gb, 0xbe); emit32(gb, instruction->opcode);                           // mov esi, opcode
+    emit8(gb, 0xba); emit32(gb, instruction->operand);                          // mov edx, operand
+    emit8(gb, 0x48); emit8(gb, 0xb8); emit64(gb, (unsigned long) cpu_execute_opcode);   // mov rax, cpu_execute_opcode
+    emit8(gb, 0xff); emit8(gb, 0xd0);                                           // call rax
+    emit8(gb, 0x41); emit8(gb, 0x01); emit8(gb, 0xc4);                          // add r12d, eax
+}
+
+/*
+ *  Leave if the cycles taken reach the next deadline (it can be earlier than when
+ *  the block started, if an instruction scheduled an event)
+ */
+static void emit_deadline_check(gb_t* gb, unsigned char** exit_jump) {
+
+    emit8(gb, 0x48); emit8(gb, 0x8b); emit8(gb, 0x83); emit32(gb, offsetof(gb_t, scheduler.next_deadline));   // mov rax, [rbx + next_deadline]
+    emit8(gb, 0x48); emit8(gb, 0x2b); emit8(gb, 0x83); emit32(gb, offsetof(gb_t, jit.start));                 // sub rax, [rbx + start]
+    emit8(gb, 0x49); emit8(gb, 0x39); emit8(gb, 0xc4);                                                        // cmp r12, rax
+    emit8(gb, 0x0f); emit8(gb, 0x83);                                                                         // jae epilogue
+    *exit_jump = gb->jit.code;
+    emit32(gb, 0);
+}
+
+static void translate_block(gb_t* gb, struct block* block) {
+
+    unsigned char* exit_jumps[MAX_BLOCK_INSTRUCTIONS*2];
+    int n_exit_jumps = 0;
+
+    block->code = (int (*)(gb_t*)) gb->jit.code;
+
+    // Prologue
+    emit8(gb, 0x53);                                        // push rbx
+    emit8(gb, 0x41); emit8(gb, 0x54);                       // push r12
+    emit8(gb, 0x41); emit8(gb, 0x55);                       // push r13
+    emit8(gb, 0x48); emit8(gb, 0x89); emit8(gb, 0xfb);      // mov rbx, rdi
+    emit8(gb, 0x4c); emit8(gb, 0x8d); emit8(gb, 0xaf);      // lea r13, [rdi + exit_request]
+    emit32(gb, offsetof(gb_t, block_cache.exit_request));
+    emit8(gb, 0x45); emit8(gb, 0x31); emit8(gb, 0xe4);      // xor r12d, r12d
+
+    for (int i = 0; i < block->n_instructions; i++) {
+
+        struct block_instruction* instruction = &block->instructions[i];
+
+        if (emit_native(gb, instruction)) {
+
+            // Translated code doesn't move pc along, so it's set for wherever the block is left
+            emit_add_cycles(gb, instructions_ticks[instruction->opcode]);
+            emit8(gb, 0x66); emit8(gb, 0xc7); emit_rbx_operand(gb, 0, REGISTER(pc)); emit16(gb, instruction->next_pc);    // mov word [pc], next_pc
+        }
+        else {
+
+            emit_interpreter_call(gb, instruction);
+
+            if (i < block->n_instructions-1) {
+
+                // Leave if the instruction asked to
+                emit8(gb, 0x41); emit8(gb, 0x80); emit8(gb, 0x7d); emit8(gb, 0x00); emit8(gb, 0x00);    // cmp byte [r13], 0
+                emit8(gb, 0x0f); emit8(gb, 0x85);                                                       // jne epilogue
+                exit_jumps[n_exit_jumps++] = gb->jit.code;
+                emit32(gb, 0);
+            }
+        }
+
+        if (i < block->n_instructions-1)
+            emit_deadline_check(gb, &exit_jumps[n_exit_jumps++]);
+    }
+
+    // Epilogue
+    for (int i = 0; i < n_exit_jumps; i++) {
+        int relative = gb->jit.code - (exit_jumps[i] + 4);
+        memcpy(exit_jumps[i], &relative, 4);
+    }
+
+    emit8(gb, 0x44); emit8(gb, 0x89); emit8(gb, 0xe0);      // mov eax, r12d
+    emit8(gb, 0x41); emit8(gb, 0x5d);                       // pop r13
+    emit8(gb, 0x41); emit8(gb, 0x5c);                       // pop r12
+    emit8(gb, 0x5b);                                        // pop rbx
+    emit8(gb, 0xc3);                                        // ret
+}
+
+
+
+/*---- Main Logic and Execution -----------------------------------*/
+
+
+static unsigned char init_jit(gb_t* gb) {
+
+    // Never writable and executable at once: translate makes the pages it writes writable while it does
+    gb->jit.code_buffer = mmap(NULL, CODE_BUFFER_SIZE, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (gb->jit.code_buffer == MAP_FAILED) {
+
+        perror("Couldn't allocate memory for the JIT");
+        gb->jit.code_buffer = NULL;
+        gb->jit.enabled = 0;
+        return 0;
+    }
+
+    gb->jit.code = gb->jit.code_buffer;
+
+    printf("JIT enabled.\n");
+
+    return 1;
+}
+
+/*
+ *  Translate block into the code buffer, which is only writable meanwhile
+ *  Returns 0 on success, or -1 if the pages couldn't be made writable (or executable again)
+ */
+static int translate(gb_t* gb, struct block* block) {
+
+    unsigned long page_size = sysconf(_SC_PAGESIZE);
+    unsigned char* start = (unsigned char*) ((unsigned long) gb->jit.code & ~(page_size - 1));
+    size_t length = gb->jit.code + MAX_BLOCK_CODE_SIZE - start;
+
+    if (mprotect(start, length, PROT_READ | PROT_WRITE)) {
+        perror("Couldn't make the JIT's code writable");
+        return -1;
+    }
+
+    translate_block(gb, block);
+
+    if (mprotect(start, length, PROT_READ | PROT_EXEC)) {
+        perror("Couldn't make the JIT's code executable");
+        block->code = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ *  Interpret a block that isn't translated yet, from its decoded instructions
+ *  (stopping after the instruction that reaches the next deadline, like translated blocks)
+ */
+static int interpret_block(gb_t* gb, struct block* block) {
+
+    int cycles = 0;
+
+    for (int i = 0; i < block->n_instructions && !gb->block_cache.exit_request
+            && gb->jit.start + cycles < gb->scheduler.next_deadline; i++) {
+
+        gb->scheduler.now = gb->scheduler.instruction_start = gb->jit.start + cycles;
+        gb->registers.pc = block->instructions[i].next_pc;
+        cycles += cpu_execute_opcode(gb, block->instructions[i].opcode, block->instructions[i].operand);
+    }
+
+    return cycles;
+}
+
+int jit_run(gb_t* gb) {
+
+    if (!gb->jit.code_buffer && !init_jit(gb))
+        return -1;
+
+    unsigned short address = gb->registers.pc;
+
+    struct block* block = block_lookup(gb, address);
+
+    if (!block)
+        return -1;
+
+    if (!block->code && ++block->times_run >= HOT_BLOCK_THRESHOLD) {
+
+        if (gb->jit.code + MAX_BLOCK_CODE_SIZE > gb->jit.code_buffer + CODE_BUFFER_SIZE) {
+
+            // Out of space, start over
+            block_flush(gb);
+            gb->jit.code = gb->jit.code_buffer;
+            block = block_lookup(gb, address);
+        }
+
+        // The interpreter runs everything from now on
+        if (translate(gb, block)) {
+            gb->jit.enabled = 0;
+            return -1;
+        }
+    }
+
+    gb->block_cache.exit_request = 0;
+    gb->jit.start = gb->scheduler.now;
+
+    int cycles = block->code ? block->code(gb) : interpret_block(gb, block);
+
+    // The caller adds the cycles the block took
+    gb->scheduler.now = gb->jit.start;
+
+    return cycles;
+}
+
+void jit_free(gb_t* gb) {
+
+    if (gb->jit.code_buffer)
+        munmap(gb->jit.code_buffer, CODE_BUFFER_SIZE);
+
+    gb->jit.code_buffer = NULL;
+    gb->jit.code = NULL;
+}
+
+#endif
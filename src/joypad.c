@@ -0,0 +1,43 @@
+#include "gb.h"
+
+/*
+ *  Scheduled when the frontend sets new keys (every frame) and when the cpu
+ *  selects a group of keys in $FF00
+ */
+void joypad_event(gb_t* gb) {
+    
+    // Before applying new states, reset the previous ones to avoid bugs
+    /* *joyp |= 0xF; */ // No longer needed bc no longer allow ANY write to the lower 4 bits
+
+    // joypad_state is defined in memory after reading from $FF00 joypad reg
+    // It holds information about the keys pressed
+    // The upper 4 bits are for standard inputs, the lower 4 are for direction inputs
+
+    /* printf("Before pressing, joypad is %x and joypad state is %x\n", *joyp, joypad_state); */
+    // $FF00 bit 4 with value 0 selects direction keys
+    if ((gb->joypad_state & 0xF) && !(*gb->memory.joyp & 0x10)) {
+
+        // Key pressed is a standard input and the type set
+        // in the joypad register ($FF00) is standard
+
+        *gb->memory.joyp &= ~(gb->joypad_state & 0xF);
+
+    }
+    // $FF00 bit 5 with value 0 selects button keys
+    else if ((gb->joypad_state & 0xF0) && !(*gb->memory.joyp & 0x20)) {
+
+        // Key pressed is a direction input and the type set
+        // in the joypad register ($FF00) is direction
+
+       *gb->memory.joyp &= ~(gb->joypad_state >> 4);
+
+    }
+    else {
+
+        // If no joypad_state is set, no key was inputted, so reset the key pressed in $ff00
+
+        return;
+    }
+
+    request_interrupt(gb, JOYPAD_INTERRUPT);
+}
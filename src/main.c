@@ -0,0 +1,222 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "emulator.h"
+#include "gb.h"
+#include "gui.h"
+
+
+static void emulate(gb_t* gb) {
+
+    while (1) {
+
+        clock_t clock_start = clock();
+
+        // Holding the rewind key plays the snapshots backwards, one a frame
+        if (gb->rewind.held)
+            rewind_step(gb);
+
+        update(gb);
+
+        // With frame skipping, only frames that were drawn are shown
+        if (ppu_new_frame(gb))
+            render_frame(gb);
+
+        if (!gb->rewind.held)
+            rewind_frame(gb);
+
+        clock_t clock_end = clock();
+        double time_taken = ((double) (clock_end-clock_start))/CLOCKS_PER_SEC;
+
+        sleep((1/60)-time_taken);
+    }
+
+}
+
+
+/*
+ *  Run frames frames as fast as possible (there's no window) drawing all of them,
+ *  then the same frames again skipping skip of every `every`, and print how fast each went
+ *  (the best of a few rounds of each, they take turns)
+ */
+static void bench(gb_t* gb, int frames, int skip, int every) {
+
+    // Both runs start from here
+    struct state_machine machine;
+    state_capture(gb, &machine);
+
+    unsigned char* memory = malloc(sizeof(gb->memory.memory));
+    unsigned char* ram = malloc(gb->cartridge.ram_size + 1);
+    memcpy(memory, gb->memory.memory, sizeof(gb->memory.memory));
+    memcpy(ram, gb->cartridge.ram_banks, gb->cartridge.ram_size);
+
+    double seconds[2] = { 0, 0 };
+
+    for (int round = 0; round < 3; round++) {
+
+        for (int run = 0; run < 2; run++) {
+
+            if ((round || run) && state_restore(gb, &machine, memory, ram, gb->cartridge.ram_size))
+                exit(1);
+
+            if (run)
+                ppu_set_frame_skip(gb, skip, every);
+            else
+                ppu_set_frame_skip(gb, 0, 1);
+
+            clock_t clock_start = clock();
+
+            for (int frame = 0; frame < frames; frame++)
+                update(gb);
+
+            double taken = ((double) (clock()-clock_start))/CLOCKS_PER_SEC;
+
+            if (!round || taken < seconds[run])
+                seconds[run] = taken;
+        }
+    }
+
+    free(memory);
+    free(ram);
+
+    printf("Drawing every frame: %d frames in %.3fs (%.1f frames/s)\n", frames, seconds[0], frames/seconds[0]);
+
+    if (every)
+        printf("Skipping %d of every %d: %d frames in %.3fs (%.1f frames/s), %.2fx\n",
+                skip, every, frames, seconds[1], frames/seconds[1], seconds[0]/seconds[1]);
+    else
+        printf("Skipping every frame: %d frames in %.3fs (%.1f frames/s), %.2fx\n",
+                frames, seconds[1], frames/seconds[1], seconds[0]/seconds[1]);
+}
+
+
+int main(int argc, char *argv[]) {
+
+    char* romstring = "roms/tetris-jp.gb";
+
+    char* testing = NULL;
+    if (argc > 1 && argv[1][0]=='-' && argv[1][1]=='d') {
+
+        if (argc > 2) debug_from = atoi(argv[2]);
+        else debug_from = 0;
+    }
+    else if (argc > 1 && argv[1][0]=='-' && argv[1][1]=='t' && argc > 2) {
+
+        testing = argv[2];
+
+        if (argc > 3 && argv[3][0]=='-' && argv[3][1]=='d') {
+
+            if (argc > 4) debug_from = atoi(argv[4]);
+            else debug_from = 0x100;
+        }
+    }
+    else if (argc > 1 && argv[1][0]=='-' && argv[1][1]=='r') {
+        if (argc > 2)
+            romstring = argv[2];
+        else
+            exit(3);
+    }
+
+    // "-l FILE" loads a save state before running, "-w FILE" writes one when the emulator is closed
+    char* load_path = NULL;
+    char* write_path = NULL;
+
+    for (int i = 1; i < argc - 1; i++) {
+
+        if (argv[i][0]=='-' && argv[i][1]=='l')
+            load_path = argv[i+1];
+        else if (argv[i][0]=='-' && argv[i][1]=='w')
+            write_path = argv[i+1];
+    }
+
+    gb_t* gb = malloc(sizeof(gb_t));
+    gb_init(gb);
+
+    emulator_start(gb, write_path);
+
+#ifdef JIT
+    // "-j" (last argument) runs hot code through the recompiler
+    if (argc > 1 && argv[argc-1][0]=='-' && argv[argc-1][1]=='j')
+        gb->jit.enabled = 1;
+#endif
+
+    // A test rom (-t) is inserted by load_tests instead
+    if (testing == NULL && insert_cartridge(gb, romstring))
+        exit(1);
+
+    // "-s SKIP EVERY" skips SKIP of every EVERY frames (EVERY 0 skips all of them, nothing asks for any)
+    // "-b FRAMES" runs FRAMES frames without a window, with and without skipping them, and prints how fast
+    int skip = 0, every = 1, bench_frames = 0;
+
+    for (int i = 1; i < argc - 1; i++) {
+
+        if (argv[i][0]=='-' && argv[i][1]=='s' && i < argc - 2) {
+            skip = atoi(argv[i+1]);
+            every = atoi(argv[i+2]);
+        }
+        else if (argv[i][0]=='-' && argv[i][1]=='b')
+            bench_frames = atoi(argv[i+1]);
+    }
+
+    if (skip < 0 || every < 0 || (every && skip > every)) {
+        fprintf(stderr, "Can't skip %d of every %d frames\n", skip, every);
+        exit(1);
+    }
+
+    if (!bench_frames)
+        init_gui(gb);
+
+    rewind_init(gb, REWIND_BUDGET, REWIND_INTERVAL);
+
+    load_roms(gb);
+
+
+    if (testing != NULL) {
+
+        // http://slack.net/~ant/old/gb-tests/
+        if (load_tests(gb, testing))
+            exit(1);
+
+        boot_tests(gb);
+    }
+
+    // "-c CODE" (as many as needed) enters a Game Genie or GameShark code
+    for (int i = 1; i < argc - 1; i++) {
+
+        if (argv[i][0]=='-' && argv[i][1]=='c' && cheats_add(gb, argv[i+1]))
+            exit(1);
+    }
+
+    boot(gb);
+
+    if (load_path) {
+
+        struct state* state = state_open(load_path);
+
+        if (!state || state_load(gb, state))
+            exit(1);
+
+        state_close(state);
+    }
+
+    if (bench_frames) {
+        bench(gb, bench_frames, skip, every);
+        exit(0);
+    }
+
+    ppu_set_frame_skip(gb, skip, every);
+
+    emulate(gb);
+
+    emulator_stop(gb);
+
+    gb_free(gb);
+    free(gb);
+
+    return 0;
+}
+
+// IDEA: make smallest possible version of the emulator ?
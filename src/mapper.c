@@ -0,0 +1,409 @@
+#include <stdio.h>
+
+#include "gb.h"
+
+static const unsigned long long CYCLES_PER_SECOND = 4194304;
+
+/*---- Banks ------------------------------------------------------*/
+
+
+/*
+ *  Map ROM bank at 0000-3FFF (slot 0) or 4000-7FFF (slot 1)
+ */
+static void map_rom_bank(gb_t* gb, int slot, int bank) {
+
+    struct cartridge* cartridge = &gb->cartridge;
+
+    // Bank numbers wrap around the banks the ROM has (always a power of two)
+    bank &= cartridge->n_rom_banks - 1;
+
+    unsigned char* rom_bank = &cartridge->rom[bank*0x4000];
+
+    if (rom_bank == cartridge->rom_banks[slot])
+        return;
+
+    cartridge->rom_banks[slot] = rom_bank;
+    cartridge->rom_bank_numbers[slot] = bank;
+
+    mmu_map_pages(gb, slot*0x40, slot*0x40 + 0x3f);
+}
+
+/*
+ *  Map RAM bank at A000-BFFF, or leave it to the mapper if bank is negative
+ *  (or the cartridge has no RAM)
+ */
+static void map_ram_bank(gb_t* gb, int bank) {
+
+    struct cartridge* cartridge = &gb->cartridge;
+
+    unsigned char* ram_bank = NULL;
+
+    if (bank >= 0 && cartridge->n_ram_banks)
+        ram_bank = &cartridge->ram_banks[(bank & (cartridge->n_ram_banks - 1))*0x2000];
+
+    if (ram_bank == cartridge->ram_bank)
+        return;
+
+    cartridge->ram_bank = ram_bank;
+
+    mmu_map_pages(gb, 0xa0, 0xbf);
+}
+
+// RAM is enabled when the lower nibble written to 0000-1FFF is 0xA, and disabled otherwise
+static unsigned char enables_ram(unsigned char data) {
+
+    return (data & 0xF) == 0xA;
+}
+
+// Disabled (or missing) RAM reads undefined (usually 0xFF) and ignores writes
+static unsigned char no_read_ram(gb_t* gb, unsigned short address) {
+
+    return 0xFF;
+}
+
+static void no_write_ram(gb_t* gb, unsigned short address, unsigned char data) {
+}
+
+
+
+/*---- No MBC -----------------------------------------------------*/
+
+
+/*
+ *  32KB of ROM, maybe with 8KB of RAM that's always enabled
+ */
+static void none_map(gb_t* gb) {
+
+    map_rom_bank(gb, 0, 0);
+    map_rom_bank(gb, 1, 1);
+    map_ram_bank(gb, 0);
+}
+
+static void none_write_register(gb_t* gb, unsigned short address, unsigned char data) {
+
+    // Read only memory, writes do nothing
+}
+
+static const struct mapper none = {
+    "None", none_map, none_write_register, no_read_ram, no_write_ram
+};
+
+
+
+/*---- MBC1 -------------------------------------------------------*/
+
+
+static void mbc1_map(gb_t* gb) {
+
+    struct cartridge* cartridge = &gb->cartridge;
+
+    unsigned char upper_bits = cartridge->ram_or_upperrom_bank_number;
+
+    // TODO: Multicarts MBC1m use one less bit in rom bank number and shift by 4 only
+
+    // In mode 1 the upper bits also select the bank at 0000-3FFF (00h, 20h, 40h or 60h) and the RAM bank
+    // (they only matter if the ROM is at least 1MB, or the RAM is 32KB)
+    map_rom_bank(gb, 0, cartridge->banking_mode_select ? upper_bits << 5 : 0);
+    map_rom_bank(gb, 1, cartridge->rom_bank_number | upper_bits << 5);
+
+    map_ram_bank(gb, cartridge->ram_enable_register ? (cartridge->banking_mode_select ? upper_bits : 0) : -1);
+}
+
+static void mbc1_write_register(gb_t* gb, unsigned short address, unsigned char data) {
+
+    struct cartridge* cartridge = &gb->cartridge;
+
+    switch (address >> 13) {
+
+        case 0: // 0000-1FFF: Enable RAM
+            cartridge->ram_enable_register = enables_ram(data);
+            break;
+
+        case 1: // 2000-3FFF: ROM Bank
+            data &= 0x1f; // number of bits on the register is just 5
+
+            // the 5 bit BANK1 register doesn't allow value 0 -> write 1 instead
+            cartridge->rom_bank_number = data ? data : 1;
+            break;
+
+        case 2: // 4000-5FFF: ROM Bank upper bits or RAM Bank
+            cartridge->ram_or_upperrom_bank_number = data & 3;
+            break;
+
+        case 3: // 6000-7FFF: Banking mode
+            cartridge->banking_mode_select = data & 1;
+            break;
+    }
+
+    mbc1_map(gb);
+}
+
+static const struct mapper mbc1 = {
+    "MBC1", mbc1_map, mbc1_write_register, no_read_ram, no_write_ram
+};
+
+
+
+/*---- MBC2 -------------------------------------------------------*/
+
+
+static void mbc2_map(gb_t* gb) {
+
+    map_rom_bank(gb, 0, 0);
+    map_rom_bank(gb, 1, gb->cartridge.rom_bank_number);
+}
+
+static void mbc2_write_register(gb_t* gb, unsigned short address, unsigned char data) {
+
+    if (address >= 0x4000)
+        return;
+
+    // Bit 8 of the address tells the two registers apart
+    if (address & 0x100) {
+
+        data &= 0xf;
+        gb->cartridge.rom_bank_number = data ? data : 1;
+    }
+    else
+        gb->cartridge.ram_enable_register = enables_ram(data);
+
+    mbc2_map(gb);
+}
+
+// MBC2 has 512 4 bit values of RAM built in, repeated over A000-BFFF (the upper bits read as 1)
+static unsigned char mbc2_read_ram(gb_t* gb, unsigned short address) {
+
+    if (!gb->cartridge.ram_enable_register)
+        return 0xFF;
+
+    return 0xF0 | gb->cartridge.ram_banks[address & 0x1ff];
+}
+
+static void mbc2_write_ram(gb_t* gb, unsigned short address, unsigned char data) {
+
+    if (gb->cartridge.ram_enable_register) {
+
+        save_mark_dirty(gb, address & 0x1ff);
+        dirty_mark(gb, DIRTY_RAM_PAGE + ((address & 0x1ff) >> 8));
+        gb->cartridge.ram_banks[address & 0x1ff] = data & 0xf;
+    }
+}
+
+static const struct mapper mbc2 = {
+    "MBC2", mbc2_map, mbc2_write_register, mbc2_read_ram, mbc2_write_ram
+};
+
+
+
+/*---- MBC3 -------------------------------------------------------*/
+
+
+/*
+ *  Bring the clock up to the current time (whole seconds only,
+ *  the rest is counted from synced next time)
+ */
+static void rtc_sync(gb_t* gb) {
+
+    struct rtc* rtc = &gb->cartridge.rtc;
+
+    unsigned long long seconds = (gb->scheduler.now - rtc->synced) / CYCLES_PER_SECOND;
+
+    rtc->synced += seconds * CYCLES_PER_SECOND;
+
+    // A halted clock doesn't count the time that went by
+    if (!seconds || (rtc->registers[RTC_DAYS_HIGH] & 0x40))
+        return;
+
+    seconds += rtc->registers[RTC_SECONDS] + rtc->registers[RTC_MINUTES]*60 + rtc->registers[RTC_HOURS]*3600;
+
+    unsigned long long days = rtc->registers[RTC_DAYS] + ((rtc->registers[RTC_DAYS_HIGH] & 1) << 8) + seconds / 86400;
+    seconds %= 86400;
+
+    rtc->registers[RTC_SECONDS] = seconds % 60;
+    rtc->registers[RTC_MINUTES] = seconds / 60 % 60;
+    rtc->registers[RTC_HOURS] = seconds / 3600;
+
+    // The day counter is 9 bits, the carry stays set once it overflows (until it's written)
+    if (days > 511)
+        rtc->registers[RTC_DAYS_HIGH] |= 0x80;
+
+    rtc->registers[RTC_DAYS] = days & 0xff;
+    rtc->registers[RTC_DAYS_HIGH] = (rtc->registers[RTC_DAYS_HIGH] & 0xfe) | ((days >> 8) & 1);
+}
+
+static void rtc_write(gb_t* gb, int reg, unsigned char data) {
+
+    static const unsigned char masks[RTC_REGISTERS] = { 0x3f, 0x3f, 0x1f, 0xff, 0xc1 };
+
+    struct rtc* rtc = &gb->cartridge.rtc;
+
+    // Time up to now is counted before the clock changes (or halts)
+    rtc_sync(gb);
+
+    rtc->registers[reg] = data & masks[reg];
+
+    // Writing the seconds starts a new second
+    if (reg == RTC_SECONDS)
+        rtc->synced = gb->scheduler.now;
+}
+
+static void mbc3_map(gb_t* gb) {
+
+    struct cartridge* cartridge = &gb->cartridge;
+
+    map_rom_bank(gb, 0, 0);
+    map_rom_bank(gb, 1, cartridge->rom_bank_number);
+
+    // The clock registers are read and written through the mapper
+    map_ram_bank(gb, cartridge->ram_enable_register && cartridge->ram_bank_number < 4 ? cartridge->ram_bank_number : -1);
+}
+
+static void mbc3_write_register(gb_t* gb, unsigned short address, unsigned char data) {
+
+    struct cartridge* cartridge = &gb->cartridge;
+
+    switch (address >> 13) {
+
+        case 0: // 0000-1FFF: Enable RAM and clock
+            cartridge->ram_enable_register = enables_ram(data);
+            break;
+
+        case 1: // 2000-3FFF: ROM Bank (7 bits, 0 selects 1 too)
+            data &= 0x7f;
+            cartridge->rom_bank_number = data ? data : 1;
+            break;
+
+        case 2: // 4000-5FFF: RAM Bank (0-3) or clock register (08-0C)
+            cartridge->ram_bank_number = data;
+            break;
+
+        case 3: // 6000-7FFF: Writing 0 and then 1 latches the clock
+            if (cartridge->rtc.latch == 0 && data == 1) {
+
+                rtc_sync(gb);
+
+                for (int i = 0; i < RTC_REGISTERS; i++)
+                    cartridge->rtc.latched[i] = cartridge->rtc.registers[i];
+            }
+
+            cartridge->rtc.latch = data;
+            break;
+    }
+
+    mbc3_map(gb);
+}
+
+static unsigned char mbc3_read_ram(gb_t* gb, unsigned short address) {
+
+    struct cartridge* cartridge = &gb->cartridge;
+
+    if (cartridge->ram_enable_register && cartridge->ram_bank_number >= 0x08 && cartridge->ram_bank_number <= 0x0c)
+        return cartridge->rtc.latched[cartridge->ram_bank_number - 0x08];
+
+    return 0xFF;
+}
+
+static void mbc3_write_ram(gb_t* gb, unsigned short address, unsigned char data) {
+
+    struct cartridge* cartridge = &gb->cartridge;
+
+    if (cartridge->ram_enable_register && cartridge->ram_bank_number >= 0x08 && cartridge->ram_bank_number <= 0x0c)
+        rtc_write(gb, cartridge->ram_bank_number - 0x08, data);
+}
+
+static const struct mapper mbc3 = {
+    "MBC3", mbc3_map, mbc3_write_register, mbc3_read_ram, mbc3_write_ram
+};
+
+
+
+/*---- MBC5 -------------------------------------------------------*/
+
+
+static void mbc5_map(gb_t* gb) {
+
+    struct cartridge* cartridge = &gb->cartridge;
+
+    map_rom_bank(gb, 0, 0);
+    map_rom_bank(gb, 1, cartridge->rom_bank_number);
+
+    map_ram_bank(gb, cartridge->ram_enable_register ? cartridge->ram_bank_number : -1);
+}
+
+static void mbc5_write_register(gb_t* gb, unsigned short address, unsigned char data) {
+
+    struct cartridge* cartridge = &gb->cartridge;
+
+    if (address < 0x2000) // Enable RAM
+        cartridge->ram_enable_register = enables_ram(data);
+
+    // ROM Bank is 9 bits (and bank 0 can be selected here too)
+    else if (address < 0x3000) // lower 8 bits
+        cartridge->rom_bank_number = (cartridge->rom_bank_number & 0x100) | data;
+    else if (address < 0x4000) // bit 8
+        cartridge->rom_bank_number = (cartridge->rom_bank_number & 0xff) | ((data & 1) << 8);
+
+    else if (address < 0x6000) // RAM Bank (bit 3 runs the motor in rumble cartridges)
+        cartridge->ram_bank_number = data & 0xf;
+
+    mbc5_map(gb);
+}
+
+static const struct mapper mbc5 = {
+    "MBC5", mbc5_map, mbc5_write_register, no_read_ram, no_write_ram
+};
+
+
+
+/*---- Cartridge Types --------------------------------------------*/
+
+
+static const struct mapper* cartridge_mapper(unsigned char mbctype) {
+
+    switch (mbctype) {
+        case 0x00: case 0x08: case 0x09:                        // ROM (+RAM +BATTERY)
+            return &none;
+        case 0x01: case 0x02: case 0x03:                        // MBC1 (+RAM +BATTERY)
+            return &mbc1;
+        case 0x05: case 0x06:                                   // MBC2 (+BATTERY)
+            return &mbc2;
+        case 0x0f: case 0x10: case 0x11: case 0x12: case 0x13:  // MBC3 (+TIMER +RAM +BATTERY)
+            return &mbc3;
+        case 0x19: case 0x1a: case 0x1b: case 0x1c: case 0x1d: case 0x1e: // MBC5 (+RAM +BATTERY +RUMBLE)
+            return &mbc5;
+    }
+
+    printf("Unsupported MBC TYPE %x, running it without one\n", mbctype);
+    return &none;
+}
+
+/*
+ *  Can bank ever be mapped at 0000-3FFF (slot 0) or 4000-7FFF (slot 1)?
+ */
+int mapper_can_map(gb_t* gb, int slot, int bank) {
+
+    // Only MBC1's mode 1 maps another bank at 0000-3FFF (20h, 40h or 60h)
+    if (slot == 0)
+        return gb->cartridge.mapper == &mbc1 ? !(bank & 0x1f) : bank == 0;
+
+    // Any bank can be switched in at 4000-7FFF, counting the numbers that wrap around to it
+    return 1;
+}
+
+/*
+ *  Set up the mapper for the cartridge type and RAM size (in the header) and map its banks
+ */
+void mapper_init(gb_t* gb) {
+
+    struct cartridge* cartridge = &gb->cartridge;
+
+    cartridge->mapper = cartridge_mapper(cartridge->mbctype);
+
+    // ROM size was checked against the header when it was loaded
+    cartridge->n_rom_banks = cartridge->rom_size / 0x4000;
+
+    // RAM was set up by save_init (2KB is one bank, repeated over A000-BFFF)
+    cartridge->n_ram_banks = (cartridge->ram_size + 0x1fff) / 0x2000;
+
+    cartridge->mapper->map(gb);
+}
@@ -1,53 +1,48 @@
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-#include "memory.h"
-
-static union address_space address_space;
-
-// make address space properties global, so we can use them directly
-unsigned char* memory = address_space.memory;
-unsigned char* ioports = address_space.ioports;
-unsigned char* interrupt_request_register = address_space.interrupt_request_register;
-unsigned char* interrupt_enable_register = address_space.interrupt_enable_register;
-unsigned char* lcdc = address_space.lcdc;
-unsigned char* lcdc_stat = address_space.lcdc_stat;
-unsigned char* lcd_ly = address_space.lcd_ly;
-unsigned char* lcd_lyc = address_space.lcd_lyc;
-unsigned char* lcd_scy = address_space.lcd_scy;
-unsigned char* lcd_scx = address_space.lcd_scx;
-unsigned char* lcd_windowy = address_space.lcd_windowy;
-unsigned char* lcd_windowx = address_space.lcd_windowx;
-unsigned char* lcd_bgp = address_space.lcd_bgp;
-unsigned char* rombanks = address_space.rombanks;
-unsigned char* disabled_bootrom = address_space.disabled_bootrom;
-unsigned char* tdiv = address_space.tdiv;
-unsigned char* tima = address_space.tima;
-unsigned char* tma = address_space.tma;
-unsigned char* tac = address_space.tac;
-unsigned char* dma = address_space.dma;
-unsigned char* joyp = address_space.joyp;
-unsigned char* obj_palette_0_data = address_space.obj_palette_0_data;
-unsigned char* obj_palette_1_data = address_space.obj_palette_1_data;
-
-// Gameboy game read only memory (inserted cartridge)
-unsigned char rom[0x200000] = {0};
-unsigned char ram_banks[0x8000] = {0}; // Max 4 ram banks (only 2 bits to change it), RAM can be 2KB, 8KB or 32KB (in the form of 4 8KB banks)
-
-unsigned char mbctype = 0;
-unsigned char romsizetype = 0;
-unsigned char ramsizetype = 0;
-
-unsigned char ram_enable_register = 0;
-unsigned char rom_bank_number = 1; // 5 bit register selects ROM bank number
-unsigned char ram_or_upperrom_bank_number = 0; // 2 bits register selects ROM bank number upper 2 bits or RAM bank number
-unsigned char banking_mode_select = 0; // 1 bit register selects between two MBC1 banking modes (mode 0 or 1)
-
-
-unsigned char cartridge_loaded = 0; // 0 if cartridge isn't loaded, 1 if it's partially loaded (all except first 256 bytes), 2 if it's fully loaded
-
-static void load_bootstrap_rom() {
+#include "gb.h"
+
+static const unsigned int BLANK_ROM_SIZE = 0x8000;
+
+/*
+ *  Without a cartridge every ROM read gets 0xFF
+ */
+static void map_blank_rom(gb_t* gb) {
+
+    gb->cartridge.rom = mmap(NULL, BLANK_ROM_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (gb->cartridge.rom == MAP_FAILED) {
+        perror("Couldn't allocate the ROM");
+        exit(1);
+    }
+
+    memset(gb->cartridge.rom, 0xff, BLANK_ROM_SIZE);
+    mprotect(gb->cartridge.rom, BLANK_ROM_SIZE, PROT_READ);
+
+    gb->cartridge.rom_size = BLANK_ROM_SIZE;
+}
+
+// MBC state at power on (the rest of gb is zeroed by gb_init)
+void mmu_init(gb_t* gb) {
+
+    map_blank_rom(gb);
+
+    gb->cartridge.rom_bank_number = 1;
+
+    mapper_init(gb);
+
+    mmu_map_pages(gb, 0x00, 0xff);
+}
+
+static void load_bootstrap_rom(gb_t* gb) {
 
     // TODO: I probably can't do this
     unsigned char bootstrap_rom[] = {
@@ -76,244 +71,279 @@ static void load_bootstrap_rom() {
     };
     unsigned int bootstrap_rom_len = 256;
 
-    memcpy(memory, bootstrap_rom, bootstrap_rom_len);
+    memcpy(gb->memory.memory, bootstrap_rom, bootstrap_rom_len);
 
 }
 
-void insert_cartridge(char* filename) {
+/*
+ *  Map the ROM file (read only, so every Gameboy running it shares the same memory)
+ *  Returns 0 on success, or -1 if it can't be loaded (the inserted cartridge is kept then)
+ */
+int insert_cartridge(gb_t* gb, char* filename) {
 
-    FILE* cartridge = fopen(filename, "rb");
-    fread(rom, sizeof(unsigned char), 0x200000, cartridge);
+    int fd = open(filename, O_RDONLY);
 
-    fclose(cartridge);
+    if (fd < 0) {
+        fprintf(stderr, "Couldn't open %s: %s\n", filename, strerror(errno));
+        return -1;
+    }
 
-    cartridge_loaded = 1;
-}
+    struct stat file;
+    unsigned char romsizetype;
 
-void load_roms() {
-    load_bootstrap_rom();
+    if (fstat(fd, &file) || pread(fd, &romsizetype, 1, 0x148) != 1) {
+        fprintf(stderr, "Couldn't read %s: it's too small for a cartridge header\n", filename);
+        close(fd);
+        return -1;
+    }
 
-    if (!cartridge_loaded)
-        memset(rom, 0xff, 0x200000);
+    // ROM is 32KB << romsizetype
+    if (romsizetype > 8) {
+        fprintf(stderr, "Couldn't load %s: unknown ROM size %x in its header\n", filename, romsizetype);
+        close(fd);
+        return -1;
+    }
 
-    memcpy(memory+256, rom+256, 0x8000-256);
-}
+    unsigned int size = 0x8000 << romsizetype;
 
-void load_tests(char* testpath) {
+    if (file.st_size < size) {
+        fprintf(stderr, "Couldn't load %s: it's truncated (%lld bytes, its header says %u)\n", filename, (long long) file.st_size, size);
+        close(fd);
+        return -1;
+    }
 
-    FILE* test = fopen(testpath, "rb");
-    fread(rom, sizeof(unsigned char), 0x200000, test);
-    memcpy(memory, rom, 0x8000);
+    unsigned char* rom = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
 
-    fclose(test);
+    if (rom == MAP_FAILED) {
+        fprintf(stderr, "Couldn't map %s: %s\n", filename, strerror(errno));
+        return -1;
+    }
 
-    *disabled_bootrom = 1;
-}
+    // Codes are for the old ROM
+    cheats_clear(gb);
 
-void check_disable_bootrom() {
+    munmap(gb->cartridge.rom, gb->cartridge.rom_size);
 
-    if (cartridge_loaded == 1 && *disabled_bootrom) {
+    gb->cartridge.rom = rom;
+    gb->cartridge.rom_size = size;
 
-        cartridge_loaded++;
-        // Replace bootrom in memory with game rom data
-        memcpy(memory, rom, 256);
+    gb->cartridge.cartridge_loaded = 1;
 
-        // Read the MBC type
-        mbctype = memory[0x147];
-        romsizetype = memory[0x148];
-        ramsizetype = memory[0x149];
-        
-        printf("Loaded cartridge.\n");
+    save_set_path(gb, filename);
 
-        printf("MBC TYPE %d\n", mbctype);
-        printf("ROM SIZE TYPE%d\n", romsizetype);
-        printf("RAM SIZE TYPE%d\n", ramsizetype);
+    // The header is read once the bootstrap rom is done, until then there's no MBC
+    gb->cartridge.mbctype = 0;
+    gb->cartridge.romsizetype = 0;
+    gb->cartridge.ramsizetype = 0;
 
-    }
+    // Code from the old ROM is gone, and the new one's banks are mapped (bank 0 once the bootstrap rom is done)
+    block_flush(gb);
+    mapper_init(gb);
 
+    return 0;
 }
 
-static void dma_transfer(unsigned char data) {
+void load_roms(gb_t* gb) {
+
+    load_bootstrap_rom(gb);
+}
 
-    /* printf("DMA transfer\n"); */
+/*
+ *  Run the ROM at testpath right away (without the bootstrap rom)
+ */
+int load_tests(gb_t* gb, char* testpath) {
 
-    // The written data value specifies the transfer source address divided by 0x100
-    // By multiplying by 0x100 (which is << 8) we get the source address
-    // Read from source address XX00 until XX9F (XX is defined by data)
-    // And write to FE00 until FE9F
-    unsigned short address = data << 8;
-    for (int i = 0; i < 0xA0; i++) {
+    if (insert_cartridge(gb, testpath))
+        return -1;
 
-        unsigned char aux;
-        mmu_read8bit(&aux, address + i);
-        mmu_write8bit(0xfe00 + i, aux);
-        /* printf("DMA transfer to address %x from address %x with data %x\n", 0xfe00+i, address+i, aux); */
-    }
+    *gb->memory.disabled_bootrom = 1;
+    check_disable_bootrom(gb);
 
+    return 0;
 }
 
+/*
+ *  Free what mmu_init and insert_cartridge allocated
+ */
+void mmu_free(gb_t* gb) {
 
-int mmu_write8bit(unsigned short address, unsigned char data) {
-    
+    munmap(gb->cartridge.rom, gb->cartridge.rom_size);
+}
 
-    /* printf("Write address %x\n", address); */
+void check_disable_bootrom(gb_t* gb) {
 
-    int extra_cycles = 0;
+    if (gb->cartridge.cartridge_loaded == 1 && *gb->memory.disabled_bootrom) {
 
-    if (address < 0x8000) {
+        gb->cartridge.cartridge_loaded++;
 
-        /* printf("Writing to ROM RamEnable: %x Bank1: %x Bank2: %x ModeSelect: %x with Address: %x and data %x\n", ram_enable_register, rom_bank_number, ram_or_upperrom_bank_number, banking_mode_select, address, data); */
+        // Read the MBC type
+        gb->cartridge.mbctype = gb->cartridge.rom[0x147];
+        gb->cartridge.romsizetype = gb->cartridge.rom[0x148];
+        gb->cartridge.ramsizetype = gb->cartridge.rom[0x149];
         
+        printf("Loaded cartridge.\n");
 
-        // Read only memory
+        printf("MBC TYPE %d\n", gb->cartridge.mbctype);
+        printf("ROM SIZE TYPE%d\n", gb->cartridge.romsizetype);
+        printf("RAM SIZE TYPE%d\n", gb->cartridge.ramsizetype);
 
-        // When the game writes to the ROM addresses (here), it is trapped and decyphered to change the Banks
+        save_init(gb);
+        mapper_init(gb);
 
-        // Handle Bank changing
+        // The cartridge's first 256 bytes are mapped now (instead of the bootstrap rom)
+        mmu_map_pages(gb, 0x00, 0x00);
 
-        // Enable RAM Banking
-        if (address < 0x2000 && mbctype >= 1 && mbctype <= 3) {
+    }
 
-            // MBC1
-            if (mbctype >= 1 && mbctype <= 3) {
+}
 
-                // RAM Banking will be enabled when the lower nibble is 0xA, and disabled when the lower nibble is 0
-                if ((data & 0xF) == 0xA) {
+/*---- OAM DMA ----------------------------------------------------*/
 
-                    /* printf("Enabled RAM\n"); */
-                    ram_enable_register = 1;
-                }
-                else {
 
-                    /* printf("Disabled RAM\n"); */
-                    ram_enable_register = 0;
-                }
+/*
+ *  Copy XX00-XX9F (XX is source) to OAM
+ *
+ *  The DMA writes OAM whatever the ppu mode is (the cpu can't, see write8bit)
+ */
+static void dma_copy(gb_t* gb, unsigned char source) {
 
-            }
+    unsigned short address = source << 8;
 
-        }
-        // Change ROM Bank
-        else if (address >= 0x2000 && address < 0x4000) {
+    // The source never crosses a page, so if it's plain memory (ROM, RAM, VRAM outside mode 3) it's one copy
+    unsigned char* page = gb->memory_map.read[source];
 
-            // MBC1
-            if (mbctype >= 1 && mbctype <= 3) {
+    if (page)
+        memcpy(gb->memory.oam, page, sizeof(gb->memory.oam));
+    else {
 
-                // Write to rom_bank_number (5bit register from 0x1 - 0x1F)
+        // Registers, RAM handled by the MBC, VRAM during mode 3...
+        for (int i = 0; i < 0xA0; i++)
+            mmu_peek8bit(gb, &gb->memory.oam[i], address + i);
+    }
 
-                /* printf("Writing to ROM BANK LOWER BITS (%x) with data %x\n", rom_bank_number, data); */
+    dirty_mark(gb, 0xfe);
+    ppu_oam_written(gb);
+}
 
-                data &= 0x1f; // number of bits on the register is just 5
+#ifdef DMA_TIMING
 
-                // the 5 bit BANK1 register doesn't allow value 0 -> write 1 instead
-                rom_bank_number = data ? data : 1;
+/*
+ *  While a transfer runs the cpu can't use OAM, nor the bus the transfer reads from:
+ *  VRAM has its own, everything else but the IO ports and high RAM is on the external bus
+ *  (reads get 0xFF instead of the byte being transferred, and writes are dropped)
+ */
+int mmu_dma_blocks(gb_t* gb, unsigned short address) {
 
+    if (!gb->dma.active || address >= 0xff00)
+        return 0;
 
-                /* printf("ROM BANK LOWER BITS is now %x\n", rom_bank_number); */
-            }
+    if (address >= 0xfe00)
+        return 1;
 
-        }
-        // Change ROM Bank upper part or RAM bank
-        else if (address >= 0x4000 && address < 0x6000) {
+    int vram_source = gb->dma.source >= 0x80 && gb->dma.source < 0xa0;
+    int vram = address >= 0x8000 && address < 0xa000;
 
-            /* printf("Writing to ROM BANK UPPER BITS (%x) with data %x\n", ram_or_upperrom_bank_number, data); */
+    return vram == vram_source;
+}
 
-            // MBC1
-            if (mbctype >= 1 && mbctype <= 3) {
+/*
+ *  Start a transfer that takes 640 cycles (one byte every 4), OAM is only
+ *  written once it's done, since nothing can see it before then
+ *  (a transfer started while one is running replaces it)
+ */
+static void dma_start(gb_t* gb, unsigned char source) {
 
-                // 2 bit register selects RAM Bank or specify two upper bits of the ROM Bank number
-                // as long as one of either RAM or ROM is large enough
+    gb->dma.active = 1;
+    gb->dma.source = source;
 
-                if (romsizetype > 4 || ramsizetype == 3) {
+    scheduler_schedule(gb, EVENT_DMA, gb->scheduler.now + DMA_CYCLES);
 
-                    ram_or_upperrom_bank_number = data & 3;
-                }
+    // Blocked pages go through read8bit and write8bit, and blocked code isn't run from the block cache
+    mmu_map_pages(gb, 0x00, 0xfe);
+    gb->block_cache.current = NULL;
+}
 
-            }
+void mmu_dma_event(gb_t* gb) {
 
-        }
-        // Change *changing* to ROM Bank or RAM Bank
-        else if (address >= 0x6000 && address < 0x8000) {
+    gb->dma.active = 0;
+    mmu_map_pages(gb, 0x00, 0xfe);
 
-            // MBC1
-            if (mbctype >= 1 && mbctype <= 3) {
+    dma_copy(gb, gb->dma.source);
+}
 
-                // is a 1 bit register
+#else
 
-                banking_mode_select = data & 1; 
+void mmu_dma_event(gb_t* gb) {
+}
 
-                // For Large RAM cart, switching to mode 1 enables RAM Banking and switches the bank selected
-                // For Large ROM carts, switching to mode 1 makes bank 0x20, 0x40, 0x60 bankable through 0000-3fff
+#endif
 
-            }
 
-        }
 
-    /* printf("Write to  %X: %02X\n", address, data); */
+/*---- Reads and Writes -------------------------------------------*/
 
 
-        return extra_cycles;
-    }
-    else if (address >= 0xa000 && address < 0xc000) {
+/*
+ *  Byte of the mapped cartridge RAM bank at address (A000-BFFF)
+ *  2KB of RAM is repeated over the whole 8KB
+ */
+static unsigned char* cartridge_ram(gb_t* gb, unsigned short address) {
 
-        /* printf("Writing to SRAM RamEnable: %x Bank1: %x Bank2: %x ModeSelect: %x\n", ram_enable_register, rom_bank_number, ram_or_upperrom_bank_number, banking_mode_select); */
+    unsigned int offset = address - 0xa000;
 
-        // Writing to RAM Bank address - only if it exists and is enabled
+    if (gb->cartridge.ram_size < 0x2000)
+        offset &= gb->cartridge.ram_size - 1;
 
-        // MBC1 and Enabled RAMG
-        if (mbctype >= 1 && mbctype <= 3 && ram_enable_register) {
+    return &gb->cartridge.ram_bank[offset];
+}
 
-            // No RAM
-            if (ramsizetype == 0) {
-                // No RAM returns undefined when reading (usually 0xFF)
-                // (return is done outside the if chain below)
-            }
+static int write8bit(gb_t* gb, unsigned short address, unsigned char data) {
+    
 
-            // RAM size 2KB might be accessed outside that space, but
-            // accessing outside the 2K of RAM is undefined behaviour, so we just let it
+    /* printf("Write address %x\n", address); */
 
-            // RAM size is 2KB or 8KB within boundaries
-            else if (ramsizetype == 1 || ramsizetype == 2) {
+#ifdef DMA_TIMING
+    if (mmu_dma_blocks(gb, address))
+        return 0;
+#endif
 
-                /* printf("Writing to SRAM address %x DATA %x\n", address - 0xa000, data); */
-                ram_banks[address - 0xa000] = data;
+    // Drop predecoded code that's being overwritten
+    block_memory_write(gb, address);
 
-                /* // Disable SRAM after writing to it */
-                /* printf("Disabled SRAM\n"); */
-                /* ram_enable_register = 0; */
+    // First write to the page in this epoch (cartridge RAM is marked by its offset below)
+    if (address >= 0x8000 && (address < 0xa000 || address >= 0xc000))
+        dirty_mark(gb, address >> 8);
 
-    /* printf("Write to  %X: %02X\n", address, data); */
-                return extra_cycles;
-            }
-            // Big RAM and mode is 1 and if ram is enabled
-            else if (ramsizetype >= 3) {
-
-                if (banking_mode_select == 1) {
-
-                    // banking select is mode 1 - address with rambank selector
-                    unsigned char current_ram_bank = ram_or_upperrom_bank_number;
-                    ram_banks[(address - 0xa000) + current_ram_bank*0x2000] = data;
-                }
-                else {
-
-                    // when banking select mode is 0 - access first bank
-                    ram_banks[(address - 0xa000)] = data;
-                }
-
-                /* // Disable SRAM after writing to it */
-                /* printf("Disabled SRAM\n"); */
-                /* ram_enable_register = 0; */
-                
-    /* printf("Write to  %X: %02X\n", address, data); */
-                return extra_cycles;
+    int extra_cycles = 0;
 
-            }
+    if (address < 0x8000) {
 
-        }
+        // Read only memory
+
+        // When the game writes to the ROM addresses (here), it is trapped by the MBC to change the Banks
+        gb->cartridge.mapper->write_register(gb, address, data);
 
-        // Extra RAM couldn't be written
-    /* printf("Write to  %X: %02X\n", address, data); */
         return extra_cycles;
+    }
+    else if (address >= 0xa000 && address < 0xc000) {
+
+        if (gb->cartridge.ram_bank) {
 
+            // First write to a clean page of battery backed RAM (or in this epoch)
+            unsigned char* byte = cartridge_ram(gb, address);
+
+            save_mark_dirty(gb, byte - gb->cartridge.ram_banks);
+            dirty_mark(gb, DIRTY_RAM_PAGE + ((byte - gb->cartridge.ram_banks) >> 8));
+            *byte = data;
+        }
+        else {
+
+            // Cartridge RAM that isn't mapped (it's disabled, missing, or handled by the MBC)
+            gb->cartridge.mapper->write_ram(gb, address, data);
+        }
+
+        return extra_cycles;
     }
 
     // Other
@@ -340,33 +370,65 @@ int mmu_write8bit(unsigned short address, unsigned char data) {
         data |= 0xF;
 
         // Set data directly to joypad (this will set bit 4 and 5) along with the reset controls if that was the case
-        *joyp = data;
+        *gb->memory.joyp = data;
+
+        // The selected keys might be pressed
+        scheduler_schedule(gb, EVENT_JOYPAD, gb->scheduler.now + 1);
 
     /* printf("Write to  %X: %02X\n", address, data); */
         return extra_cycles;
 
     }
-    else if (&memory[address] == tdiv) {
+    else if (&gb->memory.memory[address] == gb->memory.tdiv) {
 
         // If you try writing to DIV, it'll be set to 0
-        memory[address] = 0;
+        gb->memory.memory[address] = 0;
     /* printf("Write to  %X: %02X\n", address, data); */
         return extra_cycles;
     }
-    else if (&memory[address] == dma) {
+    else if (&gb->memory.memory[address] == gb->memory.interrupt_request_register) {
+
+        gb->memory.memory[address] = data;
+        scheduler_interrupt_cleared(gb);
+        return extra_cycles;
+    }
+    else if (&gb->memory.memory[address] == gb->memory.tac) {
+
+        // Starting or stopping the timer changes when TIMA is incremented next
+        timer_write_tac(gb, data);
+        return extra_cycles;
+    }
+    else if (&gb->memory.memory[address] == gb->memory.lcdc || &gb->memory.memory[address] == gb->memory.lcdc_stat
+            || &gb->memory.memory[address] == gb->memory.lcd_ly || &gb->memory.memory[address] == gb->memory.lcd_lyc) {
+
+        // The ppu reevaluates LCD STAT (and starts or stops drawing)
+        ppu_write_register(gb, address, data);
+        return extra_cycles;
+    }
+    else if (&gb->memory.memory[address] == gb->memory.disabled_bootrom) {
+
+        gb->memory.memory[address] = data;
+        check_disable_bootrom(gb);
+        return extra_cycles;
+    }
+    else if (&gb->memory.memory[address] == gb->memory.dma) {
         
         // Writing to DMA Transfer and Start address
 
-        // Launch a DMA transfer from ROM to OAM
-        /* printf("DOING DMA TRANSFER\n"); */
-        dma_transfer(data);
+        // Launch a DMA transfer to OAM
+#ifdef DMA_TIMING
+        dma_start(gb, data);
+#else
+        // It's done right away, the cpu is stalled for the time it would take instead
+        dma_copy(gb, data);
         extra_cycles = 160;
+#endif
     }
     else if (address <= 0x9fff && address >= 0x8000) {
 
         // Destination is VRAM
 
-        unsigned char mode = *lcdc_stat & 3; // 3 = 0b11, get first two bits that define the mode
+        unsigned char mode = *gb->memory.lcdc_stat & 3; // 3 = 0b11, get first two bits that define the mode
 
         if (mode == 3) {
 
@@ -375,12 +437,15 @@ int mmu_write8bit(unsigned short address, unsigned char data) {
     /* printf("Write to  %X: %02X\n", address, data); */
             return extra_cycles;
         }
+
+        // Decoded tiles in the page are out of date
+        ppu_vram_written(gb, address);
     }
     else if (address <= 0xfe9f && address >= 0xfe00) {
 
         // Destination is OAM
 
-        unsigned char mode = *lcdc_stat & 3; // 3 = 0b11, get first two bits that define the mode
+        unsigned char mode = *gb->memory.lcdc_stat & 3; // 3 = 0b11, get first two bits that define the mode
 
         if (mode > 1) {
 
@@ -390,23 +455,33 @@ int mmu_write8bit(unsigned short address, unsigned char data) {
             return extra_cycles;
         }
 
+        // The sprites each line draws are picked again
+        ppu_oam_written(gb);
+
     }
 
     assert(!(address >= 0xa000 && address < 0xc000));
 
-    memory[address] = data;
+    gb->memory.memory[address] = data;
 
     /* printf("Write to  %X: %02X\n", address, data); */
     return extra_cycles;
 }
 
-void mmu_read8bit(unsigned char* destination, unsigned short address) {
+static void read8bit(gb_t* gb, unsigned char* destination, unsigned short address) {
+
+#ifdef DMA_TIMING
+    if (mmu_dma_blocks(gb, address)) {
+        *destination = 0xFF;
+        return;
+    }
+#endif
 
     if (address <= 0x9fff && address >= 0x8000) {
 
         // Reading from VRAM
 
-        unsigned char mode = *lcdc_stat & 3; // 3 = 0b11, get first two bits that define the mode
+        unsigned char mode = *gb->memory.lcdc_stat & 3; // 3 = 0b11, get first two bits that define the mode
 
         if (mode == 3) {
 
@@ -422,7 +497,7 @@ void mmu_read8bit(unsigned char* destination, unsigned short address) {
 
         // Reading from OAM
 
-        unsigned char mode = *lcdc_stat & 3; // 3 = 0b11, get first two bits that define the mode
+        unsigned char mode = *gb->memory.lcdc_stat & 3; // 3 = 0b11, get first two bits that define the mode
 
         if (mode > 1) {
 
@@ -438,13 +513,13 @@ void mmu_read8bit(unsigned char* destination, unsigned short address) {
     else if (address >= 0xe000 && address < 0xfe00) {
 
         // Reading from ECHO ram mirrors RAM
-        *destination = memory[address-0x2000];
+        *destination = gb->memory.memory[address-0x2000];
 
     }
-    else if (&memory[address] == joyp) { // $0xFF00
+    else if (&gb->memory.memory[address] == gb->memory.joyp) { // $0xFF00
 
         
-        *destination = *joyp; 
+        *destination = *gb->memory.joyp; 
     /* printf("Read from %X: %02X\n", address, *destination); */
 
 
@@ -460,129 +535,188 @@ void mmu_read8bit(unsigned char* destination, unsigned short address) {
         return;
 
     } 
+    else if (address >= 0xA000 && address < 0xC000) {
 
-    // MBC Control
-    else if (address < 0x4000) {
+        // Cartridge RAM that isn't mapped (it's disabled, missing, or handled by the MBC)
+        *destination = gb->cartridge.mapper->read_ram(gb, address);
 
-        // MBC1 in mode 1 with large ROM (>=1MB)
-        if (mbctype >= 1 && mbctype <= 3 && banking_mode_select == 1 && romsizetype > 4) {
+        return;
+    }
 
-            // TODO: Multicarts MBC1m use one less bit in rom bank number and shift by 4 only
+    // ROM is always mapped
+    assert(address >= 0x8000);
+
+    *destination = gb->memory.memory[address];
+    /* printf("Read from %X: %02X\n", address, *destination); */
 
-            // If 0000-3fff is accessed in mode 1, bank is upper bank shifted by 5
-            // To Access bank 00, 20h, 40h or 60h
 
-            unsigned char max_banks_mask = ~(-1 << (romsizetype+1));
-            unsigned char current_rom_bank = (ram_or_upperrom_bank_number << 5) & max_banks_mask;
+}
 
-            /* printf("Accessing SPECIAL bank %x at %x\n", current_rom_bank, address + current_rom_bank*0x4000); */
+int mmu_write8bit(gb_t* gb, unsigned short address, unsigned char data) {
 
-            *destination = rom[address + current_rom_bank*0x4000]; // 16K banks
-    /* printf("Read from %X: %02X\n", address, *destination); */
+#ifdef HEATMAP
+    heatmap_count(gb, address, 1);
+#endif
 
-            return;
-            
-        }
+#ifdef TRACE
+    if (gb->trace.current)
+        trace_memory_access(gb, address, data, 1);
+#endif
 
+    unsigned char* page = gb->memory_map.write[address >> 8];
+
+    if (page) {
+        page[address & 0xff] = data;
+        return 0;
     }
-    else if (address >= 0x4000 && address < 0x8000) {
 
-        // Reading from ROM Bank
+#ifdef PIXEL_FIFO
+    // The line being drawn is drawn up to now with what LCD registers were, and the rest of it with what they are
+    if (address >= 0xff40 && address <= 0xff4b) {
 
-        /* printf("Reading from ROM RamEnable: %x Bank1: %x Bank2: %x ModeSelect: %x\n", ram_enable_register, rom_bank_number, ram_or_upperrom_bank_number, banking_mode_select); */
-    
-        // MBC1
-        if (mbctype >= 1 && mbctype <= 3) {
+        fifo_catch_up(gb);
+        int extra_cycles = write8bit(gb, address, data);
+        fifo_redraw(gb);
 
-            // TODO: Multicarts MBC1m use one less bit in rom bank number and shift by 4 only
-            unsigned char max_banks_mask = ~(-1 << (romsizetype+1));
+        return extra_cycles;
+    }
+#endif
 
-            unsigned char current_rom_bank = ((rom_bank_number ? rom_bank_number : 1) | (ram_or_upperrom_bank_number << 5)) & max_banks_mask;
+    return write8bit(gb, address, data);
+}
 
+void mmu_read8bit(gb_t* gb, unsigned char* destination, unsigned short address) {
 
-            // Since rom_bank is always 1 or more, we remove 0x4000 once to get the correct offset
-            /* printf("Accessing bank %x at %x\n", current_rom_bank, address + current_rom_bank*0x4000); */
-            *destination = rom[(address - 0x4000) + current_rom_bank*0x4000];
-    /* printf("Read from %X: %02X\n", address, *destination); */
+#ifdef HEATMAP
+    heatmap_count(gb, address, 0);
+#endif
 
-            return;
+    mmu_peek8bit(gb, destination, address);
 
-        }
+#ifdef TRACE
+    if (gb->trace.current)
+        trace_memory_access(gb, address, *destination, 0);
+#endif
+}
 
-    }
-    else if (address >= 0xA000 && address < 0xC000) {
+/*
+ *  Read like the cpu does, but without counting it in the heatmap or the trace
+ *  (for reads that aren't the cpu's: decoding blocks, OAM DMA)
+ */
+void mmu_peek8bit(gb_t* gb, unsigned char* destination, unsigned short address) {
+
+    unsigned char* page = gb->memory_map.read[address >> 8];
+
+    if (page)
+        *destination = page[address & 0xff];
+    else
+        read8bit(gb, destination, address);
+}
+
+/*
+ *  Which ROM bank is mapped at address (0000-7FFF),
+ *  so code from different banks at the same address can be told apart
+ */
+int mmu_rom_bank(gb_t* gb, unsigned short address) {
 
-        /* printf("Reading from SRAM\n"); */
+    // The bootstrap rom is mapped over the first 256 bytes until it's disabled
+    if (address < 0x100 && gb->cartridge.cartridge_loaded < 2)
+        return BOOTSTRAP_ROM_BANK;
 
-        /* printf("Reading from SRAM RamEnable: %x Bank1: %x Bank2: %x ModeSelect: %x\n", ram_enable_register, rom_bank_number, ram_or_upperrom_bank_number, banking_mode_select); */
+    return gb->cartridge.rom_bank_numbers[address >> 14];
+}
 
-        // Reading from RAM Bank
-       
-        // MBC1 with RAM and more than 1 8K RAM Bank
-        // RAMG MUST be enabled, or else undefined is read 
-        if (mbctype >= 1 && mbctype <= 3 && ram_enable_register) {
 
-            /* printf("RAM GETS PAST MBC CHECK\n"); */
 
-            // No RAM
-            if (ramsizetype == 0) {
-                // No RAM returns undefined when reading (usually 0xFF)
-                // (return is done outside the if chain below)
-                /* printf("SRAM READ IS LOST IN FIRST IF CHECK\n"); */
-            }
+/*---- Page Table -------------------------------------------------*/
 
-            // RAM size 2KB might be accessed outside that space, but
-            // accessing outside the 2K of RAM is undefined behaviour, so we just let it
 
-            // RAM size is 2KB or 8KB within boundaries
-            else if (ramsizetype == 1 || ramsizetype == 2) {
+/*
+ *  Work out where page is read from and written to right now
+ *  (NULL leaves it to read8bit and write8bit)
+ */
+static void map_page(gb_t* gb, int page) {
 
-                /* printf("Reading from correct SRAM address: %x\n", address - 0xa000); */
+    unsigned short address = page << 8;
+    unsigned char* read = NULL;
+    unsigned char* write = NULL;
 
-                *destination = ram_banks[address - 0xa000];
-    /* printf("Read from %X: %02X\n", address, *destination); */
+    unsigned char mode = *gb->memory.lcdc_stat & 3;
 
-                return;
-            }
-            // Big RAM and mode is 1 and if ram is enabled
-            else if (ramsizetype >= 3) {
+#ifdef DMA_TIMING
+    if (mmu_dma_blocks(gb, address)) {
+        gb->memory_map.read[page] = gb->memory_map.write[page] = NULL;
+        return;
+    }
+#endif
 
-                /* printf("SRAM READ IS NOT LOST IN LAST IF CHECK\n"); */
+    if (address < 0x8000) {
 
-                if (banking_mode_select == 1) {
+        // ROM is read from the bank that's selected, writes go to the MBC
+        int bank = mmu_rom_bank(gb, address);
 
-                    // banking select is mode 1 - address with rambank selector
-                    unsigned char current_ram_bank = ram_or_upperrom_bank_number;
-                    *destination = ram_banks[(address - 0xa000) + current_ram_bank*0x2000];
-                }
-                else {
+        if (bank == BOOTSTRAP_ROM_BANK)
+            read = &gb->memory.memory[address];
+        else
+            read = cheats_rom_page(gb, address >> 14, &gb->cartridge.rom_banks[address >> 14][address & 0x3fff]);
+    }
+    else if (address < 0xa000) {
 
-                    // when banking select mode is 0 - access first bank
-                    *destination = ram_banks[(address - 0xa000)];
-                }
+        // VRAM can't be accessed during mode 3 (writes to pages with decoded tiles must drop them first)
+        if (mode != 3)
+            read = write = &gb->memory.memory[address];
 
-    /* printf("Read from %X: %02X\n", address, *destination); */
+        if (dirty_page_is_clean(gb, page) || ppu_page_has_tiles(gb, page))
+            write = NULL;
+    }
+    else if (address < 0xc000) {
+
+        // Cartridge RAM, if the MBC maps some (writes to clean pages of battery backed RAM mark them dirty first)
+        if (gb->cartridge.ram_bank) {
 
-                return;
+            read = cartridge_ram(gb, address);
 
-            }
-                
+            unsigned int offset = read - gb->cartridge.ram_banks;
+
+            if (!save_page_is_clean(gb, offset) && !dirty_page_is_clean(gb, DIRTY_RAM_PAGE + (offset >> 8)))
+                write = read;
         }
+    }
+    else if (address < 0xe000) {
 
-        /* printf("Returning UNDEFINED VALUE FOR SRAM ACCESS\n"); */
+        // Work RAM, writes to pages with cached code must drop it first
+        read = &gb->memory.memory[address];
 
-        // When no Cartridge RAM is present, or is disabled, return undefined
-        *destination = 0xFF;
-    /* printf("Read from %X: %02X\n", address, *destination); */
+        if (!gb->block_cache.code_pages[page] && !dirty_page_is_clean(gb, page))
+            write = read;
+    }
+    else if (address < 0xfe00) {
 
-        return;
+        // Echo RAM (read8bit ends up reading it from its own memory too, not from work RAM)
+        read = write = &gb->memory.memory[address];
 
+        if (dirty_page_is_clean(gb, page))
+            write = NULL;
     }
+    else if (address < 0xff00) {
 
-    assert(!(address >= 0xA000 && address < 0xC000));
+        // OAM can't be read during modes 2 and 3 (writes also skip the unusable area after it)
+        if (mode < 2)
+            read = &gb->memory.memory[address];
+    }
 
-    *destination = memory[address];
-    /* printf("Read from %X: %02X\n", address, *destination); */
+    // IO ports and high RAM (and the interrupt enable register) are always left to read8bit and write8bit
+
+    gb->memory_map.read[page] = read;
+    gb->memory_map.write[page] = write;
+}
 
+/*
+ *  Remap pages first to last, after something they depend on changed
+ *  (selected banks, bootstrap rom, ppu mode, the code or tiles cached in them, OAM DMA, dirty pages or cheats)
+ */
+void mmu_map_pages(gb_t* gb, int first, int last) {
 
+    for (int page = first; page <= last; page++)
+        map_page(gb, page);
 }
@@ -1,54 +1,77 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "gb.h"
 
-/* #ifdef __APPLE__ */
-#ifndef _WIN32
-#define GLEW_STATIC
-#include <GL/glew.h>
-#include <GLFW/glfw3.h>
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(NO_SIMD) && !defined(PIXEL_FIFO)
+#define SIMD_SHADING
+#include <immintrin.h>
 #endif
 
-#ifdef _WIN32
-#include <SDL.h>
-#endif
 
+static const int TOTAL_SCANLINE_CYCLES = 456;
 
-#include "ppu.h"
-#include "memory.h"
-#include "cpu.h"
+#ifndef PIXEL_FIFO
+static void pick_shading(void);
+#endif
 
+static void start_frame(gb_t* gb);
 
-static const int TOTAL_SCANLINE_CYCLES = 456;
+void ppu_init(gb_t* gb) {
+
+#ifndef PIXEL_FIFO
+    pick_shading();
+#endif
 
-static int scanline_cycles_left = TOTAL_SCANLINE_CYCLES;
+    // Nothing's been selected from OAM yet
+    ppu_oam_written(gb);
 
-static int graphics_enabled = 0;
+    // Every frame is drawn
+    ppu_set_frame_skip(gb, 0, 1);
 
-unsigned char joypad_state = 0;
+    // The LCD is off, LY and LCD STAT are set on the first step
+    scheduler_schedule(gb, EVENT_LCD_STAT, 1);
+}
 
 
 /*---- LCD Control Status -----------------------------------------*/
 
 
 static const int MODE2_SCANLINE_CYCLES = 376; // 456-80 (M2 lasts the first 80 cycles)
+#ifndef PIXEL_FIFO
 static const int MODE3_SCANLINE_CYCLES = 204; // 376-172 (M3 lasts 172 cycles after M2)
                                               // M0 lasts from cycles 204 to 0
+#endif                                        // (with the pixel FIFO, M3 lasts as long as drawing the line takes)
+
+static unsigned char lcdc_is_enabled(gb_t* gb) {
+
+    return (*gb->memory.lcdc & 0x80); // true if bit 7 of lcd control is set
+}
 
-static unsigned char lcdc_is_enabled() {
+/*
+ *  VRAM and OAM are only accessible in some modes
+ */
+static void map_video_memory(gb_t* gb) {
 
-    return (*lcdc & 0x80); // true if bit 7 of lcd control is set
+    mmu_map_pages(gb, 0x80, 0x9f);  // VRAM
+    mmu_map_pages(gb, 0xfe, 0xfe);  // OAM
 }
 
-static void change_lcd_mode(unsigned char mode) {
+static void change_lcd_mode(gb_t* gb, unsigned char mode) {
+
+    unsigned char old_mode = *gb->memory.lcdc_stat & 3;
 
     // first clear the mode to 0 (in case mode == 0x0) (set first two bits to 0)
-    *lcdc_stat &= 0xFC; // 1111 1100
+    *gb->memory.lcdc_stat &= 0xFC; // 1111 1100
+
+    *gb->memory.lcdc_stat |= mode;
 
-    *lcdc_stat |= mode;
+    if (mode != old_mode)
+        map_video_memory(gb);
 }
 
-static int lcdmode_interrupt_is_enabled(unsigned char mode) {
+static int lcdmode_interrupt_is_enabled(gb_t* gb, unsigned char mode) {
 
     /* LCD Interrupt can be triggered by mode changes,
      * As long as its respective mode interrupt is enabled
@@ -58,17 +81,63 @@ static int lcdmode_interrupt_is_enabled(unsigned char mode) {
      *          Bit 5: Mode 2 Interrupt Enabled
      */
 
-    if (mode == 0 && (*lcdc_stat & 0x8))
+    if (mode == 0 && (*gb->memory.lcdc_stat & 0x8))
+        return 1;
+    else if (mode == 1 && (*gb->memory.lcdc_stat & 0x10))
         return 1;
-    else if (mode == 1 && (*lcdc_stat & 0x10))
+    else if (mode == 2 && (*gb->memory.lcdc_stat & 0x20))
         return 1;
-    else if (mode == 2 && (*lcdc_stat & 0x20))
+
+    return 0;
+}
+
+/*
+ *  Cycles left in the scanline when M3 ends
+ *  (with the pixel FIFO it's however long the line it draws takes)
+ */
+static int mode3_scanline_cycles(gb_t* gb) {
+
+#ifdef PIXEL_FIFO
+    return MODE2_SCANLINE_CYCLES - gb->ppu.fifo.length;
+#else
+    return MODE3_SCANLINE_CYCLES;
+#endif
+}
+
+static unsigned char lcd_mode(gb_t* gb) {
+
+    // LCD STAT is always one step behind: it shows the scanline as it was when the last instruction started
+    int scanline_cycles_left = gb->ppu.line_start + TOTAL_SCANLINE_CYCLES - gb->scheduler.instruction_start;
+
+    if (*gb->memory.lcd_ly >= 144)
         return 1;
+    else if (scanline_cycles_left >= MODE2_SCANLINE_CYCLES)
+        return 2;
+    else if (scanline_cycles_left >= mode3_scanline_cycles(gb))
+        return 3;
 
     return 0;
 }
 
-static void set_lcd_stat() {
+/*
+ *  Schedule the next mode change (or end of the scanline)
+ */
+static void schedule_ppu(gb_t* gb) {
+
+    unsigned long long elapsed = gb->scheduler.now - gb->ppu.line_start;
+    int next;
+
+    if (elapsed <= (unsigned) (TOTAL_SCANLINE_CYCLES - MODE2_SCANLINE_CYCLES))
+        next = TOTAL_SCANLINE_CYCLES - MODE2_SCANLINE_CYCLES + 1;  // M2 -> M3
+    else if (elapsed <= (unsigned) (TOTAL_SCANLINE_CYCLES - mode3_scanline_cycles(gb)))
+        next = TOTAL_SCANLINE_CYCLES - mode3_scanline_cycles(gb) + 1;  // M3 -> M0
+    else
+        next = TOTAL_SCANLINE_CYCLES;
+
+    scheduler_schedule(gb, EVENT_PPU, gb->ppu.line_start + next);
+}
+
+static void set_lcd_stat(gb_t* gb) {
 
     /* LCD goes through 4 different modes, defined with bits 1 and 0
      *      (0) 00: H-Blank
@@ -77,14 +146,14 @@ static void set_lcd_stat() {
      *      (3) 11: Transfering Data to LCD Driver
      */
 
-    if (!lcdc_is_enabled()) {
+    if (!lcdc_is_enabled(gb)) {
 
-        scanline_cycles_left = TOTAL_SCANLINE_CYCLES; // scanline is anchored
+        scheduler_cancel(gb, EVENT_PPU); // scanline is anchored (until the LCD is enabled again)
 
-        *lcd_ly = 0; // current scanline is set to 0
+        *gb->memory.lcd_ly = 0; // current scanline is set to 0
 
         // set the LCD mode to V-Blank (1) during 'LCD Disabled'
-        change_lcd_mode(0x1);
+        change_lcd_mode(gb, 0x1);
 
     } else {
 
@@ -104,32 +173,25 @@ static void set_lcd_stat() {
          * Update LCDC(ontrol) STAT
          */
 
-        unsigned char current_mode = *lcdc_stat & 0x3;
-        unsigned char mode = 0;
-
-        if (*lcd_ly >= 144)
-            mode = 1;
-        else if (scanline_cycles_left >= MODE2_SCANLINE_CYCLES)
-            mode = 2;
-        else if (scanline_cycles_left >= MODE3_SCANLINE_CYCLES)
-            mode = 3;
+        unsigned char current_mode = *gb->memory.lcdc_stat & 0x3;
+        unsigned char mode = lcd_mode(gb);
 
-        if ((mode != current_mode) && lcdmode_interrupt_is_enabled(mode))
-            request_interrupt(LCDSTAT_INTERRUPT);
+        if ((mode != current_mode) && lcdmode_interrupt_is_enabled(gb, mode))
+            request_interrupt(gb, LCDSTAT_INTERRUPT);
 
-        if (*lcd_ly == *lcd_lyc) {
+        if (*gb->memory.lcd_ly == *gb->memory.lcd_lyc) {
 
-            *lcdc_stat |= 0x4; // Set Flag: LCDC Stat bit 2 is a flag for LY == LYC
+            *gb->memory.lcdc_stat |= 0x4; // Set Flag: LCDC Stat bit 2 is a flag for LY == LYC
 
             // If LCD interrupts are enabled for LY==LYC
             // (This 'interrupt enabled' is a flag in bit 6 of LCDC Stat)
-            if (*lcdc_stat & 0x40)
-                request_interrupt(LCDSTAT_INTERRUPT);
+            if (*gb->memory.lcdc_stat & 0x40)
+                request_interrupt(gb, LCDSTAT_INTERRUPT);
 
         } else
-            *lcdc_stat &= ~0x4; // Clear LCDC Stat Bit 2 Flag
+            *gb->memory.lcdc_stat &= ~0x4; // Clear LCDC Stat Bit 2 Flag
 
-        change_lcd_mode(mode);
+        change_lcd_mode(gb, mode);
 
     }
 
@@ -137,363 +199,250 @@ static void set_lcd_stat() {
 }
 
 
-/*---- Key Events -------------------------------------------------*/
+/*
+ *  The LCD STAT interrupt conditions are checked one step after anything they
+ *  depend on changes (mode, LY, LYC, LCD STAT or LCD Control)
+ */
+void ppu_stat_event(gb_t* gb) {
 
-static void handle_input(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    set_lcd_stat(gb);
+}
 
-    /* Joypad Key has 8 bits for 8 buttons
-     * Bit 7 = Standard Start
-     * Bit 6 = Standard Select
-     * Bit 5 = Standard Button B
-     * Bit 4 = Standard Button A
-     * Bit 3 = Direction Input Down
-     * Bit 2 = Direction Input Up
-     * Bit 1 = Direction Input Left
-     * Bit 0 = Direction Input Right
-     */
+/*
+ *  Called when the cpu writes LCD Control, LCD STAT, LY or LYC
+ */
+void ppu_write_register(gb_t* gb, unsigned short address, unsigned char data) {
 
-    /* Joypad Register $FF00 holds this information:
-     
-        Bit 7 - Not used
-        Bit 6 - Not used
-        Bit 5 - P15 Select Button Keys      (0=Select)
-        Bit 4 - P14 Select Direction Keys   (0=Select)
-        Bit 3 - P13 Input Down  or Start    (0=Pressed) (Read Only)
-        Bit 2 - P12 Input Up    or Select   (0=Pressed) (Read Only)
-        Bit 1 - P11 Input Left  or Button B (0=Pressed) (Read Only)
-        Bit 0 - P10 Input Right or Button A (0=Pressed) (Read Only)
+    gb->memory.memory[address] = data;
 
-    */
+    // Writing LCD STAT overwrites the mode too (until the next update)
+    if (&gb->memory.memory[address] == gb->memory.lcdc_stat)
+        map_video_memory(gb);
 
+    // Enabling the LCD starts drawing from the top (unless it was only just disabled and that wasn't seen yet)
+    if (lcdc_is_enabled(gb) && gb->scheduler.deadlines[EVENT_PPU] == NO_EVENT) {
 
-
-    unsigned char joypad_key = 0;
-    switch (key) {
-        case GLFW_KEY_D:
-            // Right direction
-            joypad_key = 1;
-            break;
-        case GLFW_KEY_A:
-            // Left
-            joypad_key = 1 << 1;
-            break;
-        case GLFW_KEY_W:
-            // Up
-            joypad_key = 1 << 2;
-            break;
-        case GLFW_KEY_S:
-            // Down
-            joypad_key = 1 << 3;
-            break;
-        case GLFW_KEY_J:
-            // Button A
-            joypad_key = 1 << 4;
-            break;
-        case GLFW_KEY_K:
-            // Button B
-            joypad_key = 1 << 5;
-            break;
-        case GLFW_KEY_M:
-            // Standard Select
-            joypad_key = 1 << 6;
-            break;
-        case GLFW_KEY_N:
-            // Standard Start
-            joypad_key = 1 << 7;
-            break;
-        default:
-            // When it's not one of those keys do nothing
-            return;
+        gb->ppu.line_start = gb->scheduler.now;
+        gb->ppu.window_line = 0;
+        start_frame(gb);
+        schedule_ppu(gb);
     }
 
-    if (action == GLFW_PRESS) {
-
-        // Set the key as pressed:
-        // this state is used every emulator loop to check for inputs pressed
-        joypad_state |= joypad_key;
+    scheduler_schedule(gb, EVENT_LCD_STAT, gb->scheduler.now + 1);
+}
 
-    }
-    else if (action == GLFW_RELEASE) {
 
-        // The button is no longer pressed so clear it from the joypad state
-        joypad_state &= ~joypad_key;
+#ifdef PIXEL_FIFO
 
-    }
+// When M3 of the current scanline starts
+static unsigned long long mode3_start(gb_t* gb) {
 
+    return gb->ppu.line_start + TOTAL_SCANLINE_CYCLES - MODE2_SCANLINE_CYCLES;
 }
 
+/*
+ *  Called after loading a state: the FIFO isn't saved, a line in M3 is drawn again from the start of M3
+ */
+void ppu_fifo_restart(gb_t* gb) {
+
+    struct pixel_fifo* fifo = &gb->ppu.fifo;
+
+    fifo->start = 0;
+    fifo->drawing = 0;
 
+    if (!lcdc_is_enabled(gb) || *gb->memory.lcd_ly >= 144 || gb->scheduler.now <= mode3_start(gb))
+        return;
 
+    fifo_start_line(gb, mode3_start(gb));
 
+    // (it was already drawn and finished when the state was saved)
+    if (gb->scheduler.now > fifo->start + fifo->length)
+        fifo->drawing = 0;
 
-/*---- Rendering --------------------------------------------------*/
+    if (gb->scheduler.deadlines[EVENT_PPU] != NO_EVENT)
+        schedule_ppu(gb);
+}
 
+#endif
 
-static unsigned char scanlinesbuffer[SCREEN_WIDTH*SCREEN_HEIGHT];
 
-#ifdef __APPLE__
-static GLFWwindow* window;
 
-static void framebuffer_size_callback(GLFWwindow* window, int width, int height)
-{
-    // make sure the viewport matches the new window dimensions; note that width and
-    // height will be significantly larger than specified on retina displays.
-    glViewport(0, 0, SCREEN_WIDTH*SCREEN_MULTIPLIER, SCREEN_HEIGHT*SCREEN_MULTIPLIER);
-}
+/*---- Tiles ------------------------------------------------------*/
 
-static void window_size_callback(GLFWwindow* window, int width, int height) {
-    // make sure the viewport matches the new window dimensions; note that width and
-    // height will be significantly larger than specified on retina displays.
-    glViewport(0, 0, width, height);
-}
 
-#endif
+/*
+ *  Take tile's bitplanes apart into color numbers, as it is and X flipped
+ */
+static void decode_tile(gb_t* gb, int tile) {
 
-#ifdef _WIN32
-static SDL_Window* window = NULL;
-static SDL_Renderer * renderer = NULL;
-static SDL_Texture * texture = NULL;
-static SDL_Event e;
-#endif
+    struct tile_cache* tiles = &gb->ppu.tiles;
 
-void init_gui() {
-#ifdef __APPLE__
-    /* Initialize the library */
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-    /* glfwWindowHint(GLFW_DECORATED, GL_FALSE); */
-
-    window = glfwCreateWindow(SCREEN_WIDTH*SCREEN_MULTIPLIER, SCREEN_HEIGHT*SCREEN_MULTIPLIER, "Gameboy", NULL, NULL);
-    if (!window)
-    {
-        glfwTerminate();
-        exit(-1);
-    }
+    /* Each Tile occupies 16 bytes, where each 2 bytes represent a line:
 
-    glfwMakeContextCurrent(window);
-
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetWindowSizeCallback(window, window_size_callback);
-
-    glfwSetWindowAspectRatio(window, SCREEN_WIDTH, SCREEN_HEIGHT);
-
-    /* Glew initialization */
-    if (glewInit() != GLEW_OK) exit(1);
-
-    /* Create shaders */
-    const char* vert_shader = "\
-        #version 330 core\n\
-        layout (location = 0) in vec3 iPos;\
-        layout (location = 1) in vec2 iTexCoord;\
-        out vec2 TexCoord;\
-        void main()\
-        {\
-            TexCoord = vec2(iTexCoord.x, iTexCoord.y);\
-            gl_Position = vec4(iPos, 1.0);\
-        }\
-    ";
-
-    unsigned int vertex = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertex, 1, &vert_shader, NULL);
-    glCompileShader(vertex);
-
-    // print compile errors
-    int success;
-    glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
-    char infoLog[512];
-    if(!success)
-    {
-        glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-        printf("Compile Error: %s\n", infoLog);
-    };
-
-    const char* frag_shader = "\
-        #version 330 core\n\
-        out vec4 frag_color;\
-        in vec2 TexCoord;\
-        uniform sampler2D tex;\
-        void main()\
-        {\
-            frag_color = vec4(texture(tex, TexCoord).r);\
-        }\
-    ";
-
-    unsigned int fragment = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment, 1, &frag_shader, NULL);
-    glCompileShader(fragment);
-
-    // print compile errors
-    glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
-    if(!success)
-    {
-        glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-        printf("Compile Error: %s\n", infoLog);
-    };
-
-    unsigned int prog_id = glCreateProgram();
-
-    glAttachShader(prog_id, vertex);
-    glAttachShader(prog_id, fragment);
-    glLinkProgram(prog_id);
-
-    glGetProgramiv(prog_id, GL_LINK_STATUS, &success);
-    if(!success)
-    {
-        glGetProgramInfoLog(prog_id, 512, NULL, infoLog);
-        printf("Compile Error: %s\n", infoLog);
-    }
+         Byte 0-1  First Line (Upper 8 pixels)
+         Byte 2-3  Next Line
+         etc.
 
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
+       The first byte of a line has the low bit of each pixel's color, the second the high bit
+       (pixel 0 is bit 7)
+    */
+    const unsigned char* data = &gb->memory.vram[tile*16];
 
-    glUseProgram(prog_id);
+    for (int line = 0; line < 8; line++) {
 
-    float vertices[] = {
-        // positions          // texture coords
-         1.0f,  1.0f, 0.0f,   1.0f, 0.0f,   // top right
-         1.0f, -1.0f, 0.0f,   1.0f, 1.0f,   // bottom right
-        -1.0f, -1.0f, 0.0f,   0.0f, 1.0f,   // bottom left
-        -1.0f,  1.0f, 0.0f,   0.0f, 0.0f    // top left
-    };
-    unsigned int indices[] = {
-        0, 1, 3, // first triangle
-        1, 2, 3  // second triangle
-    };
+        unsigned char lo_color_bits = data[line*2];
+        unsigned char hi_color_bits = data[line*2 + 1];
 
-    unsigned int vertex_attr_buf, vertex_data_buf, elem_data_buf;
-    glGenVertexArrays(1, &vertex_attr_buf);
-    glGenBuffers(1, &vertex_data_buf);
-    glGenBuffers(1, &elem_data_buf);
+        for (int pixel = 0; pixel < 8; pixel++) {
 
+            unsigned char color = ((hi_color_bits >> (7-pixel)) & 1) << 1 | ((lo_color_bits >> (7-pixel)) & 1);
 
-    glBindVertexArray(vertex_attr_buf); /* we only need to set it once */
+            tiles->lines[tile][line][pixel] = color;
+            tiles->flipped_lines[tile][line][7-pixel] = color;
+        }
+    }
 
-    glBindBuffer(GL_ARRAY_BUFFER, vertex_data_buf);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    tiles->decoded[tile] = 1;
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elem_data_buf);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+    // Writes to the page have to drop its tiles from now on
+    if (!tiles->decoded_pages[tile/16]) {
+        tiles->decoded_pages[tile/16] = 1;
+        mmu_map_pages(gb, 0x80 + tile/16, 0x80 + tile/16);
+    }
+}
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
+/*
+ *  The 8 color numbers of line of tile (0-383, the tile at 8000 + tile*16)
+ */
+const unsigned char* ppu_tile_line(gb_t* gb, int tile, int line, int x_flip) {
 
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
+    if (!gb->ppu.tiles.decoded[tile])
+        decode_tile(gb, tile);
 
-    int textureLoc = glGetUniformLocation(prog_id, "tex");
+    return x_flip ? gb->ppu.tiles.flipped_lines[tile][line] : gb->ppu.tiles.lines[tile][line];
+}
 
-    glUniform1i(textureLoc, 0); // Set the active texture location (default is 0) (when bindTexture, it'll bind to active texture, and we can have multiple of these)
+/*
+ *  Writes to page can't be mapped while it has decoded tiles (see ppu.h)
+ */
+int ppu_page_has_tiles(gb_t* gb, int page) {
 
-    /* Bind texture once, since we only use one and we won't be changing it */
-    unsigned int tex;
-    glGenTextures(1, &tex);
-    glBindTexture(GL_TEXTURE_2D, tex);
+    return page >= 0x80 && page < 0x98 && gb->ppu.tiles.decoded_pages[page - 0x80];
+}
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	// set texture wrapping to GL_REPEAT (default wrapping method)
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    // set texture filtering parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+/*
+ *  Called when VRAM at address is written (by the cpu, or by loading a state)
+ */
+void ppu_vram_written(gb_t* gb, unsigned short address) {
 
-    glClearColor(0, 0, 0, 1);
+    int page = address >> 8;
 
-    
-    /* Set input handler for key presses */
-    glfwSetKeyCallback(window, handle_input);
+    if (!ppu_page_has_tiles(gb, page))
+        return;
 
-#endif
+    // Every tile of the page is decoded again (writes after this one aren't seen)
+    memset(&gb->ppu.tiles.decoded[(page - 0x80)*16], 0, 16);
+    gb->ppu.tiles.decoded_pages[page - 0x80] = 0;
 
-#ifdef _WIN32
-    SDL_Init( SDL_INIT_VIDEO );
-    //Create window
-    window = SDL_CreateWindow( "Gameboy", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN );
-    renderer = SDL_CreateRenderer(window, -1, 0);
-    //Get window surface
-    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, SCREEN_WIDTH, SCREEN_HEIGHT);
-#endif
-    graphics_enabled = 1;
+    mmu_map_pages(gb, page, page);
+}
+
+/*
+ *  Shades of the color numbers in palette register (for scanlinesbuffer)
+ */
+void ppu_palette_shades(unsigned char palette_register, unsigned char* shades) {
+
+    /*  Pallete Register
+          Bit 7-6 - Shade for Color Number 3
+          Bit 5-4 - Shade for Color Number 2
+          Bit 3-2 - Shade for Color Number 1
+          Bit 1-0 - Shade for Color Number 0
+
+        Possible shades of grey
+          0  White
+          1  Light gray
+          2  Dark gray
+          3  Black
+     */
+
+    for (int color = 0; color < 4; color++)
+        shades[color] = (3 - ((palette_register >> (color*2)) & 3))*85; // Do 3-color bc 0 = white and 3 = black and 0 is black in rgb
 }
 
 
-void render_frame() {
-    if (graphics_enabled) {
 
-#ifdef __APPLE__
-        if(!glfwWindowShouldClose(window)) {
+/*---- Sprites ----------------------------------------------------*/
 
-            /* Render here */
 
-            /* glClear(GL_COLOR_BUFFER_BIT); */ // don't need it for now
+/*
+ *  Make the sprite lists from OAM (called before drawing a line when OAM or the sprite size changed)
+ */
+static void select_sprites(gb_t* gb) {
 
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, SCREEN_WIDTH, SCREEN_HEIGHT, 0, GL_RED, GL_UNSIGNED_BYTE, scanlinesbuffer);
+    struct sprite_lists* lists = &gb->ppu.sprites;
+    const struct sprite_attributes* oam = (const struct sprite_attributes*) gb->memory.oam;
 
-            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    // Is the sprite 8x8 or 8x16? Test LCDC Bit 2
+    lists->height = *gb->memory.lcdc & 4 ? 16 : 8;
+    lists->changed = 0;
 
-            /* Swap front and back buffers
-             * (back buffer is being written to, front buffer is being rendered)
-             */
-            glfwSwapBuffers(window);
+    memset(lists->counts, 0, sizeof(lists->counts));
 
-            /* Poll for and process events */
-            glfwPollEvents();
+    // OAM order decides which 10 a line gets
+    for (int sprite = 0; sprite < SPRITES; sprite++) {
 
-        }
-        else {
-            glfwDestroyWindow(window);
-            glfwTerminate();
-            exit(0);
-        }
-#endif
+        // Sprites are only in the screen from 16 down (the top left corner can go 16 above the upper line)
+        int top = oam[sprite].y - 16;
+
+        for (int ly = top < 0 ? 0 : top; ly < top + lists->height && ly < SCREEN_HEIGHT; ly++) {
+
+            unsigned char* list = lists->sprites[ly];
+            int n = lists->counts[ly];
 
-#ifdef _WIN32
-        unsigned int pixels [SCREEN_WIDTH*SCREEN_HEIGHT];
-        for (int i=0; i<sizeof(scanlinesbuffer);i++){
-            unsigned int  aux = scanlinesbuffer[i];
-            pixels[i] =  0xFF00000000;
-            for(int j = 0; j<3;j++){
-                pixels[i] |= (aux << j*8);
+            if (n == SPRITES_PER_LINE)
+                continue;
+
+            // Lowest X first, the ones before it in OAM come first for the same X
+            while (n > 0 && oam[list[n-1]].x > oam[sprite].x) {
+                list[n] = list[n-1];
+                n--;
             }
+
+            list[n] = sprite;
+            lists->counts[ly]++;
         }
-        //memset(pixels, 255, SCREEN_WIDTH * SCREEN_HEIGHT * sizeof(int));
-        SDL_UpdateTexture(texture, NULL, pixels, SCREEN_WIDTH * sizeof(int));
-        SDL_RenderClear(renderer);
-        SDL_RenderCopy(renderer, texture, NULL, NULL);
-        SDL_RenderPresent(renderer);
-
-        if( SDL_PollEvent( &e ) != 0 ) {
-           //User requests quit
-           if( e.type == SDL_QUIT ) {
-               SDL_DestroyWindow( window );
-               window = NULL;
-               SDL_DestroyRenderer(renderer);
-               SDL_DestroyTexture(texture);
-               SDL_Quit();
-               exit(0);
-           }
-        }
+    }
+}
 
-#endif
+/*
+ *  Called when OAM is written (by the cpu, a DMA transfer or loading a state)
+ */
+void ppu_oam_written(gb_t* gb) {
 
-    }
+    gb->ppu.sprites.changed = 1;
 }
 
+/*
+ *  The sprites line ly draws, in the order they get the pixels they overlap (n of them)
+ */
+const unsigned char* ppu_line_sprites(gb_t* gb, int ly, int* n) {
 
+    struct sprite_lists* lists = &gb->ppu.sprites;
 
-static void render_sprites() {
-// the 4 is just helpful, the parameter is still (unsigned char*)
+    if (lists->changed || lists->height != (*gb->memory.lcdc & 4 ? 16 : 8))
+        select_sprites(gb);
 
-    /* 
-     *  4 bytes per sprite, and 40 sprites (from 0xfe00 - 0xfe9f is the sprite attribute table)
-     *
-     *  byte 0 : y pos
-     *  byte 1 : x pos
-     *  byte 2 : tile number (unsigned value selects tile from 0x8000-0x8fff)
-     *  byte 3 : attributes of the sprite
-     *
-     *
+    *n = lists->counts[ly];
+
+    return lists->sprites[ly];
+}
+
+/*
+ *  The 8 color numbers sprite has on line ly, flipped the way it says
+ */
+const unsigned char* ppu_sprite_pixels(gb_t* gb, const struct sprite_attributes* sprite, int ly) {
+
+    /*
      *  sprite attributes: (from the pandocs)
      *
      *  Bit7   OBJ-to-BG Priority (0=OBJ Above BG, 1=OBJ Behind BG color 1-3)
@@ -506,121 +455,181 @@ static void render_sprites() {
      *
      */
 
-    const int SPRITE_ATTRIBUTES_SIZE = 4;
-    const int OAM_START = 0xfe00; // attribute table base location
-    const int SPRITE_TILES_START = 0x8000; // sprites tiles base location
+    int height = gb->ppu.sprites.height;
+    unsigned char tile_number = sprite->tile;
+
+    // which line of the sprite are we drawing?
+    int sprite_line = ly - (sprite->y - 16);
+
+    // read the y axis backwards (if we were reading line 0 we read line 7, or 15, instead)
+    if (sprite->attributes & 0x40) // Y Flip
+        sprite_line = height - 1 - sprite_line;
+
+    // 8x16 sprites are two tiles, the first one's number is even
+    if (height == 16)
+        tile_number &= 0xfe;
+
+    // X flipped sprites read the color numbers the other way around
+    return ppu_tile_line(gb, tile_number + sprite_line/8, sprite_line % 8, sprite->attributes & 0x20);
+}
 
-    // Is the sprite 8x8 or 8x16? Test LCDC Stat bit number 2
-    char sprite_ysize = *lcdc & 4 ? 16 : 8; 
 
-    // run over the 40 sprites and decide which to print - however no more than 10 sprites can be in each line
-    int sprites_drawn = 0; // only 10 sprites can be drawn per scanline
-    for (int sprite = 0; sprite<40 && sprites_drawn < 10; sprite++) {
 
-        int sprite_index = sprite*SPRITE_ATTRIBUTES_SIZE; // Each sprite uses 4 bytes
+#ifndef PIXEL_FIFO
 
-        // each sprite takes 
-        unsigned char ypos; // byte 0
-        mmu_read8bit(&ypos, + OAM_START + sprite_index);
-        ypos -= 16; // kind of hard to explain, but sprites are only in the screen from 16 down (probably because the top left corner can go 16 above the upper line)
+/*---- Shading ----------------------------------------------------*/
 
-        unsigned char xpos; // byte 1
-        mmu_read8bit(&xpos, + OAM_START + sprite_index + 1);
-        xpos -= 8; // same thing as -16 but for x coordinate
 
-        unsigned char tile_number; // byte 2
-        mmu_read8bit(&tile_number, + OAM_START + sprite_index + 2);
+/*
+ *  Turning a line of color numbers into shades is a lookup per pixel, which is
+ *  what a byte shuffle does with the 4 shades as its table: 16 pixels at a time
+ *  with SSSE3, 32 with AVX2. pick_shading picks the widest the cpu has when the
+ *  ppu starts (plain C without either, or when built with -DNO_SIMD, and SSSE3 at
+ *  most with -DNO_AVX2), and they all draw exactly the same ("make framecheck"
+ *  checks it). SCREEN_WIDTH is a multiple of 32.
+ */
 
-        unsigned char attributes; // byte 3
-        mmu_read8bit(&attributes, + OAM_START + sprite_index + 3);
+static void shade_line_c(const unsigned char* colors, const unsigned char* shades, unsigned char* line) {
 
-        int hasPriorityOverBackground = !(attributes & 0x80); // if bit7 is 0
+    for (int x = 0; x < SCREEN_WIDTH; x++)
+        line[x] = shades[colors[x]];
+}
 
-        // Is the scanline passing through this sprite 
-        // And is the OBJ-to-BG Priority such that the sprite should be drawn above the background
-        if (*lcd_ly < (ypos + sprite_ysize) && *lcd_ly >= ypos) {
+#ifdef SIMD_SHADING
 
-            // Drawing sprite
-            sprites_drawn++;
-            
+__attribute__((target("ssse3")))
+static void shade_line_ssse3(const unsigned char* colors, const unsigned char* shades, unsigned char* line) {
 
-            /* Each Tile occupies 16 bytes, where each 2 bytes represent a line:
+    // Color numbers are 0-3, the rest of the table is never looked up
+    __m128i table = _mm_setr_epi8(shades[0], shades[1], shades[2], shades[3], 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
 
-                 Byte 0-1  First Line (Upper 8 pixels)
-                 Byte 2-3  Next Line
-                 etc.
-            */
+    for (int x = 0; x < SCREEN_WIDTH; x += 16) {
+
+        __m128i pixels = _mm_loadu_si128((const __m128i*) &colors[x]);
+        _mm_storeu_si128((__m128i*) &line[x], _mm_shuffle_epi8(table, pixels));
+    }
+}
 
-            // the 2 bytes for the line of the sprite we're drawing (2 bytes represent a line)
-            unsigned char lo_color_bit, hi_color_bit;
+#ifndef NO_AVX2
 
-            // the get the correct bytes first we get the address of the tile
-            unsigned short tileaddress = SPRITE_TILES_START + tile_number*16; 
+__attribute__((target("avx2")))
+static void shade_line_avx2(const unsigned char* colors, const unsigned char* shades, unsigned char* line) {
 
-            // which line of the sprite are we drawing?
-            unsigned char sprite_line = (*lcd_ly - ypos)*2;
+    // The shuffle looks up in each 128 bit half separately, so both halves have the table
+    __m256i table = _mm256_broadcastsi128_si256(_mm_setr_epi8(shades[0], shades[1], shades[2], shades[3], 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0));
 
-            // read the y axis backwards (if we were reading line 1 we read line 8 instead)
-            // TODO: I think this y flip is incorrect
-            if (attributes & 0x40) // Y Flip
-                sprite_line = (sprite_line-ypos) * -1;
+    for (int x = 0; x < SCREEN_WIDTH; x += 32) {
 
-            // Address for line in the tile
-            unsigned short line_in_tile_address = tileaddress + sprite_line;
+        __m256i pixels = _mm256_loadu_si256((const __m256i*) &colors[x]);
+        _mm256_storeu_si256((__m256i*) &line[x], _mm256_shuffle_epi8(table, pixels));
+    }
+}
 
-            // the 2 bytes for the line of the sprite we're drawing (2 bytes represent a line)
-            mmu_read8bit(&hi_color_bit, line_in_tile_address);
-            mmu_read8bit(&lo_color_bit, line_in_tile_address + 1);
+#endif
 
+#endif
 
-            unsigned char palette_colors[4];
-            unsigned char palette_register;
+// Shades a whole line: SCREEN_WIDTH color numbers into SCREEN_WIDTH shades
+static void (*shade_line)(const unsigned char* colors, const unsigned char* shades, unsigned char* line) = shade_line_c;
 
-            // Bit 4 of attributes specifies the palette
-            palette_register = (attributes & 0x10) ? *obj_palette_1_data : *obj_palette_0_data;
+static void pick_shading(void) {
 
-            palette_colors[3] = palette_register >> 6;
-            palette_colors[2] = (palette_register >> 4) & 0x3;
-            palette_colors[1] = (palette_register >> 2) & 0x3;
-            palette_colors[0] = palette_register & 0x3;
+#ifdef SIMD_SHADING
+    __builtin_cpu_init();
 
-            /* printf("Palette is the following for color 0 1 2 3: %d %d %d %d\n", palette_colors[0], palette_colors[1], palette_colors[2], palette_colors[3]); */
+#ifndef NO_AVX2
+    if (__builtin_cpu_supports("avx2"))
+        shade_line = shade_line_avx2;
+    else
+#endif
+    if (__builtin_cpu_supports("ssse3"))
+        shade_line = shade_line_ssse3;
+#endif
+}
 
-            // Draw 8 horizontal pixels of sprite in scanline
-            for (int horizontal_pixel=0; horizontal_pixel<8; horizontal_pixel++) {
 
-                int colorbit = 7 - horizontal_pixel;
-                
-                // Read the color bits the other way around to flip the sprite
-                if (attributes & 0x20) // X Flip
-                    colorbit = (colorbit - 7) * -1; // if it was 7, it'll read 0, if it was 6 -> 1, etc...
 
-                // To get color join colorbit from byte 1 on the left and byte 2 to the right
-                unsigned char pixel_color = 0;
-                pixel_color |= (hi_color_bit >> colorbit) & 1; // 7-pixel because pixel 0 is in bit 7
-                pixel_color <<= 1;
-                pixel_color |= (lo_color_bit >> colorbit) & 1;
+/*---- Drawing ----------------------------------------------------*/
 
-                // Color index 0 is transparent for sprites
-                if (pixel_color == 0)
-                    continue;
 
-                // If doesn't have priority and BG is not white, skip
-                if (!hasPriorityOverBackground && scanlinesbuffer[(*lcd_ly)*160 + xpos + horizontal_pixel] != 255)
-                    continue;
+static void render_sprites(gb_t* gb) {
 
-                scanlinesbuffer[(*lcd_ly)*160 + xpos + horizontal_pixel] = (3-palette_colors[pixel_color])*85; // Do 3-color bc 0 = white and 3 = black and 0 is black in rgb
+    unsigned char ly = *gb->memory.lcd_ly;
+    unsigned char* line = &gb->ppu.scanlinesbuffer[ly*SCREEN_WIDTH];
 
-            }
+    int n_sprites;
+    const unsigned char* sprites = ppu_line_sprites(gb, ly, &n_sprites);
 
+    // The ppu reads OAM itself (the cpu might not be able to right now)
+    const struct sprite_attributes* oam = (const struct sprite_attributes*) gb->memory.oam;
+
+    // A pixel belongs to the first sprite in the list that isn't transparent there, even if the background hides it
+    unsigned char taken[SCREEN_WIDTH] = {0};
+
+    for (int i = 0; i < n_sprites; i++) {
+
+        const struct sprite_attributes* sprite = &oam[sprites[i]];
+
+        int xpos = sprite->x - 8; // same thing as -16 for y (it can be partly off the left edge)
+
+        int hasPriorityOverBackground = !(sprite->attributes & 0x80); // if bit7 is 0
+
+        const unsigned char* pixels = ppu_sprite_pixels(gb, sprite, ly);
+
+        unsigned char shades[4];
+
+        // Bit 4 of attributes specifies the palette
+        ppu_palette_shades((sprite->attributes & 0x10) ? *gb->memory.obj_palette_1_data : *gb->memory.obj_palette_0_data, shades);
+
+        // Draw 8 horizontal pixels of sprite in scanline
+        for (int horizontal_pixel=0; horizontal_pixel<8; horizontal_pixel++) {
+
+            int x = xpos + horizontal_pixel;
+
+            // Only what's on screen
+            if (x < 0 || x >= SCREEN_WIDTH)
+                continue;
+
+            // Color index 0 is transparent for sprites
+            if (pixels[horizontal_pixel] == 0 || taken[x])
+                continue;
+
+            taken[x] = 1;
+
+            // If doesn't have priority, only background color 0 is drawn over
+            if (!hasPriorityOverBackground && gb->ppu.bg_colors[8 + x])
+                continue;
+
+            line[x] = shades[pixels[horizontal_pixel]];
         }
+    }
+}
+
+/*
+ *  Copy the color numbers of line of n tiles from a row of a tile map to colors,
+ *  starting at its column first (the row wraps around)
+ */
+static void copy_tile_lines(gb_t* gb, unsigned char* colors, const unsigned char* tile_ids, int first, int n, int line) {
+
+    // Test LCDC Bit 4 (if 0, the ids are signed bytes: tile 0 is at 9000, tiles -128 to -1 at 8800-8FFF)
+    int unsigned_tile_ids = (*gb->memory.lcdc >> 4) & 1;
+
+    for (int i = 0; i < n; i++) {
 
+        unsigned char tile_id = tile_ids[(first + i) % 32];
+        int tile = unsigned_tile_ids ? tile_id : 256 + (signed char) tile_id;
+
+        memcpy(&colors[i*8], ppu_tile_line(gb, tile, line, 0), 8);
     }
+}
+
+// The window covers the line from WX-7, once LY has reached WY (LCDC Bit 5 enables it)
+static int window_shows(gb_t* gb) {
 
+    return (*gb->memory.lcdc & 0x20) && *gb->memory.lcd_windowy <= *gb->memory.lcd_ly && *gb->memory.lcd_windowx - 7 < SCREEN_WIDTH;
 }
 
-static void render_tiles() {
-// the 4 is just helpful, the parameter is still (unsigned char*)
+static void render_tiles(gb_t* gb) {
 
     /* From the pandocs:
 
@@ -639,138 +648,155 @@ static void render_tiles() {
 
      */
 
-    unsigned char using_window = 0;
-    unsigned short tile_data_base_address;                          // location where tiles are described
-    tile_data_base_address = ((*lcdc >> 4) & 1) ? 0x8000 : 0x8800;  // Test LCDC Bit 4 (if 0, the ids are signed bytes and we'll have to check it ahead)
+    unsigned char lcdc = *gb->memory.lcdc;
+    unsigned char ly = *gb->memory.lcd_ly;
 
-    unsigned short tilemap_base_address;            // location where background (either window or actual BG)
-                                                    // tiles to be used are specified (by id)
+    // The color numbers of the whole line are put together first (sprites need them too)
+    unsigned char* colors = gb->ppu.bg_colors;
 
+    // Background: the 21 tiles the line goes through, the first one starts SCX % 8 pixels left of the screen
+    unsigned char yPos = *gb->memory.lcd_scy + ly;    // Y pos in 256x256 background
+    unsigned char scx = *gb->memory.lcd_scx;
 
-    if (((*lcdc >> 5 ) & 1)                         // Test LCDC Bit 5 (enables or disables Window)
-            && (*lcd_windowy <= *lcd_ly))           // and if current scanline is within window Y position
-        using_window = 1;
+    // tile ids are organized from the tile map's base as 32 rows of 32 bytes
+    const unsigned char* bg_tile_ids = &gb->memory.memory[(lcdc & 0x08 ? 0x9C00 : 0x9800) + (yPos/8)*32];   // Test LCDC Bit 3
 
-    if (!using_window)
-        tilemap_base_address = ((*lcdc >> 3) & 1) ? 0x9C00 : 0x9800; // Test LCDC Bit 3 (which BG tile map address)
+    copy_tile_lines(gb, &colors[8 - scx%8], bg_tile_ids, scx/8, SCREEN_WIDTH/8 + 1, yPos % 8);
 
-    else
-        tilemap_base_address = ((*lcdc >> 6) & 1) ? 0x9C00 : 0x9800; // Test LCDC Bit 6 (which Window tile map address)
+    // Window: covers the background from WX-7 to the end of the line
+    if (window_shows(gb)) {
 
-    // Find tile row, then pixel row in tile,
-    // and add the whole line of pixels to framebuffer
+        int window_x = *gb->memory.lcd_windowx - 7;
 
-    unsigned char yPos = *lcd_scy + *lcd_ly;    // Y pos in 256x256 background
-    unsigned char tile_row = (char) (yPos / 8); // 8 pixels per tile
+        // Its lines are counted separately: only lines that show it move it down
+        unsigned char window_line = gb->ppu.window_line++;
 
-    unsigned char pixels_drawn = 0;
-    while (pixels_drawn < 160) {
+        const unsigned char* window_tile_ids = &gb->memory.memory[(lcdc & 0x40 ? 0x9C00 : 0x9800) + (window_line/8)*32];   // Test LCDC Bit 6
 
-        unsigned char xPos = pixels_drawn + *lcd_scx;        // X pos in 256x256 background
-        unsigned char tile_col = (char) (xPos / 8);   // 8 pixels per tile
+        copy_tile_lines(gb, &colors[8 + window_x], window_tile_ids, 0, (SCREEN_WIDTH - window_x + 7) / 8, window_line % 8);
+    }
 
-        unsigned char tile_id;
+    unsigned char shades[4];
+    ppu_palette_shades(*gb->memory.lcd_bgp, shades);
 
-        // Get the tile id from tilemap + offset,
-        // Then get the data for that tile id
+    shade_line(&colors[8], shades, &gb->ppu.scanlinesbuffer[ly*SCREEN_WIDTH]);
+}
 
-        unsigned short tile_address = tilemap_base_address+(tile_row*32)+tile_col;   // tile ids are organized from tilemap_base as 32 rows of 32 bytes
-        unsigned short tile_data_location = tile_data_base_address;
+static void draw_scanline(gb_t* gb) {
 
-        mmu_read8bit(&tile_id, tile_address);
+    // Lines of skipped frames aren't drawn, but the window moves down all the same
+    if (!gb->ppu.frame_skip.drawing) {
 
-        if ((*lcdc >> 4) & 1) {                         // if tile identity is unsigned
-            tile_data_location += (((unsigned char) tile_id)*16);         // each tile is 16 bytes long, start at 0
-        } else {
-            tile_data_location += ((((char) tile_id)+128) * 16); // each tile is 16 bytes, start at offset 128 (signed)
-        }
+        if ((*gb->memory.lcdc & 0x1) && window_shows(gb))
+            gb->ppu.window_line++;
 
+        return;
+    }
 
-        // figure out pixel line in tile, load color data for that line
-        // get colors from pallete, mix with data to create color
-        // set pixel with color in scanlinesbuffer (which will be used in create framebuffer & render)
+    if (*gb->memory.lcdc & 0x1)    // LCDC Bit 0 enables or disables Background (BG + Window) Display
+        render_tiles(gb); 
+    else {
+        memset(&gb->ppu.scanlinesbuffer[(*gb->memory.lcd_ly)*SCREEN_WIDTH], 255, SCREEN_WIDTH); // white without it
+        memset(gb->ppu.bg_colors, 0, sizeof(gb->ppu.bg_colors));                              // and sprites are over all of it
+    }
 
-        unsigned char line_byte_in_tile = (yPos % 8) * 2;   // each tile has 8 vertical lines, each line uses 2 bytes
+    if (*gb->memory.lcdc & 0x2)    // LCDC Bit 1 enables or disables Sprites
+        render_sprites(gb);
+}
 
-        unsigned char hi_color_bit, lo_color_bit;
-        mmu_read8bit(&hi_color_bit, tile_data_location+line_byte_in_tile);
-        mmu_read8bit(&lo_color_bit, tile_data_location+line_byte_in_tile+1);
+#endif
 
 
-        /*  Background Pallete Register
-              Bit 7-6 - Shade for Color Number 3
-              Bit 5-4 - Shade for Color Number 2
-              Bit 3-2 - Shade for Color Number 1
-              Bit 1-0 - Shade for Color Number 0
 
-            Possible shades of grey
-              0  White
-              1  Light gray
-              2  Dark gray
-              3  Black
-         */
+/*---- Frame Skipping ---------------------------------------------*/
 
-        unsigned char palette_colors[4];
-        palette_colors[3] = *lcd_bgp >> 6;
-        palette_colors[2] = (*lcd_bgp >> 4) & 0x3;
-        palette_colors[1] = (*lcd_bgp >> 2) & 0x3;
-        palette_colors[0] = *lcd_bgp & 0x3;
 
+/*
+ *  Skip skip frames of every `every` (0 of 1 draws every frame),
+ *  or with every 0, only draw the frames asked for with ppu_request_frame
+ */
+void ppu_set_frame_skip(gb_t* gb, int skip, int every) {
 
-        // For each tile, add horizontal pixels until the end of the tile (or until the end of the screen),
-        // Add those pixels to the scanlines buffer, and add up to the amount of pixels drawn
-        unsigned char tile_pixels_drawn = 0;
-        unsigned char hpixel_in_tile = (xPos % 8);
-        for(; hpixel_in_tile < 8 && pixels_drawn+hpixel_in_tile<160+*lcd_scx; hpixel_in_tile++) {
+    struct frame_skip* frame_skip = &gb->ppu.frame_skip;
 
-            unsigned char pixel_color = 0;
+    frame_skip->skip = skip;
+    frame_skip->every = every;
+    frame_skip->count = 0;
+    frame_skip->requested = 0;
 
-            pixel_color |= (hi_color_bit >> (7 - hpixel_in_tile)) & 1; // 7-pixel because pixel 0 is in bit 7
-            pixel_color <<= 1;
-            pixel_color |= (lo_color_bit >> (7 - hpixel_in_tile)) & 1;
+    // The frame that's already started keeps going as it was, unless every frame is drawn now,
+    // or only the ones asked for (it wasn't, and it would only be drawn from halfway)
+    if (every == 1 && !skip)
+        frame_skip->drawing = 1;
+    else if (!every)
+        frame_skip->drawing = 0;
+}
 
-            scanlinesbuffer[(*lcd_ly)*160 + pixels_drawn + hpixel_in_tile] = (3-palette_colors[pixel_color])*85; // Do 3-color bc 0 = white and 3 = black
+/*
+ *  Draw the next frame that starts (with every 0, see ppu_set_frame_skip)
+ */
+void ppu_request_frame(gb_t* gb) {
 
-            tile_pixels_drawn++;
-        }
+    gb->ppu.frame_skip.requested = 1;
+}
 
-        pixels_drawn+=tile_pixels_drawn;
+/*
+ *  Whether render_frame has a frame to show since the last time this was called
+ *  (always, without frame skipping, scanlinesbuffer is shown as it is)
+ */
+int ppu_new_frame(gb_t* gb) {
 
-    }
+    struct frame_skip* frame_skip = &gb->ppu.frame_skip;
 
-}
+    if (frame_skip->every == 1 && !frame_skip->skip)
+        return 1;
 
+    int ready = frame_skip->ready;
+    frame_skip->ready = 0;
 
+    return ready;
+}
 
-/*---- Main Logic and Execution -----------------------------------*/
+// A frame starts (LY 0): it's drawn or skipped
+static void start_frame(gb_t* gb) {
 
+    struct frame_skip* frame_skip = &gb->ppu.frame_skip;
 
-static void draw_scanline() {
+    if (!frame_skip->every) {
+        frame_skip->drawing = frame_skip->requested;
+        frame_skip->requested = 0;
+    }
+    else
+        frame_skip->drawing = frame_skip->count++ % frame_skip->every >= (unsigned) frame_skip->skip;
+}
 
-    if (*lcdc & 0x1)    // LCDC Bit 0 enables or disables Background (BG + Window) Display
-        render_tiles(); 
 
-    if (*lcdc & 0x2)    // LCDC Bit 1 enables or disables Sprites
-        render_sprites();
-}
 
-void ppu(int cycles) {
+/*---- Main Logic and Execution -----------------------------------*/
+
 
-    set_lcd_stat();
+/*
+ *  Next mode change or end of scanline
+ */
+void ppu_event(gb_t* gb) {
 
-    if (!lcdc_is_enabled())
+    if (!lcdc_is_enabled(gb))
         return;
 
-    scanline_cycles_left -= cycles;
+#ifdef PIXEL_FIFO
+    // M3 -> M0, the line was drawn by now
+    if (gb->scheduler.now - gb->ppu.line_start > (unsigned) (TOTAL_SCANLINE_CYCLES - mode3_scanline_cycles(gb)))
+        fifo_finish_line(gb);
+#endif
 
     /* If the scanline is completely drawn according to the time passed in cycles */
-    if (scanline_cycles_left <= 0) {
+    if (gb->scheduler.now - gb->ppu.line_start >= TOTAL_SCANLINE_CYCLES) {
 
-        (*lcd_ly)++; /* Scanline advances, so we update the LCDC Y-Coordinate
+        (*gb->memory.lcd_ly)++; /* Scanline advances, so we update the LCDC Y-Coordinate
                       * register, because it needs to hold the current scanline
                       */
 
-        scanline_cycles_left = TOTAL_SCANLINE_CYCLES;
+        gb->ppu.line_start = gb->scheduler.now;
 
         /* VBLANK is confirmed when LY >= 144, the resolution is 160x144,
          * but since the first scanline is 0, the scanline number 144 is actually the 145th.
@@ -778,15 +804,42 @@ void ppu(int cycles) {
          * It means the cpu can use the VRAM without worrying, because it's not being used.
          * (Scanlines >= 144 and <= 153 are +invisible scanlines')
          */
-        if (*lcd_ly == 144)
-            request_interrupt(VBLANK_INTERRUPT);
+        if (*gb->memory.lcd_ly == 144) {
 
-        else if (*lcd_ly > 153) /* if scanline goes above 153, reset to -1 (0 in next iteration) */
-            *lcd_ly = -1;
+            request_interrupt(gb, VBLANK_INTERRUPT);
 
-        else if (*lcd_ly < 144)
-            draw_scanline();
+            if (gb->ppu.frame_skip.drawing)
+                gb->ppu.frame_skip.ready = 1;
+
+            // The window starts from its top again next frame
+            gb->ppu.window_line = 0;
+
+            // GameShark codes are applied once a frame
+            if (gb->cheats.n_pokes)
+                cheats_poke(gb);
+        }
+
+        else if (*gb->memory.lcd_ly > 153) /* if scanline goes above 153, reset to -1 (0 in next iteration) */
+            *gb->memory.lcd_ly = -1;
+
+        else if (*gb->memory.lcd_ly < 144) {
+
+            if (*gb->memory.lcd_ly == 0)
+                start_frame(gb);
+
+#ifndef PIXEL_FIFO
+            draw_scanline(gb);
+#endif
+        }
 
     }
+#ifdef PIXEL_FIFO
+    // M2 -> M3, the pixel FIFO starts drawing the line
+    else if (*gb->memory.lcd_ly < 144 && gb->scheduler.now > mode3_start(gb) && gb->ppu.fifo.start != mode3_start(gb))
+        fifo_start_line(gb, mode3_start(gb));
+#endif
+
+    scheduler_schedule(gb, EVENT_LCD_STAT, gb->scheduler.now + 1);
 
+    schedule_ppu(gb);
 }
@@ -0,0 +1,146 @@
+#ifdef PROFILE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gb.h"
+
+/*
+ *  Called by the cpu after every instruction
+ */
+void profile_count(struct profile_counter* counter, int cycles, int extra_cycles) {
+
+    counter->executions++;
+    counter->cycles += cycles + extra_cycles;
+
+    if (extra_cycles) {
+        counter->extra++;
+        counter->extra_cycles += extra_cycles;
+    }
+}
+
+
+
+/*---- Report -----------------------------------------------------*/
+
+
+struct profile_entry {
+    unsigned short opcode;      // 0xcbXX for CB opcodes
+    struct profile_counter* counter;
+};
+
+static int compare_entries(const void* a, const void* b) {
+
+    unsigned long long cycles_a = ((const struct profile_entry*) a)->counter->cycles;
+    unsigned long long cycles_b = ((const struct profile_entry*) b)->counter->cycles;
+
+    return cycles_a < cycles_b ? 1 : cycles_a > cycles_b ? -1 : 0;
+}
+
+/*
+ *  Disassembly of opcode without the operand format (e.g. "LD B, d8")
+ */
+static void mnemonic(unsigned short opcode, char* destination, int size) {
+
+    const char* disassembly = opcode > 0xff ? instructions_cb_disassembly[opcode & 0xff] : instructions_disassembly[opcode];
+
+    int length = 0;
+
+    while (*disassembly && length < size-4) {
+
+        if (!strncmp(disassembly, "0x%02X", 6)) {
+            length += sprintf(destination + length, "d8");
+            disassembly += 6;
+        }
+        else if (!strncmp(disassembly, "0x%04X", 6)) {
+            length += sprintf(destination + length, "d16");
+            disassembly += 6;
+        }
+        else
+            destination[length++] = *disassembly++;
+    }
+
+    destination[length] = 0;
+}
+
+/*
+ *  Write every opcode that ran, most cycles first, as a table (text) and as CSV (csv)
+ *  Either can be NULL
+ */
+void profile_write_report(gb_t* gb, FILE* text, FILE* csv) {
+
+    struct profile_entry entries[512];
+    int n_entries = 0;
+    unsigned long long total_executions = 0, total_cycles = 0;
+
+    for (int i = 0; i < 512; i++) {
+
+        struct profile_counter* counter = i < 256 ? &gb->profile.instructions[i] : &gb->profile.cb_instructions[i-256];
+
+        // CB itself is counted by the CB opcodes
+        if (!counter->executions || i == 0xcb)
+            continue;
+
+        entries[n_entries].opcode = i < 256 ? i : 0xcb00 | (i-256);
+        entries[n_entries].counter = counter;
+        n_entries++;
+
+        total_executions += counter->executions;
+        total_cycles += counter->cycles;
+    }
+
+    qsort(entries, n_entries, sizeof(struct profile_entry), compare_entries);
+
+    if (text) {
+        fprintf(text, "%llu instructions, %llu cycles\n\n", total_executions, total_cycles);
+        fprintf(text, "%-6s %-24s %14s %7s %14s %7s %7s %12s %12s\n",
+                "opcode", "instruction", "executions", "%", "cycles", "%", "avg", "extra", "extra cycles");
+    }
+
+    if (csv)
+        fprintf(csv, "opcode,instruction,executions,cycles,extra,extra_cycles\n");
+
+    for (int i = 0; i < n_entries; i++) {
+
+        struct profile_counter* counter = entries[i].counter;
+
+        char name[32];
+        mnemonic(entries[i].opcode, name, sizeof(name));
+
+        char opcode[8];
+        sprintf(opcode, entries[i].opcode > 0xff ? "%04x" : "%02x", entries[i].opcode);
+
+        if (text)
+            fprintf(text, "%-6s %-24s %14llu %6.2f%% %14llu %6.2f%% %7.2f %12llu %12llu\n",
+                    opcode, name,
+                    counter->executions, 100.0 * counter->executions / total_executions,
+                    counter->cycles, 100.0 * counter->cycles / total_cycles,
+                    (double) counter->cycles / counter->executions,
+                    counter->extra, counter->extra_cycles);
+
+        if (csv)
+            fprintf(csv, "%s,\"%s\",%llu,%llu,%llu,%llu\n",
+                    opcode, name, counter->executions, counter->cycles, counter->extra, counter->extra_cycles);
+    }
+}
+
+/*
+ *  Write the report to profile.txt and profile.csv
+ */
+void profile_dump(gb_t* gb) {
+
+    FILE* text = fopen("profile.txt", "w");
+    FILE* csv = fopen("profile.csv", "w");
+
+    profile_write_report(gb, text, csv);
+
+    if (text)
+        fclose(text);
+    if (csv)
+        fclose(csv);
+
+    printf("Profile written to profile.txt and profile.csv\n");
+}
+
+#endif
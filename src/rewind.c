@@ -0,0 +1,315 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gb.h"
+
+// Biggest difference: the machine and every page, each with its size (and page number) and packed as badly as it gets
+#define SCRATCH_SIZE (4 + state_packed_bound(sizeof(struct state_machine)) + DIRTY_PAGES*(4 + state_packed_bound(0x100)))
+
+/*
+ *  Start capturing a snapshot every interval frames, keeping budget bytes of differences
+ */
+void rewind_init(gb_t* gb, unsigned long long budget, int interval) {
+
+    struct rewind* rewind = &gb->rewind;
+
+    rewind_free(gb);
+
+    rewind->latest = malloc(sizeof(struct rewind_snapshot));
+    rewind->scratch = malloc(SCRATCH_SIZE);
+    rewind->buffer = malloc(budget);
+    rewind->sizes = malloc(REWIND_MAX_SNAPSHOTS * sizeof(unsigned int));
+
+    if (!rewind->latest || !rewind->scratch || !rewind->buffer || !rewind->sizes) {
+        fprintf(stderr, "Couldn't allocate the rewind buffer, rewinding is off\n");
+        rewind_free(gb);
+        return;
+    }
+
+    rewind->budget = budget;
+    rewind->interval = interval;
+}
+
+void rewind_free(gb_t* gb) {
+
+    struct rewind* rewind = &gb->rewind;
+
+    free(rewind->latest);
+    free(rewind->scratch);
+    free(rewind->buffer);
+    free(rewind->sizes);
+
+    memset(rewind, 0, sizeof(struct rewind));
+}
+
+
+
+/*---- Ring Buffer ------------------------------------------------*/
+
+
+static void drop_oldest(struct rewind* rewind) {
+
+    rewind->used -= rewind->sizes[rewind->first];
+    rewind->first = (rewind->first + 1) % REWIND_MAX_SNAPSHOTS;
+    rewind->n_differences--;
+}
+
+/*
+ *  Append the size bytes in scratch, dropping the oldest to make room
+ */
+static void push(struct rewind* rewind, unsigned int size) {
+
+    // One that doesn't fit at all means there's no going back past now
+    if (size > rewind->budget) {
+        rewind->used = rewind->n_differences = 0;
+        return;
+    }
+
+    while (rewind->budget - rewind->used < size || rewind->n_differences == REWIND_MAX_SNAPSHOTS)
+        drop_oldest(rewind);
+
+    // (it can wrap around the end)
+    unsigned long long first_part = rewind->budget - rewind->head < size ? rewind->budget - rewind->head : size;
+
+    memcpy(&rewind->buffer[rewind->head], rewind->scratch, first_part);
+    memcpy(rewind->buffer, rewind->scratch + first_part, size - first_part);
+
+    rewind->head = (rewind->head + size) % rewind->budget;
+    rewind->used += size;
+
+    rewind->sizes[(rewind->first + rewind->n_differences) % REWIND_MAX_SNAPSHOTS] = size;
+    rewind->n_differences++;
+}
+
+/*
+ *  Take the newest out into scratch
+ *  Returns its size
+ */
+static unsigned int pop(struct rewind* rewind) {
+
+    rewind->n_differences--;
+    unsigned int size = rewind->sizes[(rewind->first + rewind->n_differences) % REWIND_MAX_SNAPSHOTS];
+
+    rewind->head = (rewind->head + rewind->budget - size) % rewind->budget;
+    rewind->used -= size;
+
+    unsigned long long first_part = rewind->budget - rewind->head < size ? rewind->budget - rewind->head : size;
+
+    memcpy(rewind->scratch, &rewind->buffer[rewind->head], first_part);
+    memcpy(rewind->scratch + first_part, rewind->buffer, size - first_part);
+
+    return size;
+}
+
+
+
+/*---- Differences ------------------------------------------------*/
+
+
+/*
+ *  Difference:
+ *
+ *      unsigned short  n_pages
+ *      unsigned short  size of the machine XOR (packed), 0 if the machine didn't change
+ *      ...             the machine XOR
+ *      n_pages times:
+ *          unsigned short  page
+ *          unsigned short  size of its XOR (packed)
+ *          ...             the page XOR
+ */
+
+static unsigned char* put_short(unsigned char* out, unsigned short value) {
+
+    memcpy(out, &value, sizeof(value));
+    return out + sizeof(value);
+}
+
+static const unsigned char* get_short(const unsigned char* in, unsigned short* value) {
+
+    memcpy(value, in, sizeof(*value));
+    return in + sizeof(*value);
+}
+
+// Where page of the running gb is (address space, then cartridge RAM)
+static unsigned char* gb_page(gb_t* gb, int page) {
+
+    if (page < DIRTY_RAM_PAGE)
+        return &gb->memory.memory[page << 8];
+
+    return &gb->cartridge.ram_banks[(page - DIRTY_RAM_PAGE) << 8];
+}
+
+/*
+ *  XOR size bytes of new into old (leaving old as new), and pack the XOR at out
+ *  Returns the packed size, 0 if nothing changed
+ */
+static unsigned int pack_difference(unsigned char* old, const unsigned char* new, unsigned int size, unsigned char* out) {
+
+    unsigned char difference[sizeof(struct state_machine) > 0x100 ? sizeof(struct state_machine) : 0x100];
+    int changed = 0;
+
+    for (unsigned int i = 0; i < size; i++) {
+        difference[i] = old[i] ^ new[i];
+        changed |= difference[i];
+    }
+
+    if (!changed)
+        return 0;
+
+    memcpy(old, new, size);
+
+    return state_pack(difference, size, out);
+}
+
+/*
+ *  XOR size bytes packed at in into data (none if the packed size is 0, nothing changed)
+ *  Returns the next thing after it
+ */
+static const unsigned char* unpack_difference(unsigned char* data, unsigned int size, const unsigned char* in) {
+
+    unsigned short packed_size;
+    in = get_short(in, &packed_size);
+
+    if (!packed_size)
+        return in;
+
+    unsigned char difference[sizeof(struct state_machine) > 0x100 ? sizeof(struct state_machine) : 0x100];
+
+    if (state_unpack(in, packed_size, difference, size))
+        abort(); // the buffer was corrupted
+
+    for (unsigned int i = 0; i < size; i++)
+        data[i] ^= difference[i];
+
+    return in + packed_size;
+}
+
+/*
+ *  gb is at latest now, pages written from here on are what's different next time
+ */
+static void at_latest(gb_t* gb) {
+
+    gb->rewind.epoch = dirty_new_epoch(gb);
+    gb->rewind.frames = 0;
+}
+
+
+
+/*---- Capturing and Rewinding ------------------------------------*/
+
+
+/*
+ *  Called after every frame, captures one every interval
+ */
+void rewind_frame(gb_t* gb) {
+
+    struct rewind* rewind = &gb->rewind;
+
+    if (rewind->latest && ++rewind->frames >= rewind->interval)
+        rewind_capture(gb);
+}
+
+/*
+ *  Make gb's current state the latest snapshot (the one before it becomes a difference)
+ */
+void rewind_capture(gb_t* gb) {
+
+    struct rewind* rewind = &gb->rewind;
+    struct rewind_snapshot* latest = rewind->latest;
+
+    if (!latest)
+        return;
+
+    struct state_machine machine;
+    state_capture(gb, &machine);
+
+    int n_pages = DIRTY_RAM_PAGE + (gb->cartridge.ram_size >> 8);
+
+    // The first one is copied whole, as is one with RAM of a different size (there's no going back past that)
+    if (!rewind->captured || gb->cartridge.ram_size != rewind->ram_size) {
+
+        latest->machine = machine;
+
+        for (int page = 0; page < n_pages; page++)
+            memcpy(latest->pages[page], gb_page(gb, page), 0x100);
+
+        rewind->captured = 1;
+        rewind->ram_size = gb->cartridge.ram_size;
+        rewind->used = rewind->n_differences = 0;
+
+        at_latest(gb);
+        return;
+    }
+
+    unsigned short n_changed = 0;
+    unsigned char* out = rewind->scratch + 2;
+
+    unsigned char* size = out;
+    out += 2;
+    out += pack_difference((unsigned char*) &latest->machine, (unsigned char*) &machine, sizeof(machine), out);
+    put_short(size, out - size - 2);
+
+    for (int page = 0; page < n_pages; page++) {
+
+        // IO registers change without being written
+        if (page != 0xff && !dirty_page_written(gb, page, rewind->epoch))
+            continue;
+
+        unsigned int packed_size = pack_difference(latest->pages[page], gb_page(gb, page), 0x100, out + 4);
+
+        if (packed_size) {
+            out = put_short(out, page);
+            out = put_short(out, packed_size);
+            out += packed_size;
+            n_changed++;
+        }
+    }
+
+    put_short(rewind->scratch, n_changed);
+
+    push(rewind, out - rewind->scratch);
+
+    at_latest(gb);
+}
+
+/*
+ *  Load the latest snapshot, or the one before it if gb is at the latest already
+ *  Returns -1 if there's nothing further back
+ */
+int rewind_step(gb_t* gb) {
+
+    struct rewind* rewind = &gb->rewind;
+    struct rewind_snapshot* latest = rewind->latest;
+
+    if (!latest || !rewind->captured)
+        return -1;
+
+    if (!rewind->frames) {
+
+        if (!rewind->n_differences)
+            return -1;
+
+        pop(rewind);
+
+        const unsigned char* in = rewind->scratch;
+
+        unsigned short n_changed;
+        in = get_short(in, &n_changed);
+        in = unpack_difference((unsigned char*) &latest->machine, sizeof(latest->machine), in);
+
+        for (int i = 0; i < n_changed; i++) {
+
+            unsigned short page;
+            in = get_short(in, &page);
+            in = unpack_difference(latest->pages[page], 0x100, in);
+        }
+    }
+
+    if (state_restore(gb, &latest->machine, latest->pages[0], latest->pages[DIRTY_RAM_PAGE], rewind->ram_size))
+        return -1;
+
+    at_latest(gb);
+
+    return 0;
+}
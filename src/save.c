@@ -0,0 +1,305 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "gb.h"
+
+/*---- Cartridge Types --------------------------------------------*/
+
+
+static int has_battery(unsigned char mbctype) {
+
+    switch (mbctype) {
+        case 0x03: case 0x06: case 0x09: case 0x0d: case 0x0f: case 0x10: case 0x13: case 0x1b: case 0x1e:
+            return 1;
+    }
+
+    return 0;
+}
+
+static unsigned int ram_size(unsigned char mbctype, unsigned char ramsizetype) {
+
+    // 0, 2KB, 8KB, 32KB, 128KB, 64KB
+    static const unsigned int ram_sizes[] = { 0, 0x800, 0x2000, 0x8000, 0x20000, 0x10000 };
+
+    // MBC2 has 512 4 bit values built in
+    if (mbctype == 0x05 || mbctype == 0x06)
+        return 0x200;
+
+    return ramsizetype < sizeof(ram_sizes)/sizeof(ram_sizes[0]) ? ram_sizes[ramsizetype] : 0;
+}
+
+
+
+/*---- Background Flush -------------------------------------------*/
+
+
+/*
+ *  Sync every range it's handed until it's stopped (and nothing's left)
+ */
+static void* flush_thread(void* arg) {
+
+    gb_t* gb = arg;
+    struct save* save = &gb->save;
+
+    long page_size = sysconf(_SC_PAGESIZE);
+
+    pthread_mutex_lock(&save->lock);
+
+    while (1) {
+
+        while (save->pending_start == save->pending_end && !save->stop)
+            pthread_cond_wait(&save->wake, &save->lock);
+
+        if (save->pending_start == save->pending_end)
+            break;
+
+        // msync works on whole pages of memory
+        unsigned int start = save->pending_start & ~(page_size - 1);
+        unsigned int end = save->pending_end;
+
+        save->pending_start = save->pending_end = 0;
+
+        pthread_mutex_unlock(&save->lock);
+
+        if (msync(gb->cartridge.ram_banks + start, end - start, MS_SYNC))
+            perror("Couldn't write the save file");
+
+        pthread_mutex_lock(&save->lock);
+    }
+
+    pthread_mutex_unlock(&save->lock);
+
+    return NULL;
+}
+
+/*
+ *  Hand the dirty pages to the thread (coalesced into one range, with what it hasn't synced yet)
+ */
+static void flush_dirty_pages(gb_t* gb) {
+
+    struct save* save = &gb->save;
+
+    if (!save->n_dirty)
+        return;
+
+    int first = SAVE_PAGES, last = 0;
+
+    for (int page = 0; page < SAVE_PAGES; page++) {
+
+        if (save->dirty[page]) {
+
+            if (page < first)
+                first = page;
+            last = page;
+
+            save->dirty[page] = 0;
+        }
+    }
+
+    save->n_dirty = 0;
+
+    unsigned int start = first << 8;
+    unsigned int end = (last + 1) << 8;
+
+    pthread_mutex_lock(&save->lock);
+
+    if (save->pending_start != save->pending_end) {
+
+        if (save->pending_start < start)
+            start = save->pending_start;
+        if (save->pending_end > end)
+            end = save->pending_end;
+    }
+
+    save->pending_start = start;
+    save->pending_end = end;
+
+    pthread_cond_signal(&save->wake);
+    pthread_mutex_unlock(&save->lock);
+
+    // The next write to each page has to mark it dirty again
+    mmu_map_pages(gb, 0xa0, 0xbf);
+}
+
+
+
+/*---- Dirty Pages ------------------------------------------------*/
+
+
+/*
+ *  Writes to clean pages of battery backed RAM have to go through save_mark_dirty
+ */
+int save_page_is_clean(gb_t* gb, unsigned int offset) {
+
+    return gb->save.battery && !gb->save.dirty[offset >> 8];
+}
+
+/*
+ *  Called before RAM at offset is written
+ */
+void save_mark_dirty(gb_t* gb, unsigned int offset) {
+
+    struct save* save = &gb->save;
+
+    if (!save_page_is_clean(gb, offset))
+        return;
+
+    save->dirty[offset >> 8] = 1;
+    save->n_dirty++;
+
+    if (save->n_dirty == 1)
+        scheduler_schedule(gb, EVENT_SAVE, gb->scheduler.now + SAVE_DELAY_CYCLES);
+    else if (save->n_dirty == SAVE_MAX_DIRTY_PAGES)
+        scheduler_schedule(gb, EVENT_SAVE, gb->scheduler.now + 1);
+
+    // Writes to the page go straight to it now
+    mmu_map_pages(gb, 0xa0, 0xbf);
+}
+
+void save_event(gb_t* gb) {
+
+    flush_dirty_pages(gb);
+}
+
+
+
+/*---- Setup ------------------------------------------------------*/
+
+
+/*
+ *  The save file is the ROM's path with .sav instead of its extension
+ */
+void save_set_path(gb_t* gb, const char* rom_path) {
+
+    struct save* save = &gb->save;
+
+    snprintf(save->path, sizeof(save->path), "%s", rom_path);
+
+    char* extension = strrchr(save->path, '.');
+    char* directory = strrchr(save->path, '/');
+
+    if (extension && (!directory || extension > directory))
+        *extension = '\0';
+
+    strncat(save->path, ".sav", sizeof(save->path) - strlen(save->path) - 1);
+}
+
+/*
+ *  Map the .sav file (creating it, or growing it to the RAM size, if needed)
+ *  Returns NULL if it can't be mapped
+ */
+static unsigned char* map_save_file(gb_t* gb, unsigned int size) {
+
+    int fd = open(gb->save.path, O_RDWR | O_CREAT, 0644);
+
+    if (fd < 0) {
+        fprintf(stderr, "Couldn't open %s: %s\n", gb->save.path, strerror(errno));
+        return NULL;
+    }
+
+    struct stat file;
+
+    if (fstat(fd, &file) || (file.st_size < size && ftruncate(fd, size))) {
+        fprintf(stderr, "Couldn't resize %s: %s\n", gb->save.path, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    unsigned char* ram = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (ram == MAP_FAILED) {
+        fprintf(stderr, "Couldn't map %s: %s\n", gb->save.path, strerror(errno));
+        return NULL;
+    }
+
+    return ram;
+}
+
+/*
+ *  Set up the RAM for the cartridge type and RAM size in the header
+ */
+void save_init(gb_t* gb) {
+
+    struct cartridge* cartridge = &gb->cartridge;
+    struct save* save = &gb->save;
+
+    save_free(gb);
+
+    cartridge->ram_size = ram_size(cartridge->mbctype, cartridge->ramsizetype);
+
+    // All of it is new
+    dirty_mark_all(gb);
+
+    if (!cartridge->ram_size)
+        return;
+
+    if (has_battery(cartridge->mbctype) && save->path[0]) {
+
+        cartridge->ram_banks = map_save_file(gb, cartridge->ram_size);
+
+        if (cartridge->ram_banks) {
+
+            save->battery = 1;
+
+            pthread_mutex_init(&save->lock, NULL);
+            pthread_cond_init(&save->wake, NULL);
+            pthread_create(&save->thread, NULL, flush_thread, gb);
+
+            printf("Saving to %s\n", save->path);
+            return;
+        }
+
+        fprintf(stderr, "The game won't be saved\n");
+    }
+
+    cartridge->ram_banks = mmap(NULL, cartridge->ram_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (cartridge->ram_banks == MAP_FAILED) {
+        perror("Couldn't allocate the cartridge RAM");
+        exit(1);
+    }
+}
+
+/*
+ *  Write what's dirty and free the RAM
+ */
+void save_free(gb_t* gb) {
+
+    struct cartridge* cartridge = &gb->cartridge;
+    struct save* save = &gb->save;
+
+    if (save->battery) {
+
+        flush_dirty_pages(gb);
+
+        pthread_mutex_lock(&save->lock);
+        save->stop = 1;
+        pthread_cond_signal(&save->wake);
+        pthread_mutex_unlock(&save->lock);
+
+        pthread_join(save->thread, NULL);
+
+        pthread_mutex_destroy(&save->lock);
+        pthread_cond_destroy(&save->wake);
+
+        save->battery = 0;
+        save->stop = 0;
+        scheduler_cancel(gb, EVENT_SAVE);
+    }
+
+    if (cartridge->ram_banks)
+        munmap(cartridge->ram_banks, cartridge->ram_size);
+
+    cartridge->ram_banks = NULL;
+    cartridge->ram_size = 0;
+
+    cartridge->ram_bank = NULL;
+    mmu_map_pages(gb, 0xa0, 0xbf);
+}
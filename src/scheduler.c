@@ -0,0 +1,199 @@
+#include <string.h>
+
+#include "gb.h"
+
+static void (* const event_handlers[EVENTS])(gb_t* gb) = {
+    [EVENT_LCD_STAT] = ppu_stat_event,
+    [EVENT_PPU] = ppu_event,
+    [EVENT_DIV] = timer_div_event,
+    [EVENT_TIMA] = timer_tima_event,
+    [EVENT_JOYPAD] = joypad_event,
+    [EVENT_SAVE] = save_event,
+    [EVENT_DMA] = mmu_dma_event,
+};
+
+void scheduler_init(gb_t* gb) {
+
+    gb->scheduler.now = 0;
+    gb->scheduler.instruction_start = 0;
+
+    for (int i = 0; i < EVENTS; i++)
+        gb->scheduler.deadlines[i] = NO_EVENT;
+
+    gb->scheduler.next_deadline = NO_EVENT;
+
+    gb->scheduler.idle_cycles = 0;
+}
+
+
+
+/*---- Scheduling -------------------------------------------------*/
+
+
+static void update_next_deadline(gb_t* gb) {
+
+    unsigned long long next = NO_EVENT;
+
+    for (int i = 0; i < EVENTS; i++)
+        if (gb->scheduler.deadlines[i] < next)
+            next = gb->scheduler.deadlines[i];
+
+    gb->scheduler.next_deadline = next;
+}
+
+/*
+ *  (Re)schedule event to be handled once the time reaches deadline
+ */
+void scheduler_schedule(gb_t* gb, int event, unsigned long long deadline) {
+
+    gb->scheduler.deadlines[event] = deadline;
+
+    if (deadline < gb->scheduler.next_deadline)
+        gb->scheduler.next_deadline = deadline;
+    else
+        update_next_deadline(gb);
+}
+
+void scheduler_cancel(gb_t* gb, int event) {
+
+    gb->scheduler.deadlines[event] = NO_EVENT;
+
+    update_next_deadline(gb);
+}
+
+/*
+ *  The LY == LYC and joypad interrupts are requested on every step their
+ *  condition holds, which only makes a difference after their request flag
+ *  is cleared (when an interrupt is serviced or IF is written)
+ */
+void scheduler_interrupt_cleared(gb_t* gb) {
+
+    scheduler_schedule(gb, EVENT_LCD_STAT, gb->scheduler.now + 1);
+    scheduler_schedule(gb, EVENT_JOYPAD, gb->scheduler.now + 1);
+}
+
+/*
+ *  Handle every event that is due, in order
+ *  (handlers can schedule more, those only run if they're due already too)
+ */
+static void handle_events(gb_t* gb) {
+
+    while (gb->scheduler.next_deadline <= gb->scheduler.now) {
+
+        int event = 0;
+
+        for (int i = 1; i < EVENTS; i++)
+            if (gb->scheduler.deadlines[i] < gb->scheduler.deadlines[event])
+                event = i;
+
+        scheduler_cancel(gb, event);
+
+        event_handlers[event](gb);
+    }
+}
+
+
+
+/*
+ *  When the cpu has to stop next (instructions can schedule events, so this changes as it runs)
+ */
+static unsigned long long next_stop(gb_t* gb, unsigned long long until) {
+
+    return gb->scheduler.next_deadline < until ? gb->scheduler.next_deadline : until;
+}
+
+
+
+/*---- Idle Loops -------------------------------------------------*/
+
+
+/*
+ *  Called when the cpu jumped back a short distance, which might be the start of
+ *  an idle loop (e.g. waiting for LY or for a flag the VBlank handler sets).
+ *
+ *  Nothing but events changes memory, so if one pass over a loop that only reads
+ *  leaves the registers exactly as they were, every pass until the next event
+ *  does the same: those are skipped (only whole passes, so the event is still
+ *  seen after the same instruction as if they had run)
+ */
+static void skip_idle_loop(gb_t* gb, unsigned long long until) {
+
+    struct scheduler* scheduler = &gb->scheduler;
+
+    struct block* block = block_lookup(gb, gb->registers.pc);
+
+    if (!block || !block->idle_loop)
+        return;
+
+    cpu_sync_flags(gb);
+    struct registers before = gb->registers;
+    unsigned long long pass_start = scheduler->now;
+#ifdef HEATMAP
+    struct heatmap heatmap_before = gb->heatmap;
+#endif
+
+    // One pass (one step if the JIT runs the whole block)
+    for (int i = 0; i < block->n_instructions && scheduler->now < next_stop(gb, until); i++) {
+
+        scheduler->instruction_start = scheduler->now;
+        scheduler->now += cpu(gb);
+
+        if (gb->registers.pc == before.pc)
+            break;
+    }
+
+    cpu_sync_flags(gb);
+
+    unsigned long long deadline = next_stop(gb, until);
+
+    if (scheduler->now >= deadline || memcmp(&before, &gb->registers, sizeof(struct registers)))
+        return;
+
+    unsigned long long pass_cycles = scheduler->now - pass_start;
+    unsigned long long skipped = (deadline - scheduler->now - 1) / pass_cycles * pass_cycles;
+
+    scheduler->now += skipped;
+    scheduler->idle_cycles += skipped;
+#ifdef HEATMAP
+    heatmap_repeat(gb, &heatmap_before, skipped / pass_cycles);
+#endif
+}
+
+
+
+/*---- Main Logic and Execution -----------------------------------*/
+
+
+/*
+ *  Run the cpu until the time reaches until, handling events as they come due
+ */
+void scheduler_run(gb_t* gb, unsigned long long until) {
+
+    struct scheduler* scheduler = &gb->scheduler;
+
+    while (scheduler->now < until) {
+
+        // Nothing but the cpu runs until the next event
+        while (scheduler->now < next_stop(gb, until)) {
+
+            if (gb->cpu.halted && !(*gb->memory.interrupt_request_register & *gb->memory.interrupt_enable_register & 0x1F)) {
+
+                // A halted cpu takes 4 cycles per step and can't wake up before the next event requests an interrupt
+                scheduler->now += (next_stop(gb, until) - scheduler->now + 3) & ~3ULL;
+                scheduler->instruction_start = scheduler->now - 4;
+                break;
+            }
+
+            unsigned short pc = gb->registers.pc;
+
+            scheduler->instruction_start = scheduler->now;
+            scheduler->now += cpu(gb);
+
+            // Jumped back into what could be an idle loop
+            if ((unsigned short) (pc - gb->registers.pc) < MAX_BLOCK_INSTRUCTIONS*3 && scheduler->now < next_stop(gb, until))
+                skip_idle_loop(gb, until);
+        }
+
+        handle_events(gb);
+    }
+}
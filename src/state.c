@@ -0,0 +1,576 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "gb.h"
+
+/*---- Run Length Encoding ----------------------------------------*/
+
+
+/*
+ *  Control byte 0-127: that many + 1 bytes follow as they are
+ *  Control byte 128-255: the next byte is repeated control - 125 times (3 to 130)
+ */
+#define MIN_RUN 3
+#define MAX_RUN (127 + MIN_RUN)
+#define MAX_LITERALS 128
+
+// Worst case size of size bytes packed (all literals)
+unsigned long long state_packed_bound(unsigned long long size) {
+
+    return size + size / MAX_LITERALS + 1;
+}
+
+/*
+ *  Pack size bytes of in into out (at least packed_bound(size) bytes)
+ *  Returns the packed size
+ */
+unsigned long long state_pack(const unsigned char* in, unsigned long long size, unsigned char* out) {
+
+    unsigned long long i = 0, o = 0;
+
+    while (i < size) {
+
+        unsigned long long run = 1;
+
+        while (i + run < size && run < MAX_RUN && in[i + run] == in[i])
+            run++;
+
+        if (run >= MIN_RUN) {
+
+            out[o++] = 0x80 | (run - MIN_RUN);
+            out[o++] = in[i];
+            i += run;
+            continue;
+        }
+
+        // Literals up to the next run worth encoding
+        unsigned long long start = i;
+
+        while (i < size && i - start < MAX_LITERALS
+                && !(i + 2 < size && in[i] == in[i + 1] && in[i] == in[i + 2]))
+            i++;
+
+        out[o++] = i - start - 1;
+        memcpy(&out[o], &in[start], i - start);
+        o += i - start;
+    }
+
+    return o;
+}
+
+/*
+ *  Unpack size bytes of in into exactly out_size bytes of out
+ *  Returns -1 if in isn't that
+ */
+int state_unpack(const unsigned char* in, unsigned long long size, unsigned char* out, unsigned long long out_size) {
+
+    unsigned long long i = 0, o = 0;
+
+    while (i < size) {
+
+        unsigned char control = in[i++];
+
+        if (control & 0x80) {
+
+            unsigned long long run = (control & 0x7f) + MIN_RUN;
+
+            if (i >= size || o + run > out_size)
+                return -1;
+
+            memset(&out[o], in[i++], run);
+            o += run;
+        }
+        else {
+
+            unsigned long long n = control + 1;
+
+            if (i + n > size || o + n > out_size)
+                return -1;
+
+            memcpy(&out[o], &in[i], n);
+            i += n;
+            o += n;
+        }
+    }
+
+    return o == out_size ? 0 : -1;
+}
+
+
+
+/*---- Saving -----------------------------------------------------*/
+
+
+/*
+ *  Everything but memory
+ */
+void state_capture(gb_t* gb, struct state_machine* machine) {
+
+    memset(machine, 0, sizeof(*machine));
+
+    cpu_sync_flags(gb);
+
+    machine->af = gb->registers.af;
+    machine->bc = gb->registers.bc;
+    machine->de = gb->registers.de;
+    machine->hl = gb->registers.hl;
+    machine->sp = gb->registers.sp;
+    machine->pc = gb->registers.pc;
+    machine->interrupt_master_enable = gb->cpu.interrupt_master_enable;
+    machine->halted = gb->cpu.halted;
+    machine->stopped = gb->cpu.stopped;
+
+    machine->now = gb->scheduler.now;
+    machine->instruction_start = gb->scheduler.instruction_start;
+    memcpy(machine->deadlines, gb->scheduler.deadlines, sizeof(machine->deadlines));
+
+    machine->line_start = gb->ppu.line_start;
+    machine->window_line = gb->ppu.window_line;
+
+    machine->counter_deadline = gb->timer.counter_deadline;
+    machine->counter_cycles_left = gb->timer.counter_cycles_left;
+    machine->first_iteration = gb->timer.first_iteration;
+
+    machine->dma_active = gb->dma.active;
+    machine->dma_source = gb->dma.source;
+
+    struct cartridge* cartridge = &gb->cartridge;
+
+    machine->cartridge_loaded = cartridge->cartridge_loaded;
+    machine->ram_enable_register = cartridge->ram_enable_register;
+    machine->rom_bank_number = cartridge->rom_bank_number;
+    machine->ram_or_upperrom_bank_number = cartridge->ram_or_upperrom_bank_number;
+    machine->banking_mode_select = cartridge->banking_mode_select;
+    machine->ram_bank_number = cartridge->ram_bank_number;
+    machine->rtc = cartridge->rtc;
+}
+
+/*
+ *  Write size bytes of data as section id at the end of file (padded to STATE_ALIGN first)
+ *  Returns -1 if it couldn't be written
+ */
+static int write_section(FILE* file, struct state_section* section, int id, const void* data, unsigned long long size, int flags) {
+
+    long end = ftell(file);
+    long offset = (end + STATE_ALIGN - 1) & ~(long) (STATE_ALIGN - 1);
+
+    for (; end < offset; end++)
+        fputc(0, file);
+
+    section->id = id;
+    section->offset = offset;
+    section->unpacked_size = size;
+    section->packed = 0;
+    section->size = size;
+
+    unsigned char* packed = NULL;
+
+    if (flags & STATE_PACK) {
+
+        packed = malloc(state_packed_bound(size));
+        unsigned long long packed_size = state_pack(data, size, packed);
+
+        // Not worth unpacking if it's barely smaller
+        if (packed_size < size - size/8) {
+            section->packed = 1;
+            section->size = packed_size;
+            data = packed;
+        }
+    }
+
+    int written = fwrite(data, 1, section->size, file) == section->size;
+
+    free(packed);
+
+    return written ? 0 : -1;
+}
+
+/*
+ *  Save the state of gb to path (flags can be STATE_PACK)
+ *  Returns 0 on success, or -1 if it couldn't be written (an old file at path is kept then)
+ */
+int state_save(gb_t* gb, const char* path, int flags) {
+
+    struct state_header header;
+    memset(&header, 0, sizeof(header));
+
+    memcpy(header.magic, STATE_MAGIC, sizeof(STATE_MAGIC));
+    header.version = STATE_VERSION;
+    header.n_sections = STATE_SECTIONS;
+    memcpy(header.title, &gb->cartridge.rom[0x134], sizeof(header.title));
+    memcpy(header.checksum, &gb->cartridge.rom[0x14e], sizeof(header.checksum));
+
+    struct state_machine machine;
+    state_capture(gb, &machine);
+
+    // Written next to it and renamed once complete, so a failed save doesn't lose the old one
+    char tmp_path[4096];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE* file = fopen(tmp_path, "wb");
+
+    if (!file) {
+        fprintf(stderr, "Couldn't save the state to %s: %s\n", tmp_path, strerror(errno));
+        return -1;
+    }
+
+    // The section table is filled in as they're written
+    fwrite(&header, sizeof(header), 1, file);
+
+    int failed = write_section(file, &header.sections[0], STATE_MACHINE, &machine, sizeof(machine), flags)
+        || write_section(file, &header.sections[1], STATE_MEMORY, gb->memory.memory, sizeof(gb->memory.memory), flags)
+        || write_section(file, &header.sections[2], STATE_RAM, gb->cartridge.ram_banks, gb->cartridge.ram_size, flags);
+
+    rewind(file);
+    failed |= fwrite(&header, sizeof(header), 1, file) != 1;
+    failed |= fclose(file) != 0;
+
+    if (failed || rename(tmp_path, path)) {
+        fprintf(stderr, "Couldn't save the state to %s: %s\n", path, strerror(errno));
+        unlink(tmp_path);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+
+/*---- Opening ----------------------------------------------------*/
+
+
+static const struct state_section* find_section(const struct state* state, unsigned int id) {
+
+    for (unsigned int i = 0; i < state->header->n_sections; i++)
+        if (state->header->sections[i].id == id)
+            return &state->header->sections[i];
+
+    return NULL;
+}
+
+/*
+ *  Check the header and that every section is in the file
+ *  Returns a message saying what's wrong with it, or NULL if it's fine
+ */
+static const char* check_state(const struct state* state) {
+
+    const struct state_header* header = state->header;
+
+    if (state->size < sizeof(struct state_header) || memcmp(header->magic, STATE_MAGIC, sizeof(STATE_MAGIC)))
+        return "it isn't a save state";
+
+    if (header->version != STATE_VERSION)
+        return "it's from another version of the emulator";
+
+    if (header->n_sections > STATE_SECTIONS)
+        return "its section table is corrupt";
+
+    for (unsigned int i = 0; i < header->n_sections; i++) {
+
+        const struct state_section* section = &header->sections[i];
+
+        if (section->offset % STATE_ALIGN || section->offset > state->size || section->size > state->size - section->offset)
+            return "it's truncated";
+
+        if (!section->packed && section->size != section->unpacked_size)
+            return "its section table is corrupt";
+    }
+
+    const struct state_section* machine = find_section(state, STATE_MACHINE);
+    const struct state_section* memory = find_section(state, STATE_MEMORY);
+
+    if (!machine || machine->unpacked_size != sizeof(struct state_machine)
+            || !memory || memory->unpacked_size != sizeof(((union address_space*) 0)->memory)
+            || !find_section(state, STATE_RAM))
+        return "it's missing sections";
+
+    return NULL;
+}
+
+/*
+ *  Map the state at path (read only)
+ *  Returns NULL if it can't be opened or isn't a valid state
+ */
+struct state* state_open(const char* path) {
+
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) {
+        fprintf(stderr, "Couldn't open %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    struct stat file;
+
+    if (fstat(fd, &file) || !file.st_size) {
+        fprintf(stderr, "Couldn't load %s: it's empty\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    unsigned char* data = mmap(NULL, file.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Couldn't map %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    struct state* state = calloc(1, sizeof(struct state));
+    state->data = data;
+    state->size = file.st_size;
+    state->header = (const struct state_header*) data;
+
+    const char* error = check_state(state);
+
+    if (error) {
+        fprintf(stderr, "Couldn't load %s: %s\n", path, error);
+        state_close(state);
+        return NULL;
+    }
+
+    return state;
+}
+
+void state_close(struct state* state) {
+
+    munmap(state->data, state->size);
+    free(state);
+}
+
+
+
+/*---- Loading ----------------------------------------------------*/
+
+
+/*
+ *  Get the cartridge to the stage it was saved at: before the bootstrap rom was
+ *  done there's no MBC (nor RAM), after it the one in the header is set up
+ */
+static void load_cartridge_stage(gb_t* gb, unsigned char cartridge_loaded) {
+
+    struct cartridge* cartridge = &gb->cartridge;
+
+    if (cartridge->cartridge_loaded == cartridge_loaded || !cartridge->cartridge_loaded)
+        return;
+
+    if (cartridge_loaded == 2) {
+
+        // The address space was loaded already, with the bootstrap rom disabled
+        cartridge->cartridge_loaded = 1;
+        check_disable_bootrom(gb);
+    }
+    else {
+
+        cartridge->cartridge_loaded = 1;
+        cartridge->mbctype = 0;
+        cartridge->romsizetype = 0;
+        cartridge->ramsizetype = 0;
+
+        save_init(gb);
+        mapper_init(gb);
+    }
+}
+
+/*
+ *  Copy n_pages pages from source to destination, which is dirty page first_page onwards
+ *  (only the pages written since since, if it isn't 0)
+ */
+static void load_pages(gb_t* gb, unsigned char* destination, const unsigned char* source, int first_page, int n_pages, unsigned int since) {
+
+    for (int i = 0; i < n_pages; i++) {
+
+        int page = first_page + i;
+
+        // IO registers change without being written
+        if (since && page != 0xff && !dirty_page_written(gb, page, since))
+            continue;
+
+        memcpy(&destination[i << 8], &source[i << 8], 0x100);
+
+        // Code, tiles and sprites that were picked from it are gone, and it changed for anyone tracking pages
+        if (page >= DIRTY_RAM_PAGE)
+            save_mark_dirty(gb, i << 8);
+        else {
+            block_memory_write(gb, (page << 8) | 0x80);
+            ppu_vram_written(gb, page << 8);
+
+            if (page == 0xfe)
+                ppu_oam_written(gb);
+        }
+
+        dirty_mark(gb, page);
+    }
+}
+
+static void load_machine(gb_t* gb, const struct state_machine* machine) {
+
+    gb->registers.af = machine->af;
+    gb->registers.bc = machine->bc;
+    gb->registers.de = machine->de;
+    gb->registers.hl = machine->hl;
+    gb->registers.sp = machine->sp;
+    gb->registers.pc = machine->pc;
+    gb->cpu.interrupt_master_enable = machine->interrupt_master_enable;
+    gb->cpu.halted = machine->halted;
+    gb->cpu.stopped = machine->stopped;
+    gb->cpu.extra_instruction_cycles = 0;
+#ifdef LAZY_FLAGS
+    gb->cpu.lazy.operation = LAZY_NONE; // registers.f is up to date
+#endif
+
+    gb->scheduler.now = machine->now;
+    gb->scheduler.instruction_start = machine->instruction_start;
+
+    // The save file has its own schedule (see below)
+    for (int i = 0; i < EVENTS; i++)
+        if (i != EVENT_SAVE)
+            scheduler_schedule(gb, i, machine->deadlines[i]);
+
+    gb->ppu.line_start = machine->line_start;
+    gb->ppu.window_line = machine->window_line;
+
+    gb->timer.counter_deadline = machine->counter_deadline;
+    gb->timer.counter_cycles_left = machine->counter_cycles_left;
+    gb->timer.first_iteration = machine->first_iteration;
+
+    gb->dma.active = machine->dma_active;
+    gb->dma.source = machine->dma_source;
+
+    struct cartridge* cartridge = &gb->cartridge;
+
+    cartridge->ram_enable_register = machine->ram_enable_register;
+    cartridge->rom_bank_number = machine->rom_bank_number;
+    cartridge->ram_or_upperrom_bank_number = machine->ram_or_upperrom_bank_number;
+    cartridge->banking_mode_select = machine->banking_mode_select;
+    cartridge->ram_bank_number = machine->ram_bank_number;
+    cartridge->rtc = machine->rtc;
+}
+
+/*
+ *  Restore gb to machine, the 64KB address space at memory and ram_size bytes of cartridge RAM at ram
+ *  (only the pages written since since, if it isn't 0)
+ *  Returns -1 if the RAM isn't the size of the cartridge's
+ */
+static int restore(gb_t* gb, const struct state_machine* machine, const unsigned char* memory,
+        const unsigned char* ram, unsigned int ram_size, unsigned int since) {
+
+    // Time goes back (or forward) to when it was saved before anything is marked dirty
+    load_machine(gb, machine);
+
+    load_pages(gb, gb->memory.memory, memory, 0, sizeof(gb->memory.memory) >> 8, since);
+
+    load_cartridge_stage(gb, machine->cartridge_loaded);
+
+    if (ram_size != gb->cartridge.ram_size)
+        return -1;
+
+    load_pages(gb, gb->cartridge.ram_banks, ram, DIRTY_RAM_PAGE, ram_size >> 8, since);
+
+    // Written RAM is saved a while after it was written, from now
+    if (gb->save.n_dirty)
+        scheduler_schedule(gb, EVENT_SAVE, gb->scheduler.now + SAVE_DELAY_CYCLES);
+
+    // Banks the MBC registers select, and everything the page table depends on
+    gb->cartridge.mapper->map(gb);
+    mmu_map_pages(gb, 0x00, 0xff);
+
+    gb->block_cache.current = NULL;
+    gb->block_cache.exit_request = 1;
+
+#ifdef PIXEL_FIFO
+    ppu_fifo_restart(gb);
+#endif
+
+    return 0;
+}
+
+/*
+ *  Restore gb from a state that's already in memory (see state_capture)
+ *  Returns -1 if it can't be loaded (gb might be half loaded then)
+ */
+int state_restore(gb_t* gb, const struct state_machine* machine, const unsigned char* memory,
+        const unsigned char* ram, unsigned int ram_size) {
+
+    if (restore(gb, machine, memory, ram, ram_size, 0)) {
+        fprintf(stderr, "Couldn't restore the state: its cartridge RAM isn't the cartridge's\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ *  Unpack section into size bytes at destination (or point to it if it isn't packed)
+ *  Returns NULL if it's corrupt
+ */
+static const unsigned char* section_data(const struct state* state, const struct state_section* section, unsigned char* destination) {
+
+    const unsigned char* data = state->data + section->offset;
+
+    if (!section->packed)
+        return data;
+
+    if (state_unpack(data, section->size, destination, section->unpacked_size))
+        return NULL;
+
+    return destination;
+}
+
+/*
+ *  Restore gb to state (the cartridge it was saved with must be inserted)
+ *  Returns 0 on success, or -1 if it can't be loaded (gb might be half loaded then)
+ */
+int state_load(gb_t* gb, struct state* state) {
+
+    const struct state_header* header = state->header;
+
+    if (memcmp(header->title, &gb->cartridge.rom[0x134], sizeof(header->title))
+            || memcmp(header->checksum, &gb->cartridge.rom[0x14e], sizeof(header->checksum))) {
+        fprintf(stderr, "Couldn't load the state: it was saved with another cartridge\n");
+        return -1;
+    }
+
+    const struct state_section* machine_section = find_section(state, STATE_MACHINE);
+    const struct state_section* memory_section = find_section(state, STATE_MEMORY);
+    const struct state_section* ram_section = find_section(state, STATE_RAM);
+
+    // Packed sections are unpacked here first
+    struct state_machine machine_buffer;
+    unsigned char* memory_buffer = memory_section->packed ? malloc(memory_section->unpacked_size) : NULL;
+    unsigned char* ram_buffer = ram_section->packed ? malloc(ram_section->unpacked_size) : NULL;
+
+    const struct state_machine* machine = (const struct state_machine*) section_data(state, machine_section, (unsigned char*) &machine_buffer);
+    const unsigned char* memory = section_data(state, memory_section, memory_buffer);
+    const unsigned char* ram = section_data(state, ram_section, ram_buffer);
+
+    // Only the pages written since it was last loaded here are different
+    // (sections are page aligned, so the machine can be read in place too)
+    unsigned int since = 0;
+
+    if (state->loaded_into == gb && state->epoch && state->epoch <= gb->dirty.epoch)
+        since = state->epoch;
+
+    int result = -1;
+
+    if (!machine || !memory || !ram)
+        fprintf(stderr, "Couldn't load the state: it's corrupt\n");
+    else if (restore(gb, machine, memory, ram, ram_section->unpacked_size, since))
+        fprintf(stderr, "Couldn't load the state: its cartridge RAM isn't the cartridge's\n");
+    else {
+        state->loaded_into = gb;
+        state->epoch = dirty_new_epoch(gb);
+        result = 0;
+    }
+
+    free(memory_buffer);
+    free(ram_buffer);
+
+    return result;
+}
@@ -1,36 +1,27 @@
-
-#include "timer.h"
-#include "memory.h"
-#include "cpu.h"
+#include "gb.h"
 
 static const int TOTAL_DIVIDER_CYCLES = 256;
 
-static int divider_cycles_left = TOTAL_DIVIDER_CYCLES;
-static int counter_cycles_left = -1;
+void timer_init(gb_t* gb) {
 
-static int first_iteration = 1;
+    gb->timer.counter_cycles_left = -1;
 
-static unsigned char timer_is_enabled() {
+    gb->timer.first_iteration = 1;
 
-    return (*tac & 4);
+    scheduler_schedule(gb, EVENT_DIV, TOTAL_DIVIDER_CYCLES);
 }
 
-static void set_div() {
-
-    if (divider_cycles_left > 0)
-        return;
-
-    (*tdiv)++;
+static unsigned char timer_is_enabled(gb_t* gb) {
 
-    divider_cycles_left = TOTAL_DIVIDER_CYCLES;
+    return (*gb->memory.tac & 4);
 }
 
-static int get_counter_speed() {
+static int get_counter_speed(gb_t* gb) {
 
     // (Cycles/Second) / (Interactions/Second) == Cycles/Interaction
     // The results from this calculation are hardcoded below
 
-    /* 
+    /*
      *  Frequency value of interactions
      *  00: 4096 Hz
      *  01: 262144 Hz
@@ -38,10 +29,10 @@ static int get_counter_speed() {
      *  11: 16384 Hz
      */
 
-    unsigned char val = *tac & 3; // get first 2 bits
+    unsigned char val = *gb->memory.tac & 3; // get first 2 bits
     switch (val) {
         case 0:
-            return 1024; 
+            return 1024;
         case 1:
             return 16;
         case 2:
@@ -52,34 +43,74 @@ static int get_counter_speed() {
     return 0;
 }
 
-void timer(int cycles) {
+static void schedule_tima(gb_t* gb) {
 
-    divider_cycles_left -= cycles;
-    set_div();
+    // TODO: If call is the operation, cycles could be 24
+    // If, z.b., TIMA was due 4 cycles into it, the next increment is already due too,
+    // but still only happens after the next instruction.
+    unsigned long long next_step = gb->scheduler.now + 1;
 
-    if ( !timer_is_enabled()  )
-        return;
+    scheduler_schedule(gb, EVENT_TIMA, gb->timer.counter_deadline > next_step ? gb->timer.counter_deadline : next_step);
+}
+
+
+
+/*---- Events -----------------------------------------------------*/
+
+
+/*
+ *  DIV is incremented every 256 cycles
+ */
+void timer_div_event(gb_t* gb) {
+
+    (*gb->memory.tdiv)++;
+
+    scheduler_schedule(gb, EVENT_DIV, gb->scheduler.now + TOTAL_DIVIDER_CYCLES);
+}
+
+/*
+ *  TIMA is incremented at the speed selected in TAC, while TAC enables it
+ */
+void timer_tima_event(gb_t* gb) {
+
+    gb->timer.counter_deadline += get_counter_speed(gb);
+
+    if (*gb->memory.tima == 255) {
+        *gb->memory.tima = *gb->memory.tma;
+        request_interrupt(gb, TIMER_INTERRUPT);
 
-    if (first_iteration) {
-        counter_cycles_left = get_counter_speed();
-        first_iteration = 0;
     }
+    else
+        (*gb->memory.tima)++;
 
-    // TODO: If call is the operation, cycles could be 24
-    // If, z.b., counter_cycles_left = 4, tima would be set twice.
-    counter_cycles_left -= cycles;
+    schedule_tima(gb);
+}
+
+/*
+ *  Writing TAC starts or stops TIMA (what's left of the current increment is kept while it's stopped)
+ */
+void timer_write_tac(gb_t* gb, unsigned char data) {
+
+    unsigned char was_enabled = timer_is_enabled(gb);
 
-    if (counter_cycles_left <= 0) {
+    *gb->memory.tac = data;
 
-        counter_cycles_left += get_counter_speed();
+    if (was_enabled == timer_is_enabled(gb))
+        return;
 
-        if (*tima == 255) {
-            *tima = *tma;
-            request_interrupt(TIMER_INTERRUPT);
+    if (timer_is_enabled(gb)) {
 
+        if (gb->timer.first_iteration) {
+            gb->timer.counter_cycles_left = get_counter_speed(gb);
+            gb->timer.first_iteration = 0;
         }
-        else
-            (*tima)++;
+
+        gb->timer.counter_deadline = gb->scheduler.now + gb->timer.counter_cycles_left;
+        schedule_tima(gb);
     }
+    else {
 
+        gb->timer.counter_cycles_left = gb->timer.counter_deadline - gb->scheduler.now;
+        scheduler_cancel(gb, EVENT_TIMA);
+    }
 }
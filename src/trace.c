@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "gb.h"
+
+/*
+ *  Record the state before the instruction that's about to run
+ *  (the program counter already points past it)
+ */
+void trace_fill_record(gb_t* gb, struct trace_record* record, unsigned char opcode, unsigned short operand) {
+
+    cpu_sync_flags(gb);
+
+    record->cycle = gb->scheduler.now;
+    record->pc = gb->registers.pc - instructions_length[opcode];
+    record->operand = operand;
+    record->af = gb->registers.af;
+    record->bc = gb->registers.bc;
+    record->de = gb->registers.de;
+    record->hl = gb->registers.hl;
+    record->sp = gb->registers.sp;
+    record->bank = record->pc < 0x8000 ? mmu_rom_bank(gb, record->pc) : 0;
+    record->opcode = opcode;
+    record->n_accesses = 0;
+}
+
+
+
+/*---- Ring Buffer ------------------------------------------------*/
+
+
+#ifdef TRACE
+
+void trace_instruction(gb_t* gb, unsigned char opcode, unsigned short operand) {
+
+    struct trace_record* record = &gb->trace.records[gb->trace.n_records++ & (TRACE_RECORDS-1)];
+
+    trace_fill_record(gb, record, opcode, operand);
+
+    gb->trace.current = record;
+}
+
+/*
+ *  Called by the memory map for every access of the running instruction
+ */
+void trace_memory_access(gb_t* gb, unsigned short address, unsigned char value, unsigned char write) {
+
+    struct trace_record* record = gb->trace.current;
+
+    if (record->n_accesses < TRACE_ACCESSES) {
+        record->accesses[record->n_accesses].address = address;
+        record->accesses[record->n_accesses].value = value;
+        record->accesses[record->n_accesses].write = write;
+    }
+
+    if (record->n_accesses < 255)
+        record->n_accesses++;
+}
+
+/*
+ *  Write the buffer to path, oldest record first
+ *  Returns 0 if it couldn't be written
+ */
+int trace_dump(gb_t* gb, const char* path) {
+
+    FILE* file = fopen(path, "wb");
+
+    if (!file)
+        return 0;
+
+    unsigned long long n_records = gb->trace.n_records < TRACE_RECORDS ? gb->trace.n_records : TRACE_RECORDS;
+
+    struct trace_file_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    header.record_size = sizeof(struct trace_record);
+    header.n_records = n_records;
+
+    fwrite(&header, sizeof(header), 1, file);
+
+    for (unsigned long long i = gb->trace.n_records - n_records; i < gb->trace.n_records; i++)
+        fwrite(&gb->trace.records[i & (TRACE_RECORDS-1)], sizeof(struct trace_record), 1, file);
+
+    fclose(file);
+
+    printf("Trace of the last %llu instructions written to %s\n", n_records, path);
+
+    return 1;
+}
+
+#endif
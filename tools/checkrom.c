@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <string.h>
+
+/*
+ *  Write the ROM "make statecheck" runs: 32KB, MBC1 with 8KB of battery RAM,
+ *  and a header the bootstrap rom accepts (so it boots like a real cartridge)
+ *
+ *  It copies pseudo random tiles, tile maps and OAM into VRAM and OAM, then every
+ *  frame (at VBlank) it counts the frame in battery RAM and, on every 4th one,
+ *  scrolls, picks LCD Control out of a table (window, tile data, tile maps, sprite
+ *  size, sprites and background on or off), pokes tile data and OAM, and moves
+ *  the window. Half way down the screen (line 72) it flips bit 7 of SCX, so the two
+ *  halves scroll differently. Everything it draws comes from the frame counter, so
+ *  any state that's lost shows up in the frames.
+ *
+ *  Usage: checkrom out.gb
+ */
+
+static unsigned char rom[0x8000];
+static int pc = 0x150;
+
+static void emit(int n, const unsigned char* bytes) {
+
+    memcpy(&rom[pc], bytes, n);
+    pc += n;
+}
+
+#define EMIT(...) emit(sizeof((unsigned char[]) { __VA_ARGS__ }), (unsigned char[]) { __VA_ARGS__ })
+
+// JR opcode to target (backwards), or to where patch_jr points it later (when it's 0)
+static int jr(unsigned char opcode, int target) {
+
+    EMIT(opcode, (unsigned char) (target - (pc + 2)));
+    return pc - 1;
+}
+
+static void patch_jr(int offset) {
+
+    rom[offset] = (unsigned char) (pc - (offset + 1));
+}
+
+// Loops until LY is line (JR NZ), or until it isn't (JR Z)
+static void wait_line(unsigned char line, unsigned char opcode) {
+
+    int loop = pc;
+    EMIT(0xF0, 0x44, 0xFE, line);       // ldh a,(LY); cp line
+    jr(opcode, loop);
+}
+
+static unsigned int seed = 1;
+
+static unsigned char next_random(void) {
+
+    seed = seed * 1103515245 + 12345;
+    return seed >> 16;
+}
+
+int main(int argc, char *argv[]) {
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s out.gb\n", argv[0]);
+        return 1;
+    }
+
+    /*---- Header ----*/
+
+    static const unsigned char logo[] = {
+        0xCE, 0xED, 0x66, 0x66, 0xCC, 0x0D, 0x00, 0x0B, 0x03, 0x73, 0x00, 0x83, 0x00, 0x0C, 0x00, 0x0D,
+        0x00, 0x08, 0x11, 0x1F, 0x88, 0x89, 0x00, 0x0E, 0xDC, 0xCC, 0x6E, 0xE6, 0xDD, 0xDD, 0xD9, 0x99,
+        0xBB, 0xBB, 0x67, 0x63, 0x6E, 0x0E, 0xEC, 0xCC, 0xDD, 0xDC, 0x99, 0x9F, 0xBB, 0xB9, 0x33, 0x3E,
+    };
+
+    rom[0x100] = 0x00;                  // nop; jp 0150
+    rom[0x101] = 0xC3;
+    rom[0x102] = 0x50;
+    rom[0x103] = 0x01;
+
+    memcpy(&rom[0x104], logo, sizeof(logo));
+    memcpy(&rom[0x134], "CHECKROM", 8);
+
+    rom[0x147] = 0x03;                  // MBC1+RAM+BATTERY
+    rom[0x148] = 0x00;                  // 32KB
+    rom[0x149] = 0x02;                  // 8KB
+
+    /*---- Data ----*/
+
+    // 4000-57FF: the 384 tiles, 5800-5FFF: both tile maps
+    for (int i = 0x4000; i < 0x6000; i++)
+        rom[i] = next_random();
+
+    // 6000-609F: OAM, sprites mostly on screen
+    for (int sprite = 0; sprite < 40; sprite++) {
+
+        rom[0x6000 + sprite*4] = next_random() % 170;
+        rom[0x6000 + sprite*4 + 1] = next_random() % 176;
+        rom[0x6000 + sprite*4 + 2] = next_random();
+        rom[0x6000 + sprite*4 + 3] = next_random();
+    }
+
+    // 7000-700F: LCD Control values (always with the LCD on)
+    static const unsigned char lcdc[] = {
+        0xF3, 0xE7, 0xB3, 0xD1, 0xFB, 0x93, 0xF7, 0xC3, 0xA3, 0xF2, 0xEB, 0x97, 0xF1, 0xBF, 0xD3, 0xE3,
+    };
+    memcpy(&rom[0x7000], lcdc, sizeof(lcdc));
+
+    /*---- Code ----*/
+
+    EMIT(0xF3);                         // di
+    EMIT(0x31, 0xFE, 0xFF);             // ld sp,FFFE
+
+    wait_line(0x90, 0x20);
+    EMIT(0xAF, 0xE0, 0x40);             // LCD off
+    EMIT(0x3E, 0x0A, 0xEA, 0x00, 0x00); // enable cartridge RAM
+    EMIT(0xAF, 0xEA, 0x00, 0xA0);       // the frame counter (A000) starts at 0
+
+    // Copy 4000-5FFF to 8000-9FFF
+    EMIT(0x21, 0x00, 0x40, 0x11, 0x00, 0x80, 0x01, 0x00, 0x20);
+    int copy = pc;
+    EMIT(0x2A, 0x12, 0x13, 0x0B, 0x78, 0xB1);   // ld a,(hl+); ld (de),a; inc de; dec bc; ld a,b; or c
+    jr(0x20, copy);
+
+    // Copy 6000-609F to FE00-FE9F
+    EMIT(0x21, 0x00, 0x60, 0x11, 0x00, 0xFE, 0x06, 0xA0);
+    copy = pc;
+    EMIT(0x2A, 0x12, 0x13, 0x05);               // ld a,(hl+); ld (de),a; inc de; dec b
+    jr(0x20, copy);
+
+    EMIT(0x3E, 0xE4, 0xE0, 0x47);       // BGP
+    EMIT(0x3E, 0xD2, 0xE0, 0x48);       // OBP0
+    EMIT(0x3E, 0x1B, 0xE0, 0x49);       // OBP1
+    EMIT(0x3E, 0x30, 0xE0, 0x4A);       // WY
+    EMIT(0x3E, 0x37, 0xE0, 0x4B);       // WX
+    EMIT(0x3E, 0xF3, 0xE0, 0x40);       // LCD on
+
+    int frame = pc;
+    wait_line(0x90, 0x20);
+
+    EMIT(0xF0, 0x43, 0xEE, 0x80, 0xE0, 0x43);   // SCX back as it was above line 72
+    EMIT(0x21, 0x00, 0xA0, 0x34);               // count the frame
+    EMIT(0x7E, 0xE6, 0x03);                     // every 4th one:
+    int skip = jr(0x20, 0);
+
+    EMIT(0xF0, 0x43, 0xC6, 0x03, 0xE0, 0x43);   // SCX += 3
+    EMIT(0xF0, 0x42, 0x3C, 0xE0, 0x42);         // SCY += 1
+    EMIT(0x7E, 0x0F, 0x0F, 0xE6, 0x0F, 0x5F, 0x16, 0x70, 0x1A, 0xE0, 0x40);    // LCD Control from the table
+    EMIT(0x7E, 0x5F, 0x16, 0x80, 0xEE, 0x5A, 0x12, 0x16, 0x90, 0x12);          // poke tile data at 80xx and 90xx
+    EMIT(0x7E, 0xE6, 0x9F, 0x5F, 0x16, 0xFE, 0x7E, 0x12);                      // poke OAM
+    EMIT(0x7E, 0x07, 0xE0, 0x48);                                              // OBP0
+    EMIT(0x7E, 0xE6, 0x7F, 0xE0, 0x4A);                                        // WY
+    EMIT(0x7E, 0x07, 0x07, 0x07, 0xE0, 0x4B);                                  // WX
+
+    patch_jr(skip);
+
+    wait_line(0x90, 0x28);                      // out of line 144
+    wait_line(0x48, 0x20);                      // down to line 72
+    EMIT(0xF0, 0x43, 0xEE, 0x80, 0xE0, 0x43);   // SCX for the bottom half
+    jr(0x18, frame);
+
+    /*---- Checksums ----*/
+
+    unsigned char header_checksum = 0;
+    for (int i = 0x134; i <= 0x14C; i++)
+        header_checksum = header_checksum - rom[i] - 1;
+    rom[0x14D] = header_checksum;
+
+    unsigned short global_checksum = 0;
+    for (int i = 0; i < (int) sizeof(rom); i++)
+        if (i != 0x14E && i != 0x14F)
+            global_checksum += rom[i];
+    rom[0x14E] = global_checksum >> 8;
+    rom[0x14F] = global_checksum & 0xFF;
+
+    FILE* file = fopen(argv[1], "wb");
+
+    if (!file || fwrite(rom, sizeof(rom), 1, file) != 1) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    fclose(file);
+
+    return 0;
+}
@@ -0,0 +1,64 @@
+#!/bin/sh
+#
+#  Check that gb-headless builds draw exactly the same frames, i.e. with the
+#  background shaded in plain C, SSSE3 and AVX2 (see "make framecheck"): each
+#  one writes every frame of the same run, and their hashes have to match
+#
+#  Usage: tools/framecheck.sh FRAMES GB_HEADLESS... -- ROM     (or -t TESTROM, anything after -- is passed on)
+#
+
+usage() {
+    echo "Usage: $0 FRAMES GB_HEADLESS... -- ROM" >&2
+    exit 1
+}
+
+[ $# -lt 4 ] && usage
+
+frames=$1
+shift
+
+headlesses=""
+while [ $# -gt 0 ] && [ "$1" != "--" ]; do
+    headlesses="$headlesses $1"
+    shift
+done
+
+[ $# -lt 2 ] && usage
+shift
+
+# A build whose instructions the cpu doesn't have shades with the next widest, which doesn't check it
+for flag in ssse3 avx2; do
+    if [ -r /proc/cpuinfo ] && ! grep -qw $flag /proc/cpuinfo; then
+        echo "framecheck: this cpu has no $flag, its build shades like the one before it" >&2
+    fi
+done
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+first=""
+failed=0
+
+for headless in $headlesses; do
+
+    out="$dir/$(basename "$headless")"
+    mkdir "$out"
+
+    "$headless" "$@" -f $frames -o "$out/" > /dev/null || exit 1
+
+    count=$(ls "$out" | wc -l)
+    hash=$(cat "$out"/*.pgm | cksum | cut -d ' ' -f 1)
+
+    echo "framecheck: $headless drew $count frames, hash $hash"
+
+    if [ -z "$first" ]; then
+        first="$count $hash"
+    elif [ "$count $hash" != "$first" ]; then
+        echo "framecheck: $headless differs from $(echo $headlesses | cut -d ' ' -f 1)" >&2
+        failed=1
+    fi
+done
+
+[ $failed -eq 0 ] && echo "framecheck: all the frames match"
+
+exit $failed
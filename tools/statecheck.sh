@@ -0,0 +1,56 @@
+#!/bin/sh
+#
+#  Check that save states round-trip: a run that's saved halfway and loaded
+#  again (twice, the second load only copies back what the first pass wrote)
+#  draws the same frames from there as a run that's never saved
+#
+#  Usage: tools/statecheck.sh GB_HEADLESS FRAMES ROM     (or -t TESTROM, anything after FRAMES is passed on)
+#
+
+if [ $# -lt 3 ]; then
+    echo "Usage: $0 GB_HEADLESS FRAMES ROM" >&2
+    exit 1
+fi
+
+headless=$1
+frames=$2
+shift 2
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+mkdir "$dir/whole" "$dir/loaded"
+
+# The first half written to a state, all of it (which leaves battery RAM as it is at the end,
+# so the state has to bring it back), then the second half from the state, twice
+"$headless" "$@" -f $frames -w "$dir/half.state" > /dev/null || exit 1
+"$headless" "$@" -f $((frames * 2)) -o "$dir/whole/" > /dev/null || exit 1
+"$headless" "$@" -f $frames -l "$dir/half.state" -p 2 -o "$dir/loaded/" > /dev/null || exit 1
+
+whole=$(ls "$dir/whole" | wc -l)
+loaded=$(ls "$dir/loaded" | wc -l)
+half=$((loaded / 2))
+
+if [ $half -eq 0 ] || [ $half -gt $whole ]; then
+    echo "statecheck: $whole frames without the state, $loaded with it" >&2
+    exit 1
+fi
+
+# The second half's frames are the last ones of the whole run, in both passes
+failed=0
+
+for pass in 0 1; do
+    for i in $(seq 0 $((half - 1))); do
+
+        expected=$(printf "%s/whole/%06d.pgm" "$dir" $((whole - half + i)))
+        got=$(printf "%s/loaded/%06d.pgm" "$dir" $((pass * half + i)))
+
+        if ! cmp -s "$expected" "$got"; then
+            echo "statecheck: frame $i of pass $pass after loading differs" >&2
+            failed=1
+        fi
+    done
+done
+
+[ $failed -eq 0 ] && echo "statecheck: $half frames after loading match, in both passes"
+
+exit $failed
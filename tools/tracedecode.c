@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "trace.h"
+
+/*
+ *  Print a trace written by the emulator (built with -DTRACE), oldest instruction first
+ *
+ *  Usage: tracedecode trace.bin [last n instructions]
+ */
+int main(int argc, char *argv[]) {
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s trace.bin [last n instructions]\n", argv[0]);
+        return 1;
+    }
+
+    FILE* file = fopen(argv[1], "rb");
+
+    if (!file) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    struct trace_file_header header;
+
+    if (fread(&header, sizeof(header), 1, file) != 1 || strncmp(header.magic, TRACE_MAGIC, sizeof(header.magic))) {
+        fprintf(stderr, "%s isn't a trace (or was written by an older version)\n", argv[1]);
+        return 1;
+    }
+
+    if (header.record_size != sizeof(struct trace_record)) {
+        fprintf(stderr, "%s was written by a different build (records of %u bytes, expected %zu)\n",
+                argv[1], header.record_size, sizeof(struct trace_record));
+        return 1;
+    }
+
+    unsigned int skip = 0;
+
+    if (argc > 2) {
+        unsigned int last;
+        if (sscanf(argv[2], "%u", &last) == 1 && last < header.n_records)
+            skip = header.n_records - last;
+    }
+
+    fseek(file, (long) skip * sizeof(struct trace_record), SEEK_CUR);
+
+    struct trace_record record;
+
+    for (unsigned int i = skip; i < header.n_records && fread(&record, sizeof(record), 1, file) == 1; i++)
+        trace_print_record(stdout, &record);
+
+    fclose(file);
+
+    return 0;
+}